@@ -1,11 +1,28 @@
 #version 450
 
+// the workgroup shape is specialized when the pipeline is created, 32x32 unless tuned otherwise
 layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+layout(local_size_x_id = 0, local_size_y_id = 1) in;
 
 layout(binding = 0, rgba8) uniform image2D image;
 
+// the image is rendered as one or more tiles, each dispatched on its own
+layout(push_constant) uniform PushConstants {
+	ivec2 offset;      // of the tile in the whole image
+	ivec2 extent;      // of the tile, the last workgroups of a row or column may hang over it
+	uint column_count; // pattern tiles across the whole image
+	uint pattern_size; // side of the square pattern tiles
+};
+
 void main() {
-	vec2 rg = vec2(gl_LocalInvocationID.xy) / (vec2(gl_WorkGroupSize.xy) - vec2(-1.0));
-	float b = float(gl_WorkGroupID.x) / float(gl_NumWorkGroups.x - 1);
+	if (any(greaterThanEqual(gl_GlobalInvocationID.xy, uvec2(extent)))) {
+		return;
+	}
+
+	// the pattern does not depend on the workgroup shape, so every shape renders the same image
+	uvec2 tile_size = uvec2(pattern_size);
+	uvec2 position = uvec2(offset) + gl_GlobalInvocationID.xy;
+	vec2 rg = vec2(position % tile_size) / (vec2(tile_size) - vec2(-1.0));
+	float b = float(position.x / tile_size.x) / float(max(column_count, 2u) - 1u);
 	imageStore(image, ivec2(gl_GlobalInvocationID.xy), vec4(rg, b, 1.0));
 }
@@ -0,0 +1,40 @@
+#version 450
+
+// writes tightly packed rgb8, byte for byte the body of a ppm file
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+layout(binding = 0, std430) writeonly buffer Texels {
+	uint words[];
+};
+
+layout(push_constant) uniform PushConstants {
+	uint width;
+	uint height;
+	uint column_count; // pattern tiles across the image
+	uint pattern_size; // side of the square pattern tiles
+};
+
+// the colours comp.glsl produces, with the same pattern and the same clamped divisor for blue
+vec3 texel_colour(uint texel) {
+	uvec2 tile_size = uvec2(pattern_size);
+	uvec2 position = uvec2(texel % width, texel / width);
+	vec2 rg = vec2(position % tile_size) / (vec2(tile_size) - vec2(-1.0));
+	float b = float(position.x / tile_size.x) / float(max(column_count, 2u) - 1u);
+	return vec3(rg, b);
+}
+
+void main() {
+	// one 32 bit word per invocation, which straddles at most two texels
+	uint word = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+	uint texel_count = width * height;
+	if (word * 4 >= texel_count * 3) {
+		return;
+	}
+
+	vec4 bytes;
+	for (uint i = 0; i < 4; ++i) {
+		uint byte_index = word * 4 + i;
+		bytes[i] = texel_colour(min(byte_index / 3, texel_count - 1))[byte_index % 3];
+	}
+	words[word] = packUnorm4x8(bytes);
+}
@@ -1,613 +1,5034 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
 #include <vulkan/vulkan.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #define IMAGE_WIDTH  768
 #define IMAGE_HEIGHT 512
 
+// frames handed to another process through a shared memory ring, each slot starts with a frame
+// header on its own cache line and the ring holds this many frames unless told otherwise
+#define FRAME_RING_MAGIC      0x474e4952u
+#define FRAME_RING_SLOT_COUNT 4
+#define CACHE_LINE_SIZE       64
+
+// side of the square tiles of the pattern comp.glsl draws unless a batch job asks for another,
+// independent of its workgroup shape
+#define PATTERN_TILE_SIZE 32
+
+// workgroup shape of comp.glsl when none is given and none has been tuned for the device
+#define DEFAULT_WORKGROUP_WIDTH  32
+#define DEFAULT_WORKGROUP_HEIGHT 32
+
+// tiled rendering draws each tile into one image this size, so memory use does not grow with the
+// output, and keeps this many tiles in flight so the gpu renders one while the cpu writes another
+#define TILE_SIZE       1024
+#define TILE_SLOT_COUNT 2
+
+// most tiles a batch may keep in flight and longest output path of a batch job, paths starting
+// with shm: name a posix shared memory object instead of a file
+#define MAX_TILE_SLOT_COUNT 16
+#define MAX_JOB_PATH_LENGTH 256
+#define SHM_PATH_PREFIX     "shm:"
+
+// longest request or reply line of the render service and most latencies its client keeps
+#define MAX_SERVICE_LINE_LENGTH (MAX_JOB_PATH_LENGTH + 64)
+
+// connections are served one at a time, so one that sends nothing for this long is dropped rather
+// than keeping every other client waiting
+#define SERVICE_IDLE_TIMEOUT_S 10
+#define MAX_CLIENT_REQUESTS     100000
+
+// workgroup size of comp_rgb.glsl, which packs one 32 bit word of rgb8 output per invocation
+#define RGB_WORKGROUP_SIZE 256
+
+// timestamps written around the gpu work for each image
+#define TIMESTAMP_DISPATCH_BEGIN 0
+#define TIMESTAMP_DISPATCH_END   1
+#define TIMESTAMP_COPY_END       2
+#define TIMESTAMP_COUNT          3
+
 struct {
 	PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessengerEXT;
 	PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessengerEXT;
+	PFN_vkGetMemoryHostPointerPropertiesEXT vkGetMemoryHostPointerPropertiesEXT;
+	PFN_vkGetMemoryFdKHR vkGetMemoryFdKHR;
+	PFN_vkGetSemaphoreFdKHR vkGetSemaphoreFdKHR;
+	PFN_vkImportSemaphoreFdKHR vkImportSemaphoreFdKHR;
+	PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR;
 } ext;
 
 #define LOAD_EXTENSION_FUNC(FuncName) \
 	ext.FuncName = (PFN_##FuncName)vkGetInstanceProcAddr(instance, #FuncName); \
 	if (!ext.FuncName) return false
 
-void save_rgb8_image_to_ppm(char const *filename,
-                            uint16_t width_px,
-                            uint16_t height_px,
-                            uint8_t *texel_buffer) {
-	FILE *file = fopen(filename, "wb");
-	fprintf(file, "P6 %d %d 255\n", width_px, height_px);
-	fwrite(texel_buffer, 3, width_px * height_px, file);
-	fclose(file);
-}
+// readback conversion is split into bands of rows, one per thread, with at least this many texels
+// in each band so that starting a thread never costs more than it saves
+#define MAX_CONVERT_THREADS           16
+#define MIN_TEXELS_PER_CONVERT_THREAD (256 * 1024)
 
-char *load_binary_file(char const *filename, size_t *size) {
-	FILE *file = fopen(filename, "rb");
-	if (!file) {
-		return NULL;
+void convert_rgba8_to_rgb8_scalar(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	for (size_t s = 0, d = 0; s < texel_count * 4; s += 4, d += 3) {
+		dst[d+0] = src[s+0];
+		dst[d+1] = src[s+1];
+		dst[d+2] = src[s+2];
 	}
+}
 
-	fseek(file, 0, SEEK_END);
-	*size = ftell(file);
-	fseek(file, 0, SEEK_SET);
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+void convert_rgba8_to_rgb8_ssse3(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	// gather the rgb bytes of four texels into the low 12 bytes and store those
+	__m128i const shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; i + 4 <= texel_count; i += 4) {
+		__m128i const rgb = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(src + i * 4)), shuffle);
+		_mm_storel_epi64((__m128i *)(dst + i * 3), rgb);
+		uint32_t const last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(rgb, 8));
+		memcpy(dst + i * 3 + 8, &last, sizeof(last));
+	}
+	convert_rgba8_to_rgb8_scalar(src + i * 4, dst + i * 3, texel_count - i);
+}
 
-	char *buffer = malloc(*size);
-	fread(buffer, 1, *size, file);
+__attribute__((target("avx2")))
+void convert_rgba8_to_rgb8_avx2(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	// the byte shuffle stays within each 128 bit lane, so a dword permute then joins the two
+	// 12 byte halves into 24 contiguous bytes
+	__m256i const shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+	                                         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	__m256i const compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	size_t i = 0;
+	for (; i + 8 <= texel_count; i += 8) {
+		__m256i const rgba = _mm256_loadu_si256((__m256i const *)(src + i * 4));
+		__m256i const rgb  = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(rgba, shuffle), compact);
+		_mm_storeu_si128((__m128i *)(dst + i * 3), _mm256_castsi256_si128(rgb));
+		_mm_storel_epi64((__m128i *)(dst + i * 3 + 16), _mm256_extracti128_si256(rgb, 1));
+	}
+	convert_rgba8_to_rgb8_ssse3(src + i * 4, dst + i * 3, texel_count - i);
+}
+#elif defined(__ARM_NEON)
+void convert_rgba8_to_rgb8_neon(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	// the de-interleaving load splits the channels, storing three of them drops alpha
+	size_t i = 0;
+	for (; i + 16 <= texel_count; i += 16) {
+		uint8x16x4_t const rgba = vld4q_u8(src + i * 4);
+		uint8x16x3_t const rgb  = { { rgba.val[0], rgba.val[1], rgba.val[2] } };
+		vst3q_u8(dst + i * 3, rgb);
+	}
+	convert_rgba8_to_rgb8_scalar(src + i * 4, dst + i * 3, texel_count - i);
+}
+#endif
 
-	fclose(file);
+struct convert_kernel {
+	char const *name;
+	void (*convert)(uint8_t const *src, uint8_t *dst, size_t texel_count);
+};
 
-	return buffer;
+// the widest kernel the cpu supports, checked at run time as the build targets baseline x86-64
+struct convert_kernel select_convert_kernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return (struct convert_kernel){ "avx2", convert_rgba8_to_rgb8_avx2 };
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return (struct convert_kernel){ "ssse3", convert_rgba8_to_rgb8_ssse3 };
+	}
+#elif defined(__ARM_NEON)
+	return (struct convert_kernel){ "neon", convert_rgba8_to_rgb8_neon };
+#endif
+	return (struct convert_kernel){ "scalar", convert_rgba8_to_rgb8_scalar };
 }
 
-VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
-	VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
-	VkDebugUtilsMessageTypeFlagsEXT message_type,
-	VkDebugUtilsMessengerCallbackDataEXT const *callback_data,
-	void *user_data) {
-	if (message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-		fprintf(stderr, "validation layer: %s\n", callback_data->pMessage);
+uint32_t get_convert_thread_count(void) {
+	long const cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpu_count < 1) {
+		return 1;
 	}
-	return VK_FALSE;
+	return cpu_count > MAX_CONVERT_THREADS ? MAX_CONVERT_THREADS : (uint32_t)cpu_count;
 }
 
-bool create_shader_module(VkDevice device, char const *filename, VkShaderModule *shader_module) {
-	size_t shader_code_size;
-	void *shader_code = load_binary_file(filename, &shader_code_size);
-	if (!shader_code) {
-		return false;
-	}
+struct convert_band {
+	void (*convert)(uint8_t const *src, uint8_t *dst, size_t texel_count);
+	uint8_t const *src;
+	uint8_t *dst;
+	size_t texel_count;
+};
 
-	VkShaderModuleCreateInfo shader_module_create_info = {
-		.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = shader_code_size,
-		.pCode    = shader_code,
-	};
+void *convert_band_thread(void *arg) {
+	struct convert_band const *band = arg;
+	band->convert(band->src, band->dst, band->texel_count);
+	return NULL;
+}
 
-	VkResult result = vkCreateShaderModule(device, &shader_module_create_info, NULL, shader_module);
-	free(shader_code);
-	return result == VK_SUCCESS;
+void convert_rgba8_image_to_rgb8(struct convert_kernel const *kernel,
+                                 uint8_t const *src,
+                                 uint8_t *dst,
+                                 uint32_t width_px,
+                                 uint32_t height_px,
+                                 uint32_t thread_count) {
+	size_t const texel_count = (size_t)width_px * height_px;
+	uint32_t band_count = texel_count / MIN_TEXELS_PER_CONVERT_THREAD;
+	if (band_count > thread_count) band_count = thread_count;
+	if (band_count > height_px) band_count = height_px;
+	if (band_count < 1) band_count = 1;
+
+	struct convert_band bands[MAX_CONVERT_THREADS];
+	for (uint32_t i = 0, row = 0; i < band_count; ++i) {
+		uint32_t const row_count = (height_px - row) / (band_count - i);
+		bands[i] = (struct convert_band){
+			.convert     = kernel->convert,
+			.src         = src + (size_t)row * width_px * 4,
+			.dst         = dst + (size_t)row * width_px * 3,
+			.texel_count = (size_t)row_count * width_px,
+		};
+		row += row_count;
+	}
+
+	// the calling thread converts the first band, and any band whose thread fails to start
+	pthread_t threads[MAX_CONVERT_THREADS];
+	bool thread_started[MAX_CONVERT_THREADS] = { false };
+	for (uint32_t i = 1; i < band_count; ++i) {
+		thread_started[i] = pthread_create(&threads[i], NULL, convert_band_thread, &bands[i]) == 0;
+	}
+	convert_band_thread(&bands[0]);
+	for (uint32_t i = 1; i < band_count; ++i) {
+		if (thread_started[i]) {
+			pthread_join(threads[i], NULL);
+		} else {
+			convert_band_thread(&bands[i]);
+		}
+	}
 }
 
-bool generate_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_px) {
-	// create vulkan instance
-	VkApplicationInfo app_info = {
-		.sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-		.pApplicationName   = "Offscreen Compute Shader Example",
-		.applicationVersion = VK_MAKE_VERSION(1, 0, 0),
-		.pEngineName        = "No Engine",
-		.engineVersion      = VK_MAKE_VERSION(1, 0, 0),
-		.apiVersion         = VK_API_VERSION_1_1,
-	};
+// buffers and images are sub-allocated from device memory blocks of at least this size, so the
+// driver sees a handful of allocations instead of one per resource
+#define MEMORY_BLOCK_SIZE       (16 * 1024 * 1024)
+#define MAX_MEMORY_BLOCKS       16
+#define MAX_MEMORY_BLOCK_RANGES 64
 
-	char const *extension_names[] = { VK_EXT_DEBUG_UTILS_EXTENSION_NAME };
-	char const *validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
+// what the cpu and gpu do with a resource, which decides the memory type it is placed in
+enum memory_usage {
+	MEMORY_USAGE_GPU_ONLY, // never mapped
+	MEMORY_USAGE_UPLOAD,   // written once by the cpu and copied from by the gpu
+	MEMORY_USAGE_READBACK, // written by the gpu and read by the cpu
+	MEMORY_USAGE_DYNAMIC,  // rewritten by the cpu every frame and read by the gpu
+};
 
-	VkInstanceCreateInfo instance_create_info = {
-		.sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-		.pApplicationInfo        = &app_info,
-		.enabledLayerCount       = 1,
-		.ppEnabledLayerNames     = validation_layers,
-		.enabledExtensionCount   = 1,
-		.ppEnabledExtensionNames = extension_names,
-	};
+// a part of a memory block that is either free or holds one buffer or image
+struct memory_range {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	bool used;
+	bool linear;
+};
 
-	VkInstance instance;
-	if (vkCreateInstance(&instance_create_info, NULL, &instance) != VK_SUCCESS) {
-		return false;
-	}
+// the ranges of a block are kept in offset order and always cover the whole block
+struct memory_block {
+	VkDeviceMemory memory;
+	uint32_t memory_type_index;
+	VkDeviceSize size;
+	uint8_t *mapped;
+	uint32_t range_count;
+	struct memory_range ranges[MAX_MEMORY_BLOCK_RANGES];
+};
 
-	// load extension functions
-	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
-	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
+struct memory_arena {
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkDeviceSize buffer_image_granularity;
+	VkDeviceSize non_coherent_atom_size;
+	VkMemoryAllocateFlags allocate_flags;
+	uint32_t block_count;
+	struct memory_block blocks[MAX_MEMORY_BLOCKS];
+};
 
-	// setup debug messenger
-	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
-		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
-		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-		.pfnUserCallback = debug_callback,
-	};
+// where a buffer or image lives in the arena, mapped is only set for host visible memory
+struct memory_allocation {
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t block_index;
+	uint8_t *mapped;
+};
 
-	VkDebugUtilsMessengerEXT debug_messenger;
-	if (ext.vkCreateDebugUtilsMessengerEXT(instance,
-                                           &debug_messenger_create_info,
-                                           NULL,
-                                           &debug_messenger) != VK_SUCCESS) {
-		return false;
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void init_memory_arena(struct memory_arena *arena,
+                       VkPhysicalDevice physical_device,
+                       VkDevice device,
+                       VkMemoryAllocateFlags allocate_flags) {
+	VkPhysicalDeviceProperties device_properties;
+	vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+
+	arena->device                   = device;
+	arena->buffer_image_granularity = device_properties.limits.bufferImageGranularity;
+	arena->non_coherent_atom_size   = device_properties.limits.nonCoherentAtomSize;
+	arena->allocate_flags           = allocate_flags;
+	arena->block_count              = 0;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &arena->memory_properties);
+}
+
+// ranks a memory type for a usage, 0 means the type cannot be used for it
+uint32_t score_memory_type(VkMemoryPropertyFlags flags, enum memory_usage usage) {
+	bool const device_local  = flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bool const host_visible  = flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	bool const host_coherent = flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	bool const host_cached   = flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	if (flags & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT)) {
+		return 0;
+	}
+	if (usage != MEMORY_USAGE_GPU_ONLY && !host_visible) {
+		return 0;
 	}
 
-	// select physical device
-	uint32_t physical_device_count = 0;
-	vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL);
-	if (physical_device_count == 0) {
-		return false;
+	switch (usage) {
+	case MEMORY_USAGE_GPU_ONLY:
+		// leave host visible device memory to the resources the cpu writes
+		return 1 + (device_local ? 2 : 0) + (host_visible ? 0 : 1);
+	case MEMORY_USAGE_UPLOAD:
+		// sequential writes are fine in write combined memory, staging stays out of device memory
+		return 1 + (host_coherent ? 2 : 0) + (device_local ? 0 : 1);
+	case MEMORY_USAGE_READBACK:
+		// reads from uncached memory bypass the cpu caches and run many times slower
+		return 1 + (host_cached ? 4 : 0) + (host_coherent ? 2 : 0) + (device_local ? 0 : 1);
+	case MEMORY_USAGE_DYNAMIC:
+		// the gpu reads small per frame data straight from device memory when it is mappable
+		return 1 + (device_local ? 4 : 0) + (host_coherent ? 2 : 0);
 	}
 
-	VkPhysicalDevice physical_devices[physical_device_count];
-	vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices);
+	return 0;
+}
 
-	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
-	uint32_t compute_queue_index;
-	for (uint32_t i = 0; i < physical_device_count; ++i) {
-		VkPhysicalDeviceProperties device_properties;
-		vkGetPhysicalDeviceProperties(physical_devices[i], &device_properties);
-		if (device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-		    device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
+// picks the best scoring memory type allowed by memory_type_bits, ties go to the lowest index
+bool find_memory_type(VkPhysicalDeviceMemoryProperties const *memory_properties,
+                      uint32_t memory_type_bits,
+                      enum memory_usage usage,
+                      uint32_t *memory_type_index) {
+	uint32_t best_score = 0;
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		if (!(memory_type_bits & (1u << i))) {
 			continue;
 		}
+		uint32_t const score = score_memory_type(memory_properties->memoryTypes[i].propertyFlags, usage);
+		if (score > best_score) {
+			best_score         = score;
+			*memory_type_index = i;
+		}
+	}
 
-		uint32_t queue_family_count = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &queue_family_count, NULL);
-		VkQueueFamilyProperties queue_family_properties[queue_family_count];
-		vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i],
-		                                         &queue_family_count,
-		                                         queue_family_properties);
-		compute_queue_index = UINT32_MAX;
-		for (uint32_t j = 0; j < queue_family_count; ++j) {
-			if (queue_family_properties[j].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-				compute_queue_index = j;
-				break;
-			}
+	return best_score > 0;
+}
+
+bool allocate_from_block(struct memory_block *block,
+                         VkDeviceSize size,
+                         VkDeviceSize alignment,
+                         bool linear,
+                         VkDeviceSize granularity,
+                         VkDeviceSize *offset) {
+	// first fit, linear and optimal resources must not share a granularity page with each other
+	for (uint32_t i = 0; i < block->range_count; ++i) {
+		struct memory_range const range = block->ranges[i];
+		if (range.used) {
+			continue;
+		}
+
+		VkDeviceSize start = align_up(range.offset, alignment);
+		if (i > 0 && block->ranges[i - 1].used && block->ranges[i - 1].linear != linear) {
+			start = align_up(start, granularity);
+		}
+		VkDeviceSize const range_end = range.offset + range.size;
+		if (start + size > range_end) {
+			continue;
 		}
-		if (compute_queue_index == UINT32_MAX) {
+		bool const next_conflicts = i + 1 < block->range_count &&
+		                            block->ranges[i + 1].used &&
+		                            block->ranges[i + 1].linear != linear;
+		if (next_conflicts && align_up(start + size, granularity) > range_end) {
 			continue;
 		}
 
-		physical_device = physical_devices[i];
-		break;
+		// split into leading padding, the allocation and the free remainder
+		uint32_t const new_ranges = (start > range.offset ? 1 : 0) + (start + size < range_end ? 1 : 0);
+		if (block->range_count + new_ranges > MAX_MEMORY_BLOCK_RANGES) {
+			return false;
+		}
+		memmove(&block->ranges[i + 1 + new_ranges],
+		        &block->ranges[i + 1],
+		        (block->range_count - i - 1) * sizeof(struct memory_range));
+		block->range_count += new_ranges;
+
+		uint32_t r = i;
+		if (start > range.offset) {
+			block->ranges[r++] = (struct memory_range){
+				.offset = range.offset,
+				.size   = start - range.offset,
+			};
+		}
+		block->ranges[r++] = (struct memory_range){
+			.offset = start,
+			.size   = size,
+			.used   = true,
+			.linear = linear,
+		};
+		if (start + size < range_end) {
+			block->ranges[r] = (struct memory_range){
+				.offset = start + size,
+				.size   = range_end - (start + size),
+			};
+		}
+
+		*offset = start;
+		return true;
 	}
 
-	if (physical_device == VK_NULL_HANDLE) {
+	return false;
+}
+
+bool allocate_memory(struct memory_arena *arena,
+                     VkMemoryRequirements const *memory_requirements,
+                     enum memory_usage usage,
+                     bool linear,
+                     struct memory_allocation *allocation) {
+	uint32_t memory_type_index;
+	if (!find_memory_type(&arena->memory_properties,
+	                      memory_requirements->memoryTypeBits,
+	                      usage,
+	                      &memory_type_index)) {
 		return false;
 	}
 
-	// create device
-	float const queue_priority = 1.0f;
-	VkDeviceQueueCreateInfo device_queue_create_info = {
-		.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-		.queueFamilyIndex = compute_queue_index,
-		.queueCount       = 1,
-		.pQueuePriorities = &queue_priority,
-	};
+	// flushes and invalidates work on whole atoms, so non coherent allocations never share one
+	VkMemoryPropertyFlags const memory_type_flags =
+		arena->memory_properties.memoryTypes[memory_type_index].propertyFlags;
+	VkDeviceSize size      = memory_requirements->size;
+	VkDeviceSize alignment = memory_requirements->alignment;
+	if ((memory_type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+	    !(memory_type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		size      = align_up(size, arena->non_coherent_atom_size);
+		alignment = alignment > arena->non_coherent_atom_size ? alignment : arena->non_coherent_atom_size;
+	}
 
-	VkDeviceCreateInfo device_create_info = {
-		.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		.queueCreateInfoCount    = 1,
-		.pQueueCreateInfos       = &device_queue_create_info,
-		.enabledLayerCount       = 1,
-		.ppEnabledLayerNames     = validation_layers,
-	};
+	// try the existing blocks of this memory type before allocating a new one
+	for (uint32_t i = 0; i <= arena->block_count; ++i) {
+		if (i == arena->block_count) {
+			if (arena->block_count == MAX_MEMORY_BLOCKS) {
+				return false;
+			}
 
-	VkDevice device;
-	if (vkCreateDevice(physical_device, &device_create_info, NULL, &device) != VK_SUCCESS) {
-		return false;
-	}
+			VkDeviceSize const block_size = size > MEMORY_BLOCK_SIZE ? size : MEMORY_BLOCK_SIZE;
 
-	// find host coherent memory types
-	VkPhysicalDeviceMemoryProperties memory_properties;
-	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
-	
-	uint32_t host_coherent_memory_types = 0;
-	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
-		if ((memory_properties.memoryTypes[i].propertyFlags &
-			 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
-			(memory_properties.memoryTypes[i].propertyFlags &
-			 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
-			) {
-			host_coherent_memory_types |= 1 << i;
+			VkMemoryAllocateFlagsInfo memory_allocate_flags_info = {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+				.flags = arena->allocate_flags,
+			};
+			VkMemoryAllocateInfo memory_allocate_info = {
+				.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+				.pNext           = arena->allocate_flags ? &memory_allocate_flags_info : NULL,
+				.allocationSize  = block_size,
+				.memoryTypeIndex = memory_type_index,
+			};
+			struct memory_block *block = &arena->blocks[i];
+			if (vkAllocateMemory(arena->device, &memory_allocate_info, NULL, &block->memory) != VK_SUCCESS) {
+				return false;
+			}
+
+			// host visible blocks stay mapped, a memory object can only be mapped once
+			void *mapped = NULL;
+			if ((memory_type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+			    vkMapMemory(arena->device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+				vkFreeMemory(arena->device, block->memory, NULL);
+				return false;
+			}
+
+			block->memory_type_index = memory_type_index;
+			block->size              = block_size;
+			block->mapped            = mapped;
+			block->range_count       = 1;
+			block->ranges[0]         = (struct memory_range){ .offset = 0, .size = block_size };
+			arena->block_count      += 1;
+		}
+
+		struct memory_block *block = &arena->blocks[i];
+		VkDeviceSize offset;
+		if (block->memory_type_index != memory_type_index ||
+		    !allocate_from_block(block,
+		                         size,
+		                         alignment,
+		                         linear,
+		                         arena->buffer_image_granularity,
+		                         &offset)) {
+			continue;
 		}
+
+		*allocation = (struct memory_allocation){
+			.memory      = block->memory,
+			.offset      = offset,
+			.size        = size,
+			.block_index = i,
+			.mapped      = block->mapped ? block->mapped + offset : NULL,
+		};
+		return true;
 	}
 
-	// get compute queue from device
-	VkQueue compute_queue;
-	vkGetDeviceQueue(device, compute_queue_index, 0, &compute_queue);
+	return false;
+}
 
-	// create command pool
-	VkCommandPoolCreateInfo command_pool_create_info = {
-		.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-		.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-		.queueFamilyIndex = compute_queue_index,
-	};
-	VkCommandPool command_pool;
-	if (vkCreateCommandPool(device, &command_pool_create_info, NULL, &command_pool) != VK_SUCCESS) {
-		return false;
+void free_memory(struct memory_arena *arena, struct memory_allocation const *allocation) {
+	struct memory_block *block = &arena->blocks[allocation->block_index];
+
+	uint32_t i = 0;
+	while (i < block->range_count && block->ranges[i].offset != allocation->offset) {
+		i += 1;
+	}
+	if (i == block->range_count) {
+		return;
 	}
+	block->ranges[i].used   = false;
+	block->ranges[i].linear = false;
 
-	// create command buffer
-	VkCommandBufferAllocateInfo command_buffer_alloc_info = {
-		.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool        = command_pool,
-		.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
-	};
-	VkCommandBuffer command_buffer;
-	if (vkAllocateCommandBuffers(device, &command_buffer_alloc_info, &command_buffer) != VK_SUCCESS) {
-		return false;
+	// merge with free neighbours so the free list does not fragment into slivers
+	if (i + 1 < block->range_count && !block->ranges[i + 1].used) {
+		block->ranges[i].size += block->ranges[i + 1].size;
+		memmove(&block->ranges[i + 1],
+		        &block->ranges[i + 2],
+		        (block->range_count - i - 2) * sizeof(struct memory_range));
+		block->range_count -= 1;
 	}
+	if (i > 0 && !block->ranges[i - 1].used) {
+		block->ranges[i - 1].size += block->ranges[i].size;
+		memmove(&block->ranges[i],
+		        &block->ranges[i + 1],
+		        (block->range_count - i - 1) * sizeof(struct memory_range));
+		block->range_count -= 1;
+	}
+}
 
-	// create fence
-	VkFenceCreateInfo fence_create_info = {
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-	};
+bool bind_buffer_memory(struct memory_arena *arena,
+                        VkBuffer buffer,
+                        enum memory_usage usage,
+                        struct memory_allocation *allocation) {
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(arena->device, buffer, &memory_requirements);
 
-	VkFence fence;
-	if (vkCreateFence(device, &fence_create_info, NULL, &fence) != VK_SUCCESS) {
+	if (!allocate_memory(arena, &memory_requirements, usage, true, allocation)) {
 		return false;
 	}
 
-	// create image
-	VkImageCreateInfo image_create_info = {
-		.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-		.imageType     = VK_IMAGE_TYPE_2D,
-		.format        = VK_FORMAT_R8G8B8A8_UNORM,
-		.extent.width  = width_px,
-		.extent.height = height_px,
-		.extent.depth  = 1,
-		.mipLevels     = 1,
-		.arrayLayers   = 1,
-		.samples       = VK_SAMPLE_COUNT_1_BIT,
-		.tiling        = VK_IMAGE_TILING_OPTIMAL,
-		.usage         = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-		.sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
-		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-	};
+	return vkBindBufferMemory(arena->device, buffer, allocation->memory, allocation->offset) == VK_SUCCESS;
+}
 
-	VkImage image;
-	if (vkCreateImage(device, &image_create_info, NULL, &image) != VK_SUCCESS) {
+bool bind_image_memory(struct memory_arena *arena,
+                       VkImage image,
+                       VkImageTiling tiling,
+                       enum memory_usage usage,
+                       struct memory_allocation *allocation) {
+	VkMemoryRequirements memory_requirements;
+	vkGetImageMemoryRequirements(arena->device, image, &memory_requirements);
+
+	if (!allocate_memory(arena,
+	                     &memory_requirements,
+	                     usage,
+	                     tiling == VK_IMAGE_TILING_LINEAR,
+	                     allocation)) {
 		return false;
 	}
 
-	VkMemoryRequirements memory_requirements;
-	vkGetImageMemoryRequirements(device, image, &memory_requirements);
+	return vkBindImageMemory(arena->device, image, allocation->memory, allocation->offset) == VK_SUCCESS;
+}
 
-	uint32_t usable_memory_bits = memory_requirements.memoryTypeBits & host_coherent_memory_types;
-	if (usable_memory_bits == 0) {
+// the range to flush or invalidate for an allocation, false when its memory is coherent and needs neither
+bool get_non_coherent_range(struct memory_arena const *arena,
+                            struct memory_allocation const *allocation,
+                            VkMappedMemoryRange *mapped_memory_range) {
+	struct memory_block const *block = &arena->blocks[allocation->block_index];
+	if (arena->memory_properties.memoryTypes[block->memory_type_index].propertyFlags &
+	    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
 		return false;
 	}
 
-	VkMemoryAllocateInfo memory_alloc_info = {
-		.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize  = memory_requirements.size,
-		.memoryTypeIndex = __builtin_ctz(usable_memory_bits),
+	*mapped_memory_range = (VkMappedMemoryRange){
+		.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.memory = allocation->memory,
+		.offset = allocation->offset,
+		.size   = allocation->size,
 	};
-	VkDeviceMemory image_memory;
-	if (vkAllocateMemory(device, &memory_alloc_info, NULL, &image_memory) != VK_SUCCESS) {
-		return false;
+	return true;
+}
+
+// makes cpu writes visible to the gpu, call before the submit that reads them
+bool flush_memory(struct memory_arena const *arena, struct memory_allocation const *allocation) {
+	VkMappedMemoryRange mapped_memory_range;
+	if (!get_non_coherent_range(arena, allocation, &mapped_memory_range)) {
+		return true;
 	}
+	return vkFlushMappedMemoryRanges(arena->device, 1, &mapped_memory_range) == VK_SUCCESS;
+}
 
-	if (vkBindImageMemory(device, image, image_memory, 0) != VK_SUCCESS) {
-		return false;
+// makes gpu writes visible to the cpu, call after waiting for the submit that wrote them
+bool invalidate_memory(struct memory_arena const *arena, struct memory_allocation const *allocation) {
+	VkMappedMemoryRange mapped_memory_range;
+	if (!get_non_coherent_range(arena, allocation, &mapped_memory_range)) {
+		return true;
 	}
+	return vkInvalidateMappedMemoryRanges(arena->device, 1, &mapped_memory_range) == VK_SUCCESS;
+}
 
-	// create image view
-	VkImageViewCreateInfo image_view_create_info = {
-		.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-		.image                           = VK_NULL_HANDLE,
-		.viewType                        = VK_IMAGE_VIEW_TYPE_2D,
-		.format                          = VK_FORMAT_R8G8B8A8_UNORM,
-		.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY,
-		.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY,
-		.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY,
-		.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY,
-		.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-		.subresourceRange.baseMipLevel   = 0,
-		.subresourceRange.levelCount     = 1,
-		.subresourceRange.baseArrayLayer = 0,
-		.subresourceRange.layerCount     = 1,
-		.image                           = image,
-	};
+void report_memory_arena(struct memory_arena const *arena) {
+	// fragmentation is the share of free memory outside the largest free range
+	VkDeviceSize total_size = 0, used_size = 0, free_size = 0, largest_free_size = 0;
+	uint32_t allocation_count = 0;
+	for (uint32_t i = 0; i < arena->block_count; ++i) {
+		struct memory_block const *block = &arena->blocks[i];
+		total_size += block->size;
+		for (uint32_t j = 0; j < block->range_count; ++j) {
+			struct memory_range const *range = &block->ranges[j];
+			if (range->used) {
+				used_size        += range->size;
+				allocation_count += 1;
+			} else {
+				free_size += range->size;
+				if (range->size > largest_free_size) {
+					largest_free_size = range->size;
+				}
+			}
+		}
+	}
+	double const fragmentation = free_size > 0 ? 1.0 - (double)largest_free_size / free_size : 0.0;
 
-	VkImageView image_view;
-	if (vkCreateImageView(device, &image_view_create_info, NULL, &image_view) != VK_SUCCESS) {
-		return false;
+	printf("memory arena: %u blocks, %.1f KiB allocated, %.1f KiB used by %u resources, %.1f%% fragmented\n",
+	       arena->block_count,
+	       total_size / 1024.0,
+	       used_size / 1024.0,
+	       allocation_count,
+	       fragmentation * 100.0);
+}
+
+void destroy_memory_arena(struct memory_arena *arena) {
+	for (uint32_t i = 0; i < arena->block_count; ++i) {
+		if (arena->blocks[i].mapped) {
+			vkUnmapMemory(arena->device, arena->blocks[i].memory);
+		}
+		vkFreeMemory(arena->device, arena->blocks[i].memory, NULL);
 	}
+	arena->block_count = 0;
+}
 
-	// create destination buffer for image data
-	uint32_t const image_buffer_size = width_px * height_px * 4;
+// application memory imported with VK_EXT_external_memory_host, so the readback copy writes
+// straight into it instead of into driver allocated memory
+struct imported_host_buffer {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	uint8_t *host_memory;
+};
 
-	VkBufferCreateInfo image_buffer_create_info = {
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size  = image_buffer_size,
-		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+bool create_imported_host_buffer(VkDevice device,
+                                 VkPhysicalDeviceMemoryProperties const *memory_properties,
+                                 VkDeviceSize import_alignment,
+                                 VkDeviceSize size,
+                                 VkBufferUsageFlags usage,
+                                 struct imported_host_buffer *imported) {
+	// the pointer and the allocation size must be multiples of the import alignment
+	VkDeviceSize const page_size       = sysconf(_SC_PAGESIZE);
+	VkDeviceSize const alignment       = import_alignment > page_size ? import_alignment : page_size;
+	VkDeviceSize const allocation_size = align_up(size, alignment);
+	*imported = (struct imported_host_buffer){
+		.host_memory = aligned_alloc(alignment, allocation_size),
 	};
-
-	VkBuffer image_buffer;
-	if (vkCreateBuffer(device, &image_buffer_create_info, NULL, &image_buffer) != VK_SUCCESS) {
+	if (!imported->host_memory) {
 		return false;
 	}
 
-	vkGetBufferMemoryRequirements(device, image_buffer, &memory_requirements);
-
-	uint32_t const memory_types_matching_requirements =
-		memory_requirements.memoryTypeBits & host_coherent_memory_types;
-	if (memory_types_matching_requirements == 0) {
+	VkExternalMemoryBufferCreateInfo external_memory_buffer_create_info = {
+		.sType       = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+	};
+	VkBufferCreateInfo buffer_create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = &external_memory_buffer_create_info,
+		.size  = size,
+		.usage = usage,
+	};
+	if (vkCreateBuffer(device, &buffer_create_info, NULL, &imported->buffer) != VK_SUCCESS) {
+		free(imported->host_memory);
 		return false;
 	}
 
-	VkMemoryAllocateInfo image_buffer_memory_allocate_info = {
-		.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize  = memory_requirements.size,
-		.memoryTypeIndex = __builtin_ctz(memory_types_matching_requirements),
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(device, imported->buffer, &memory_requirements);
+
+	VkMemoryHostPointerPropertiesEXT host_pointer_properties = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
 	};
+	bool imported_ok =
+		ext.vkGetMemoryHostPointerPropertiesEXT(device,
+		                                        VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+		                                        imported->host_memory,
+		                                        &host_pointer_properties) == VK_SUCCESS;
 
-	VkDeviceMemory image_buffer_memory;
-	if (vkAllocateMemory(device,
-	                     &image_buffer_memory_allocate_info,
-	                     NULL,
-	                     &image_buffer_memory) != VK_SUCCESS) {
-		return false;
+	// imported memory is never mapped, so there is nothing to invalidate and it must be coherent
+	uint32_t memory_type_bits = host_pointer_properties.memoryTypeBits & memory_requirements.memoryTypeBits;
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		if (!(memory_properties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			memory_type_bits &= ~(1u << i);
+		}
+	}
+
+	uint32_t memory_type_index;
+	imported_ok = imported_ok &&
+	              find_memory_type(memory_properties, memory_type_bits, MEMORY_USAGE_READBACK, &memory_type_index);
+	if (imported_ok) {
+		VkImportMemoryHostPointerInfoEXT import_memory_host_pointer_info = {
+			.sType        = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+			.handleType   = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+			.pHostPointer = imported->host_memory,
+		};
+		VkMemoryAllocateInfo memory_allocate_info = {
+			.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext           = &import_memory_host_pointer_info,
+			.allocationSize  = allocation_size,
+			.memoryTypeIndex = memory_type_index,
+		};
+		imported_ok = vkAllocateMemory(device, &memory_allocate_info, NULL, &imported->memory) == VK_SUCCESS;
+		if (imported_ok && vkBindBufferMemory(device, imported->buffer, imported->memory, 0) != VK_SUCCESS) {
+			vkFreeMemory(device, imported->memory, NULL);
+			imported_ok = false;
+		}
 	}
 
-	if (vkBindBufferMemory(device, image_buffer, image_buffer_memory, 0) != VK_SUCCESS) {
+	if (!imported_ok) {
+		vkDestroyBuffer(device, imported->buffer, NULL);
+		free(imported->host_memory);
 		return false;
 	}
 
+	return true;
+}
+
+void destroy_imported_host_buffer(VkDevice device, struct imported_host_buffer *imported) {
+	vkDestroyBuffer(device, imported->buffer, NULL);
+
+	// the application memory has to outlive the device memory imported from it
+	vkFreeMemory(device, imported->memory, NULL);
+	free(imported->host_memory);
+}
+
+// the fd extensions being present does not mean a timeline semaphore can cross them, the query has
+// to name the semaphore type as well
+bool timeline_semaphore_fd_supported(VkPhysicalDevice physical_device, VkExternalSemaphoreFeatureFlags features) {
+	VkSemaphoreTypeCreateInfo semaphore_type_create_info = {
+		.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+	};
+	VkPhysicalDeviceExternalSemaphoreInfo external_semaphore_info = {
+		.sType      = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO,
+		.pNext      = &semaphore_type_create_info,
+		.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+	};
+	VkExternalSemaphoreProperties external_semaphore_properties = {
+		.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES,
+	};
+	vkGetPhysicalDeviceExternalSemaphoreProperties(physical_device,
+	                                               &external_semaphore_info,
+	                                               &external_semaphore_properties);
+	return (external_semaphore_properties.externalSemaphoreFeatures & features) == features;
+}
+
+// readback buffer in memory another process can import through an opaque fd
+struct exported_buffer {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	VkBufferUsageFlags usage;
+	VkDeviceSize allocation_size;
+	uint32_t memory_type_index;
+	bool dedicated; // the importer has to make a dedicated allocation as well
+	void *mapped;
+};
+
+bool create_exported_buffer(VkPhysicalDevice physical_device,
+                            VkDevice device,
+                            VkPhysicalDeviceMemoryProperties const *memory_properties,
+                            VkDeviceSize size,
+                            VkBufferUsageFlags usage,
+                            struct exported_buffer *exported) {
+	*exported = (struct exported_buffer){0};
+
+	// the extension being present does not mean buffers with this usage can be exported
+	VkPhysicalDeviceExternalBufferInfo external_buffer_info = {
+		.sType      = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_BUFFER_INFO,
+		.usage      = usage,
+		.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+	};
+	VkExternalBufferProperties external_buffer_properties = {
+		.sType = VK_STRUCTURE_TYPE_EXTERNAL_BUFFER_PROPERTIES,
+	};
+	vkGetPhysicalDeviceExternalBufferProperties(physical_device, &external_buffer_info, &external_buffer_properties);
+	VkExternalMemoryFeatureFlags const external_memory_features =
+		external_buffer_properties.externalMemoryProperties.externalMemoryFeatures;
+	if (!(external_memory_features & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT)) {
+		fputs("readback buffers cannot be exported as opaque fds\n", stderr);
+		return false;
+	}
+
+	VkExternalMemoryBufferCreateInfo external_memory_buffer_create_info = {
+		.sType       = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+	};
+	VkBufferCreateInfo buffer_create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = &external_memory_buffer_create_info,
+		.size  = size,
+		.usage = usage,
+	};
+	if (vkCreateBuffer(device, &buffer_create_info, NULL, &exported->buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkMemoryDedicatedRequirements memory_dedicated_requirements = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+	};
+	VkMemoryRequirements2 memory_requirements2 = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+		.pNext = &memory_dedicated_requirements,
+	};
+	VkBufferMemoryRequirementsInfo2 buffer_memory_requirements_info = {
+		.sType  = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+		.buffer = exported->buffer,
+	};
+	vkGetBufferMemoryRequirements2(device, &buffer_memory_requirements_info, &memory_requirements2);
+	VkMemoryRequirements const memory_requirements = memory_requirements2.memoryRequirements;
+
+	// both processes map the memory without invalidating it, so it must be coherent
+	uint32_t memory_type_bits = memory_requirements.memoryTypeBits;
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		if (!(memory_properties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			memory_type_bits &= ~(1u << i);
+		}
+	}
+
+	// exported memory is never sub-allocated from the arena's shared blocks, and some drivers also
+	// require or prefer it to be tied to this one buffer
+	bool const dedicated =
+		(external_memory_features & VK_EXTERNAL_MEMORY_FEATURE_DEDICATED_ONLY_BIT) ||
+		memory_dedicated_requirements.requiresDedicatedAllocation ||
+		memory_dedicated_requirements.prefersDedicatedAllocation;
+	VkMemoryDedicatedAllocateInfo memory_dedicated_allocate_info = {
+		.sType  = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+		.buffer = exported->buffer,
+	};
+	VkExportMemoryAllocateInfo export_memory_allocate_info = {
+		.sType       = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+		.pNext       = dedicated ? &memory_dedicated_allocate_info : NULL,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+	};
+	VkMemoryAllocateInfo memory_allocate_info = {
+		.sType          = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext          = &export_memory_allocate_info,
+		.allocationSize = memory_requirements.size,
+	};
+	bool exported_ok =
+		find_memory_type(memory_properties,
+		                 memory_type_bits,
+		                 MEMORY_USAGE_READBACK,
+		                 &memory_allocate_info.memoryTypeIndex) &&
+		vkAllocateMemory(device, &memory_allocate_info, NULL, &exported->memory) == VK_SUCCESS;
+	if (exported_ok &&
+	    (vkBindBufferMemory(device, exported->buffer, exported->memory, 0) != VK_SUCCESS ||
+	     vkMapMemory(device, exported->memory, 0, VK_WHOLE_SIZE, 0, &exported->mapped) != VK_SUCCESS)) {
+		vkFreeMemory(device, exported->memory, NULL);
+		exported_ok = false;
+	}
+
+	if (!exported_ok) {
+		vkDestroyBuffer(device, exported->buffer, NULL);
+		return false;
+	}
+
+	exported->size              = size;
+	exported->usage             = usage;
+	exported->allocation_size   = memory_requirements.size;
+	exported->memory_type_index = memory_allocate_info.memoryTypeIndex;
+	exported->dedicated         = dedicated;
+	return true;
+}
+
+void destroy_exported_buffer(VkDevice device, struct exported_buffer *exported) {
+	vkDestroyBuffer(device, exported->buffer, NULL);
+	vkFreeMemory(device, exported->memory, NULL);
+}
+
+// push constants of comp.glsl, which renders one tile of a possibly larger image
+struct tile_push_constants {
+	int32_t offset[2];
+	int32_t extent[2];
+	uint32_t column_count;
+	uint32_t pattern_size;
+};
+
+// push constants of comp_rgb.glsl, which renders the same pattern as packed rgb texels
+struct rgb_push_constants {
+	uint32_t width;
+	uint32_t height;
+	uint32_t column_count;
+	uint32_t pattern_size;
+};
+
+// how create_render_context sets up the output, all false is the storage image path
+struct render_options {
+	bool import_host_memory;
+	bool rgb_buffer_output;
+	uint32_t workgroup_size[2]; // of comp.glsl, zero for the tuned or default shape
+	bool export_fd;             // readback memory and a timeline semaphore other processes can import
+};
+
+struct render_context {
+	uint16_t width_px;
+	uint16_t height_px;
+	VkInstance instance;
+	VkDebugUtilsMessengerEXT debug_messenger;
+	VkDevice device;
+	struct memory_arena arena;
+	VkQueue compute_queue;
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	VkQueryPool query_pool;
+	uint64_t timestamp_mask;
+	float timestamp_period;
+	double dispatch_ms;
+	double copy_ms;
+	VkImage image;
+	struct memory_allocation image_allocation;
+	VkImageView image_view;
+	VkBuffer image_buffer;
+	struct memory_allocation image_buffer_allocation;
+	bool host_memory_imported;
+	struct imported_host_buffer imported_image_buffer;
+	bool memory_exported;
+	struct exported_buffer exported_image_buffer;
+	VkSemaphore timeline_semaphore;
+	uint64_t timeline_value;
+	uint8_t device_uuid[VK_UUID_SIZE];
+	uint8_t driver_uuid[VK_UUID_SIZE];
+	bool rgb_buffer_output;
+	uint8_t *image_buffer_mapped;
+	struct convert_kernel convert_kernel;
+	uint32_t convert_thread_count;
+	VkDescriptorSetLayout descriptor_set_layout;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline compute_pipeline;
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet descriptor_set;
+	uint32_t workgroup_size[2];
+	char tuning_filename[64];
+};
+
+bool save_rgb8_image_to_ppm(char const *filename,
+                            uint16_t width_px,
+                            uint16_t height_px,
+                            uint8_t *texel_buffer) {
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "P6 %d %d 255\n", width_px, height_px);
+	bool const written = fwrite(texel_buffer, 3, width_px * height_px, file) == (size_t)width_px * height_px;
+	return fclose(file) == 0 && written;
+}
+
+// a ppm file mapped for writing, the header is already in place and the texels follow it
+struct mapped_ppm {
+	uint8_t *mapping;
+	size_t size;
+	uint8_t *texels;
+};
+
+bool map_ppm_file(char const *filename, uint32_t width_px, uint32_t height_px, struct mapped_ppm *ppm) {
+	char header[32];
+	int const header_size = snprintf(header, sizeof(header), "P6 %u %u 255\n", width_px, height_px);
+	size_t const size = header_size + (size_t)width_px * height_px * 3;
+
+	// the file is sized up front, converted texels reach it through the page cache
+	int const fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		return false;
+	}
+	void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	memcpy(mapping, header, header_size);
+
+	*ppm = (struct mapped_ppm){
+		.mapping = mapping,
+		.size    = size,
+		.texels  = (uint8_t *)mapping + header_size,
+	};
+	return true;
+}
+
+bool unmap_ppm_file(struct mapped_ppm *ppm) {
+	// the kernel writes the dirty pages back, nothing is copied on the way out
+	return munmap(ppm->mapping, ppm->size) == 0;
+}
+
+char *load_binary_file(char const *filename, size_t *size) {
+	FILE *file = fopen(filename, "rb");
+	if (!file) {
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char *buffer = malloc(*size);
+	fread(buffer, 1, *size, file);
+
+	fclose(file);
+
+	return buffer;
+}
+
+// full validation prints every warning and error as it arrives, the performance mode only collects
+// the performance warnings of the best practices checks and summarizes them at exit
+enum validation_mode {
+	VALIDATION_FULL,
+	VALIDATION_PERFORMANCE,
+	VALIDATION_OFF,
+};
+
+// VK_EXAMPLES_VALIDATION is full, performance or off, a release build defaults to off
+enum validation_mode get_validation_mode(void) {
+	char const *mode = getenv("VK_EXAMPLES_VALIDATION");
+	if (mode && strcmp(mode, "full") == 0) {
+		return VALIDATION_FULL;
+	}
+	if (mode && strcmp(mode, "performance") == 0) {
+		return VALIDATION_PERFORMANCE;
+	}
+	if (mode && strcmp(mode, "off") == 0) {
+		return VALIDATION_OFF;
+	}
+#ifdef VK_EXAMPLES_RELEASE
+	return VALIDATION_OFF;
+#else
+	return VALIDATION_FULL;
+#endif
+}
+
+// performance messages are counted by message id, only the text of the first one is kept
+#define MAX_PERFORMANCE_MESSAGES 64
+
+struct performance_message {
+	int32_t id;
+	char *id_name;
+	char *text;
+	uint32_t count;
+};
+
+struct {
+	struct performance_message messages[MAX_PERFORMANCE_MESSAGES];
+	uint32_t message_count;
+	uint32_t dropped_count; // occurrences of messages that no longer fit in the table
+	bool summary_registered;
+} performance_messages;
+
+void record_performance_message(VkDebugUtilsMessengerCallbackDataEXT const *callback_data) {
+	char const *id_name = callback_data->pMessageIdName ? callback_data->pMessageIdName : "";
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		if (message->id == callback_data->messageIdNumber && strcmp(message->id_name, id_name) == 0) {
+			message->count += 1;
+			return;
+		}
+	}
+	if (performance_messages.message_count == MAX_PERFORMANCE_MESSAGES) {
+		performance_messages.dropped_count += 1;
+		return;
+	}
+	performance_messages.messages[performance_messages.message_count++] = (struct performance_message){
+		.id      = callback_data->messageIdNumber,
+		.id_name = strdup(id_name),
+		.text    = strdup(callback_data->pMessage ? callback_data->pMessage : ""),
+		.count   = 1,
+	};
+}
+
+// registered with atexit, so messages reported while the instance is destroyed are counted too
+void report_performance_messages(void) {
+	uint32_t total_count = performance_messages.dropped_count;
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		total_count += performance_messages.messages[i].count;
+	}
+	fprintf(stderr,
+	        "performance warnings: %u, %u distinct\n",
+	        total_count,
+	        performance_messages.message_count);
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		fprintf(stderr, "%8u  %s: %s\n", message->count, message->id_name, message->text);
+		free(message->id_name);
+		free(message->text);
+	}
+	if (performance_messages.dropped_count > 0) {
+		fprintf(stderr, "%8u  messages beyond the first %d distinct ones\n",
+		        performance_messages.dropped_count,
+		        MAX_PERFORMANCE_MESSAGES);
+	}
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
+	VkDebugUtilsMessageTypeFlagsEXT message_type,
+	VkDebugUtilsMessengerCallbackDataEXT const *callback_data,
+	void *user_data) {
+	// the performance mode passes the table that collects its messages
+	if (user_data) {
+		record_performance_message(callback_data);
+		return VK_FALSE;
+	}
+	if (message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+		fprintf(stderr, "validation layer: %s\n", callback_data->pMessage);
+	}
+	return VK_FALSE;
+}
+
+bool create_debug_messenger(VkInstance instance,
+                            enum validation_mode validation,
+                            VkDebugUtilsMessengerEXT *debug_messenger) {
+	// load extension functions
+	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
+	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
+
+	// setup debug messenger
+	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+		.pfnUserCallback = debug_callback,
+	};
+
+	// the performance mode collects performance messages only, the callback counts them instead of
+	// printing each one
+	if (validation == VALIDATION_PERFORMANCE) {
+		debug_messenger_create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		debug_messenger_create_info.pUserData   = &performance_messages;
+		if (!performance_messages.summary_registered) {
+			atexit(report_performance_messages);
+			performance_messages.summary_registered = true;
+		}
+	}
+
+	return ext.vkCreateDebugUtilsMessengerEXT(instance,
+	                                          &debug_messenger_create_info,
+	                                          NULL,
+	                                          debug_messenger) == VK_SUCCESS;
+}
+
+// spir-v compiled by the makefile and embedded in the binary, so no shader files are read at startup
+uint32_t const comp_spv[] =
+#include "comp.spv.inc"
+;
+
+uint32_t const comp_rgb_spv[] =
+#include "comp_rgb.spv.inc"
+;
+
+struct embedded_shader {
+	char const *filename;
+	uint32_t const *code;
+	size_t code_size;
+};
+
+struct embedded_shader const embedded_shaders[] = {
+	{ "comp.spv",     comp_spv,     sizeof(comp_spv) },
+	{ "comp_rgb.spv", comp_rgb_spv, sizeof(comp_rgb_spv) },
+};
+
+bool create_shader_module(VkDevice device, char const *filename, VkShaderModule *shader_module) {
+	// a directory in VK_EXAMPLES_SHADER_DIR overrides the embedded shaders with its .spv files
+	char const *shader_dir = getenv("VK_EXAMPLES_SHADER_DIR");
+	void *file_code = NULL;
+	uint32_t const *shader_code = NULL;
+	size_t shader_code_size = 0;
+	if (shader_dir && shader_dir[0] != '\0') {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", shader_dir, filename);
+		file_code = load_binary_file(path, &shader_code_size);
+		shader_code = file_code;
+	} else {
+		for (size_t i = 0; i < sizeof(embedded_shaders) / sizeof(embedded_shaders[0]); ++i) {
+			if (strcmp(embedded_shaders[i].filename, filename) == 0) {
+				shader_code      = embedded_shaders[i].code;
+				shader_code_size = embedded_shaders[i].code_size;
+				break;
+			}
+		}
+	}
+	if (!shader_code) {
+		fprintf(stderr, "failed to load shader %s\n", filename);
+		return false;
+	}
+
+	VkShaderModuleCreateInfo shader_module_create_info = {
+		.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shader_code_size,
+		.pCode    = shader_code,
+	};
+
+	VkResult result = vkCreateShaderModule(device, &shader_module_create_info, NULL, shader_module);
+	free(file_code);
+	return result == VK_SUCCESS;
+}
+
+bool device_matches_override(char const *device_override,
+                             uint32_t device_index,
+                             char const *device_name) {
+	// no override means every device is a candidate
+	if (!device_override || device_override[0] == '\0') {
+		return true;
+	}
+
+	// a number selects a device by index, anything else is matched against the device name
+	char *end;
+	unsigned long override_index = strtoul(device_override, &end, 10);
+	if (*end == '\0') {
+		return override_index == device_index;
+	}
+	return strstr(device_name, device_override) != NULL;
+}
+
+uint64_t score_physical_device(VkPhysicalDevice physical_device,
+                               VkPhysicalDeviceType device_type,
+                               VkQueueFamilyProperties const *queue_family_properties) {
+	// device type matters most, cpu implementations such as lavapipe are the last resort
+	uint64_t type_score;
+	switch (device_type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   type_score = 4; break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type_score = 3; break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    type_score = 2; break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:            type_score = 1; break;
+		default:                                     type_score = 0; break;
+	}
+
+	// then a queue that can record timestamps
+	uint64_t queue_score = queue_family_properties->timestampValidBits > 0 ? 1 : 0;
+
+	// then the amount of device local memory
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+	uint64_t device_local_mib = 0;
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+		if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			device_local_mib += memory_properties.memoryHeaps[i].size >> 20;
+		}
+	}
+	if (device_local_mib >= (1ull << 39)) {
+		device_local_mib = (1ull << 39) - 1;
+	}
+
+	return (type_score << 40) | (queue_score << 39) | device_local_mib;
+}
+
+double timestamp_delta_ms(uint64_t begin,
+                          uint64_t end,
+                          uint64_t timestamp_mask,
+                          float timestamp_period) {
+	// only the valid bits take part, so the subtraction also handles wrap around
+	return ((end - begin) & timestamp_mask) * timestamp_period / 1000000.0;
+}
+
+bool device_supports_extension(VkPhysicalDevice physical_device, char const *extension_name) {
+	uint32_t extension_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, NULL);
+	VkExtensionProperties extensions[extension_count];
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, extensions);
+	for (uint32_t i = 0; i < extension_count; ++i) {
+		if (strcmp(extension_name, extensions[i].extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void get_pipeline_cache_filename(VkPhysicalDeviceProperties const *device_properties,
+                                 char *filename,
+                                 size_t filename_size) {
+	// cache data is only valid for the device and driver version that produced it
+	char uuid[2 * VK_UUID_SIZE + 1];
+	for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+		sprintf(&uuid[2 * i], "%02x", device_properties->pipelineCacheUUID[i]);
+	}
+	snprintf(filename, filename_size, "pipeline-cache-%s-%08x.bin", uuid, device_properties->driverVersion);
+}
+
+bool save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, char const *filename) {
+	size_t data_size = 0;
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, NULL) != VK_SUCCESS) {
+		return false;
+	}
+
+	void *data = malloc(data_size);
+	if (!data) {
+		return false;
+	}
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, data) != VK_SUCCESS) {
+		free(data);
+		return false;
+	}
+
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		free(data);
+		return false;
+	}
+	size_t written = fwrite(data, 1, data_size, file);
+	fclose(file);
+	free(data);
+
+	return written == data_size;
+}
+
+void report_pipeline_creation(double creation_ms,
+                              size_t initial_cache_size,
+                              VkPipelineCreationFeedbackEXT const *feedback) {
+	printf("pipeline creation: %.3f ms (%s start", creation_ms, initial_cache_size > 0 ? "warm" : "cold");
+	if (feedback && (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+		bool const cache_hit =
+			feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+		printf(", driver reports %.3f ms, cache %s", feedback->duration / 1000000.0, cache_hit ? "hit" : "miss");
+	}
+	printf(")\n");
+}
+
+void get_tuning_filename(VkPhysicalDevice physical_device, char *filename, size_t filename_size) {
+	// tuning results belong to the device itself, whatever driver version runs it
+	VkPhysicalDeviceIDProperties id_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+	};
+	VkPhysicalDeviceProperties2 properties2 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &id_properties,
+	};
+	vkGetPhysicalDeviceProperties2(physical_device, &properties2);
+
+	char uuid[2 * VK_UUID_SIZE + 1];
+	for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+		sprintf(&uuid[2 * i], "%02x", id_properties.deviceUUID[i]);
+	}
+	snprintf(filename, filename_size, "workgroup-size-%s.txt", uuid);
+}
+
+bool workgroup_size_supported(VkPhysicalDeviceLimits const *limits, uint32_t width, uint32_t height) {
+	return width > 0 && height > 0 &&
+	       width <= limits->maxComputeWorkGroupSize[0] &&
+	       height <= limits->maxComputeWorkGroupSize[1] &&
+	       width * height <= limits->maxComputeWorkGroupInvocations;
+}
+
+bool load_workgroup_size(char const *filename, uint32_t workgroup_size[2]) {
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		return false;
+	}
+	bool const loaded = fscanf(file, "%u %u", &workgroup_size[0], &workgroup_size[1]) == 2;
+	fclose(file);
+	return loaded;
+}
+
+bool save_workgroup_size(char const *filename, uint32_t const workgroup_size[2]) {
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "%u %u\n", workgroup_size[0], workgroup_size[1]);
+	return fclose(file) == 0;
+}
+
+double get_time_ms(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+// startup phases, each timed with the monotonic clock the first time it runs, reported when
+// VK_EXAMPLES_PROFILE names the json file to write them to
+#define MAX_PROFILE_SPANS 32
+
+struct profile_span {
+	char const *name;
+	double start_ms;
+	double duration_ms;
+};
+
+struct {
+	struct profile_span spans[MAX_PROFILE_SPANS];
+	uint32_t span_count;
+	double origin_ms;
+} startup_profile;
+
+bool startup_profile_enabled(void) {
+	char const *json_filename = getenv("VK_EXAMPLES_PROFILE");
+	return json_filename && json_filename[0] != '\0';
+}
+
+// returns UINT32_MAX for a phase that already ran, ending that span is a no-op
+uint32_t begin_profile_span(char const *name) {
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		if (strcmp(startup_profile.spans[i].name, name) == 0) {
+			return UINT32_MAX;
+		}
+	}
+	if (startup_profile.span_count == MAX_PROFILE_SPANS) {
+		return UINT32_MAX;
+	}
+	double const now_ms = get_time_ms();
+	if (startup_profile.span_count == 0) {
+		startup_profile.origin_ms = now_ms;
+	}
+	startup_profile.spans[startup_profile.span_count] = (struct profile_span){
+		.name     = name,
+		.start_ms = now_ms - startup_profile.origin_ms,
+	};
+	return startup_profile.span_count++;
+}
+
+void end_profile_span(uint32_t span) {
+	if (span < startup_profile.span_count) {
+		struct profile_span *profile_span = &startup_profile.spans[span];
+		profile_span->duration_ms = get_time_ms() - startup_profile.origin_ms - profile_span->start_ms;
+	}
+}
+
+// the instance is created with the validation layer, the same instance without it is created once
+// more to show what the layer costs, after the loader has already been initialized by the first
+void profile_instance_without_validation(VkInstanceCreateInfo const *instance_create_info) {
+	if (!startup_profile_enabled() || instance_create_info->enabledLayerCount == 0) {
+		return;
+	}
+	VkInstanceCreateInfo create_info = *instance_create_info;
+	create_info.enabledLayerCount   = 0;
+	create_info.ppEnabledLayerNames = NULL;
+
+	VkInstance instance;
+	uint32_t const span = begin_profile_span("instance without validation");
+	VkResult const result = vkCreateInstance(&create_info, NULL, &instance);
+	end_profile_span(span);
+	if (result == VK_SUCCESS) {
+		vkDestroyInstance(instance, NULL);
+	}
+}
+
+// prints the phases as a table and writes them as json, start times are relative to the first phase
+bool report_startup_profile(void) {
+	if (!startup_profile_enabled() || startup_profile.span_count == 0) {
+		return true;
+	}
+	printf("%-28s %10s %10s\n", "phase", "start ms", "ms");
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		printf("%-28s %10.3f %10.3f\n", span->name, span->start_ms, span->duration_ms);
+	}
+
+	FILE *file = fopen(getenv("VK_EXAMPLES_PROFILE"), "w");
+	if (!file) {
+		return false;
+	}
+	fputs("{\n  \"phases\": [\n", file);
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		fprintf(file,
+		        "    { \"name\": \"%s\", \"start_ms\": %.3f, \"duration_ms\": %.3f }%s\n",
+		        span->name,
+		        span->start_ms,
+		        span->duration_ms,
+		        i + 1 < startup_profile.span_count ? "," : "");
+	}
+	fputs("  ]\n}\n", file);
+	return fclose(file) == 0;
+}
+
+bool create_render_context(struct render_context *context,
+                           uint16_t width_px,
+                           uint16_t height_px,
+                           struct render_options const *options) {
+	// create vulkan instance
+	VkApplicationInfo app_info = {
+		.sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+		.pApplicationName   = "Offscreen Compute Shader Example",
+		.applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+		.pEngineName        = "No Engine",
+		.engineVersion      = VK_MAKE_VERSION(1, 0, 0),
+		.apiVersion         = VK_API_VERSION_1_1,
+	};
+
+	char const *extension_names[] = { VK_EXT_DEBUG_UTILS_EXTENSION_NAME };
+	char const *validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
+
+	// validation is off in release mode, the performance mode adds the best practices checks
+	enum validation_mode const validation = get_validation_mode();
+	VkValidationFeatureEnableEXT const best_practices = VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT;
+	VkValidationFeaturesEXT validation_features = {
+		.sType                         = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT,
+		.enabledValidationFeatureCount = 1,
+		.pEnabledValidationFeatures    = &best_practices,
+	};
+
+	VkInstanceCreateInfo instance_create_info = {
+		.sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pNext                   = validation == VALIDATION_PERFORMANCE ? &validation_features : NULL,
+		.pApplicationInfo        = &app_info,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
+		.ppEnabledLayerNames     = validation_layers,
+		.enabledExtensionCount   = validation != VALIDATION_OFF ? 1 : 0,
+		.ppEnabledExtensionNames = extension_names,
+	};
+
+	uint32_t const instance_span = begin_profile_span("instance");
+	VkInstance instance;
+	if (vkCreateInstance(&instance_create_info, NULL, &instance) != VK_SUCCESS) {
+		return false;
+	}
+	end_profile_span(instance_span);
+	profile_instance_without_validation(&instance_create_info);
+
+	// setup debug messenger, unless validation is off
+	uint32_t const debug_messenger_span = begin_profile_span("debug messenger");
+	VkDebugUtilsMessengerEXT debug_messenger = VK_NULL_HANDLE;
+	if (validation != VALIDATION_OFF && !create_debug_messenger(instance, validation, &debug_messenger)) {
+		return false;
+	}
+	end_profile_span(debug_messenger_span);
+
+	// select physical device
+	uint32_t const device_enumeration_span = begin_profile_span("device enumeration");
+	uint32_t physical_device_count = 0;
+	vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL);
+	if (physical_device_count == 0) {
+		return false;
+	}
+
+	VkPhysicalDevice physical_devices[physical_device_count];
+	vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices);
+
+	// an index or part of a device name in VK_EXAMPLES_DEVICE overrides the automatic choice
+	char const *device_override = getenv("VK_EXAMPLES_DEVICE");
+
+	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+	uint32_t compute_queue_index;
+	uint32_t timestamp_valid_bits;
+	float timestamp_period;
+	uint64_t best_device_score = 0;
+	for (uint32_t i = 0; i < physical_device_count; ++i) {
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_devices[i], &device_properties);
+		if (!device_matches_override(device_override, i, device_properties.deviceName)) {
+			continue;
+		}
+
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &queue_family_count, NULL);
+		VkQueueFamilyProperties queue_family_properties[queue_family_count];
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i],
+		                                         &queue_family_count,
+		                                         queue_family_properties);
+		uint32_t candidate_compute_queue_index = UINT32_MAX;
+		for (uint32_t j = 0; j < queue_family_count; ++j) {
+			if (queue_family_properties[j].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+				candidate_compute_queue_index = j;
+				break;
+			}
+		}
+		if (candidate_compute_queue_index == UINT32_MAX) {
+			continue;
+		}
+
+		// keep the highest scoring device that meets all requirements
+		uint64_t device_score =
+			score_physical_device(physical_devices[i],
+			                      device_properties.deviceType,
+			                      &queue_family_properties[candidate_compute_queue_index]);
+		if (physical_device != VK_NULL_HANDLE && device_score <= best_device_score) {
+			continue;
+		}
+
+		physical_device      = physical_devices[i];
+		best_device_score    = device_score;
+		compute_queue_index  = candidate_compute_queue_index;
+		timestamp_valid_bits = queue_family_properties[candidate_compute_queue_index].timestampValidBits;
+		timestamp_period     = device_properties.limits.timestampPeriod;
+	}
+
+	if (physical_device == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	// pipeline creation feedback is optional and only used to report pipeline cache hits
+	bool const creation_feedback_supported =
+		device_supports_extension(physical_device, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	char const *device_extensions[5];
+	uint32_t device_extension_count = 0;
+	if (creation_feedback_supported) {
+		device_extensions[device_extension_count++] = VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME;
+	}
+
+	// importing the readback memory is optional, without the extension the copy goes to mapped memory
+	bool const host_memory_import_supported =
+		options->import_host_memory &&
+		device_supports_extension(physical_device, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+	if (host_memory_import_supported) {
+		device_extensions[device_extension_count++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+	} else if (options->import_host_memory) {
+		fputs("VK_EXT_external_memory_host is not supported, reading back through mapped memory\n", stderr);
+	}
+
+	// sharing the readback memory with another process needs fd export of memory and of a timeline
+	// semaphore that tells the other process when the memory holds a finished image
+	bool const fd_export_supported =
+		options->export_fd &&
+		device_supports_extension(physical_device, VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME) &&
+		device_supports_extension(physical_device, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME) &&
+		device_supports_extension(physical_device, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features = {
+		.sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+		.timelineSemaphore = VK_TRUE,
+	};
+	if (fd_export_supported) {
+		device_extensions[device_extension_count++] = VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME;
+		device_extensions[device_extension_count++] = VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME;
+		device_extensions[device_extension_count++] = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+	} else if (options->export_fd) {
+		fputs("external memory and semaphore fds are not supported\n", stderr);
+		return false;
+	}
+	if (fd_export_supported &&
+	    !timeline_semaphore_fd_supported(physical_device, VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT)) {
+		fputs("timeline semaphores cannot be exported as opaque fds\n", stderr);
+		return false;
+	}
+
+	// create device
+	float const queue_priority = 1.0f;
+	VkDeviceQueueCreateInfo device_queue_create_info = {
+		.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+		.queueFamilyIndex = compute_queue_index,
+		.queueCount       = 1,
+		.pQueuePriorities = &queue_priority,
+	};
+
+	VkDeviceCreateInfo device_create_info = {
+		.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+		.pNext                   = fd_export_supported ? &timeline_semaphore_features : NULL,
+		.queueCreateInfoCount    = 1,
+		.pQueueCreateInfos       = &device_queue_create_info,
+		.enabledExtensionCount   = device_extension_count,
+		.ppEnabledExtensionNames = device_extensions,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
+		.ppEnabledLayerNames     = validation_layers,
+	};
+
+	end_profile_span(device_enumeration_span);
+	uint32_t const device_span = begin_profile_span("device");
+	VkDevice device;
+	if (vkCreateDevice(physical_device, &device_create_info, NULL, &device) != VK_SUCCESS) {
+		return false;
+	}
+	end_profile_span(device_span);
+
+	// create arena that buffers and images are sub-allocated from
+	uint32_t const allocation_span = begin_profile_span("allocation");
+	struct memory_arena arena;
+	init_memory_arena(&arena, physical_device, device, 0);
+
+	// get compute queue from device
+	VkQueue compute_queue;
+	vkGetDeviceQueue(device, compute_queue_index, 0, &compute_queue);
+
+	// create command pool
+	VkCommandPoolCreateInfo command_pool_create_info = {
+		.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = compute_queue_index,
+	};
+	VkCommandPool command_pool;
+	if (vkCreateCommandPool(device, &command_pool_create_info, NULL, &command_pool) != VK_SUCCESS) {
+		return false;
+	}
+
+	// create command buffer
+	VkCommandBufferAllocateInfo command_buffer_alloc_info = {
+		.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool        = command_pool,
+		.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	VkCommandBuffer command_buffer;
+	if (vkAllocateCommandBuffers(device, &command_buffer_alloc_info, &command_buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	// create fence
+	VkFenceCreateInfo fence_create_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
+
+	VkFence fence;
+	if (vkCreateFence(device, &fence_create_info, NULL, &fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	// create timestamp query pool
+	VkQueryPoolCreateInfo query_pool_create_info = {
+		.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType  = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = TIMESTAMP_COUNT,
+	};
+
+	VkQueryPool query_pool;
+	if (vkCreateQueryPool(device, &query_pool_create_info, NULL, &query_pool) != VK_SUCCESS) {
+		return false;
+	}
+
+	// a queue without valid timestamp bits cannot write timestamps, so timing is skipped
+	uint64_t const timestamp_mask =
+		timestamp_valid_bits >= 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+
+	// create image, the packed rgb path writes straight to the destination buffer and needs none
+	bool const rgb_buffer_output = options->rgb_buffer_output;
+	VkImage image = VK_NULL_HANDLE;
+	struct memory_allocation image_allocation = {0};
+	VkImageView image_view = VK_NULL_HANDLE;
+	if (!rgb_buffer_output) {
+		VkImageCreateInfo image_create_info = {
+			.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType     = VK_IMAGE_TYPE_2D,
+			.format        = VK_FORMAT_R8G8B8A8_UNORM,
+			.extent.width  = width_px,
+			.extent.height = height_px,
+			.extent.depth  = 1,
+			.mipLevels     = 1,
+			.arrayLayers   = 1,
+			.samples       = VK_SAMPLE_COUNT_1_BIT,
+			.tiling        = VK_IMAGE_TILING_OPTIMAL,
+			.usage         = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		};
+
+		if (vkCreateImage(device, &image_create_info, NULL, &image) != VK_SUCCESS) {
+			return false;
+		}
+
+		if (!bind_image_memory(&arena,
+		                       image,
+		                       VK_IMAGE_TILING_OPTIMAL,
+		                       MEMORY_USAGE_GPU_ONLY,
+		                       &image_allocation)) {
+			return false;
+		}
+
+		// create image view
+		VkImageViewCreateInfo image_view_create_info = {
+			.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image                           = VK_NULL_HANDLE,
+			.viewType                        = VK_IMAGE_VIEW_TYPE_2D,
+			.format                          = VK_FORMAT_R8G8B8A8_UNORM,
+			.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+			.subresourceRange.baseMipLevel   = 0,
+			.subresourceRange.levelCount     = 1,
+			.subresourceRange.baseArrayLayer = 0,
+			.subresourceRange.layerCount     = 1,
+			.image                           = image,
+		};
+
+		if (vkCreateImageView(device, &image_view_create_info, NULL, &image_view) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
+	// create destination buffer for image data, in imported application memory when possible, rgba
+	// texels copied from the image or rgb texels packed by the shader and padded to a whole word
+	uint32_t const image_buffer_size = rgb_buffer_output
+	                                 ? (width_px * height_px * 3 + 3) & ~3u
+	                                 : width_px * height_px * 4;
+	VkBufferUsageFlags const image_buffer_usage = rgb_buffer_output
+	                                            ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+	                                            : VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	struct imported_host_buffer imported_image_buffer = {0};
+	bool host_memory_imported = false;
+	if (host_memory_import_supported) {
+		LOAD_EXTENSION_FUNC(vkGetMemoryHostPointerPropertiesEXT);
+
+		VkPhysicalDeviceExternalMemoryHostPropertiesEXT external_memory_host_properties = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+		};
+		VkPhysicalDeviceProperties2 physical_device_properties2 = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &external_memory_host_properties,
+		};
+		vkGetPhysicalDeviceProperties2(physical_device, &physical_device_properties2);
+
+		host_memory_imported =
+			create_imported_host_buffer(device,
+			                            &arena.memory_properties,
+			                            external_memory_host_properties.minImportedHostPointerAlignment,
+			                            image_buffer_size,
+			                            image_buffer_usage,
+			                            &imported_image_buffer);
+		if (!host_memory_imported) {
+			fputs("host memory import failed, reading back through mapped memory\n", stderr);
+		}
+	}
+
+	struct exported_buffer exported_image_buffer = {0};
+	VkSemaphore timeline_semaphore = VK_NULL_HANDLE;
+	uint8_t device_uuid[VK_UUID_SIZE] = {0};
+	uint8_t driver_uuid[VK_UUID_SIZE] = {0};
+	if (fd_export_supported) {
+		LOAD_EXTENSION_FUNC(vkGetMemoryFdKHR);
+		LOAD_EXTENSION_FUNC(vkGetSemaphoreFdKHR);
+		LOAD_EXTENSION_FUNC(vkImportSemaphoreFdKHR);
+		LOAD_EXTENSION_FUNC(vkWaitSemaphoresKHR);
+
+		// opaque fds only import into the same device and driver, the other process checks both
+		VkPhysicalDeviceIDProperties id_properties = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+		};
+		VkPhysicalDeviceProperties2 physical_device_properties2 = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &id_properties,
+		};
+		vkGetPhysicalDeviceProperties2(physical_device, &physical_device_properties2);
+		memcpy(device_uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+		memcpy(driver_uuid, id_properties.driverUUID, VK_UUID_SIZE);
+
+		if (!create_exported_buffer(physical_device,
+		                            device,
+		                            &arena.memory_properties,
+		                            image_buffer_size,
+		                            image_buffer_usage,
+		                            &exported_image_buffer)) {
+			fputs("failed to allocate exportable readback memory\n", stderr);
+			return false;
+		}
+
+		VkExportSemaphoreCreateInfo export_semaphore_create_info = {
+			.sType       = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+			.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+		};
+		VkSemaphoreTypeCreateInfo semaphore_type_create_info = {
+			.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.pNext         = &export_semaphore_create_info,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		};
+		VkSemaphoreCreateInfo semaphore_create_info = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &semaphore_type_create_info,
+		};
+		if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &timeline_semaphore) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
+	VkBuffer image_buffer = fd_export_supported ? exported_image_buffer.buffer : imported_image_buffer.buffer;
+	struct memory_allocation image_buffer_allocation = {0};
+	if (!host_memory_imported && !fd_export_supported) {
+		VkBufferCreateInfo image_buffer_create_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size  = image_buffer_size,
+			.usage = image_buffer_usage,
+		};
+
+		if (vkCreateBuffer(device, &image_buffer_create_info, NULL, &image_buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		if (!bind_buffer_memory(&arena,
+		                        image_buffer,
+		                        MEMORY_USAGE_READBACK,
+		                        &image_buffer_allocation)) {
+			return false;
+		}
+	}
+	end_profile_span(allocation_span);
+
 	// create descriptor set layout
+	VkDescriptorType const descriptor_type = rgb_buffer_output
+	                                       ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+	                                       : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
 	VkDescriptorSetLayoutBinding descriptor_set_layout_binding = {
 		.binding         = 0,
-		.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		.descriptorType  = descriptor_type,
 		.descriptorCount = 1,
 		.stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
 	};
 
-	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
-		.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
-		.pBindings    = &descriptor_set_layout_binding,
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
+		.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 1,
+		.pBindings    = &descriptor_set_layout_binding,
+	};
+
+	VkDescriptorSetLayout descriptor_set_layout;
+	if (vkCreateDescriptorSetLayout(device,
+	                                &descriptor_set_layout_create_info,
+	                                NULL, &descriptor_set_layout) != VK_SUCCESS) {
+		return false;
+	}
+
+	// create pipeline layout, the image shader gets the tile to render as push constants and the
+	// packed rgb shader the image size and the same pattern parameters
+	VkPushConstantRange push_constant_range = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset     = 0,
+		.size       = rgb_buffer_output ? sizeof(struct rgb_push_constants) : sizeof(struct tile_push_constants),
+	};
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+		.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount         = 1,
+		.pSetLayouts            = &descriptor_set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges    = &push_constant_range,
+	};
+
+	VkPipelineLayout pipeline_layout;
+	if (vkCreatePipelineLayout(device, &pipeline_layout_create_info, NULL, &pipeline_layout) != VK_SUCCESS) {
+		return false;
+	}
+
+	// create shader module
+	uint32_t const shader_span = begin_profile_span("shader load");
+	VkShaderModule comp_shader_module;
+	if (!create_shader_module(device, rgb_buffer_output ? "comp_rgb.spv" : "comp.spv", &comp_shader_module)) {
+		return false;
+	}
+	end_profile_span(shader_span);
+
+	// the workgroup shape of comp.glsl is the one asked for, else the one tuned for this device, else
+	// the default, and always one the device supports
+	VkPhysicalDeviceProperties physical_device_properties;
+	vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+	char tuning_filename[64];
+	get_tuning_filename(physical_device, tuning_filename, sizeof(tuning_filename));
+
+	uint32_t workgroup_size[2] = { options->workgroup_size[0], options->workgroup_size[1] };
+	if (workgroup_size[0] == 0 && !load_workgroup_size(tuning_filename, workgroup_size)) {
+		workgroup_size[0] = DEFAULT_WORKGROUP_WIDTH;
+		workgroup_size[1] = DEFAULT_WORKGROUP_HEIGHT;
+	}
+	if (!workgroup_size_supported(&physical_device_properties.limits, workgroup_size[0], workgroup_size[1])) {
+		fprintf(stderr,
+		        "workgroup size %ux%u is not supported, using %ux%u\n",
+		        workgroup_size[0],
+		        workgroup_size[1],
+		        DEFAULT_WORKGROUP_WIDTH,
+		        DEFAULT_WORKGROUP_HEIGHT);
+		workgroup_size[0] = DEFAULT_WORKGROUP_WIDTH;
+		workgroup_size[1] = DEFAULT_WORKGROUP_HEIGHT;
+	}
+
+	VkSpecializationMapEntry const specialization_map_entries[2] = {
+		{ .constantID = 0, .offset = 0,                .size = sizeof(uint32_t) },
+		{ .constantID = 1, .offset = sizeof(uint32_t), .size = sizeof(uint32_t) },
+	};
+	VkSpecializationInfo const specialization_info = {
+		.mapEntryCount = 2,
+		.pMapEntries   = specialization_map_entries,
+		.dataSize      = sizeof(workgroup_size),
+		.pData         = workgroup_size,
+	};
+
+	// create compute pipeline
+	VkComputePipelineCreateInfo compute_pipeline_create_info = {
+		.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.layout       = pipeline_layout,
+		.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+		.stage.module = comp_shader_module,
+		.stage.pName  = "main",
+	};
+	if (!rgb_buffer_output) {
+		compute_pipeline_create_info.stage.pSpecializationInfo = &specialization_info;
+	}
+
+	// load the pipeline cache left behind by an earlier run on the same device and driver
+	uint32_t const pipeline_span = begin_profile_span("pipeline creation");
+	char pipeline_cache_filename[64];
+	get_pipeline_cache_filename(&physical_device_properties,
+	                            pipeline_cache_filename,
+	                            sizeof(pipeline_cache_filename));
+
+	size_t pipeline_cache_data_size = 0;
+	void *pipeline_cache_data = load_binary_file(pipeline_cache_filename, &pipeline_cache_data_size);
+	VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = pipeline_cache_data_size,
+		.pInitialData    = pipeline_cache_data,
+	};
+
+	VkPipelineCache pipeline_cache;
+	VkResult pipeline_cache_result =
+		vkCreatePipelineCache(device, &pipeline_cache_create_info, NULL, &pipeline_cache);
+	free(pipeline_cache_data);
+	if (pipeline_cache_result != VK_SUCCESS) {
+		return false;
+	}
+
+	// let the driver report whether the cache was hit
+	VkPipelineCreationFeedbackEXT pipeline_creation_feedback = {0};
+	VkPipelineCreationFeedbackEXT stage_creation_feedbacks[1];
+	VkPipelineCreationFeedbackCreateInfoEXT pipeline_creation_feedback_create_info = {
+		.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+		.pPipelineCreationFeedback          = &pipeline_creation_feedback,
+		.pipelineStageCreationFeedbackCount = 1,
+		.pPipelineStageCreationFeedbacks    = stage_creation_feedbacks,
+	};
+	if (creation_feedback_supported) {
+		compute_pipeline_create_info.pNext = &pipeline_creation_feedback_create_info;
+	}
+
+	VkPipeline compute_pipeline;
+	double const pipeline_creation_start_ms = get_time_ms();
+	if (vkCreateComputePipelines(device,
+	                             pipeline_cache,
+	                             1,
+	                             &compute_pipeline_create_info,
+	                             NULL,
+	                             &compute_pipeline) != VK_SUCCESS) {
+		return false;
+	}
+	double const pipeline_creation_ms = get_time_ms() - pipeline_creation_start_ms;
+	report_pipeline_creation(pipeline_creation_ms,
+	                         pipeline_cache_data_size,
+	                         creation_feedback_supported ? &pipeline_creation_feedback : NULL);
+
+	// write the cache back so the next run starts warm
+	if (!save_pipeline_cache(device, pipeline_cache, pipeline_cache_filename)) {
+		fprintf(stderr, "failed to save pipeline cache to %s\n", pipeline_cache_filename);
+	}
+	vkDestroyPipelineCache(device, pipeline_cache, NULL);
+	end_profile_span(pipeline_span);
+
+	// free shader module
+	vkDestroyShaderModule(device, comp_shader_module, NULL);
+
+	// create descriptor pool
+	VkDescriptorPoolSize descriptor_pool_size = {
+		.type            = descriptor_type,
+		.descriptorCount = 1,
+	};
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+		.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags         = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+		.poolSizeCount = 1,
+		.pPoolSizes    = &descriptor_pool_size,
+		.maxSets       = 1,
+	};
+
+	VkDescriptorPool descriptor_pool;
+	if (vkCreateDescriptorPool(device, &descriptor_pool_create_info, NULL, &descriptor_pool) != VK_SUCCESS) {
+		return false;
+	}
+
+	// allocate descriptor set
+	VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+		.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool     = descriptor_pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts        = &descriptor_set_layout,
+	};
+
+	VkDescriptorSet descriptor_set;
+	if (vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &descriptor_set) != VK_SUCCESS) {
+		return false;
+	}
+
+	// update descriptor set
+	VkDescriptorImageInfo descriptor_image_info = {
+		.imageView   = image_view,
+		.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+	};
+
+	VkDescriptorBufferInfo descriptor_buffer_info = {
+		.buffer = image_buffer,
+		.offset = 0,
+		.range  = VK_WHOLE_SIZE,
+	};
+
+	VkWriteDescriptorSet write_descriptor_set = {
+		.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet          = descriptor_set,
+		.dstBinding      = 0,
+		.descriptorCount = 1,
+		.descriptorType  = descriptor_type,
+		.pImageInfo      = rgb_buffer_output ? NULL : &descriptor_image_info,
+		.pBufferInfo     = rgb_buffer_output ? &descriptor_buffer_info : NULL,
+	};
+
+	vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, NULL);
+
+	// record command buffer
+	VkCommandBufferBeginInfo command_buffer_begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	};
+	if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (timestamp_mask != 0) {
+		vkCmdResetQueryPool(command_buffer, query_pool, 0, TIMESTAMP_COUNT);
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_DISPATCH_BEGIN);
+	}
+
+	VkImageMemoryBarrier image_memory_barrier = {
+		.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout                   = VK_IMAGE_LAYOUT_GENERAL,
+		.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED,
+		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.subresourceRange.levelCount = 1,
+		.subresourceRange.layerCount = 1,
+		.image                       = image,
+	};
+
+	if (!rgb_buffer_output) {
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0,
+			0,
+			NULL,
+			0,
+			NULL,
+			1,
+			&image_memory_barrier
+		);
+	}
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline);
+
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		pipeline_layout,
+		0,
+		1,
+		&descriptor_set,
+		0,
+		NULL
+	);
+
+	if (rgb_buffer_output) {
+		struct rgb_push_constants const push_constants = {
+			.width        = width_px,
+			.height       = height_px,
+			.column_count = (width_px + PATTERN_TILE_SIZE - 1) / PATTERN_TILE_SIZE,
+			.pattern_size = PATTERN_TILE_SIZE,
+		};
+		vkCmdPushConstants(command_buffer,
+		                   pipeline_layout,
+		                   VK_SHADER_STAGE_COMPUTE_BIT,
+		                   0,
+		                   sizeof(push_constants),
+		                   &push_constants);
+
+		// one invocation per output word, spread over y once x reaches the minimum group count limit
+		uint32_t const word_count    = image_buffer_size / 4;
+		uint32_t const group_count   = (word_count + RGB_WORKGROUP_SIZE - 1) / RGB_WORKGROUP_SIZE;
+		uint32_t const group_count_x = group_count < 65535 ? group_count : 65535;
+		vkCmdDispatch(command_buffer, group_count_x, (group_count + group_count_x - 1) / group_count_x, 1);
+	} else {
+		// the whole image as a single tile, rounded up to whole workgroups
+		struct tile_push_constants const push_constants = {
+			.extent       = { width_px, height_px },
+			.column_count = (width_px + PATTERN_TILE_SIZE - 1) / PATTERN_TILE_SIZE,
+			.pattern_size = PATTERN_TILE_SIZE,
+		};
+		vkCmdPushConstants(command_buffer,
+		                   pipeline_layout,
+		                   VK_SHADER_STAGE_COMPUTE_BIT,
+		                   0,
+		                   sizeof(push_constants),
+		                   &push_constants);
+		vkCmdDispatch(command_buffer,
+		              (width_px + workgroup_size[0] - 1) / workgroup_size[0],
+		              (height_px + workgroup_size[1] - 1) / workgroup_size[1],
+		              1);
+	}
+
+	if (timestamp_mask != 0) {
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_DISPATCH_END);
+	}
+
+	if (!rgb_buffer_output) {
+		image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0,
+			0,
+			NULL,
+			0,
+			NULL,
+			1,
+			&image_memory_barrier
+		);
+
+		VkBufferImageCopy buffer_image_copy = {
+			.bufferOffset                    = 0,
+			.bufferRowLength                 = 0,
+			.bufferImageHeight               = 0,
+			.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+			.imageSubresource.mipLevel       = 0,
+			.imageSubresource.baseArrayLayer = 0,
+			.imageSubresource.layerCount     = 1,
+			.imageOffset.x                   = 0,
+			.imageOffset.y                   = 0,
+			.imageOffset.z                   = 0,
+			.imageExtent.width               = width_px,
+			.imageExtent.height              = height_px,
+			.imageExtent.depth               = 1,
+		};
+
+		vkCmdCopyImageToBuffer(command_buffer,
+		                       image,
+		                       VK_IMAGE_LAYOUT_GENERAL,
+		                       image_buffer,
+		                       1,
+		                       &buffer_image_copy);
+	}
+
+	// make the copy or the shader's writes available to host reads, the invalidate after the fence
+	// then makes them visible
+	VkBufferMemoryBarrier image_buffer_memory_barrier = {
+		.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask       = rgb_buffer_output ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer              = image_buffer,
+		.offset              = 0,
+		.size                = VK_WHOLE_SIZE,
+	};
+	vkCmdPipelineBarrier(command_buffer,
+	                     rgb_buffer_output ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_HOST_BIT,
+	                     0,
+	                     0, NULL,
+	                     1, &image_buffer_memory_barrier,
+	                     0, NULL);
+
+	if (timestamp_mask != 0) {
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_COPY_END);
+	}
+
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	// imported memory is the application's own, otherwise the destination buffer's block stays mapped
+	// for the lifetime of the context
+	uint8_t *image_buffer_mapped = host_memory_imported
+	                             ? imported_image_buffer.host_memory
+	                             : fd_export_supported
+	                             ? exported_image_buffer.mapped
+	                             : image_buffer_allocation.mapped;
+
+	report_memory_arena(&arena);
+
+	// the gpu copies the rgba image to the readback memory and the cpu packs it into the texel buffer,
+	// unless the shader already wrote packed rgb texels there
+	printf("readback: %s%s, per image the gpu copies %u bytes and the cpu %u bytes\n",
+	       rgb_buffer_output ? "packed rgb in " : "",
+	       host_memory_imported ? "imported host memory"
+	                            : fd_export_supported ? "exported device memory" : "mapped device memory",
+	       rgb_buffer_output ? 0 : image_buffer_size,
+	       rgb_buffer_output ? 0 : width_px * height_px * 3);
+
+	// keep everything needed to render images and to clean up
+	*context = (struct render_context){
+		.width_px                = width_px,
+		.height_px               = height_px,
+		.instance                = instance,
+		.debug_messenger         = debug_messenger,
+		.device                  = device,
+		.arena                   = arena,
+		.compute_queue           = compute_queue,
+		.command_pool            = command_pool,
+		.command_buffer          = command_buffer,
+		.fence                   = fence,
+		.query_pool              = query_pool,
+		.timestamp_mask          = timestamp_mask,
+		.timestamp_period        = timestamp_period,
+		.image                   = image,
+		.image_allocation        = image_allocation,
+		.image_view              = image_view,
+		.image_buffer            = image_buffer,
+		.image_buffer_allocation = image_buffer_allocation,
+		.host_memory_imported    = host_memory_imported,
+		.imported_image_buffer   = imported_image_buffer,
+		.memory_exported         = fd_export_supported,
+		.exported_image_buffer   = exported_image_buffer,
+		.timeline_semaphore      = timeline_semaphore,
+		.rgb_buffer_output       = rgb_buffer_output,
+		.image_buffer_mapped     = image_buffer_mapped,
+		.convert_kernel          = select_convert_kernel(),
+		.convert_thread_count    = get_convert_thread_count(),
+		.descriptor_set_layout   = descriptor_set_layout,
+		.pipeline_layout         = pipeline_layout,
+		.compute_pipeline        = compute_pipeline,
+		.descriptor_pool         = descriptor_pool,
+		.descriptor_set          = descriptor_set,
+		.workgroup_size          = { workgroup_size[0], workgroup_size[1] },
+	};
+	strcpy(context->tuning_filename, tuning_filename);
+	memcpy(context->device_uuid, device_uuid, VK_UUID_SIZE);
+	memcpy(context->driver_uuid, driver_uuid, VK_UUID_SIZE);
+
+	return true;
+}
+
+bool generate_image(struct render_context *context, uint8_t *texel_buffer) {
+	// submit the command buffer that was recorded when the context was created
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers    = &context->command_buffer,
+	};
+	uint32_t const submit_span = begin_profile_span("first submit");
+	if (vkQueueSubmit(context->compute_queue, 1, &submit_info, context->fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (vkWaitForFences(context->device, 1, &context->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+		return false;
+	}
+	end_profile_span(submit_span);
+
+	vkResetFences(context->device, 1, &context->fence);
+
+	// read back gpu timings
+	if (context->timestamp_mask != 0) {
+		uint64_t timestamps[TIMESTAMP_COUNT];
+		if (vkGetQueryPoolResults(context->device,
+		                          context->query_pool,
+		                          0,
+		                          TIMESTAMP_COUNT,
+		                          sizeof(timestamps),
+		                          timestamps,
+		                          sizeof(uint64_t),
+		                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+			return false;
+		}
+		context->dispatch_ms = timestamp_delta_ms(timestamps[TIMESTAMP_DISPATCH_BEGIN],
+		                                          timestamps[TIMESTAMP_DISPATCH_END],
+		                                          context->timestamp_mask,
+		                                          context->timestamp_period);
+		context->copy_ms = timestamp_delta_ms(timestamps[TIMESTAMP_DISPATCH_END],
+		                                      timestamps[TIMESTAMP_COPY_END],
+		                                      context->timestamp_mask,
+		                                      context->timestamp_period);
+	}
+
+	// readback memory is preferably cached, which is not always coherent
+	uint32_t const readback_span = begin_profile_span("readback");
+	if (!context->host_memory_imported &&
+	    !context->memory_exported &&
+	    !invalidate_memory(&context->arena, &context->image_buffer_allocation)) {
+		return false;
+	}
+
+	// read back image data into output buffer, vectorized and split across threads by rows, packed
+	// rgb output is read straight from the mapped buffer instead
+	if (!context->rgb_buffer_output) {
+		convert_rgba8_image_to_rgb8(&context->convert_kernel,
+		                            context->image_buffer_mapped,
+		                            texel_buffer,
+		                            context->width_px,
+		                            context->height_px,
+		                            context->convert_thread_count);
+	}
+	end_profile_span(readback_span);
+
+	// report successful render
+	return true;
+}
+
+void destroy_render_context(struct render_context *context) {
+	uint32_t const teardown_span = begin_profile_span("teardown");
+	VkDevice device = context->device;
+	vkDestroyDescriptorPool(device, context->descriptor_pool, NULL);
+	vkDestroyPipeline(device, context->compute_pipeline, NULL);
+	vkDestroyPipelineLayout(device, context->pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(device, context->descriptor_set_layout, NULL);
+	if (context->host_memory_imported) {
+		destroy_imported_host_buffer(device, &context->imported_image_buffer);
+	} else if (context->memory_exported) {
+		destroy_exported_buffer(device, &context->exported_image_buffer);
+		vkDestroySemaphore(device, context->timeline_semaphore, NULL);
+	} else {
+		vkDestroyBuffer(device, context->image_buffer, NULL);
+	}
+	vkDestroyImageView(device, context->image_view, NULL);
+	vkDestroyImage(device, context->image, NULL);
+	vkDestroyQueryPool(device, context->query_pool, NULL);
+	vkDestroyFence(device, context->fence, NULL);
+	vkDestroyCommandPool(device, context->command_pool, NULL);
+	destroy_memory_arena(&context->arena);
+	vkDestroyDevice(device, NULL);
+	if (context->debug_messenger != VK_NULL_HANDLE) {
+		ext.vkDestroyDebugUtilsMessengerEXT(context->instance, context->debug_messenger, NULL);
+	}
+	vkDestroyInstance(context->instance, NULL);
+	end_profile_span(teardown_span);
+}
+
+// header at the start of a frame ring, followed by slot_count slots of slot_size bytes. The one
+// producer and the one consumer each advance their own sequence number, on its own cache line, and
+// frame i lives in slot i % slot_count, so neither side ever takes a lock
+struct frame_ring_header {
+	_Atomic uint32_t magic; // published last, with release order
+	uint32_t slot_count;
+	uint32_t width_px;
+	uint32_t height_px;
+	uint64_t frame_size;
+	uint64_t slot_size;
+	uint64_t header_size;
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t write_sequence; // frames published
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t read_sequence;  // frames consumed
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint32_t closed;         // no more frames will be published
+};
+
+// start of every slot, the rgb8 texels of the frame follow at CACHE_LINE_SIZE
+struct frame_slot_header {
+	uint64_t sequence;
+	uint64_t frame_size;
+};
+
+struct frame_ring {
+	struct frame_ring_header *header;
+	size_t mapped_size;
+	uint64_t sequence;
+};
+
+void wait_for_frame_ring(uint32_t *spin_count) {
+	// spin briefly, then sleep so a stalled peer does not cost a whole core
+	if (++*spin_count < 64) {
+		sched_yield();
+	} else {
+		struct timespec const delay = { .tv_nsec = 50000 };
+		nanosleep(&delay, NULL);
+	}
+}
+
+uint8_t *get_frame_slot(struct frame_ring const *ring, uint64_t sequence) {
+	struct frame_ring_header const *header = ring->header;
+	return (uint8_t *)header + header->header_size + (sequence % header->slot_count) * header->slot_size;
+}
+
+bool create_frame_ring(char const *name,
+                       uint32_t slot_count,
+                       uint32_t width_px,
+                       uint32_t height_px,
+                       struct frame_ring *ring) {
+	size_t const page_size   = sysconf(_SC_PAGESIZE);
+	size_t const header_size = (sizeof(struct frame_ring_header) + page_size - 1) & ~(page_size - 1);
+	size_t const frame_size  = (size_t)width_px * height_px * 3;
+	size_t const slot_size   = (CACHE_LINE_SIZE + frame_size + page_size - 1) & ~(page_size - 1);
+	size_t const mapped_size = header_size + slot_count * slot_size;
+
+	// a ring left under this name may still be mapped by a consumer, so it is unlinked rather than
+	// truncated, the consumer keeps its own mapping and the new ring is a new object
+	shm_unlink(name);
+	int const fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, mapped_size) != 0) {
+		close(fd);
+		return false;
+	}
+	void *mapped = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	// the magic is written last, a consumer that sees it sees the rest of the header too
+	struct frame_ring_header *header = mapped;
+	header->slot_count  = slot_count;
+	header->width_px    = width_px;
+	header->height_px   = height_px;
+	header->frame_size  = frame_size;
+	header->slot_size   = slot_size;
+	header->header_size = header_size;
+	atomic_store_explicit(&header->write_sequence, 0, memory_order_relaxed);
+	atomic_store_explicit(&header->read_sequence, 0, memory_order_relaxed);
+	atomic_store_explicit(&header->closed, 0, memory_order_relaxed);
+	atomic_store_explicit(&header->magic, FRAME_RING_MAGIC, memory_order_release);
+
+	*ring = (struct frame_ring){
+		.header      = header,
+		.mapped_size = mapped_size,
+	};
+	return true;
+}
+
+uint8_t *acquire_frame_slot(struct frame_ring *ring, double *blocked_ms) {
+	// the next slot is free once the consumer is fewer than slot_count frames behind
+	struct frame_ring_header *header = ring->header;
+	double const start_ms = get_time_ms();
+	uint32_t spin_count = 0;
+	while (ring->sequence - atomic_load_explicit(&header->read_sequence, memory_order_acquire) >=
+	       header->slot_count) {
+		wait_for_frame_ring(&spin_count);
+	}
+	*blocked_ms += get_time_ms() - start_ms;
+	return get_frame_slot(ring, ring->sequence) + CACHE_LINE_SIZE;
+}
+
+void publish_frame(struct frame_ring *ring) {
+	struct frame_slot_header *slot_header = (struct frame_slot_header *)get_frame_slot(ring, ring->sequence);
+	slot_header->sequence   = ring->sequence;
+	slot_header->frame_size = ring->header->frame_size;
+	ring->sequence += 1;
+	atomic_store_explicit(&ring->header->write_sequence, ring->sequence, memory_order_release);
+}
+
+void close_frame_ring(struct frame_ring *ring) {
+	// the consumer unlinks the ring once it has drained it
+	atomic_store_explicit(&ring->header->closed, 1, memory_order_release);
+	munmap(ring->header, ring->mapped_size);
+}
+
+bool run_ring_output(char const *name, uint32_t frame_count, uint32_t slot_count, struct render_options const *options) {
+	if (frame_count == 0 || slot_count == 0) {
+		return false;
+	}
+
+	struct render_context context;
+	struct frame_ring ring;
+	if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, options) ||
+	    !create_frame_ring(name, slot_count, IMAGE_WIDTH, IMAGE_HEIGHT, &ring)) {
+		return false;
+	}
+
+	// frames are converted straight into the slot, the ring is the only copy outside the gpu
+	double blocked_ms = 0.0;
+	double const start_ms = get_time_ms();
+	for (uint32_t i = 0; i < frame_count; ++i) {
+		uint8_t *texels = acquire_frame_slot(&ring, &blocked_ms);
+		if (!generate_image(&context, texels)) {
+			return false;
+		}
+		// packed rgb output is already laid out as a frame in mapped memory
+		if (context.rgb_buffer_output) {
+			memcpy(texels, context.image_buffer_mapped, ring.header->frame_size);
+		}
+		publish_frame(&ring);
+	}
+	double const total_ms = get_time_ms() - start_ms;
+
+	uint64_t const frame_size = ring.header->frame_size;
+	close_frame_ring(&ring);
+	destroy_render_context(&context);
+
+	printf("ring %s: %u frames of %ux%u in %.3f ms, %.1f frames per second, %.1f MiB/s, "
+	       "%.3f ms waiting for the consumer\n",
+	       name,
+	       frame_count,
+	       IMAGE_WIDTH,
+	       IMAGE_HEIGHT,
+	       total_ms,
+	       frame_count * 1000.0 / total_ms,
+	       frame_count * frame_size / (1024.0 * 1024.0) / (total_ms / 1000.0),
+	       blocked_ms);
+	return true;
+}
+
+bool run_ring_consumer(char const *name) {
+	// the producer may not have created the ring yet
+	int fd = -1;
+	for (uint32_t attempt = 0; attempt < 500 && fd < 0; ++attempt) {
+		fd = shm_open(name, O_RDWR, 0);
+		if (fd < 0) {
+			struct timespec const delay = { .tv_nsec = 10000000 };
+			nanosleep(&delay, NULL);
+		}
+	}
+	if (fd < 0) {
+		fprintf(stderr, "no frame ring called %s\n", name);
+		return false;
+	}
+
+	// the object exists before the producer sizes it, and touching a mapping past its end raises
+	// SIGBUS, so the header is only mapped once the object is large enough to hold it
+	struct stat ring_stat = {0};
+	for (uint32_t attempt = 0; attempt < 500; ++attempt) {
+		if (fstat(fd, &ring_stat) != 0 || ring_stat.st_size >= (off_t)sizeof(struct frame_ring_header)) {
+			break;
+		}
+		struct timespec const delay = { .tv_nsec = 10000000 };
+		nanosleep(&delay, NULL);
+	}
+	if (ring_stat.st_size < (off_t)sizeof(struct frame_ring_header)) {
+		fprintf(stderr, "frame ring %s was never sized\n", name);
+		close(fd);
+		return false;
+	}
+
+	// map the header to learn the size of the ring, then the whole ring
+	struct frame_ring_header *header =
+		mmap(NULL, sizeof(struct frame_ring_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (header == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	uint32_t spin_count = 0;
+	while (atomic_load_explicit(&header->magic, memory_order_acquire) != FRAME_RING_MAGIC) {
+		wait_for_frame_ring(&spin_count);
+	}
+	size_t const mapped_size = header->header_size + header->slot_count * header->slot_size;
+	munmap(header, sizeof(struct frame_ring_header));
+
+	// the producer sizes the ring before it publishes the magic, so a ring smaller than its header
+	// claims was left behind by a producer that died, or was never a frame ring
+	if (fstat(fd, &ring_stat) != 0 || (uint64_t)ring_stat.st_size < mapped_size) {
+		fprintf(stderr, "frame ring %s is smaller than its header says\n", name);
+		close(fd);
+		return false;
+	}
+
+	struct frame_ring ring = { .mapped_size = mapped_size };
+	ring.header = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring.header == MAP_FAILED) {
+		return false;
+	}
+	header = ring.header;
+
+	// every frame is read in full, the checksum keeps the reads from being optimized away
+	uint64_t checksum = 0;
+	double start_ms = 0.0;
+	for (;;) {
+		spin_count = 0;
+		while (atomic_load_explicit(&header->write_sequence, memory_order_acquire) == ring.sequence) {
+			if (atomic_load_explicit(&header->closed, memory_order_acquire) &&
+			    atomic_load_explicit(&header->write_sequence, memory_order_acquire) == ring.sequence) {
+				break;
+			}
+			wait_for_frame_ring(&spin_count);
+		}
+		if (atomic_load_explicit(&header->write_sequence, memory_order_acquire) == ring.sequence) {
+			break;
+		}
+		if (ring.sequence == 0) {
+			start_ms = get_time_ms();
+		}
+
+		struct frame_slot_header const *slot_header =
+			(struct frame_slot_header const *)get_frame_slot(&ring, ring.sequence);
+		if (slot_header->sequence != ring.sequence || slot_header->frame_size != header->frame_size) {
+			fprintf(stderr, "frame %llu is out of sequence\n", (unsigned long long)ring.sequence);
+			return false;
+		}
+		uint8_t const *texels = (uint8_t const *)slot_header + CACHE_LINE_SIZE;
+		for (uint64_t i = 0; i + 8 <= slot_header->frame_size; i += 8) {
+			uint64_t word;
+			memcpy(&word, texels + i, sizeof(word));
+			checksum += word;
+		}
+
+		ring.sequence += 1;
+		atomic_store_explicit(&header->read_sequence, ring.sequence, memory_order_release);
+	}
+	double const total_ms = get_time_ms() - start_ms;
+
+	printf("consumed %llu frames of %ux%u in %.3f ms, %.1f frames per second, %.1f MiB/s, checksum %016llx\n",
+	       (unsigned long long)ring.sequence,
+	       header->width_px,
+	       header->height_px,
+	       total_ms,
+	       ring.sequence * 1000.0 / total_ms,
+	       ring.sequence * header->frame_size / (1024.0 * 1024.0) / (total_ms / 1000.0),
+	       (unsigned long long)checksum);
+	munmap(ring.header, ring.mapped_size);
+	shm_unlink(name);
+	return true;
+}
+
+// where the kernel allows it images are written through io_uring, otherwise by a few writer
+// threads, in both cases straight from a pool of pinned buffers. A buffer holds a whole ppm file,
+// with the header right before the texels so a single write covers it, or rows that land at their
+// own offsets in a larger file, such as one tile of an image or one frame of a stream
+#define MAX_WRITER_BUFFERS     16
+#define MAX_WRITER_SUBMISSIONS 1024
+#define WRITER_BUFFER_COUNT    4
+#define WRITER_THREAD_COUNT    4
+#define WRITER_HEADER_SIZE     64
+
+struct writer_buffer {
+	uint8_t *data;        // WRITER_HEADER_SIZE bytes of header space, then the rgb8 texels
+	size_t mapped_size;
+	uint8_t *start;       // of the first row, a whole file is one row that starts with its header
+	size_t row_size;
+	uint32_t row_count;
+	off_t offset;         // of the first row in the file
+	off_t row_stride;     // between the starts of consecutive rows in the file
+	struct iovec *rows;   // what is left to write of every row
+	uint32_t next_row;    // the first row that has not been submitted yet
+	uint32_t rows_in_flight;
+	int fd;               // owned by the buffer until its write completes
+	bool pending;         // the buffer returns to the pool once all of its rows are written
+};
+
+// the submission and completion rings shared with the kernel
+struct io_uring_queue {
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	_Atomic uint32_t *sq_tail;
+	uint32_t sq_mask;
+	uint32_t *sq_array;
+	_Atomic uint32_t *cq_head;
+	_Atomic uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+	uint32_t unsubmitted; // prepared submissions the kernel has not taken yet
+	bool buffers_registered;
+};
+
+struct image_writer {
+	bool use_uring;
+	struct io_uring_queue uring;
+	struct writer_buffer buffers[MAX_WRITER_BUFFERS];
+	uint32_t buffer_count;
+	uint32_t max_row_count;
+	uint32_t rows_per_submission; // rows of one buffer in flight at once, so the queue never overflows
+	pthread_t threads[WRITER_THREAD_COUNT];
+	uint32_t thread_count;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; // signalled when a write is queued or completes
+	uint32_t queue[MAX_WRITER_BUFFERS];
+	uint32_t queue_head;
+	uint32_t queue_count;
+	bool stopping;
+	bool failed;
+};
+
+bool create_io_uring_queue(struct io_uring_queue *uring, uint32_t entry_count) {
+	struct io_uring_params params = {0};
+	*uring = (struct io_uring_queue){ .fd = syscall(__NR_io_uring_setup, entry_count, &params) };
+	if (uring->fd < 0) {
+		return false;
+	}
+
+	// newer kernels map both rings with a single mmap
+	uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap && uring->cq_ring_size > uring->sq_ring_size) {
+		uring->sq_ring_size = uring->cq_ring_size;
+	}
+	uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	uring->sq_ring = mmap(NULL,
+	                      uring->sq_ring_size,
+	                      PROT_READ | PROT_WRITE,
+	                      MAP_SHARED | MAP_POPULATE,
+	                      uring->fd,
+	                      IORING_OFF_SQ_RING);
+	uring->cq_ring = single_mmap ? uring->sq_ring : mmap(NULL,
+	                                                     uring->cq_ring_size,
+	                                                     PROT_READ | PROT_WRITE,
+	                                                     MAP_SHARED | MAP_POPULATE,
+	                                                     uring->fd,
+	                                                     IORING_OFF_CQ_RING);
+	uring->sqes = mmap(NULL,
+	                   uring->sqes_size,
+	                   PROT_READ | PROT_WRITE,
+	                   MAP_SHARED | MAP_POPULATE,
+	                   uring->fd,
+	                   IORING_OFF_SQES);
+	if (uring->sq_ring == MAP_FAILED || uring->cq_ring == MAP_FAILED || uring->sqes == MAP_FAILED) {
+		close(uring->fd);
+		return false;
+	}
+
+	uint8_t *sq_ring = uring->sq_ring;
+	uint8_t *cq_ring = uring->cq_ring;
+	uring->sq_tail  = (_Atomic uint32_t *)(sq_ring + params.sq_off.tail);
+	uring->sq_mask  = *(uint32_t *)(sq_ring + params.sq_off.ring_mask);
+	uring->sq_array = (uint32_t *)(sq_ring + params.sq_off.array);
+	uring->cq_head  = (_Atomic uint32_t *)(cq_ring + params.cq_off.head);
+	uring->cq_tail  = (_Atomic uint32_t *)(cq_ring + params.cq_off.tail);
+	uring->cq_mask  = *(uint32_t *)(cq_ring + params.cq_off.ring_mask);
+	uring->cqes     = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+	return true;
+}
+
+void destroy_io_uring_queue(struct io_uring_queue *uring) {
+	munmap(uring->sqes, uring->sqes_size);
+	if (uring->cq_ring != uring->sq_ring) {
+		munmap(uring->cq_ring, uring->cq_ring_size);
+	}
+	munmap(uring->sq_ring, uring->sq_ring_size);
+	close(uring->fd);
+}
+
+// fills a submission for what is left of one row, the kernel picks it up on the next enter
+void prepare_row_write(struct image_writer *writer, uint32_t buffer_index, uint32_t row) {
+	struct io_uring_queue *uring = &writer->uring;
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	struct iovec *rest = &buffer->rows[row];
+	size_t const written = (uint8_t *)rest->iov_base - (buffer->start + row * buffer->row_size);
+	uint32_t const tail  = atomic_load_explicit(uring->sq_tail, memory_order_relaxed);
+	uint32_t const index = tail & uring->sq_mask;
+	struct io_uring_sqe *sqe = &uring->sqes[index];
+	*sqe = (struct io_uring_sqe){
+		.fd        = buffer->fd,
+		.off       = buffer->offset + row * buffer->row_stride + written,
+		.user_data = (uint64_t)buffer_index << 32 | row,
+	};
+	if (uring->buffers_registered) {
+		sqe->opcode    = IORING_OP_WRITE_FIXED;
+		sqe->addr      = (uintptr_t)rest->iov_base;
+		sqe->len       = rest->iov_len;
+		sqe->buf_index = buffer_index;
+	} else {
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr   = (uintptr_t)rest;
+		sqe->len    = 1;
+	}
+	uring->sq_array[index] = index;
+	atomic_store_explicit(uring->sq_tail, tail + 1, memory_order_release);
+	uring->unsubmitted += 1;
+	buffer->rows_in_flight += 1;
+}
+
+// hands every prepared submission to the kernel, and waits for a completion when asked to. What the
+// kernel does not take now is handed over again on the next call, so no prepared write is lost
+bool enter_io_uring(struct io_uring_queue *uring, bool wait) {
+	if (uring->unsubmitted == 0 && !wait) {
+		return true;
+	}
+	int const submitted = syscall(__NR_io_uring_enter,
+	                              uring->fd,
+	                              uring->unsubmitted,
+	                              wait ? 1 : 0,
+	                              wait ? IORING_ENTER_GETEVENTS : 0,
+	                              NULL,
+	                              0);
+	if (submitted < 0) {
+		return false;
+	}
+	uring->unsubmitted -= submitted;
+	return true;
+}
+
+// prepares the next rows of a buffer up to its share of the queue
+void prepare_buffer_rows(struct image_writer *writer, uint32_t buffer_index) {
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	while (buffer->next_row < buffer->row_count && buffer->rows_in_flight < writer->rows_per_submission) {
+		prepare_row_write(writer, buffer_index, buffer->next_row++);
+	}
+}
+
+bool reap_image_writes(struct image_writer *writer, bool wait) {
+	struct io_uring_queue *uring = &writer->uring;
+	if (wait && !enter_io_uring(uring, true)) {
+		return false;
+	}
+
+	uint32_t head = atomic_load_explicit(uring->cq_head, memory_order_relaxed);
+	uint32_t const tail = atomic_load_explicit(uring->cq_tail, memory_order_acquire);
+	for (; head != tail; ++head) {
+		struct io_uring_cqe const *cqe = &uring->cqes[head & uring->cq_mask];
+		uint32_t const buffer_index = cqe->user_data >> 32;
+		uint32_t const row = (uint32_t)cqe->user_data;
+		struct writer_buffer *buffer = &writer->buffers[buffer_index];
+		struct iovec *rest = &buffer->rows[row];
+		buffer->rows_in_flight -= 1;
+		if (cqe->res <= 0) {
+			writer->failed = true;
+		} else {
+			rest->iov_base = (uint8_t *)rest->iov_base + cqe->res;
+			rest->iov_len -= cqe->res;
+		}
+
+		// a short write is continued from where it stopped, a finished row makes room for the next
+		if (!writer->failed) {
+			if (rest->iov_len > 0) {
+				prepare_row_write(writer, buffer_index, row);
+			} else {
+				prepare_buffer_rows(writer, buffer_index);
+			}
+		}
+
+		// after a failure nothing more is submitted and the buffer is released once it is idle
+		if (buffer->rows_in_flight == 0 && (writer->failed || buffer->next_row == buffer->row_count)) {
+			if (close(buffer->fd) != 0) {
+				writer->failed = true;
+			}
+			buffer->pending = false;
+		}
+	}
+	atomic_store_explicit(uring->cq_head, head, memory_order_release);
+	if (!enter_io_uring(uring, false)) {
+		writer->failed = true;
+	}
+	return !writer->failed;
+}
+
+bool write_buffer_rows(struct writer_buffer *buffer) {
+	for (uint32_t row = 0; row < buffer->row_count; ++row) {
+		struct iovec *rest = &buffer->rows[row];
+		while (rest->iov_len > 0) {
+			size_t const written_before = (uint8_t *)rest->iov_base - (buffer->start + row * buffer->row_size);
+			ssize_t const written = pwrite(buffer->fd,
+			                               rest->iov_base,
+			                               rest->iov_len,
+			                               buffer->offset + row * buffer->row_stride + written_before);
+			if (written <= 0) {
+				return false;
+			}
+			rest->iov_base = (uint8_t *)rest->iov_base + written;
+			rest->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+void *image_writer_thread(void *arg) {
+	struct image_writer *writer = arg;
+	pthread_mutex_lock(&writer->mutex);
+	while (true) {
+		while (writer->queue_count == 0 && !writer->stopping) {
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		if (writer->queue_count == 0) {
+			break;
+		}
+		struct writer_buffer *buffer = &writer->buffers[writer->queue[writer->queue_head]];
+		writer->queue_head = (writer->queue_head + 1) % MAX_WRITER_BUFFERS;
+		writer->queue_count -= 1;
+		pthread_mutex_unlock(&writer->mutex);
+
+		bool const written = write_buffer_rows(buffer);
+		bool const closed = close(buffer->fd) == 0;
+
+		pthread_mutex_lock(&writer->mutex);
+		writer->failed |= !written || !closed;
+		buffer->pending = false;
+		pthread_cond_broadcast(&writer->cond);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+	return NULL;
+}
+
+void destroy_image_writer(struct image_writer *writer) {
+	if (writer->use_uring) {
+		destroy_io_uring_queue(&writer->uring);
+	} else if (writer->thread_count > 0) {
+		pthread_mutex_lock(&writer->mutex);
+		writer->stopping = true;
+		pthread_cond_broadcast(&writer->cond);
+		pthread_mutex_unlock(&writer->mutex);
+		for (uint32_t i = 0; i < writer->thread_count; ++i) {
+			pthread_join(writer->threads[i], NULL);
+		}
+	}
+	if (!writer->use_uring) {
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->mutex);
+	}
+	for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+		munmap(writer->buffers[i].data, writer->buffers[i].mapped_size);
+		free(writer->buffers[i].rows);
+	}
+}
+
+bool create_image_writer(struct image_writer *writer,
+                         uint32_t buffer_count,
+                         size_t texel_size,
+                         uint32_t max_row_count,
+                         bool use_threads) {
+	if (buffer_count == 0 || buffer_count > MAX_WRITER_BUFFERS || max_row_count == 0) {
+		return false;
+	}
+	*writer = (struct image_writer){
+		.buffer_count        = buffer_count,
+		.max_row_count       = max_row_count,
+		.rows_per_submission = MAX_WRITER_SUBMISSIONS / buffer_count,
+	};
+	if (writer->rows_per_submission > max_row_count) {
+		writer->rows_per_submission = max_row_count;
+	}
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+
+	// page aligned and faulted in up front, locked where the memlock limit allows
+	size_t const page_size = sysconf(_SC_PAGESIZE);
+	struct iovec iovecs[MAX_WRITER_BUFFERS];
+	for (uint32_t i = 0; i < buffer_count; ++i) {
+		struct writer_buffer *buffer = &writer->buffers[i];
+		buffer->mapped_size = (WRITER_HEADER_SIZE + texel_size + page_size - 1) & ~(page_size - 1);
+		buffer->data = mmap(NULL,
+		                    buffer->mapped_size,
+		                    PROT_READ | PROT_WRITE,
+		                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+		                    -1,
+		                    0);
+		buffer->rows = buffer->data != MAP_FAILED ? malloc(max_row_count * sizeof(struct iovec)) : NULL;
+		if (!buffer->rows) {
+			if (buffer->data != MAP_FAILED) {
+				munmap(buffer->data, buffer->mapped_size);
+			}
+			writer->buffer_count = i;
+			destroy_image_writer(writer);
+			return false;
+		}
+		mlock(buffer->data, buffer->mapped_size);
+		iovecs[i] = (struct iovec){ .iov_base = buffer->data, .iov_len = buffer->mapped_size };
+	}
+
+	// registered buffers stay pinned by the kernel, so writes skip mapping them on every submission
+	if (!use_threads && create_io_uring_queue(&writer->uring, buffer_count * writer->rows_per_submission)) {
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->mutex);
+		writer->use_uring = true;
+		writer->uring.buffers_registered =
+			syscall(__NR_io_uring_register, writer->uring.fd, IORING_REGISTER_BUFFERS, iovecs, buffer_count) == 0;
+		return true;
+	}
+
+	for (uint32_t i = 0; i < WRITER_THREAD_COUNT; ++i) {
+		if (pthread_create(&writer->threads[i], NULL, image_writer_thread, writer) != 0) {
+			break;
+		}
+		writer->thread_count += 1;
+	}
+	if (writer->thread_count == 0) {
+		destroy_image_writer(writer);
+		return false;
+	}
+	return true;
+}
+
+bool find_free_writer_buffer(struct image_writer const *writer, uint32_t *buffer_index) {
+	for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+		if (!writer->buffers[i].pending) {
+			*buffer_index = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint8_t *acquire_writer_buffer(struct image_writer *writer, uint32_t *buffer_index) {
+	bool failed;
+	if (writer->use_uring) {
+		if (!reap_image_writes(writer, false)) {
+			return NULL;
+		}
+		while (!find_free_writer_buffer(writer, buffer_index)) {
+			if (!reap_image_writes(writer, true)) {
+				return NULL;
+			}
+		}
+		failed = writer->failed;
+	} else {
+		pthread_mutex_lock(&writer->mutex);
+		while (!find_free_writer_buffer(writer, buffer_index)) {
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		failed = writer->failed;
+		pthread_mutex_unlock(&writer->mutex);
+	}
+	return failed ? NULL : writer->buffers[*buffer_index].data + WRITER_HEADER_SIZE;
+}
+
+// queues row_count rows of row_size bytes from start, which lies in the acquired buffer, to the
+// file at offset and every row_stride bytes after it, the writer closes fd once they are written
+bool queue_buffer_write(struct image_writer *writer,
+                        uint32_t buffer_index,
+                        uint8_t *start,
+                        int fd,
+                        off_t offset,
+                        size_t row_size,
+                        uint32_t row_count,
+                        off_t row_stride) {
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	if (row_count == 0 || row_count > writer->max_row_count) {
+		close(fd);
+		return false;
+	}
+	buffer->start      = start;
+	buffer->fd         = fd;
+	buffer->offset     = offset;
+	buffer->row_size   = row_size;
+	buffer->row_count  = row_count;
+	buffer->row_stride = row_stride;
+	for (uint32_t row = 0; row < row_count; ++row) {
+		buffer->rows[row] = (struct iovec){ .iov_base = start + row * row_size, .iov_len = row_size };
+	}
+
+	if (writer->use_uring) {
+		buffer->pending        = true;
+		buffer->next_row       = 0;
+		buffer->rows_in_flight = 0;
+		prepare_buffer_rows(writer, buffer_index);
+		return enter_io_uring(&writer->uring, false);
+	}
+	pthread_mutex_lock(&writer->mutex);
+	buffer->pending = true;
+	writer->queue[(writer->queue_head + writer->queue_count) % MAX_WRITER_BUFFERS] = buffer_index;
+	writer->queue_count += 1;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+	return true;
+}
+
+// queues the acquired buffer as a whole ppm file
+bool queue_image_write(struct image_writer *writer,
+                       uint32_t buffer_index,
+                       char const *filename,
+                       uint32_t width_px,
+                       uint32_t height_px) {
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	char header[WRITER_HEADER_SIZE];
+	int const header_size = snprintf(header, sizeof(header), "P6 %u %u 255\n", width_px, height_px);
+	uint8_t *start = buffer->data + WRITER_HEADER_SIZE - header_size;
+	memcpy(start, header, header_size);
+
+	int const fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	return queue_buffer_write(writer,
+	                          buffer_index,
+	                          start,
+	                          fd,
+	                          0,
+	                          header_size + (size_t)width_px * height_px * 3,
+	                          1,
+	                          0);
+}
+
+// waits for every queued write, a failure is reported once and the writer can be used again after
+bool finish_image_writes(struct image_writer *writer) {
+	bool failed;
+	if (writer->use_uring) {
+		for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+			while (writer->buffers[i].pending) {
+				if (!enter_io_uring(&writer->uring, true)) {
+					return false;
+				}
+				reap_image_writes(writer, false);
+			}
+		}
+		failed = writer->failed;
+		writer->failed = false;
+	} else {
+		pthread_mutex_lock(&writer->mutex);
+		for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+			while (writer->buffers[i].pending) {
+				pthread_cond_wait(&writer->cond, &writer->mutex);
+			}
+		}
+		failed = writer->failed;
+		writer->failed = false;
+		pthread_mutex_unlock(&writer->mutex);
+	}
+	return !failed;
+}
+
+bool run_writer_benchmark(uint32_t image_count) {
+	// large enough that the file write is a real part of every image
+	uint16_t const width_px  = 2048;
+	uint16_t const height_px = 2048;
+	size_t const texel_size  = (size_t)width_px * height_px * 3;
+	char const *const writer_names[3] = { "blocking fwrite", "io_uring", "writer threads" };
+
+	// files are reused once no write to them can still be pending
+	uint32_t const file_count = 2 * WRITER_BUFFER_COUNT;
+	char filename[64];
+
+	if (image_count == 0) {
+		return false;
+	}
+
+	struct render_options const options = {0};
+	struct render_context context;
+	if (!create_render_context(&context, width_px, height_px, &options)) {
+		return false;
+	}
+
+	// the current writer converts into one heap buffer and writes it before the next render
+	double images_per_second[3] = { 0.0 };
+	uint8_t *texel_buffer = malloc(texel_size);
+	if (!texel_buffer || !generate_image(&context, texel_buffer)) {
+		return false;
+	}
+	double start_ms = get_time_ms();
+	for (uint32_t i = 0; i < image_count; ++i) {
+		if (!generate_image(&context, texel_buffer)) {
+			return false;
+		}
+		snprintf(filename, sizeof(filename), "writer-bench-%u.ppm", i % file_count);
+		if (!save_rgb8_image_to_ppm(filename, width_px, height_px, texel_buffer)) {
+			return false;
+		}
+	}
+	images_per_second[0] = image_count * 1000.0 / (get_time_ms() - start_ms);
+	free(texel_buffer);
+
+	// the asynchronous writers render the next image while earlier ones are still being written
+	for (uint32_t j = 1; j < 3; ++j) {
+		struct image_writer writer;
+		if (!create_image_writer(&writer, WRITER_BUFFER_COUNT, texel_size, 1, j == 2)) {
+			return false;
+		}
+		if (j == 1 && !writer.use_uring) {
+			fputs("io_uring is not available, skipping it\n", stderr);
+			destroy_image_writer(&writer);
+			continue;
+		}
+
+		start_ms = get_time_ms();
+		for (uint32_t i = 0; i < image_count; ++i) {
+			uint32_t buffer_index;
+			uint8_t *texels = acquire_writer_buffer(&writer, &buffer_index);
+			if (!texels || !generate_image(&context, texels)) {
+				return false;
+			}
+			snprintf(filename, sizeof(filename), "writer-bench-%u.ppm", i % file_count);
+			if (!queue_image_write(&writer, buffer_index, filename, width_px, height_px)) {
+				return false;
+			}
+		}
+		if (!finish_image_writes(&writer)) {
+			return false;
+		}
+		images_per_second[j] = image_count * 1000.0 / (get_time_ms() - start_ms);
+		if (j == 1 && !writer.uring.buffers_registered) {
+			fputs("io_uring buffer registration failed, writes were not from fixed buffers\n", stderr);
+		}
+		destroy_image_writer(&writer);
+	}
+
+	destroy_render_context(&context);
+	for (uint32_t i = 0; i < file_count && i < image_count; ++i) {
+		snprintf(filename, sizeof(filename), "writer-bench-%u.ppm", i);
+		unlink(filename);
+	}
+
+	printf("%u images of %ux%u, %u buffers in flight for the asynchronous writers\n",
+	       image_count, width_px, height_px, WRITER_BUFFER_COUNT);
+	for (uint32_t j = 0; j < 3; ++j) {
+		if (images_per_second[j] > 0.0) {
+			printf("%-16s %8.1f images per second\n", writer_names[j], images_per_second[j]);
+		}
+	}
+	return true;
+}
+
+bool run_benchmark(uint32_t image_count, struct render_options const *options) {
+	uint8_t *texel_buffer = malloc(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+
+	// time setup and the first image separately from the warmed up steady state
+	struct render_context context;
+	double start_ms = get_time_ms();
+	if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, options)) {
+		return false;
+	}
+	double const setup_ms = get_time_ms() - start_ms;
+
+	start_ms = get_time_ms();
+	if (!generate_image(&context, texel_buffer)) {
+		return false;
+	}
+	double const first_image_ms = get_time_ms() - start_ms;
+
+	double total_ms = 0.0;
+	double min_ms = 0.0;
+	double max_ms = 0.0;
+	double total_dispatch_ms = 0.0;
+	double total_copy_ms = 0.0;
+	for (uint32_t i = 0; i < image_count; ++i) {
+		start_ms = get_time_ms();
+		if (!generate_image(&context, texel_buffer)) {
+			return false;
+		}
+		double const image_ms = get_time_ms() - start_ms;
+		total_ms += image_ms;
+		if (i == 0 || image_ms < min_ms) min_ms = image_ms;
+		if (i == 0 || image_ms > max_ms) max_ms = image_ms;
+		total_dispatch_ms += context.dispatch_ms;
+		total_copy_ms += context.copy_ms;
+	}
+
+	bool const has_timestamps = context.timestamp_mask != 0;
+
+	destroy_render_context(&context);
+	free(texel_buffer);
+
+	printf("image size:  %dx%d\n", IMAGE_WIDTH, IMAGE_HEIGHT);
+	printf("setup:       %.3f ms\n", setup_ms);
+	printf("first image: %.3f ms\n", first_image_ms);
+	if (image_count > 0) {
+		printf("per image:   mean %.3f ms, min %.3f ms, max %.3f ms over %u images\n",
+		       total_ms / image_count, min_ms, max_ms, image_count);
+		if (has_timestamps) {
+			printf("gpu mean:    dispatch %.3f ms, copy %.3f ms\n",
+			       total_dispatch_ms / image_count, total_copy_ms / image_count);
+		}
+	}
+	return true;
+}
+
+bool run_convert_benchmark(uint32_t iteration_count) {
+	// 8k, the size at which the byte loop used to cost more than the render
+	uint32_t const width_px    = 7680;
+	uint32_t const height_px   = 4320;
+	size_t const   texel_count = (size_t)width_px * height_px;
+
+	uint8_t *rgba          = malloc(texel_count * 4);
+	uint8_t *rgb_reference = malloc(texel_count * 3);
+	uint8_t *rgb           = malloc(texel_count * 3);
+	if (!rgba || !rgb_reference || !rgb || iteration_count == 0) {
+		return false;
+	}
+	for (size_t i = 0; i < texel_count * 4; ++i) {
+		rgba[i] = (uint8_t)(i * 7 + (i >> 12));
+	}
+
+	struct convert_kernel const kernel = select_convert_kernel();
+	uint32_t const thread_count = get_convert_thread_count();
+
+	// the first pass of each variant faults in the destination pages and is not timed
+	double scalar_ms = 0.0;
+	for (uint32_t i = 0; i <= iteration_count; ++i) {
+		double const start_ms = get_time_ms();
+		convert_rgba8_to_rgb8_scalar(rgba, rgb_reference, texel_count);
+		if (i > 0) scalar_ms += get_time_ms() - start_ms;
+	}
+
+	double kernel_ms[2] = { 0.0, 0.0 };
+	uint32_t const kernel_threads[2] = { 1, thread_count };
+	for (uint32_t k = 0; k < 2; ++k) {
+		for (uint32_t i = 0; i <= iteration_count; ++i) {
+			memset(rgb, 0, texel_count * 3);
+			double const start_ms = get_time_ms();
+			convert_rgba8_image_to_rgb8(&kernel, rgba, rgb, width_px, height_px, kernel_threads[k]);
+			if (i > 0) kernel_ms[k] += get_time_ms() - start_ms;
+			if (memcmp(rgb, rgb_reference, texel_count * 3) != 0) {
+				fprintf(stderr, "%s conversion on %u threads does not match the byte loop\n",
+				        kernel.name, kernel_threads[k]);
+				return false;
+			}
+		}
+	}
+
+	free(rgb);
+	free(rgb_reference);
+	free(rgba);
+
+	// bandwidth counts the rgba bytes read plus the rgb bytes written
+	double const megabytes = texel_count * 7 / (1024.0 * 1024.0);
+	scalar_ms    /= iteration_count;
+	kernel_ms[0] /= iteration_count;
+	kernel_ms[1] /= iteration_count;
+
+	printf("image size: %ux%u, mean of %u conversions\n", width_px, height_px, iteration_count);
+	printf("%-20s %8.3f ms, %6.0f MiB/s\n", "byte loop:", scalar_ms, megabytes * 1000.0 / scalar_ms);
+	for (uint32_t k = 0; k < 2; ++k) {
+		char label[64];
+		snprintf(label, sizeof(label), "%s, %u thread%s:",
+		         kernel.name, kernel_threads[k], kernel_threads[k] == 1 ? "" : "s");
+		printf("%-20s %8.3f ms, %6.0f MiB/s, %.1fx the byte loop\n",
+		       label, kernel_ms[k], megabytes * 1000.0 / kernel_ms[k], scalar_ms / kernel_ms[k]);
+	}
+	return true;
+}
+
+bool run_readback_benchmark(uint32_t iteration_count) {
+	struct render_context context;
+	struct render_options const options = {0};
+	if (iteration_count == 0 || !create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, &options)) {
+		return false;
+	}
+	VkDevice device = context.device;
+	VkPhysicalDeviceMemoryProperties const *memory_properties = &context.arena.memory_properties;
+
+	// the type the arena picked for the context's own readback buffer
+	uint32_t const readback_memory_type_index =
+		context.arena.blocks[context.image_buffer_allocation.block_index].memory_type_index;
+
+	// as much data as an 8k image, rewritten by the gpu before every read
+	VkDeviceSize const buffer_size = 7680 * 4320 * 4;
+	uint32_t const fill_value = 0x01020304;
+	uint8_t *host_copy = malloc(buffer_size);
+	if (!host_copy) {
+		return false;
+	}
+
+	VkBufferCreateInfo buffer_create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size  = buffer_size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	};
+
+	printf("readback of %.0f MiB, mean of %u reads\n", buffer_size / (1024.0 * 1024.0), iteration_count);
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		VkMemoryPropertyFlags const flags = memory_properties->memoryTypes[i].propertyFlags;
+		if (!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+			continue;
+		}
+
+		VkBuffer buffer;
+		if (vkCreateBuffer(device, &buffer_create_info, NULL, &buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkMemoryRequirements memory_requirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+
+		// a dedicated allocation of exactly this type rather than the arena's pick
+		VkMemoryAllocateInfo memory_allocate_info = {
+			.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize  = memory_requirements.size,
+			.memoryTypeIndex = i,
+		};
+		VkDeviceMemory memory;
+		if (!(memory_requirements.memoryTypeBits & (1u << i)) ||
+		    vkAllocateMemory(device, &memory_allocate_info, NULL, &memory) != VK_SUCCESS) {
+			printf("type %2u: cannot hold the buffer\n", i);
+			vkDestroyBuffer(device, buffer, NULL);
+			continue;
+		}
+
+		void *mapped;
+		if (vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS ||
+		    vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+			.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool        = context.command_pool,
+			.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VkCommandBuffer command_buffer;
+		if (vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &command_buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkCommandBufferBeginInfo command_buffer_begin_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		};
+		if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+			return false;
+		}
+
+		vkCmdFillBuffer(command_buffer, buffer, 0, VK_WHOLE_SIZE, fill_value);
+
+		VkBufferMemoryBarrier buffer_memory_barrier = {
+			.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer              = buffer,
+			.offset              = 0,
+			.size                = VK_WHOLE_SIZE,
+		};
+		vkCmdPipelineBarrier(command_buffer,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     VK_PIPELINE_STAGE_HOST_BIT,
+		                     0,
+		                     0, NULL,
+		                     1, &buffer_memory_barrier,
+		                     0, NULL);
+
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkSubmitInfo submit_info = {
+			.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers    = &command_buffer,
+		};
+		VkMappedMemoryRange mapped_memory_range = {
+			.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			.memory = memory,
+			.offset = 0,
+			.size   = VK_WHOLE_SIZE,
+		};
+
+		// the first read faults in the host copy and is not timed
+		double total_ms = 0.0;
+		for (uint32_t j = 0; j <= iteration_count; ++j) {
+			if (vkQueueSubmit(context.compute_queue, 1, &submit_info, context.fence) != VK_SUCCESS ||
+			    vkWaitForFences(device, 1, &context.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+				return false;
+			}
+			vkResetFences(device, 1, &context.fence);
+
+			double const start_ms = get_time_ms();
+			if (!(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) &&
+			    vkInvalidateMappedMemoryRanges(device, 1, &mapped_memory_range) != VK_SUCCESS) {
+				return false;
+			}
+			memcpy(host_copy, mapped, buffer_size);
+			if (j > 0) total_ms += get_time_ms() - start_ms;
+		}
+
+		uint32_t last_value;
+		memcpy(&last_value, host_copy + buffer_size - sizeof(last_value), sizeof(last_value));
+		if (last_value != fill_value) {
+			fprintf(stderr, "type %u read back stale data\n", i);
+			return false;
+		}
+
+		char description[64];
+		snprintf(description, sizeof(description), "%shost visible%s%s",
+		         flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ? "device local, " : "",
+		         flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ? ", coherent" : "",
+		         flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT ? ", cached" : "");
+		double const mean_ms = total_ms / iteration_count;
+		printf("type %2u: heap %u, %-44s %8.3f ms, %6.0f MiB/s%s\n",
+		       i,
+		       memory_properties->memoryTypes[i].heapIndex,
+		       description,
+		       mean_ms,
+		       buffer_size / (1024.0 * 1024.0) * 1000.0 / mean_ms,
+		       i == readback_memory_type_index ? "  <- readback" : "");
+
+		vkFreeCommandBuffers(device, context.command_pool, 1, &command_buffer);
+		vkUnmapMemory(device, memory);
+		vkDestroyBuffer(device, buffer, NULL);
+		vkFreeMemory(device, memory, NULL);
+	}
+
+	free(host_copy);
+	destroy_render_context(&context);
+	return true;
+}
+
+bool run_output_benchmark(uint32_t image_count) {
+	// sizes are multiples of the 32x32 pattern tiles of the image path
+	uint16_t const sizes[][2] = { { 768, 512 }, { 1024, 1024 }, { 2048, 2048 }, { 4096, 4096 } };
+	uint32_t const size_count = sizeof(sizes) / sizeof(sizes[0]);
+	char const *const output_names[2] = { "image, copy and repack", "packed rgb buffer" };
+
+	if (image_count == 0) {
+		return false;
+	}
+
+	// results are printed at the end, setup of each context prints its own report
+	double mean_ms[size_count][2];
+	double gpu_ms[size_count][2];
+	for (uint32_t i = 0; i < size_count; ++i) {
+		for (uint32_t j = 0; j < 2; ++j) {
+			struct render_options const options = { .rgb_buffer_output = j == 1 };
+			struct render_context context;
+			if (!create_render_context(&context, sizes[i][0], sizes[i][1], &options)) {
+				return false;
+			}
+			uint8_t *texel_buffer = malloc((size_t)sizes[i][0] * sizes[i][1] * 3);
+
+			// the first image warms up the caches and faults in the texel buffer
+			if (!texel_buffer || !generate_image(&context, texel_buffer)) {
+				return false;
+			}
+
+			double total_ms = 0.0;
+			double total_gpu_ms = 0.0;
+			for (uint32_t k = 0; k < image_count; ++k) {
+				double const start_ms = get_time_ms();
+				if (!generate_image(&context, texel_buffer)) {
+					return false;
+				}
+				total_ms += get_time_ms() - start_ms;
+				total_gpu_ms += context.dispatch_ms + context.copy_ms;
+			}
+			mean_ms[i][j] = total_ms / image_count;
+			gpu_ms[i][j]  = context.timestamp_mask != 0 ? total_gpu_ms / image_count : 0.0;
+
+			destroy_render_context(&context);
+			free(texel_buffer);
+		}
+	}
+
+	printf("mean of %u images, per image time includes the cpu repack, gpu time is dispatch plus copy\n",
+	       image_count);
+	for (uint32_t i = 0; i < size_count; ++i) {
+		for (uint32_t j = 0; j < 2; ++j) {
+			printf("%4ux%-4u %-24s %8.3f ms per image, %8.3f ms gpu\n",
+			       sizes[i][0], sizes[i][1], output_names[j], mean_ms[i][j], gpu_ms[i][j]);
+		}
+	}
+	return true;
+}
+
+bool run_workgroup_tuning(uint32_t image_count) {
+	// candidate shapes of comp.glsl, from narrow rows that suit cpu simd lanes to large squares
+	uint32_t const shapes[][2] = {
+		{ 8, 8 }, { 16, 8 }, { 16, 16 }, { 32, 4 }, { 32, 8 }, { 32, 16 }, { 32, 32 },
+		{ 64, 1 }, { 64, 4 }, { 128, 1 }, { 128, 2 }, { 256, 1 }, { 8, 32 }, { 4, 64 },
+	};
+	uint32_t const shape_count = sizeof(shapes) / sizeof(shapes[0]);
+
+	if (image_count == 0) {
+		return false;
+	}
+
+	// every shape gets its own pipeline and so its own context, timed by gpu timestamps around the
+	// dispatch only
+	uint32_t best_shape = UINT32_MAX;
+	double best_ms = 0.0;
+	char tuning_filename[64] = "";
+	for (uint32_t i = 0; i < shape_count; ++i) {
+		struct render_options const options = { .workgroup_size = { shapes[i][0], shapes[i][1] } };
+		struct render_context context;
+		if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, &options)) {
+			return false;
+		}
+		if (context.timestamp_mask == 0) {
+			fputs("the compute queue cannot write timestamps, nothing to tune with\n", stderr);
+			destroy_render_context(&context);
+			return false;
+		}
+		strcpy(tuning_filename, context.tuning_filename);
+
+		// shapes the device does not support fall back to the default, which is timed on its own
+		bool const supported = context.workgroup_size[0] == shapes[i][0] &&
+		                       context.workgroup_size[1] == shapes[i][1];
+		double total_ms = 0.0;
+		uint8_t *texel_buffer = malloc(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+		if (supported) {
+			// the first image warms up the caches
+			if (!texel_buffer || !generate_image(&context, texel_buffer)) {
+				return false;
+			}
+			for (uint32_t j = 0; j < image_count; ++j) {
+				if (!generate_image(&context, texel_buffer)) {
+					return false;
+				}
+				total_ms += context.dispatch_ms;
+			}
+		}
+		free(texel_buffer);
+		destroy_render_context(&context);
+
+		if (!supported) {
+			printf("%3ux%-3u not supported\n", shapes[i][0], shapes[i][1]);
+			continue;
+		}
+		double const mean_ms = total_ms / image_count;
+		printf("%3ux%-3u %8.3f ms dispatch\n", shapes[i][0], shapes[i][1], mean_ms);
+		if (best_shape == UINT32_MAX || mean_ms < best_ms) {
+			best_shape = i;
+			best_ms    = mean_ms;
+		}
+	}
+
+	if (best_shape == UINT32_MAX || !save_workgroup_size(tuning_filename, shapes[best_shape])) {
+		return false;
+	}
+	printf("best workgroup size %ux%u, saved to %s\n", shapes[best_shape][0], shapes[best_shape][1], tuning_filename);
+	return true;
+}
+
+// one image to render, split into tiles and streamed into its file as they complete
+struct render_job {
+	char filename[MAX_JOB_PATH_LENGTH];
+	uint32_t width_px;
+	uint32_t height_px;
+	uint32_t pattern_size;
+	FILE *file;
+	off_t body_offset;
+	uint32_t tile_count_x;
+	uint64_t tile_count;
+	uint64_t tiles_written;
+};
+
+// one tile in flight, rendered and copied into its own readback buffer
+struct tile_slot {
+	struct render_job *job;
+	VkBuffer buffer;
+	struct memory_allocation allocation;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+	bool pending;
+};
+
+bool record_tile(struct render_context const *context, struct tile_slot const *slot) {
+	VkCommandBuffer command_buffer = slot->command_buffer;
+	VkCommandBufferBeginInfo command_buffer_begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS ||
+	    vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+		return false;
+	}
+
+	// every tile reuses the image, the barrier also waits for the previous tile's copy out of it
+	VkImageMemoryBarrier image_memory_barrier = {
+		.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout                   = VK_IMAGE_LAYOUT_GENERAL,
+		.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED,
+		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.subresourceRange.levelCount = 1,
+		.subresourceRange.layerCount = 1,
+		.image                       = context->image,
+	};
+	vkCmdPipelineBarrier(command_buffer,
+	                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+	                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+	                     0,
+	                     0, NULL,
+	                     0, NULL,
+	                     1, &image_memory_barrier);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->compute_pipeline);
+	vkCmdBindDescriptorSets(command_buffer,
+	                        VK_PIPELINE_BIND_POINT_COMPUTE,
+	                        context->pipeline_layout,
+	                        0,
+	                        1,
+	                        &context->descriptor_set,
+	                        0,
+	                        NULL);
+
+	struct tile_push_constants const push_constants = {
+		.offset       = { slot->x, slot->y },
+		.extent       = { slot->width, slot->height },
+		.column_count = (slot->job->width_px + slot->job->pattern_size - 1) / slot->job->pattern_size,
+		.pattern_size = slot->job->pattern_size,
+	};
+	vkCmdPushConstants(command_buffer,
+	                   context->pipeline_layout,
+	                   VK_SHADER_STAGE_COMPUTE_BIT,
+	                   0,
+	                   sizeof(push_constants),
+	                   &push_constants);
+	vkCmdDispatch(command_buffer,
+	              (slot->width + context->workgroup_size[0] - 1) / context->workgroup_size[0],
+	              (slot->height + context->workgroup_size[1] - 1) / context->workgroup_size[1],
+	              1);
+
+	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	vkCmdPipelineBarrier(command_buffer,
+	                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+	                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+	                     0,
+	                     0, NULL,
+	                     0, NULL,
+	                     1, &image_memory_barrier);
+
+	// edge tiles only fill the top left of the image, the copy packs their rows tightly
+	VkBufferImageCopy buffer_image_copy = {
+		.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.imageSubresource.layerCount = 1,
+		.imageExtent.width           = slot->width,
+		.imageExtent.height          = slot->height,
+		.imageExtent.depth           = 1,
+	};
+	vkCmdCopyImageToBuffer(command_buffer,
+	                       context->image,
+	                       VK_IMAGE_LAYOUT_GENERAL,
+	                       slot->buffer,
+	                       1,
+	                       &buffer_image_copy);
+
+	VkBufferMemoryBarrier buffer_memory_barrier = {
+		.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer              = slot->buffer,
+		.offset              = 0,
+		.size                = VK_WHOLE_SIZE,
+	};
+	vkCmdPipelineBarrier(command_buffer,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_HOST_BIT,
+	                     0,
+	                     0, NULL,
+	                     1, &buffer_memory_barrier,
+	                     0, NULL);
+
+	return vkEndCommandBuffer(command_buffer) == VK_SUCCESS;
+}
+
+bool write_tile(struct render_context *context, struct tile_slot const *slot, struct image_writer *writer) {
+	if (!invalidate_memory(&context->arena, &slot->allocation)) {
+		return false;
+	}
+
+	// the tile is converted into a writer buffer, which waits for an earlier tile's write to complete
+	// when none is free
+	uint32_t buffer_index;
+	uint8_t *tile_texels = acquire_writer_buffer(writer, &buffer_index);
+	if (!tile_texels) {
+		return false;
+	}
+	convert_rgba8_image_to_rgb8(&context->convert_kernel,
+	                            slot->allocation.mapped,
+	                            tile_texels,
+	                            slot->width,
+	                            slot->height,
+	                            context->convert_thread_count);
+
+	// each row of the tile lands in its own place in the file, nothing larger than a tile is held.
+	// The write gets its own descriptor so that the job can close the file before the write is done
+	struct render_job *job = slot->job;
+	int const fd = dup(fileno(job->file));
+	if (fd < 0 ||
+	    !queue_buffer_write(writer,
+	                        buffer_index,
+	                        tile_texels,
+	                        fd,
+	                        job->body_offset + ((off_t)slot->y * job->width_px + slot->x) * 3,
+	                        (size_t)slot->width * 3,
+	                        slot->height,
+	                        (off_t)job->width_px * 3)) {
+		return false;
+	}
+
+	// the job's own descriptor is not needed once its last tile is queued
+	if (++job->tiles_written == job->tile_count) {
+		bool const closed = fclose(job->file) == 0;
+		job->file = NULL;
+		return closed;
+	}
+	return true;
+}
+
+bool open_render_job(struct render_job *job) {
+	char header[64];
+	int const header_size = snprintf(header, sizeof(header), "P6 %u %u 255\n", job->width_px, job->height_px);
+
+	// shared memory outputs are sized up front, a reader maps them once the job is reported done
+	if (strncmp(job->filename, SHM_PATH_PREFIX, strlen(SHM_PATH_PREFIX)) == 0) {
+		int const fd = shm_open(job->filename + strlen(SHM_PATH_PREFIX), O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			return false;
+		}
+		off_t const size = header_size + (off_t)job->width_px * job->height_px * 3;
+		if (ftruncate(fd, size) != 0 || !(job->file = fdopen(fd, "wb"))) {
+			close(fd);
+			return false;
+		}
+	} else {
+		job->file = fopen(job->filename, "wb");
+		if (!job->file) {
+			return false;
+		}
+	}
+	fputs(header, job->file);
+	fflush(job->file);
+	job->body_offset   = ftell(job->file);
+	job->tile_count_x  = (job->width_px + TILE_SIZE - 1) / TILE_SIZE;
+	job->tile_count    = (uint64_t)job->tile_count_x * ((job->height_px + TILE_SIZE - 1) / TILE_SIZE);
+	job->tiles_written = 0;
+	return true;
+}
+
+// the readback buffers, command buffers and fences of the tiles in flight, created once and reused
+// by every job. The first slot is the context's own readback buffer, command buffer and fence, which
+// a tile-sized context would otherwise leave unused. Converted tiles are written out by the writer
+// while later tiles render
+struct tile_pool {
+	struct tile_slot slots[MAX_TILE_SLOT_COUNT];
+	uint32_t slot_count;
+	struct image_writer writer;
+};
+
+bool create_tile_pool(struct render_context *context, uint32_t slot_count, struct tile_pool *pool) {
+	VkDevice device = context->device;
+	if (slot_count == 0 || slot_count > MAX_TILE_SLOT_COUNT) {
+		fprintf(stderr, "between 1 and %u command buffers can be in flight\n", MAX_TILE_SLOT_COUNT);
+		return false;
+	}
+
+	// tiles are copied into the context's readback buffer only when it is a mapped rgba buffer of
+	// exactly one tile
+	if (context->width_px != TILE_SIZE ||
+	    context->height_px != TILE_SIZE ||
+	    context->rgb_buffer_output ||
+	    context->host_memory_imported ||
+	    context->memory_exported) {
+		fputs("tiles need a context with a mapped rgba readback buffer of one tile\n", stderr);
+		return false;
+	}
+
+	struct tile_slot *slots = pool->slots;
+	pool->slot_count = slot_count;
+	slots[0] = (struct tile_slot){
+		.buffer         = context->image_buffer,
+		.allocation     = context->image_buffer_allocation,
+		.command_buffer = context->command_buffer,
+		.fence          = context->fence,
+	};
+	for (uint32_t i = 1; i < slot_count; ++i) {
+		struct tile_slot *slot = &slots[i];
+		*slot = (struct tile_slot){0};
+
+		VkBufferCreateInfo buffer_create_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size  = TILE_SIZE * TILE_SIZE * 4,
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		};
+		if (vkCreateBuffer(device, &buffer_create_info, NULL, &slot->buffer) != VK_SUCCESS ||
+		    !bind_buffer_memory(&context->arena, slot->buffer, MEMORY_USAGE_READBACK, &slot->allocation)) {
+			return false;
+		}
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+			.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool        = context->command_pool,
+			.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		if (vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &slot->command_buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkFenceCreateInfo fence_create_info = {
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		};
+		if (vkCreateFence(device, &fence_create_info, NULL, &slot->fence) != VK_SUCCESS) {
+			return false;
+		}
+	}
+	return create_image_writer(&pool->writer, WRITER_BUFFER_COUNT, TILE_SIZE * TILE_SIZE * 3, TILE_SIZE, false);
+}
+
+void destroy_tile_pool(struct render_context *context, struct tile_pool *pool) {
+	destroy_image_writer(&pool->writer);
+	// the first slot belongs to the context
+	for (uint32_t i = 1; i < pool->slot_count; ++i) {
+		vkDestroyFence(context->device, pool->slots[i].fence, NULL);
+		vkFreeCommandBuffers(context->device, context->command_pool, 1, &pool->slots[i].command_buffer);
+		vkDestroyBuffer(context->device, pool->slots[i].buffer, NULL);
+	}
+}
+
+bool render_jobs(struct render_context *context,
+                 struct tile_pool *pool,
+                 struct render_job *jobs,
+                 uint32_t job_count) {
+	VkDevice device = context->device;
+	struct tile_slot *slots = pool->slots;
+	uint32_t const slot_count = pool->slot_count;
+
+	// the tiles of all jobs form one sequence, tile i goes to slot i % slot_count and is converted and
+	// queued for writing when the slot comes round again, so the gpu renders the first tiles of the
+	// next job while the last tiles of this one are written, the extra iterations at the end drain
+	// the slots
+	uint32_t job_index = 0;
+	uint64_t tile_index = 0;
+	for (uint64_t i = 0;; ++i) {
+		struct tile_slot *slot = &slots[i % slot_count];
+		if (slot->pending) {
+			if (vkWaitForFences(device, 1, &slot->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+				return false;
+			}
+			vkResetFences(device, 1, &slot->fence);
+			if (!write_tile(context, slot, &pool->writer)) {
+				fprintf(stderr, "failed to write %s\n", slot->job->filename);
+				return false;
+			}
+			slot->pending = false;
+		}
+
+		if (job_index == job_count) {
+			bool drained = true;
+			for (uint32_t j = 0; j < slot_count; ++j) {
+				drained = drained && !slots[j].pending;
+			}
+			if (drained) {
+				break;
+			}
+			continue;
+		}
+
+		struct render_job *job = &jobs[job_index];
+		if (tile_index == 0 && !open_render_job(job)) {
+			fprintf(stderr, "failed to open %s\n", job->filename);
+			return false;
+		}
+
+		slot->job    = job;
+		slot->x      = (tile_index % job->tile_count_x) * TILE_SIZE;
+		slot->y      = (tile_index / job->tile_count_x) * TILE_SIZE;
+		slot->width  = job->width_px - slot->x < TILE_SIZE ? job->width_px - slot->x : TILE_SIZE;
+		slot->height = job->height_px - slot->y < TILE_SIZE ? job->height_px - slot->y : TILE_SIZE;
+		if (!record_tile(context, slot)) {
+			return false;
+		}
+
+		VkSubmitInfo submit_info = {
+			.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers    = &slot->command_buffer,
+		};
+		if (vkQueueSubmit(context->compute_queue, 1, &submit_info, slot->fence) != VK_SUCCESS) {
+			return false;
+		}
+		slot->pending = true;
+
+		if (++tile_index == job->tile_count) {
+			job_index += 1;
+			tile_index = 0;
+		}
+	}
+
+	// the jobs are complete once the writes of their last tiles are
+	return finish_image_writes(&pool->writer);
+}
+
+bool render_tiled_image(char const *filename, uint32_t width_px, uint32_t height_px) {
+	if (width_px == 0 || height_px == 0 || strlen(filename) >= MAX_JOB_PATH_LENGTH) {
+		return false;
+	}
+
+	struct render_options const options = {0};
+	struct render_context context;
+	if (!create_render_context(&context, TILE_SIZE, TILE_SIZE, &options)) {
+		return false;
+	}
+
+	struct render_job job = {
+		.width_px     = width_px,
+		.height_px    = height_px,
+		.pattern_size = PATTERN_TILE_SIZE,
+	};
+	strcpy(job.filename, filename);
+
+	struct tile_pool pool;
+	double const start_ms = get_time_ms();
+	if (!create_tile_pool(&context, TILE_SLOT_COUNT, &pool) || !render_jobs(&context, &pool, &job, 1)) {
+		return false;
+	}
+	double const total_ms = get_time_ms() - start_ms;
+	destroy_tile_pool(&context, &pool);
+	destroy_render_context(&context);
+
+	printf("tiled: %ux%u as %llu tiles of %ux%u in %.3f ms, %.1f MiB of tile buffers\n",
+	       width_px,
+	       height_px,
+	       (unsigned long long)job.tile_count,
+	       TILE_SIZE,
+	       TILE_SIZE,
+	       total_ms,
+	       (TILE_SIZE * TILE_SIZE * (4.0 * TILE_SLOT_COUNT + 3.0 * WRITER_BUFFER_COUNT)) / (1024.0 * 1024.0));
+	return true;
+}
+
+struct render_job *load_job_manifest(char const *filename, uint32_t *job_count) {
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		return NULL;
+	}
+
+	// one job per line as "output.ppm width height [pattern size]", blank lines and lines starting
+	// with # are skipped
+	struct render_job *jobs = NULL;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+	char line[MAX_JOB_PATH_LENGTH + 64];
+	for (uint32_t line_number = 1; fgets(line, sizeof(line), file); ++line_number) {
+		char path[MAX_JOB_PATH_LENGTH];
+		struct render_job job = { .pattern_size = PATTERN_TILE_SIZE };
+		int const field_count =
+			sscanf(line, "%255s %u %u %u", path, &job.width_px, &job.height_px, &job.pattern_size);
+		if (field_count <= 0 || path[0] == '#') {
+			continue;
+		}
+		if (field_count < 3 || job.width_px == 0 || job.height_px == 0 || job.pattern_size < 2) {
+			fprintf(stderr, "%s:%u: expected output path, width, height and optional pattern size\n",
+			        filename, line_number);
+			free(jobs);
+			fclose(file);
+			return NULL;
+		}
+		strcpy(job.filename, path);
+
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 16;
+			struct render_job *grown = realloc(jobs, capacity * sizeof(struct render_job));
+			if (!grown) {
+				free(jobs);
+				fclose(file);
+				return NULL;
+			}
+			jobs = grown;
+		}
+		jobs[count++] = job;
+	}
+	fclose(file);
+
+	*job_count = count;
+	return jobs;
+}
+
+bool run_batch(char const *manifest_filename, uint32_t slot_count) {
+	uint32_t job_count = 0;
+	struct render_job *jobs = load_job_manifest(manifest_filename, &job_count);
+	if (!jobs || job_count == 0) {
+		free(jobs);
+		return false;
+	}
+
+	// one instance, device and pipeline serve every job in the manifest
+	double start_ms = get_time_ms();
+	struct render_options const options = {0};
+	struct render_context context;
+	struct tile_pool pool;
+	if (!create_render_context(&context, TILE_SIZE, TILE_SIZE, &options) ||
+	    !create_tile_pool(&context, slot_count, &pool)) {
+		return false;
+	}
+	double const setup_ms = get_time_ms() - start_ms;
+
+	start_ms = get_time_ms();
+	if (!render_jobs(&context, &pool, jobs, job_count)) {
+		return false;
+	}
+	double const total_ms = get_time_ms() - start_ms;
+
+	uint64_t texel_count = 0;
+	for (uint32_t i = 0; i < job_count; ++i) {
+		texel_count += (uint64_t)jobs[i].width_px * jobs[i].height_px;
+	}
+	destroy_tile_pool(&context, &pool);
+	destroy_render_context(&context);
+	free(jobs);
+
+	printf("batch: %u jobs, %.1f Mtexels with %u in flight, setup %.3f ms, render %.3f ms, %.3f ms per job\n",
+	       job_count,
+	       texel_count / 1000000.0,
+	       slot_count,
+	       setup_ms,
+	       total_ms,
+	       total_ms / job_count);
+	return true;
+}
+
+bool parse_render_request(char const *line, struct render_job *job, char *error, size_t error_size) {
+	// "compute width height pattern_size output", the output a file path or shm:/name
+	char example[32];
+	char path[MAX_JOB_PATH_LENGTH];
+	*job = (struct render_job){0};
+	if (sscanf(line, "%31s %u %u %u %255s", example, &job->width_px, &job->height_px, &job->pattern_size, path) != 5) {
+		snprintf(error, error_size, "expected example, width, height, pattern size and output");
+		return false;
+	}
+	if (strcmp(example, "compute") != 0) {
+		snprintf(error, error_size, "unsupported example %s, only compute is served", example);
+		return false;
+	}
+	if (job->width_px == 0 || job->height_px == 0 || job->pattern_size < 2) {
+		snprintf(error, error_size, "bad size %ux%u or pattern size %u", job->width_px, job->height_px, job->pattern_size);
+		return false;
+	}
+	strcpy(job->filename, path);
+	return true;
+}
+
+// takes ownership of fd, which is closed on return whether or not the connection could be served
+bool serve_connection(struct render_context *context, struct tile_pool *pool, int fd, bool *quit) {
+	// reads and writes that stall past the timeout fail, which ends the connection
+	struct timeval const idle_timeout = { .tv_sec = SERVICE_IDLE_TIMEOUT_S };
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle_timeout, sizeof(idle_timeout)) != 0 ||
+	    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &idle_timeout, sizeof(idle_timeout)) != 0) {
+		close(fd);
+		return false;
+	}
+	FILE *requests = fdopen(fd, "r");
+	if (!requests) {
+		close(fd);
+		return false;
+	}
+	int const reply_fd = dup(fd);
+	FILE *replies = reply_fd >= 0 ? fdopen(reply_fd, "w") : NULL;
+	if (!replies) {
+		if (reply_fd >= 0) {
+			close(reply_fd);
+		}
+		fclose(requests);
+		return false;
+	}
+
+	// requests are handled in the order they arrive, each answered with "ok latency_ms" or
+	// "error message" once its output is complete
+	char line[MAX_SERVICE_LINE_LENGTH];
+	while (!*quit && fgets(line, sizeof(line), requests)) {
+		double const start_ms = get_time_ms();
+		if (strncmp(line, "quit", 4) == 0) {
+			*quit = true;
+			fputs("ok 0\n", replies);
+		} else {
+			struct render_job job;
+			char error[MAX_SERVICE_LINE_LENGTH];
+			if (!parse_render_request(line, &job, error, sizeof(error))) {
+				fprintf(replies, "error %s\n", error);
+			} else if (!render_jobs(context, pool, &job, 1)) {
+				// a failed job may leave slots with work in flight and tiles being written, the pool
+				// is only safe to reuse once the device is idle and the writes are done
+				vkDeviceWaitIdle(context->device);
+				finish_image_writes(&pool->writer);
+				for (uint32_t i = 0; i < pool->slot_count; ++i) {
+					pool->slots[i].pending = false;
+					vkResetFences(context->device, 1, &pool->slots[i].fence);
+				}
+				if (job.file) {
+					fclose(job.file);
+				}
+				fprintf(replies, "error failed to render %s\n", job.filename);
+			} else {
+				fprintf(replies, "ok %.3f\n", get_time_ms() - start_ms);
+			}
+		}
+		if (fflush(replies) != 0) {
+			break;
+		}
+	}
+
+	fclose(replies);
+	fclose(requests);
+	return true;
+}
+
+bool run_render_service(char const *socket_path, uint32_t slot_count) {
+	// the instance, device, pipeline and tile buffers are created once and kept warm for every request
+	struct render_options const options = {0};
+	struct render_context context;
+	struct tile_pool pool;
+	if (!create_render_context(&context, TILE_SIZE, TILE_SIZE, &options) ||
+	    !create_tile_pool(&context, slot_count, &pool)) {
+		return false;
+	}
+
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		return false;
+	}
+	strcpy(address.sun_path, socket_path);
+	unlink(socket_path);
+
+	int const listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0 ||
+	    bind(listen_fd, (struct sockaddr const *)&address, sizeof(address)) != 0 ||
+	    listen(listen_fd, 16) != 0) {
+		return false;
+	}
+
+	// a client that goes away mid reply must not take the service down with it
+	signal(SIGPIPE, SIG_IGN);
+	printf("serving on %s\n", socket_path);
+	fflush(stdout);
+
+	bool quit = false;
+	bool accept_failed = false;
+	while (!quit) {
+		int const fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			// an interrupted call or a client that gave up is retried at once, running out of
+			// descriptors or memory backs off until connections close, anything else is fatal
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+				struct timespec const delay = { .tv_nsec = 100000000 };
+				nanosleep(&delay, NULL);
+				continue;
+			}
+			perror("accept");
+			accept_failed = true;
+			break;
+		}
+		if (!serve_connection(&context, &pool, fd, &quit)) {
+			fputs("failed to serve a connection\n", stderr);
+		}
+	}
+
+	close(listen_fd);
+	unlink(socket_path);
+	destroy_tile_pool(&context, &pool);
+	destroy_render_context(&context);
+	return !accept_failed;
+}
+
+int compare_doubles(void const *a, void const *b) {
+	double const x = *(double const *)a;
+	double const y = *(double const *)b;
+	return (x > y) - (x < y);
+}
+
+bool run_render_client(char const *socket_path,
+                       uint32_t request_count,
+                       uint32_t width_px,
+                       uint32_t height_px,
+                       char const *output) {
+	if (request_count == 0 || request_count > MAX_CLIENT_REQUESTS) {
+		return false;
+	}
+
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		return false;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr const *)&address, sizeof(address)) != 0) {
+		fprintf(stderr, "cannot connect to %s\n", socket_path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	FILE *replies = fdopen(fd, "r");
+	int const request_fd = replies ? dup(fd) : -1;
+	FILE *requests = request_fd >= 0 ? fdopen(request_fd, "w") : NULL;
+	if (!requests) {
+		if (request_fd >= 0) {
+			close(request_fd);
+		}
+		if (replies) {
+			fclose(replies);
+		} else {
+			close(fd);
+		}
+		return false;
+	}
+
+	// one request at a time, so each latency is a full round trip with nothing queued ahead of it
+	double *latencies_ms = malloc(request_count * sizeof(double));
+	if (!latencies_ms) {
+		return false;
+	}
+	double service_ms = 0.0;
+	double const start_ms = get_time_ms();
+	for (uint32_t i = 0; i < request_count; ++i) {
+		double const request_start_ms = get_time_ms();
+		fprintf(requests, "compute %u %u %u %s\n", width_px, height_px, PATTERN_TILE_SIZE, output);
+		fflush(requests);
+
+		char reply[MAX_SERVICE_LINE_LENGTH] = "no reply\n";
+		double reply_ms = 0.0;
+		if (!fgets(reply, sizeof(reply), replies) || sscanf(reply, "ok %lf", &reply_ms) != 1) {
+			fprintf(stderr, "request %u failed: %s", i, reply);
+			return false;
+		}
+		latencies_ms[i] = get_time_ms() - request_start_ms;
+		service_ms += reply_ms;
+	}
+	double const total_ms = get_time_ms() - start_ms;
+
+	fclose(requests);
+	fclose(replies);
+
+	qsort(latencies_ms, request_count, sizeof(double), compare_doubles);
+	printf("%u requests of %ux%u in %.3f ms, %.1f requests per second\n",
+	       request_count,
+	       width_px,
+	       height_px,
+	       total_ms,
+	       request_count * 1000.0 / total_ms);
+	printf("latency p50 %.3f ms, p99 %.3f ms, max %.3f ms, mean service time %.3f ms\n",
+	       latencies_ms[request_count / 2],
+	       latencies_ms[(uint32_t)(request_count * 0.99)],
+	       latencies_ms[request_count - 1],
+	       service_ms / request_count);
+	free(latencies_ms);
+	return true;
+}
+
+// sent with the memory and semaphore fds to the process that imports them
+struct export_message {
+	uint8_t device_uuid[VK_UUID_SIZE];
+	uint8_t driver_uuid[VK_UUID_SIZE];
+	uint64_t allocation_size;
+	uint32_t memory_type_index;
+	uint32_t dedicated; // the memory belongs to one buffer, created with the size and usage below
+	uint64_t buffer_size;
+	uint32_t buffer_usage;
+	uint32_t width_px;
+	uint32_t height_px;
+	uint64_t timeline_value; // the memory holds the rgba8 image once the semaphore reaches this
+};
+
+bool send_export_message(int socket_fd, struct export_message const *message, int const fds[2]) {
+	struct iovec iov = {
+		.iov_base = (void *)message,
+		.iov_len  = sizeof(*message),
+	};
+	union {
+		char buffer[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control = {0};
+	struct msghdr msg = {
+		.msg_iov        = &iov,
+		.msg_iovlen     = 1,
+		.msg_control    = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type  = SCM_RIGHTS;
+	cmsg->cmsg_len   = CMSG_LEN(2 * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, 2 * sizeof(int));
+	return sendmsg(socket_fd, &msg, 0) == sizeof(*message);
+}
+
+bool receive_export_message(int socket_fd, struct export_message *message, int fds[2]) {
+	struct iovec iov = {
+		.iov_base = message,
+		.iov_len  = sizeof(*message),
+	};
+	union {
+		char buffer[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg = {
+		.msg_iov        = &iov,
+		.msg_iovlen     = 1,
+		.msg_control    = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
 	};
+	if (recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(*message)) {
+		return false;
+	}
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+		return false;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+	return true;
+}
 
-	VkDescriptorSetLayout descriptor_set_layout;
-	if (vkCreateDescriptorSetLayout(device,
-	                                &descriptor_set_layout_create_info,
-	                                NULL, &descriptor_set_layout) != VK_SUCCESS) {
+bool run_fd_export(char const *socket_path) {
+	struct render_options const options = { .export_fd = true };
+	struct render_context context;
+	if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, &options)) {
 		return false;
 	}
+	VkDevice device = context.device;
 
-	// create pipeline layout
-	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
-		.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.setLayoutCount = 1,
-		.pSetLayouts    = &descriptor_set_layout,
-	};
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		return false;
+	}
+	strcpy(address.sun_path, socket_path);
+	unlink(socket_path);
+	int const listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0 ||
+	    bind(listen_fd, (struct sockaddr const *)&address, sizeof(address)) != 0 ||
+	    listen(listen_fd, 1) != 0) {
+		return false;
+	}
+	printf("waiting for an importer on %s\n", socket_path);
+	fflush(stdout);
+	int const socket_fd = accept(listen_fd, NULL, NULL);
+	close(listen_fd);
+	unlink(socket_path);
+	if (socket_fd < 0) {
+		return false;
+	}
 
-	VkPipelineLayout pipeline_layout;
-	if (vkCreatePipelineLayout(device, &pipeline_layout_create_info, NULL, &pipeline_layout) != VK_SUCCESS) {
+	// every export hands out new fds, the importer owns them once they are sent
+	VkMemoryGetFdInfoKHR memory_get_fd_info = {
+		.sType      = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+		.memory     = context.exported_image_buffer.memory,
+		.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+	};
+	VkSemaphoreGetFdInfoKHR semaphore_get_fd_info = {
+		.sType      = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+		.semaphore  = context.timeline_semaphore,
+		.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+	};
+	int fds[2];
+	if (ext.vkGetMemoryFdKHR(device, &memory_get_fd_info, &fds[0]) != VK_SUCCESS ||
+	    ext.vkGetSemaphoreFdKHR(device, &semaphore_get_fd_info, &fds[1]) != VK_SUCCESS) {
 		return false;
 	}
 
-	// create shader module
-	VkShaderModule comp_shader_module;
-	create_shader_module(device, "comp.spv", &comp_shader_module);
+	// submit the render signalling the timeline and hand it over straight away, the importer waits
+	// on the semaphore rather than on this process
+	context.timeline_value += 1;
+	VkTimelineSemaphoreSubmitInfo timeline_semaphore_submit_info = {
+		.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues    = &context.timeline_value,
+	};
+	VkSubmitInfo submit_info = {
+		.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext                = &timeline_semaphore_submit_info,
+		.commandBufferCount   = 1,
+		.pCommandBuffers      = &context.command_buffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores    = &context.timeline_semaphore,
+	};
+	if (vkQueueSubmit(context.compute_queue, 1, &submit_info, context.fence) != VK_SUCCESS) {
+		return false;
+	}
 
-	// create compute pipeline
-	VkComputePipelineCreateInfo compute_pipeline_create_info = {
-		.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-		.layout       = pipeline_layout,
-		.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT,
-		.stage.module = comp_shader_module,
-		.stage.pName  = "main",
+	struct export_message message = {
+		.allocation_size   = context.exported_image_buffer.allocation_size,
+		.memory_type_index = context.exported_image_buffer.memory_type_index,
+		.dedicated         = context.exported_image_buffer.dedicated,
+		.buffer_size       = context.exported_image_buffer.size,
+		.buffer_usage      = context.exported_image_buffer.usage,
+		.width_px          = context.width_px,
+		.height_px         = context.height_px,
+		.timeline_value    = context.timeline_value,
 	};
+	memcpy(message.device_uuid, context.device_uuid, VK_UUID_SIZE);
+	memcpy(message.driver_uuid, context.driver_uuid, VK_UUID_SIZE);
+	bool const sent = send_export_message(socket_fd, &message, fds);
+	close(fds[0]);
+	close(fds[1]);
+	if (!sent) {
+		return false;
+	}
 
-	VkPipeline compute_pipeline;
-	if (vkCreateComputePipelines(device,
-	                             VK_NULL_HANDLE,
-	                             1,
-	                             &compute_pipeline_create_info,
-	                             NULL,
-	                             &compute_pipeline) != VK_SUCCESS) {
+	// the memory must outlive the importer's use of it, so wait for its verdict before tearing down
+	char reply[64] = "";
+	ssize_t const reply_size = read(socket_fd, reply, sizeof(reply) - 1);
+	close(socket_fd);
+	vkWaitForFences(device, 1, &context.fence, VK_TRUE, UINT64_MAX);
+	destroy_render_context(&context);
+
+	printf("importer replied: %s\n", reply_size > 0 ? reply : "nothing");
+	return strncmp(reply, "ok", 2) == 0;
+}
+
+uint32_t count_pattern_mismatches(uint8_t const *texels, uint32_t width_px, uint32_t height_px) {
+	// the texels comp.glsl writes for a whole image with the default pattern, give or take rounding
+	uint32_t const column_count = (width_px + PATTERN_TILE_SIZE - 1) / PATTERN_TILE_SIZE;
+	uint32_t mismatches = 0;
+	for (uint32_t y = 0; y < height_px; ++y) {
+		for (uint32_t x = 0; x < width_px; ++x) {
+			float const expected[4] = {
+				(float)(x % PATTERN_TILE_SIZE) / (PATTERN_TILE_SIZE + 1),
+				(float)(y % PATTERN_TILE_SIZE) / (PATTERN_TILE_SIZE + 1),
+				(float)(x / PATTERN_TILE_SIZE) / ((column_count > 2 ? column_count : 2) - 1),
+				1.0f,
+			};
+			uint8_t const *texel = &texels[((size_t)y * width_px + x) * 4];
+			for (uint32_t c = 0; c < 4; ++c) {
+				int const difference = texel[c] - (int)(expected[c] * 255.0f + 0.5f);
+				if (difference < -1 || difference > 1) {
+					mismatches += 1;
+					break;
+				}
+			}
+		}
+	}
+	return mismatches;
+}
+
+// the importer only maps memory and waits on a semaphore, so instead of a render context it gets a
+// device on the exporter's gpu with just the extensions for importing both fds
+bool create_import_device(struct export_message const *message, VkInstance *instance_out, VkDevice *device_out) {
+	VkApplicationInfo app_info = {
+		.sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+		.pApplicationName   = "Offscreen Compute Shader Example",
+		.applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+		.pEngineName        = "No Engine",
+		.engineVersion      = VK_MAKE_VERSION(1, 0, 0),
+		.apiVersion         = VK_API_VERSION_1_1,
+	};
+	VkInstanceCreateInfo instance_create_info = {
+		.sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pApplicationInfo = &app_info,
+	};
+	VkInstance instance;
+	if (vkCreateInstance(&instance_create_info, NULL, &instance) != VK_SUCCESS) {
 		return false;
 	}
+	*instance_out = instance;
 
-	// free shader module
-	vkDestroyShaderModule(device, comp_shader_module, NULL);
+	// opaque fds only import into the same device and driver
+	uint32_t physical_device_count = 0;
+	vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL);
+	VkPhysicalDevice physical_devices[physical_device_count + 1];
+	vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices);
+	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+	for (uint32_t i = 0; i < physical_device_count && physical_device == VK_NULL_HANDLE; ++i) {
+		VkPhysicalDeviceIDProperties id_properties = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+		};
+		VkPhysicalDeviceProperties2 physical_device_properties2 = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &id_properties,
+		};
+		vkGetPhysicalDeviceProperties2(physical_devices[i], &physical_device_properties2);
+		if (memcmp(message->device_uuid, id_properties.deviceUUID, VK_UUID_SIZE) == 0 &&
+		    memcmp(message->driver_uuid, id_properties.driverUUID, VK_UUID_SIZE) == 0) {
+			physical_device = physical_devices[i];
+		}
+	}
+	if (physical_device == VK_NULL_HANDLE) {
+		fputs("the exporter runs on a different device or driver\n", stderr);
+		return false;
+	}
 
-	// create descriptor pool
-	VkDescriptorPoolSize descriptor_pool_size = {
-		.type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-		.descriptorCount = 1,
+	char const *device_extensions[] = {
+		VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+		VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME,
+		VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
 	};
+	for (uint32_t i = 0; i < sizeof(device_extensions) / sizeof(device_extensions[0]); ++i) {
+		if (!device_supports_extension(physical_device, device_extensions[i])) {
+			fprintf(stderr, "%s is not supported\n", device_extensions[i]);
+			return false;
+		}
+	}
+	if (!timeline_semaphore_fd_supported(physical_device, VK_EXTERNAL_SEMAPHORE_FEATURE_IMPORTABLE_BIT)) {
+		fputs("timeline semaphores cannot be imported from opaque fds\n", stderr);
+		return false;
+	}
 
-	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
-		.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.flags         = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-		.poolSizeCount = 1,
-		.pPoolSizes    = &descriptor_pool_size,
-		.maxSets       = 1,
+	// a device needs at least one queue, nothing is ever submitted to it
+	float const queue_priority = 1.0f;
+	VkDeviceQueueCreateInfo device_queue_create_info = {
+		.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+		.queueFamilyIndex = 0,
+		.queueCount       = 1,
+		.pQueuePriorities = &queue_priority,
+	};
+	VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features = {
+		.sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+		.timelineSemaphore = VK_TRUE,
+	};
+	VkDeviceCreateInfo device_create_info = {
+		.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+		.pNext                   = &timeline_semaphore_features,
+		.queueCreateInfoCount    = 1,
+		.pQueueCreateInfos       = &device_queue_create_info,
+		.enabledExtensionCount   = sizeof(device_extensions) / sizeof(device_extensions[0]),
+		.ppEnabledExtensionNames = device_extensions,
 	};
+	if (vkCreateDevice(physical_device, &device_create_info, NULL, device_out) != VK_SUCCESS) {
+		return false;
+	}
 
-	VkDescriptorPool descriptor_pool;
-	if (vkCreateDescriptorPool(device, &descriptor_pool_create_info, NULL, &descriptor_pool) != VK_SUCCESS) {
+	LOAD_EXTENSION_FUNC(vkImportSemaphoreFdKHR);
+	LOAD_EXTENSION_FUNC(vkWaitSemaphoresKHR);
+	return true;
+}
+
+bool run_fd_import(char const *socket_path) {
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
 		return false;
 	}
+	strcpy(address.sun_path, socket_path);
 
-	// allocate descriptor set
-	VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
-		.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.descriptorPool     = descriptor_pool,
-		.descriptorSetCount = 1,
-		.pSetLayouts        = &descriptor_set_layout,
-	};
+	// the exporter may still be starting up
+	int socket_fd = -1;
+	for (uint32_t attempt = 0; attempt < 500 && socket_fd < 0; ++attempt) {
+		socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (socket_fd >= 0 && connect(socket_fd, (struct sockaddr const *)&address, sizeof(address)) != 0) {
+			close(socket_fd);
+			socket_fd = -1;
+			struct timespec const delay = { .tv_nsec = 10000000 };
+			nanosleep(&delay, NULL);
+		}
+	}
+	if (socket_fd < 0) {
+		fprintf(stderr, "cannot connect to %s\n", socket_path);
+		return false;
+	}
 
-	VkDescriptorSet descriptor_set;
-	if (vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &descriptor_set) != VK_SUCCESS) {
+	struct export_message message;
+	int fds[2];
+	if (!receive_export_message(socket_fd, &message, fds)) {
 		return false;
 	}
 
-	// update descriptor set
-	VkDescriptorImageInfo descriptor_image_info = {
-		.imageView   = image_view,
-		.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
-	};
+	VkInstance instance = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	if (!create_import_device(&message, &instance, &device)) {
+		close(fds[0]);
+		close(fds[1]);
+		if (device != VK_NULL_HANDLE) {
+			vkDestroyDevice(device, NULL);
+		}
+		if (instance != VK_NULL_HANDLE) {
+			vkDestroyInstance(instance, NULL);
+		}
+		return false;
+	}
 
-	VkWriteDescriptorSet write_descriptor_set = {
-		.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.dstSet          = descriptor_set,
-		.dstBinding      = 0,
-		.descriptorCount = 1,
-		.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-		.pImageInfo      = &descriptor_image_info,
-	};
+	// dedicated memory can only be imported for a buffer created exactly like the exporter's
+	VkBuffer buffer = VK_NULL_HANDLE;
+	if (message.dedicated) {
+		VkExternalMemoryBufferCreateInfo external_memory_buffer_create_info = {
+			.sType       = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+			.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+		};
+		VkBufferCreateInfo buffer_create_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = &external_memory_buffer_create_info,
+			.size  = message.buffer_size,
+			.usage = message.buffer_usage,
+		};
+		if (vkCreateBuffer(device, &buffer_create_info, NULL, &buffer) != VK_SUCCESS) {
+			return false;
+		}
+	}
 
-	vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, NULL);
+	// on success vulkan owns the fds
+	VkMemoryDedicatedAllocateInfo memory_dedicated_allocate_info = {
+		.sType  = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+		.buffer = buffer,
+	};
+	VkImportMemoryFdInfoKHR import_memory_fd_info = {
+		.sType      = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+		.pNext      = message.dedicated ? &memory_dedicated_allocate_info : NULL,
+		.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+		.fd         = fds[0],
+	};
+	VkMemoryAllocateInfo memory_allocate_info = {
+		.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext           = &import_memory_fd_info,
+		.allocationSize  = message.allocation_size,
+		.memoryTypeIndex = message.memory_type_index,
+	};
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &memory_allocate_info, NULL, &memory) != VK_SUCCESS ||
+	    (buffer != VK_NULL_HANDLE && vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS)) {
+		fputs("failed to import the memory fd\n", stderr);
+		return false;
+	}
 
-	// record command buffer
-	VkCommandBufferBeginInfo command_buffer_begin_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	VkSemaphoreTypeCreateInfo semaphore_type_create_info = {
+		.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
 	};
-	if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+	VkSemaphoreCreateInfo semaphore_create_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &semaphore_type_create_info,
+	};
+	VkSemaphore semaphore;
+	if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &semaphore) != VK_SUCCESS) {
+		return false;
+	}
+	VkImportSemaphoreFdInfoKHR import_semaphore_fd_info = {
+		.sType      = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+		.semaphore  = semaphore,
+		.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+		.fd         = fds[1],
+	};
+	if (ext.vkImportSemaphoreFdKHR(device, &import_semaphore_fd_info) != VK_SUCCESS) {
+		fputs("failed to import the semaphore fd\n", stderr);
 		return false;
 	}
 
-	VkImageMemoryBarrier image_memory_barrier = {
-		.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED,
-		.newLayout                   = VK_IMAGE_LAYOUT_GENERAL,
-		.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED,
-		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-		.subresourceRange.levelCount = 1,
-		.subresourceRange.layerCount = 1,
-		.image                       = image,
+	// wait for the exporter's gpu work, then read its pixels in place
+	double const start_ms = get_time_ms();
+	VkSemaphoreWaitInfo semaphore_wait_info = {
+		.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores    = &semaphore,
+		.pValues        = &message.timeline_value,
 	};
+	void *mapped;
+	if (ext.vkWaitSemaphoresKHR(device, &semaphore_wait_info, 5000000000ull) != VK_SUCCESS ||
+	    vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+		return false;
+	}
+	double const wait_ms = get_time_ms() - start_ms;
+	uint32_t const mismatches = count_pattern_mismatches(mapped, message.width_px, message.height_px);
 
-	vkCmdPipelineBarrier(
-		command_buffer,
-		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-		0,
-		0,
-		NULL,
-		0,
-		NULL,
-		1,
-		&image_memory_barrier
-	);
+	char reply[64];
+	int const reply_size = snprintf(reply, sizeof(reply), "%s %u mismatches", mismatches == 0 ? "ok" : "bad", mismatches);
+	bool const replied = write(socket_fd, reply, reply_size) == reply_size;
+	close(socket_fd);
 
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline);
+	vkUnmapMemory(device, memory);
+	vkDestroyBuffer(device, buffer, NULL);
+	vkFreeMemory(device, memory, NULL);
+	vkDestroySemaphore(device, semaphore, NULL);
+	vkDestroyDevice(device, NULL);
+	vkDestroyInstance(instance, NULL);
 
-	vkCmdBindDescriptorSets(
-		command_buffer,
-		VK_PIPELINE_BIND_POINT_COMPUTE,
-		pipeline_layout,
-		0,
-		1,
-		&descriptor_set,
-		0,
-		NULL
-	);
+	printf("imported %ux%u image after waiting %.3f ms, %u of %u texels mismatched\n",
+	       message.width_px,
+	       message.height_px,
+	       wait_ms,
+	       mismatches,
+	       message.width_px * message.height_px);
+	return replied && mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+	// leading --import-host-memory and --rgb-buffer apply to the render and to --bench, a leading
+	// --mmap-output has the render convert straight into the mapped output file
+	struct render_options options = {0};
+	bool mmap_output = false;
+	while (argc > 1) {
+		if (strcmp(argv[1], "--import-host-memory") == 0) {
+			options.import_host_memory = true;
+		} else if (strcmp(argv[1], "--rgb-buffer") == 0) {
+			options.rgb_buffer_output = true;
+		} else if (strcmp(argv[1], "--mmap-output") == 0) {
+			mmap_output = true;
+		} else {
+			break;
+		}
+		argc -= 1;
+		argv += 1;
+	}
 
-	vkCmdDispatch(command_buffer, width_px / 32, height_px / 32, 1);
+	if (argc == 3 && strcmp(argv[1], "--export-fd") == 0) {
+		if (!run_fd_export(argv[2])) {
+			fputs("fd export failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	if (argc == 3 && strcmp(argv[1], "--import-fd") == 0) {
+		if (!run_fd_import(argv[2])) {
+			fputs("fd import failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	vkCmdPipelineBarrier(
-		command_buffer,
-		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-		0,
-		0,
-		NULL,
-		0,
-		NULL,
-		1,
-		&image_memory_barrier
-	);
+	if (argc == 3 && strcmp(argv[1], "--serve") == 0) {
+		if (!run_render_service(argv[2], TILE_SLOT_COUNT)) {
+			fputs("render service failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	VkBufferImageCopy buffer_image_copy = {
-		.bufferOffset                    = 0,
-		.bufferRowLength                 = 0,
-		.bufferImageHeight               = 0,
-		.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-		.imageSubresource.mipLevel       = 0,
-		.imageSubresource.baseArrayLayer = 0,
-		.imageSubresource.layerCount     = 1,
-		.imageOffset.x                   = 0,
-		.imageOffset.y                   = 0,
-		.imageOffset.z                   = 0,
-		.imageExtent.width               = width_px,
-		.imageExtent.height              = height_px,
-		.imageExtent.depth               = 1,
-	};
+	if ((argc == 6 || argc == 7) && strcmp(argv[1], "--client") == 0) {
+		char const *output = argc == 7 ? argv[6] : SHM_PATH_PREFIX "/vulkan-examples-client";
+		if (!run_render_client(argv[2],
+		                       strtoul(argv[3], NULL, 10),
+		                       strtoul(argv[4], NULL, 10),
+		                       strtoul(argv[5], NULL, 10),
+		                       output)) {
+			fputs("render client failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	vkCmdCopyImageToBuffer(command_buffer,
-	                       image,
-	                       VK_IMAGE_LAYOUT_GENERAL,
-	                       image_buffer,
-	                       1,
-	                       &buffer_image_copy);
+	if ((argc == 3 || argc == 4) && strcmp(argv[1], "--batch") == 0) {
+		uint32_t const slot_count = argc == 4 ? strtoul(argv[3], NULL, 10) : TILE_SLOT_COUNT;
+		if (!run_batch(argv[2], slot_count)) {
+			fputs("batch failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
+	if (argc == 4 && strcmp(argv[1], "--tiled") == 0) {
+		if (!render_tiled_image("image.ppm", strtoul(argv[2], NULL, 10), strtoul(argv[3], NULL, 10))) {
+			fputs("tiled render failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-		return false;
+	if (argc == 3 && strcmp(argv[1], "--tune-workgroup") == 0) {
+		if (!run_workgroup_tuning(strtoul(argv[2], NULL, 10))) {
+			fputs("workgroup tuning failed\n", stderr);
+			return 1;
+		}
+		return 0;
 	}
 
-	// submit command buffer
-	VkSubmitInfo submit_info = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers    = &command_buffer,
-	};
-	if (vkQueueSubmit(compute_queue, 1, &submit_info, fence) != VK_SUCCESS) {
-		return false;
+	if (argc == 3 && strcmp(argv[1], "--bench-writer") == 0) {
+		if (!run_writer_benchmark(strtoul(argv[2], NULL, 10))) {
+			fputs("writer benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
 	}
 
-	if (vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
-		return false;
+	if (argc == 3 && strcmp(argv[1], "--bench-output") == 0) {
+		if (!run_output_benchmark(strtoul(argv[2], NULL, 10))) {
+			fputs("output benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
 	}
 
-	// read back image data into output buffer
-	void *mapped;
-	if (vkMapMemory(device, image_buffer_memory, 0, image_buffer_size, 0, &mapped) != VK_SUCCESS) {
-		return false;
+	if (argc == 3 && strcmp(argv[1], "--bench-readback") == 0) {
+		if (!run_readback_benchmark(strtoul(argv[2], NULL, 10))) {
+			fputs("readback benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
 	}
 
-	uint8_t *image_src_data = mapped;
-	for (uint32_t s = 0, d = 0; s < image_buffer_size; s += 4, d += 3) {
-		texel_buffer[d+0] = image_src_data[s+0];
-		texel_buffer[d+1] = image_src_data[s+1];
-		texel_buffer[d+2] = image_src_data[s+2];
+	if (argc == 3 && strcmp(argv[1], "--bench-convert") == 0) {
+		if (!run_convert_benchmark(strtoul(argv[2], NULL, 10))) {
+			fputs("conversion benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
 	}
 
-	vkUnmapMemory(device, image_buffer_memory);
+	if ((argc == 4 || argc == 5) && strcmp(argv[1], "--ring") == 0) {
+		uint32_t const slot_count = argc == 5 ? strtoul(argv[4], NULL, 10) : FRAME_RING_SLOT_COUNT;
+		if (!run_ring_output(argv[2], strtoul(argv[3], NULL, 10), slot_count, &options)) {
+			fputs("ring output failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	// free all resources
-	vkDestroyDescriptorPool(device, descriptor_pool, NULL);
-	vkDestroyPipeline(device, compute_pipeline, NULL);
-	vkDestroyPipelineLayout(device, pipeline_layout, NULL);
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, NULL);
-	vkFreeMemory(device, image_buffer_memory, NULL);
-	vkDestroyBuffer(device, image_buffer, NULL);
-	vkDestroyImageView(device, image_view, NULL);
-	vkFreeMemory(device, image_memory, NULL);
-	vkDestroyImage(device, image, NULL);
-	vkDestroyFence(device, fence, NULL);
-	vkDestroyCommandPool(device, command_pool, NULL);
-	vkDestroyDevice(device, NULL);
-	ext.vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, NULL);
-	vkDestroyInstance(instance, NULL);
+	if (argc == 3 && strcmp(argv[1], "--consume-ring") == 0) {
+		if (!run_ring_consumer(argv[2])) {
+			fputs("ring consumer failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	// report successful render
-	return true;
-}
+	if (argc == 3 && strcmp(argv[1], "--bench") == 0) {
+		if (!run_benchmark(strtoul(argv[2], NULL, 10), &options)) {
+			fputs("benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-int main() {
-	uint8_t *texel_buffer = malloc(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
-	if (!generate_image(texel_buffer, IMAGE_WIDTH, IMAGE_HEIGHT)) {
+	// packed rgb output is already laid out as the ppm body and is written from the mapped buffer,
+	// a mapped output file replaces the heap buffer and the copy out of it
+	struct mapped_ppm ppm;
+	uint8_t *texel_buffer = NULL;
+	if (mmap_output) {
+		if (!map_ppm_file("image.ppm", IMAGE_WIDTH, IMAGE_HEIGHT, &ppm)) {
+			fputs("failed to map image.ppm\n", stderr);
+			return 1;
+		}
+		texel_buffer = ppm.texels;
+	} else if (!options.rgb_buffer_output) {
+		texel_buffer = malloc(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+	}
+	struct render_context context;
+	if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, &options) ||
+	    !generate_image(&context, texel_buffer)) {
 		fputs("render failed\n", stderr);
 		return 1;
 	}
-	save_rgb8_image_to_ppm("image.ppm", IMAGE_WIDTH, IMAGE_HEIGHT, texel_buffer);
+	if (context.timestamp_mask != 0) {
+		printf("gpu dispatch: %.3f ms\ngpu copy:     %.3f ms\n", context.dispatch_ms, context.copy_ms);
+	}
+	if (mmap_output) {
+		// packed rgb output never went through the texel buffer
+		if (options.rgb_buffer_output) {
+			memcpy(ppm.texels, context.image_buffer_mapped, IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+		}
+		destroy_render_context(&context);
+		if (!report_startup_profile()) {
+			fputs("failed to write startup profile\n", stderr);
+		}
+		return unmap_ppm_file(&ppm) ? 0 : 1;
+	}
+
+	// a single image is written at once, one file gains nothing from the asynchronous writer
+	bool const written = save_rgb8_image_to_ppm("image.ppm",
+	                                            IMAGE_WIDTH,
+	                                            IMAGE_HEIGHT,
+	                                            options.rgb_buffer_output ? context.image_buffer_mapped : texel_buffer);
+	destroy_render_context(&context);
 	free(texel_buffer);
+	if (!report_startup_profile()) {
+		fputs("failed to write startup profile\n", stderr);
+	}
+	if (!written) {
+		fputs("failed to write image.ppm\n", stderr);
+		return 1;
+	}
 	return 0;
 }
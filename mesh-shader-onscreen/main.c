@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -11,6 +12,15 @@
 #define WINDOW_HEIGHT 600
 #define APP_NAME      "Onscreen Mesh Shader Example"
 
+// frames the cpu may record ahead of the gpu
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define MAX_FRAMES_IN_FLIGHT     4
+
+// timestamps written around the gpu work for each frame
+#define TIMESTAMP_DRAW_BEGIN 0
+#define TIMESTAMP_DRAW_END   1
+#define TIMESTAMP_COUNT      2
+
 struct {
 	PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessengerEXT;
 	PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessengerEXT;
@@ -39,21 +49,188 @@ char *load_binary_file(char const *filename, size_t *size) {
 	return buffer;
 }
 
+// full validation prints every warning and error as it arrives, the performance mode only collects
+// the performance warnings of the best practices checks and summarizes them at exit
+enum validation_mode {
+	VALIDATION_FULL,
+	VALIDATION_PERFORMANCE,
+	VALIDATION_OFF,
+};
+
+// VK_EXAMPLES_VALIDATION is full, performance or off, a release build defaults to off
+enum validation_mode get_validation_mode(void) {
+	char const *mode = getenv("VK_EXAMPLES_VALIDATION");
+	if (mode && strcmp(mode, "full") == 0) {
+		return VALIDATION_FULL;
+	}
+	if (mode && strcmp(mode, "performance") == 0) {
+		return VALIDATION_PERFORMANCE;
+	}
+	if (mode && strcmp(mode, "off") == 0) {
+		return VALIDATION_OFF;
+	}
+#ifdef VK_EXAMPLES_RELEASE
+	return VALIDATION_OFF;
+#else
+	return VALIDATION_FULL;
+#endif
+}
+
+// performance messages are counted by message id, only the text of the first one is kept
+#define MAX_PERFORMANCE_MESSAGES 64
+
+struct performance_message {
+	int32_t id;
+	char *id_name;
+	char *text;
+	uint32_t count;
+};
+
+struct {
+	struct performance_message messages[MAX_PERFORMANCE_MESSAGES];
+	uint32_t message_count;
+	uint32_t dropped_count; // occurrences of messages that no longer fit in the table
+	bool summary_registered;
+} performance_messages;
+
+void record_performance_message(VkDebugUtilsMessengerCallbackDataEXT const *callback_data) {
+	char const *id_name = callback_data->pMessageIdName ? callback_data->pMessageIdName : "";
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		if (message->id == callback_data->messageIdNumber && strcmp(message->id_name, id_name) == 0) {
+			message->count += 1;
+			return;
+		}
+	}
+	if (performance_messages.message_count == MAX_PERFORMANCE_MESSAGES) {
+		performance_messages.dropped_count += 1;
+		return;
+	}
+	performance_messages.messages[performance_messages.message_count++] = (struct performance_message){
+		.id      = callback_data->messageIdNumber,
+		.id_name = strdup(id_name),
+		.text    = strdup(callback_data->pMessage ? callback_data->pMessage : ""),
+		.count   = 1,
+	};
+}
+
+// registered with atexit, so messages reported while the instance is destroyed are counted too
+void report_performance_messages(void) {
+	uint32_t total_count = performance_messages.dropped_count;
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		total_count += performance_messages.messages[i].count;
+	}
+	fprintf(stderr,
+	        "performance warnings: %u, %u distinct\n",
+	        total_count,
+	        performance_messages.message_count);
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		fprintf(stderr, "%8u  %s: %s\n", message->count, message->id_name, message->text);
+		free(message->id_name);
+		free(message->text);
+	}
+	if (performance_messages.dropped_count > 0) {
+		fprintf(stderr, "%8u  messages beyond the first %d distinct ones\n",
+		        performance_messages.dropped_count,
+		        MAX_PERFORMANCE_MESSAGES);
+	}
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
 	VkDebugUtilsMessageTypeFlagsEXT message_type,
 	VkDebugUtilsMessengerCallbackDataEXT const *callback_data,
 	void *user_data) {
+	// the performance mode passes the table that collects its messages
+	if (user_data) {
+		record_performance_message(callback_data);
+		return VK_FALSE;
+	}
 	if (message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
 		fprintf(stderr, "validation layer: %s\n", callback_data->pMessage);
 	}
 	return VK_FALSE;
 }
 
+bool create_debug_messenger(VkInstance instance,
+                            enum validation_mode validation,
+                            VkDebugUtilsMessengerEXT *debug_messenger) {
+	// load extension functions
+	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
+	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
+
+	// setup debug messenger
+	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+		.pfnUserCallback = debug_callback,
+	};
+
+	// the performance mode collects performance messages only, the callback counts them instead of
+	// printing each one
+	if (validation == VALIDATION_PERFORMANCE) {
+		debug_messenger_create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		debug_messenger_create_info.pUserData   = &performance_messages;
+		if (!performance_messages.summary_registered) {
+			atexit(report_performance_messages);
+			performance_messages.summary_registered = true;
+		}
+	}
+
+	return ext.vkCreateDebugUtilsMessengerEXT(instance,
+	                                          &debug_messenger_create_info,
+	                                          NULL,
+	                                          debug_messenger) == VK_SUCCESS;
+}
+
+// spir-v compiled by the makefile and embedded in the binary, so no shader files are read at startup
+uint32_t const mesh_spv[] =
+#include "mesh.spv.inc"
+;
+
+uint32_t const frag_spv[] =
+#include "frag.spv.inc"
+;
+
+struct embedded_shader {
+	char const *filename;
+	uint32_t const *code;
+	size_t code_size;
+};
+
+struct embedded_shader const embedded_shaders[] = {
+	{ "mesh.spv", mesh_spv, sizeof(mesh_spv) },
+	{ "frag.spv", frag_spv, sizeof(frag_spv) },
+};
+
 bool create_shader_module(VkDevice device, char const *filename, VkShaderModule *shader_module) {
-	size_t shader_code_size;
-	void *shader_code = load_binary_file(filename, &shader_code_size);
+	// a directory in VK_EXAMPLES_SHADER_DIR overrides the embedded shaders with its .spv files
+	char const *shader_dir = getenv("VK_EXAMPLES_SHADER_DIR");
+	void *file_code = NULL;
+	uint32_t const *shader_code = NULL;
+	size_t shader_code_size = 0;
+	if (shader_dir && shader_dir[0] != '\0') {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", shader_dir, filename);
+		file_code = load_binary_file(path, &shader_code_size);
+		shader_code = file_code;
+	} else {
+		for (size_t i = 0; i < sizeof(embedded_shaders) / sizeof(embedded_shaders[0]); ++i) {
+			if (strcmp(embedded_shaders[i].filename, filename) == 0) {
+				shader_code      = embedded_shaders[i].code;
+				shader_code_size = embedded_shaders[i].code_size;
+				break;
+			}
+		}
+	}
 	if (!shader_code) {
+		fprintf(stderr, "failed to load shader %s\n", filename);
 		return false;
 	}
 
@@ -64,16 +241,279 @@ bool create_shader_module(VkDevice device, char const *filename, VkShaderModule
 	};
 
 	VkResult result = vkCreateShaderModule(device, &shader_module_create_info, NULL, shader_module);
-	free(shader_code);
+	free(file_code);
 	return result == VK_SUCCESS;
 }
 
-bool run_rasterizer() {
+bool device_matches_override(char const *device_override,
+                             uint32_t device_index,
+                             char const *device_name) {
+	// no override means every device is a candidate
+	if (!device_override || device_override[0] == '\0') {
+		return true;
+	}
+
+	// a number selects a device by index, anything else is matched against the device name
+	char *end;
+	unsigned long override_index = strtoul(device_override, &end, 10);
+	if (*end == '\0') {
+		return override_index == device_index;
+	}
+	return strstr(device_name, device_override) != NULL;
+}
+
+uint64_t score_physical_device(VkPhysicalDevice physical_device,
+                               VkPhysicalDeviceType device_type,
+                               VkQueueFamilyProperties const *queue_family_properties) {
+	// device type matters most, cpu implementations such as lavapipe are the last resort
+	uint64_t type_score;
+	switch (device_type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   type_score = 4; break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type_score = 3; break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    type_score = 2; break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:            type_score = 1; break;
+		default:                                     type_score = 0; break;
+	}
+
+	// then a queue that can record timestamps
+	uint64_t queue_score = queue_family_properties->timestampValidBits > 0 ? 1 : 0;
+
+	// then the amount of device local memory
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+	uint64_t device_local_mib = 0;
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+		if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			device_local_mib += memory_properties.memoryHeaps[i].size >> 20;
+		}
+	}
+	if (device_local_mib >= (1ull << 39)) {
+		device_local_mib = (1ull << 39) - 1;
+	}
+
+	return (type_score << 40) | (queue_score << 39) | device_local_mib;
+}
+
+double timestamp_delta_ms(uint64_t begin,
+                          uint64_t end,
+                          uint64_t timestamp_mask,
+                          float timestamp_period) {
+	// only the valid bits take part, so the subtraction also handles wrap around
+	return ((end - begin) & timestamp_mask) * timestamp_period / 1000000.0;
+}
+
+bool write_frame_timings(FILE *timings_file,
+                         VkDevice device,
+                         VkQueryPool query_pool,
+                         uint32_t first_query,
+                         uint32_t frame_index,
+                         uint64_t timestamp_mask,
+                         float timestamp_period) {
+	uint64_t timestamps[TIMESTAMP_COUNT];
+	if (vkGetQueryPoolResults(device,
+	                          query_pool,
+	                          first_query,
+	                          TIMESTAMP_COUNT,
+	                          sizeof(timestamps),
+	                          timestamps,
+	                          sizeof(uint64_t),
+	                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+		return false;
+	}
+	fprintf(timings_file,
+	        "%u,%.4f\n",
+	        frame_index,
+	        timestamp_delta_ms(timestamps[TIMESTAMP_DRAW_BEGIN],
+	                           timestamps[TIMESTAMP_DRAW_END],
+	                           timestamp_mask,
+	                           timestamp_period));
+
+	return true;
+}
+
+double get_time_ms(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+// startup phases, each timed with the monotonic clock the first time it runs, reported when
+// VK_EXAMPLES_PROFILE names the json file to write them to
+#define MAX_PROFILE_SPANS 32
+
+struct profile_span {
+	char const *name;
+	double start_ms;
+	double duration_ms;
+};
+
+struct {
+	struct profile_span spans[MAX_PROFILE_SPANS];
+	uint32_t span_count;
+	double origin_ms;
+} startup_profile;
+
+bool startup_profile_enabled(void) {
+	char const *json_filename = getenv("VK_EXAMPLES_PROFILE");
+	return json_filename && json_filename[0] != '\0';
+}
+
+// returns UINT32_MAX for a phase that already ran, ending that span is a no-op
+uint32_t begin_profile_span(char const *name) {
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		if (strcmp(startup_profile.spans[i].name, name) == 0) {
+			return UINT32_MAX;
+		}
+	}
+	if (startup_profile.span_count == MAX_PROFILE_SPANS) {
+		return UINT32_MAX;
+	}
+	double const now_ms = get_time_ms();
+	if (startup_profile.span_count == 0) {
+		startup_profile.origin_ms = now_ms;
+	}
+	startup_profile.spans[startup_profile.span_count] = (struct profile_span){
+		.name     = name,
+		.start_ms = now_ms - startup_profile.origin_ms,
+	};
+	return startup_profile.span_count++;
+}
+
+void end_profile_span(uint32_t span) {
+	if (span < startup_profile.span_count) {
+		struct profile_span *profile_span = &startup_profile.spans[span];
+		profile_span->duration_ms = get_time_ms() - startup_profile.origin_ms - profile_span->start_ms;
+	}
+}
+
+// the instance is created with the validation layer, the same instance without it is created once
+// more to show what the layer costs, after the loader has already been initialized by the first
+void profile_instance_without_validation(VkInstanceCreateInfo const *instance_create_info) {
+	if (!startup_profile_enabled() || instance_create_info->enabledLayerCount == 0) {
+		return;
+	}
+	VkInstanceCreateInfo create_info = *instance_create_info;
+	create_info.enabledLayerCount   = 0;
+	create_info.ppEnabledLayerNames = NULL;
+
+	VkInstance instance;
+	uint32_t const span = begin_profile_span("instance without validation");
+	VkResult const result = vkCreateInstance(&create_info, NULL, &instance);
+	end_profile_span(span);
+	if (result == VK_SUCCESS) {
+		vkDestroyInstance(instance, NULL);
+	}
+}
+
+// prints the phases as a table and writes them as json, start times are relative to the first phase
+bool report_startup_profile(void) {
+	if (!startup_profile_enabled() || startup_profile.span_count == 0) {
+		return true;
+	}
+	printf("%-28s %10s %10s\n", "phase", "start ms", "ms");
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		printf("%-28s %10.3f %10.3f\n", span->name, span->start_ms, span->duration_ms);
+	}
+
+	FILE *file = fopen(getenv("VK_EXAMPLES_PROFILE"), "w");
+	if (!file) {
+		return false;
+	}
+	fputs("{\n  \"phases\": [\n", file);
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		fprintf(file,
+		        "    { \"name\": \"%s\", \"start_ms\": %.3f, \"duration_ms\": %.3f }%s\n",
+		        span->name,
+		        span->start_ms,
+		        span->duration_ms,
+		        i + 1 < startup_profile.span_count ? "," : "");
+	}
+	fputs("  ]\n}\n", file);
+	return fclose(file) == 0;
+}
+
+bool device_supports_extension(VkPhysicalDevice physical_device, char const *extension_name) {
+	uint32_t extension_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, NULL);
+	VkExtensionProperties extensions[extension_count];
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, extensions);
+	for (uint32_t i = 0; i < extension_count; ++i) {
+		if (strcmp(extension_name, extensions[i].extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void get_pipeline_cache_filename(VkPhysicalDeviceProperties const *device_properties,
+                                 char *filename,
+                                 size_t filename_size) {
+	// cache data is only valid for the device and driver version that produced it
+	char uuid[2 * VK_UUID_SIZE + 1];
+	for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+		sprintf(&uuid[2 * i], "%02x", device_properties->pipelineCacheUUID[i]);
+	}
+	snprintf(filename, filename_size, "pipeline-cache-%s-%08x.bin", uuid, device_properties->driverVersion);
+}
+
+bool save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, char const *filename) {
+	size_t data_size = 0;
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, NULL) != VK_SUCCESS) {
+		return false;
+	}
+
+	void *data = malloc(data_size);
+	if (!data) {
+		return false;
+	}
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, data) != VK_SUCCESS) {
+		free(data);
+		return false;
+	}
+
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		free(data);
+		return false;
+	}
+	size_t written = fwrite(data, 1, data_size, file);
+	fclose(file);
+	free(data);
+
+	return written == data_size;
+}
+
+void report_pipeline_creation(double creation_ms,
+                              size_t initial_cache_size,
+                              VkPipelineCreationFeedbackEXT const *feedback) {
+	printf("pipeline creation: %.3f ms (%s start", creation_ms, initial_cache_size > 0 ? "warm" : "cold");
+	if (feedback && (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+		bool const cache_hit =
+			feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+		printf(", driver reports %.3f ms, cache %s", feedback->duration / 1000000.0, cache_hit ? "hit" : "miss");
+	}
+	printf(")\n");
+}
+
+bool run_rasterizer(char const *timings_filename, uint32_t frames_in_flight) {
+	// open the per frame gpu timings file if one was requested
+	FILE *timings_file = NULL;
+	if (timings_filename) {
+		timings_file = fopen(timings_filename, "w");
+		if (!timings_file) {
+			return false;
+		}
+	}
+
 	// create window
+	uint32_t const window_span = begin_profile_span("window");
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 	GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, APP_NAME, NULL, NULL);
+	end_profile_span(window_span);
 
 	// create vulkan instance
 	VkApplicationInfo app_info = {
@@ -95,52 +535,54 @@ bool run_rasterizer() {
 
 	char const *validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
 
+	// validation is off in release mode, the performance mode adds the best practices checks
+	enum validation_mode const validation = get_validation_mode();
+	VkValidationFeatureEnableEXT const best_practices = VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT;
+	VkValidationFeaturesEXT validation_features = {
+		.sType                         = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT,
+		.enabledValidationFeatureCount = 1,
+		.pEnabledValidationFeatures    = &best_practices,
+	};
+
 	VkInstanceCreateInfo instance_create_info = {
 		.sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pNext                   = validation == VALIDATION_PERFORMANCE ? &validation_features : NULL,
 		.pApplicationInfo        = &app_info,
-		.enabledLayerCount       = 1,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
 		.ppEnabledLayerNames     = validation_layers,
-		.enabledExtensionCount   = glfw_extension_count + 1,
+		.enabledExtensionCount   = glfw_extension_count + (validation != VALIDATION_OFF ? 1 : 0),
 		.ppEnabledExtensionNames = extension_names,
 	};
 
+	uint32_t const instance_span = begin_profile_span("instance");
 	VkInstance instance;
 	if (vkCreateInstance(&instance_create_info, NULL, &instance) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(instance_span);
+	profile_instance_without_validation(&instance_create_info);
 
 	// load extension functions
-	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
-	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
 	LOAD_EXTENSION_FUNC(vkCmdDrawMeshTasksEXT);
 
-	// setup debug messenger
-	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
-		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
-		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-		.pfnUserCallback = debug_callback,
-	};
-
-	VkDebugUtilsMessengerEXT debug_messenger;
-	if (ext.vkCreateDebugUtilsMessengerEXT(instance,
-                                           &debug_messenger_create_info,
-                                           NULL,
-                                           &debug_messenger) != VK_SUCCESS) {
+	// setup debug messenger, unless validation is off
+	uint32_t const debug_messenger_span = begin_profile_span("debug messenger");
+	VkDebugUtilsMessengerEXT debug_messenger = VK_NULL_HANDLE;
+	if (validation != VALIDATION_OFF && !create_debug_messenger(instance, validation, &debug_messenger)) {
 		return false;
 	}
+	end_profile_span(debug_messenger_span);
 
 	// create surface
+	uint32_t const surface_span = begin_profile_span("surface");
 	VkSurfaceKHR surface;
 	if (glfwCreateWindowSurface(instance, window, NULL, &surface) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(surface_span);
 
 	// select physical device
+	uint32_t const device_enumeration_span = begin_profile_span("device enumeration");
 	uint32_t physical_device_count = 0;
 	vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL);
 	if (physical_device_count == 0) {
@@ -158,13 +600,18 @@ bool run_rasterizer() {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 
+	// an index or part of a device name in VK_EXAMPLES_DEVICE overrides the automatic choice
+	char const *device_override = getenv("VK_EXAMPLES_DEVICE");
+
 	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
 	uint32_t graphics_queue_index, present_queue_index;
+	uint32_t timestamp_valid_bits;
+	float timestamp_period;
+	uint64_t best_device_score = 0;
 	for (uint32_t i = 0; i < physical_device_count; ++i) {
 		VkPhysicalDeviceProperties device_properties;
 		vkGetPhysicalDeviceProperties(physical_devices[i], &device_properties);
-		if (device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-		    device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
+		if (!device_matches_override(device_override, i, device_properties.deviceName)) {
 			continue;
 		}
 
@@ -191,30 +638,54 @@ bool run_rasterizer() {
 		vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i],
 		                                         &queue_family_count,
 		                                         queue_family_properties);
-		graphics_queue_index = UINT32_MAX;
-		present_queue_index  = UINT32_MAX;
+		uint32_t candidate_graphics_queue_index = UINT32_MAX;
+		uint32_t candidate_present_queue_index  = UINT32_MAX;
 		for (uint32_t j = 0; j < queue_family_count; ++j) {
 			if (queue_family_properties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				graphics_queue_index = j;
+				candidate_graphics_queue_index = j;
 			}
 			VkBool32 present_support = false;
 			vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i], j, surface, &present_support);
 			if (present_support) {
-				present_queue_index = j;
+				candidate_present_queue_index = j;
 			}
 		}
-		if (graphics_queue_index == UINT32_MAX || present_queue_index == UINT32_MAX) {
+		if (candidate_graphics_queue_index == UINT32_MAX ||
+		    candidate_present_queue_index == UINT32_MAX) {
 			continue;
 		}
 
-		physical_device = physical_devices[i];
-		break;
+		// keep the highest scoring device that meets all requirements
+		uint64_t device_score =
+			score_physical_device(physical_devices[i],
+			                      device_properties.deviceType,
+			                      &queue_family_properties[candidate_graphics_queue_index]);
+		if (physical_device != VK_NULL_HANDLE && device_score <= best_device_score) {
+			continue;
+		}
+
+		physical_device      = physical_devices[i];
+		best_device_score    = device_score;
+		graphics_queue_index = candidate_graphics_queue_index;
+		present_queue_index  = candidate_present_queue_index;
+		timestamp_valid_bits = queue_family_properties[candidate_graphics_queue_index].timestampValidBits;
+		timestamp_period     = device_properties.limits.timestampPeriod;
 	}
 
 	if (physical_device == VK_NULL_HANDLE) {
 		return false;
 	}
 
+	// pipeline creation feedback is optional and only used to report pipeline cache hits
+	bool const creation_feedback_supported =
+		device_supports_extension(physical_device, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	char const *device_extensions[NUM_REQUIRED_EXTENSIONS + 1];
+	memcpy(device_extensions, required_extensions, sizeof(required_extensions));
+	uint32_t device_extension_count = NUM_REQUIRED_EXTENSIONS;
+	if (creation_feedback_supported) {
+		device_extensions[device_extension_count++] = VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME;
+	}
+
 	// create device
 	float const queue_priority = 1.0f;
 	VkDeviceQueueCreateInfo device_queue_create_infos[2] = {
@@ -250,16 +721,19 @@ bool run_rasterizer() {
 		.pNext                   = (void*)&device_features,
 		.queueCreateInfoCount    = num_queues,
 		.pQueueCreateInfos       = device_queue_create_infos,
-		.enabledExtensionCount   = NUM_REQUIRED_EXTENSIONS,
-		.ppEnabledExtensionNames = required_extensions,
-		.enabledLayerCount       = 1,
+		.enabledExtensionCount   = device_extension_count,
+		.ppEnabledExtensionNames = device_extensions,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
 		.ppEnabledLayerNames     = validation_layers,
 	};
 
+	end_profile_span(device_enumeration_span);
+	uint32_t const device_span = begin_profile_span("device");
 	VkDevice device;
 	if (vkCreateDevice(physical_device, &device_create_info, NULL, &device) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(device_span);
 
 	// get queues from device
 	VkQueue graphics_queue;
@@ -268,6 +742,7 @@ bool run_rasterizer() {
 	vkGetDeviceQueue(device, present_queue_index, 0, &present_queue);
 
 	// create swap chain
+	uint32_t const swap_chain_span = begin_profile_span("swap chain");
 	VkSurfaceCapabilitiesKHR swap_chain_capabilities;
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &swap_chain_capabilities);
 
@@ -374,6 +849,7 @@ bool run_rasterizer() {
 		}
 
 	}
+	end_profile_span(swap_chain_span);
 
 	// create command pool
 	VkCommandPoolCreateInfo command_pool_create_info = {
@@ -386,42 +862,72 @@ bool run_rasterizer() {
 		return false;
 	}
 
-	// create command buffer
-	VkCommandBufferAllocateInfo command_buffer_alloc_info = {
+	// create per frame command buffers so the cpu can record a frame while the gpu works on earlier ones
+	VkCommandBufferAllocateInfo frame_command_buffer_alloc_info = {
 		.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.commandPool        = command_pool,
 		.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
+		.commandBufferCount = frames_in_flight,
 	};
-	VkCommandBuffer command_buffer;
-	if (vkAllocateCommandBuffers(device, &command_buffer_alloc_info, &command_buffer) != VK_SUCCESS) {
+	VkCommandBuffer frame_command_buffers[MAX_FRAMES_IN_FLIGHT];
+	if (vkAllocateCommandBuffers(device, &frame_command_buffer_alloc_info, frame_command_buffers) != VK_SUCCESS) {
 		return false;
 	}
 
-	// create semaphores
+	// create per frame semaphores and fences, the fences start signalled so the first wait on each returns
 	VkSemaphoreCreateInfo semaphore_create_info = {
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
 	};
+	VkFenceCreateInfo frame_fence_create_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
 
-	VkSemaphore image_available_semaphore;
-	if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &image_available_semaphore) != VK_SUCCESS) {
-		return false;
+	VkSemaphore image_available_semaphores[MAX_FRAMES_IN_FLIGHT];
+	VkFence frame_fences[MAX_FRAMES_IN_FLIGHT];
+	for (uint32_t i = 0; i < frames_in_flight; ++i) {
+		if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &image_available_semaphores[i]) != VK_SUCCESS) {
+			return false;
+		}
+		if (vkCreateFence(device, &frame_fence_create_info, NULL, &frame_fences[i]) != VK_SUCCESS) {
+			return false;
+		}
 	}
-	VkSemaphore render_finished_semaphore;
-	if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &render_finished_semaphore) != VK_SUCCESS) {
-		return false;
+
+	// a swap chain image can still be queued for presentation when its frame slot comes round again,
+	// so the render finished semaphores belong to the swap chain images rather than the frames
+	VkSemaphore render_finished_semaphores[image_count];
+	for (uint32_t i = 0; i < image_count; ++i) {
+		if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &render_finished_semaphores[i]) != VK_SUCCESS) {
+			return false;
+		}
 	}
 
-	// create fence
-	VkFenceCreateInfo fence_create_info = {
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	// create timestamp query pool
+	VkQueryPoolCreateInfo query_pool_create_info = {
+		.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType  = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = TIMESTAMP_COUNT * frames_in_flight,
 	};
 
-	VkFence fence;
-	if (vkCreateFence(device, &fence_create_info, NULL, &fence) != VK_SUCCESS) {
+	VkQueryPool query_pool;
+	if (vkCreateQueryPool(device, &query_pool_create_info, NULL, &query_pool) != VK_SUCCESS) {
 		return false;
 	}
 
+	// a queue without valid timestamp bits cannot write timestamps, so timing is skipped
+	uint64_t const timestamp_mask =
+		timestamp_valid_bits >= 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+
+	// per frame gpu timings are only written when the queue supports timestamps
+	if (timings_file) {
+		if (timestamp_mask == 0) {
+			fputs("timestamps not supported, no gpu timings will be written\n", stderr);
+		}
+		fputs("frame,draw_ms\n", timings_file);
+	}
+	bool const write_timings = timings_file && timestamp_mask != 0;
+
 	// create render pass
 	VkAttachmentDescription colour_attachment_description = {
 		.format         = surface_format.format,
@@ -480,11 +986,17 @@ bool run_rasterizer() {
 	}
 
 	// create shader modules
+	uint32_t const shader_span = begin_profile_span("shader load");
 	VkShaderModule mesh_shader_module;
-	create_shader_module(device, "mesh.spv", &mesh_shader_module);
+	if (!create_shader_module(device, "mesh.spv", &mesh_shader_module)) {
+		return false;
+	}
 
 	VkShaderModule frag_shader_module;
-	create_shader_module(device, "frag.spv", &frag_shader_module);
+	if (!create_shader_module(device, "frag.spv", &frag_shader_module)) {
+		return false;
+	}
+	end_profile_span(shader_span);
 	
 	// create rasterization pipeline
 	VkPipelineShaderStageCreateInfo shader_stage_create_infos[2] = {
@@ -567,15 +1079,65 @@ bool run_rasterizer() {
 		.subpass             = 0,
 	};
 
+	// load the pipeline cache left behind by an earlier run on the same device and driver
+	VkPhysicalDeviceProperties physical_device_properties;
+	vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+	uint32_t const pipeline_span = begin_profile_span("pipeline creation");
+	char pipeline_cache_filename[64];
+	get_pipeline_cache_filename(&physical_device_properties,
+	                            pipeline_cache_filename,
+	                            sizeof(pipeline_cache_filename));
+
+	size_t pipeline_cache_data_size = 0;
+	void *pipeline_cache_data = load_binary_file(pipeline_cache_filename, &pipeline_cache_data_size);
+	VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = pipeline_cache_data_size,
+		.pInitialData    = pipeline_cache_data,
+	};
+
+	VkPipelineCache pipeline_cache;
+	VkResult pipeline_cache_result =
+		vkCreatePipelineCache(device, &pipeline_cache_create_info, NULL, &pipeline_cache);
+	free(pipeline_cache_data);
+	if (pipeline_cache_result != VK_SUCCESS) {
+		return false;
+	}
+
+	// let the driver report whether the cache was hit
+	VkPipelineCreationFeedbackEXT pipeline_creation_feedback = {0};
+	VkPipelineCreationFeedbackEXT stage_creation_feedbacks[2];
+	VkPipelineCreationFeedbackCreateInfoEXT pipeline_creation_feedback_create_info = {
+		.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+		.pPipelineCreationFeedback          = &pipeline_creation_feedback,
+		.pipelineStageCreationFeedbackCount = 2,
+		.pPipelineStageCreationFeedbacks    = stage_creation_feedbacks,
+	};
+	if (creation_feedback_supported) {
+		graphics_pipeline_create_info.pNext = &pipeline_creation_feedback_create_info;
+	}
+
 	VkPipeline graphics_pipeline;
+	double const pipeline_creation_start_ms = get_time_ms();
 	if (vkCreateGraphicsPipelines(device,
-	                              VK_NULL_HANDLE,
+	                              pipeline_cache,
 	                              1,
 	                              &graphics_pipeline_create_info,
 	                              NULL,
 	                              &graphics_pipeline) != VK_SUCCESS) {
 		return false;
 	}
+	double const pipeline_creation_ms = get_time_ms() - pipeline_creation_start_ms;
+	report_pipeline_creation(pipeline_creation_ms,
+	                         pipeline_cache_data_size,
+	                         creation_feedback_supported ? &pipeline_creation_feedback : NULL);
+
+	// write the cache back so the next run starts warm
+	if (!save_pipeline_cache(device, pipeline_cache, pipeline_cache_filename)) {
+		fprintf(stderr, "failed to save pipeline cache to %s\n", pipeline_cache_filename);
+	}
+	vkDestroyPipelineCache(device, pipeline_cache, NULL);
+	end_profile_span(pipeline_span);
 
 	// free shader modules
 	vkDestroyShaderModule(device, frag_shader_module, NULL);
@@ -603,16 +1165,40 @@ bool run_rasterizer() {
 	}
 
 	// main app loop
+	uint32_t frame_index = 0;
+	double total_wait_ms = 0.0;
+	double const loop_start_ms = get_time_ms();
 	while (!glfwWindowShouldClose(window)) {
 		// handle window system events
 		glfwPollEvents();
 
+		// wait until the gpu has finished the last frame that used this slot
+		uint32_t const frame_slot = frame_index % frames_in_flight;
+		uint32_t const first_query = frame_slot * TIMESTAMP_COUNT;
+		VkCommandBuffer const frame_command_buffer = frame_command_buffers[frame_slot];
+		double const wait_start_ms = get_time_ms();
+		vkWaitForFences(device, 1, &frame_fences[frame_slot], VK_TRUE, UINT64_MAX);
+		total_wait_ms += get_time_ms() - wait_start_ms;
+
+		// that frame's timestamps are now available
+		if (write_timings && frame_index >= frames_in_flight) {
+			if (!write_frame_timings(timings_file,
+			                         device,
+			                         query_pool,
+			                         first_query,
+			                         frame_index - frames_in_flight,
+			                         timestamp_mask,
+			                         timestamp_period)) {
+				return false;
+			}
+		}
+
 		// acquire next swap chain image
 		uint32_t swap_chain_image_index;
 		vkAcquireNextImageKHR(device,
 		                      swap_chain,
 		                      UINT64_MAX,
-		                      image_available_semaphore,
+		                      image_available_semaphores[frame_slot],
 		                      VK_NULL_HANDLE,
 		                      &swap_chain_image_index);
 
@@ -620,10 +1206,18 @@ bool run_rasterizer() {
 		VkCommandBufferBeginInfo command_buffer_begin_info = {
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		};
-		if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+		if (vkBeginCommandBuffer(frame_command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
 			return false;
 		}
 
+		if (write_timings) {
+			vkCmdResetQueryPool(frame_command_buffer, query_pool, first_query, TIMESTAMP_COUNT);
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_DRAW_BEGIN);
+		}
+
 		VkClearValue clear_color = {{{ 0.0f, 0.0f, 0.0f, 1.0f }}};
 		VkRenderPassBeginInfo render_pass_begin_info = {
 			.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
@@ -634,15 +1228,22 @@ bool run_rasterizer() {
 			.clearValueCount   = 1,
 			.pClearValues      = &clear_color,
 		};
-		vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(frame_command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdBindPipeline(frame_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
 
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+		ext.vkCmdDrawMeshTasksEXT(frame_command_buffer, 1, 1, 1);
 
-		ext.vkCmdDrawMeshTasksEXT(command_buffer, 1, 1, 1);
+		vkCmdEndRenderPass(frame_command_buffer);
 
-		vkCmdEndRenderPass(command_buffer);
+		if (write_timings) {
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_DRAW_END);
+		}
 
-		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		if (vkEndCommandBuffer(frame_command_buffer) != VK_SUCCESS) {
 			return false;
 		}
 
@@ -651,36 +1252,67 @@ bool run_rasterizer() {
 		VkSubmitInfo submit_info = {
 			.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 			.waitSemaphoreCount   = 1,
-			.pWaitSemaphores      = &image_available_semaphore,
+			.pWaitSemaphores      = &image_available_semaphores[frame_slot],
 			.pWaitDstStageMask    = &wait_stage,
 			.commandBufferCount   = 1,
-			.pCommandBuffers      = &command_buffer,
+			.pCommandBuffers      = &frame_command_buffer,
 			.signalSemaphoreCount = 1,
-			.pSignalSemaphores    = &render_finished_semaphore,
+			.pSignalSemaphores    = &render_finished_semaphores[swap_chain_image_index],
 		};
 
-		if (vkQueueSubmit(graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
+		uint32_t const submit_span = frame_index == 0 ? begin_profile_span("first submit") : UINT32_MAX;
+		vkResetFences(device, 1, &frame_fences[frame_slot]);
+		if (vkQueueSubmit(graphics_queue, 1, &submit_info, frame_fences[frame_slot]) != VK_SUCCESS) {
 			return false;
 		}
+		end_profile_span(submit_span);
 
 		VkPresentInfoKHR present_info = {
 			.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 			.waitSemaphoreCount = 1,
-			.pWaitSemaphores    = &render_finished_semaphore,
+			.pWaitSemaphores    = &render_finished_semaphores[swap_chain_image_index],
 			.swapchainCount     = 1,
 			.pSwapchains        = &swap_chain,
 			.pImageIndices      = &swap_chain_image_index,
 		};
+		uint32_t const present_span = frame_index == 0 ? begin_profile_span("first present") : UINT32_MAX;
 		vkQueuePresentKHR(present_queue, &present_info);
+		end_profile_span(present_span);
 
-		vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &fence);
+		frame_index += 1;
 	}
 
 	// wait for all renders to finish before cleanup
 	vkDeviceWaitIdle(device);
+	double const loop_ms = get_time_ms() - loop_start_ms;
+
+	// write the timings of the frames that were still in flight when the loop ended
+	if (write_timings) {
+		uint32_t const first_pending_frame = frame_index > frames_in_flight ? frame_index - frames_in_flight : 0;
+		for (uint32_t i = first_pending_frame; i < frame_index; ++i) {
+			if (!write_frame_timings(timings_file,
+			                         device,
+			                         query_pool,
+			                         (i % frames_in_flight) * TIMESTAMP_COUNT,
+			                         i,
+			                         timestamp_mask,
+			                         timestamp_period)) {
+				return false;
+			}
+		}
+	}
+
+	// report the frame rate and how long the cpu spent blocked on the gpu
+	if (frame_index > 0) {
+		printf("frames: %u, frames in flight: %u, %.1f fps, mean cpu wait: %.3f ms per frame\n",
+		       frame_index,
+		       frames_in_flight,
+		       frame_index * 1000.0 / loop_ms,
+		       total_wait_ms / frame_index);
+	}
 
 	// free all resources
+	uint32_t const teardown_span = begin_profile_span("teardown");
 	for (uint32_t i = 0; i < image_count; ++i) {
 		vkDestroyFramebuffer(device, swap_chain_framebuffers[i], NULL);
 	}
@@ -690,26 +1322,55 @@ bool run_rasterizer() {
 	for (uint32_t i = 0; i < image_count; ++i) {
 		vkDestroyImageView(device, swap_chain_image_views[i], NULL);
 	}
-	vkDestroyFence(device, fence, NULL);
-	vkDestroySemaphore(device, render_finished_semaphore, NULL);
-	vkDestroySemaphore(device, image_available_semaphore, NULL);
+	vkDestroyQueryPool(device, query_pool, NULL);
+	for (uint32_t i = 0; i < image_count; ++i) {
+		vkDestroySemaphore(device, render_finished_semaphores[i], NULL);
+	}
+	for (uint32_t i = 0; i < frames_in_flight; ++i) {
+		vkDestroyFence(device, frame_fences[i], NULL);
+		vkDestroySemaphore(device, image_available_semaphores[i], NULL);
+	}
 	vkDestroyCommandPool(device, command_pool, NULL);
 	vkDestroySwapchainKHR(device, swap_chain, NULL);
 	vkDestroyDevice(device, NULL);
 	vkDestroySurfaceKHR(instance, surface, NULL);
-	ext.vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, NULL);
+	if (debug_messenger != VK_NULL_HANDLE) {
+		ext.vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, NULL);
+	}
 	vkDestroyInstance(instance, NULL);
 	glfwDestroyWindow(window);
 	glfwTerminate();
+	end_profile_span(teardown_span);
+	if (timings_file) {
+		fclose(timings_file);
+	}
 
 	// report successful render
 	return true;
 }
 
-int main() {
-	if (!run_rasterizer()) {
+int main(int argc, char **argv) {
+	// optionally write per frame gpu timings to a csv file and change the number of frames in flight
+	char const *timings_filename = NULL;
+	uint32_t frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--timings-csv") == 0) {
+			timings_filename = argv[i + 1];
+		} else if (strcmp(argv[i], "--frames-in-flight") == 0) {
+			frames_in_flight = strtoul(argv[i + 1], NULL, 10);
+		}
+	}
+	if (frames_in_flight < 1 || frames_in_flight > MAX_FRAMES_IN_FLIGHT) {
+		fprintf(stderr, "frames in flight must be between 1 and %d\n", MAX_FRAMES_IN_FLIGHT);
+		return 1;
+	}
+
+	if (!run_rasterizer(timings_filename, frames_in_flight)) {
 		fputs("run failed\n", stderr);
 		return 1;
 	}
+	if (!report_startup_profile()) {
+		fputs("failed to write startup profile\n", stderr);
+	}
 	return 0;
 }
@@ -1,13 +1,46 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 #include <vulkan/vulkan.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #define IMAGE_WIDTH  800
 #define IMAGE_HEIGHT 600
 
+// frames handed to another process through a shared memory ring, each slot starts with a frame
+// header on its own cache line and the ring holds this many frames unless told otherwise
+#define FRAME_RING_MAGIC      0x474e4952u
+#define FRAME_RING_SLOT_COUNT 4
+#define CACHE_LINE_SIZE       64
+
+// timestamps written around the gpu work for each image
+#define TIMESTAMP_TRACE_BEGIN 0
+#define TIMESTAMP_TRACE_END   1
+#define TIMESTAMP_COPY_END    2
+#define TIMESTAMP_IMAGE_COUNT 3
+
+// timestamps written around each acceleration structure build
+#define TIMESTAMP_BUILD_BEGIN 3
+#define TIMESTAMP_BUILD_END   4
+#define TIMESTAMP_COUNT       5
+
+// initial buffer contents reach device local memory through a staging buffer of this size
+#define STAGING_BUFFER_SIZE (256 * 1024)
+
 struct {
 	PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessengerEXT;
 	PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessengerEXT;
@@ -20,12 +53,714 @@ struct {
 	PFN_vkCmdTraceRaysKHR vkCmdTraceRaysKHR;
 	PFN_vkGetRayTracingShaderGroupHandlesKHR vkGetRayTracingShaderGroupHandlesKHR;
 	PFN_vkCreateRayTracingPipelinesKHR vkCreateRayTracingPipelinesKHR;
+	PFN_vkGetMemoryHostPointerPropertiesEXT vkGetMemoryHostPointerPropertiesEXT;
 } ext;
 
 #define LOAD_EXTENSION_FUNC(FuncName) \
 	ext.FuncName = (PFN_##FuncName)vkGetInstanceProcAddr(instance, #FuncName); \
 	if (!ext.FuncName) return false
 
+// readback conversion is split into bands of rows, one per thread, with at least this many texels
+// in each band so that starting a thread never costs more than it saves
+#define MAX_CONVERT_THREADS           16
+#define MIN_TEXELS_PER_CONVERT_THREAD (256 * 1024)
+
+void convert_rgba8_to_rgb8_scalar(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	for (size_t s = 0, d = 0; s < texel_count * 4; s += 4, d += 3) {
+		dst[d+0] = src[s+0];
+		dst[d+1] = src[s+1];
+		dst[d+2] = src[s+2];
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+void convert_rgba8_to_rgb8_ssse3(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	// gather the rgb bytes of four texels into the low 12 bytes and store those
+	__m128i const shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; i + 4 <= texel_count; i += 4) {
+		__m128i const rgb = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(src + i * 4)), shuffle);
+		_mm_storel_epi64((__m128i *)(dst + i * 3), rgb);
+		uint32_t const last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(rgb, 8));
+		memcpy(dst + i * 3 + 8, &last, sizeof(last));
+	}
+	convert_rgba8_to_rgb8_scalar(src + i * 4, dst + i * 3, texel_count - i);
+}
+
+__attribute__((target("avx2")))
+void convert_rgba8_to_rgb8_avx2(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	// the byte shuffle stays within each 128 bit lane, so a dword permute then joins the two
+	// 12 byte halves into 24 contiguous bytes
+	__m256i const shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+	                                         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	__m256i const compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	size_t i = 0;
+	for (; i + 8 <= texel_count; i += 8) {
+		__m256i const rgba = _mm256_loadu_si256((__m256i const *)(src + i * 4));
+		__m256i const rgb  = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(rgba, shuffle), compact);
+		_mm_storeu_si128((__m128i *)(dst + i * 3), _mm256_castsi256_si128(rgb));
+		_mm_storel_epi64((__m128i *)(dst + i * 3 + 16), _mm256_extracti128_si256(rgb, 1));
+	}
+	convert_rgba8_to_rgb8_ssse3(src + i * 4, dst + i * 3, texel_count - i);
+}
+#elif defined(__ARM_NEON)
+void convert_rgba8_to_rgb8_neon(uint8_t const *src, uint8_t *dst, size_t texel_count) {
+	// the de-interleaving load splits the channels, storing three of them drops alpha
+	size_t i = 0;
+	for (; i + 16 <= texel_count; i += 16) {
+		uint8x16x4_t const rgba = vld4q_u8(src + i * 4);
+		uint8x16x3_t const rgb  = { { rgba.val[0], rgba.val[1], rgba.val[2] } };
+		vst3q_u8(dst + i * 3, rgb);
+	}
+	convert_rgba8_to_rgb8_scalar(src + i * 4, dst + i * 3, texel_count - i);
+}
+#endif
+
+struct convert_kernel {
+	char const *name;
+	void (*convert)(uint8_t const *src, uint8_t *dst, size_t texel_count);
+};
+
+// the widest kernel the cpu supports, checked at run time as the build targets baseline x86-64
+struct convert_kernel select_convert_kernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return (struct convert_kernel){ "avx2", convert_rgba8_to_rgb8_avx2 };
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return (struct convert_kernel){ "ssse3", convert_rgba8_to_rgb8_ssse3 };
+	}
+#elif defined(__ARM_NEON)
+	return (struct convert_kernel){ "neon", convert_rgba8_to_rgb8_neon };
+#endif
+	return (struct convert_kernel){ "scalar", convert_rgba8_to_rgb8_scalar };
+}
+
+uint32_t get_convert_thread_count(void) {
+	long const cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpu_count < 1) {
+		return 1;
+	}
+	return cpu_count > MAX_CONVERT_THREADS ? MAX_CONVERT_THREADS : (uint32_t)cpu_count;
+}
+
+struct convert_band {
+	void (*convert)(uint8_t const *src, uint8_t *dst, size_t texel_count);
+	uint8_t const *src;
+	uint8_t *dst;
+	size_t texel_count;
+};
+
+void *convert_band_thread(void *arg) {
+	struct convert_band const *band = arg;
+	band->convert(band->src, band->dst, band->texel_count);
+	return NULL;
+}
+
+void convert_rgba8_image_to_rgb8(struct convert_kernel const *kernel,
+                                 uint8_t const *src,
+                                 uint8_t *dst,
+                                 uint32_t width_px,
+                                 uint32_t height_px,
+                                 uint32_t thread_count) {
+	size_t const texel_count = (size_t)width_px * height_px;
+	uint32_t band_count = texel_count / MIN_TEXELS_PER_CONVERT_THREAD;
+	if (band_count > thread_count) band_count = thread_count;
+	if (band_count > height_px) band_count = height_px;
+	if (band_count < 1) band_count = 1;
+
+	struct convert_band bands[MAX_CONVERT_THREADS];
+	for (uint32_t i = 0, row = 0; i < band_count; ++i) {
+		uint32_t const row_count = (height_px - row) / (band_count - i);
+		bands[i] = (struct convert_band){
+			.convert     = kernel->convert,
+			.src         = src + (size_t)row * width_px * 4,
+			.dst         = dst + (size_t)row * width_px * 3,
+			.texel_count = (size_t)row_count * width_px,
+		};
+		row += row_count;
+	}
+
+	// the calling thread converts the first band, and any band whose thread fails to start
+	pthread_t threads[MAX_CONVERT_THREADS];
+	bool thread_started[MAX_CONVERT_THREADS] = { false };
+	for (uint32_t i = 1; i < band_count; ++i) {
+		thread_started[i] = pthread_create(&threads[i], NULL, convert_band_thread, &bands[i]) == 0;
+	}
+	convert_band_thread(&bands[0]);
+	for (uint32_t i = 1; i < band_count; ++i) {
+		if (thread_started[i]) {
+			pthread_join(threads[i], NULL);
+		} else {
+			convert_band_thread(&bands[i]);
+		}
+	}
+}
+
+// buffers and images are sub-allocated from device memory blocks of at least this size, so the
+// driver sees a handful of allocations instead of one per resource
+#define MEMORY_BLOCK_SIZE       (16 * 1024 * 1024)
+#define MAX_MEMORY_BLOCKS       16
+#define MAX_MEMORY_BLOCK_RANGES 64
+
+// what the cpu and gpu do with a resource, which decides the memory type it is placed in
+enum memory_usage {
+	MEMORY_USAGE_GPU_ONLY, // never mapped
+	MEMORY_USAGE_UPLOAD,   // written once by the cpu and copied from by the gpu
+	MEMORY_USAGE_READBACK, // written by the gpu and read by the cpu
+	MEMORY_USAGE_DYNAMIC,  // rewritten by the cpu every frame and read by the gpu
+};
+
+// a part of a memory block that is either free or holds one buffer or image
+struct memory_range {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	bool used;
+	bool linear;
+};
+
+// the ranges of a block are kept in offset order and always cover the whole block
+struct memory_block {
+	VkDeviceMemory memory;
+	uint32_t memory_type_index;
+	VkDeviceSize size;
+	uint8_t *mapped;
+	uint32_t range_count;
+	struct memory_range ranges[MAX_MEMORY_BLOCK_RANGES];
+};
+
+struct memory_arena {
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkDeviceSize buffer_image_granularity;
+	VkDeviceSize non_coherent_atom_size;
+	VkMemoryAllocateFlags allocate_flags;
+	uint32_t block_count;
+	struct memory_block blocks[MAX_MEMORY_BLOCKS];
+};
+
+// where a buffer or image lives in the arena, mapped is only set for host visible memory
+struct memory_allocation {
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t block_index;
+	uint8_t *mapped;
+};
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void init_memory_arena(struct memory_arena *arena,
+                       VkPhysicalDevice physical_device,
+                       VkDevice device,
+                       VkMemoryAllocateFlags allocate_flags) {
+	VkPhysicalDeviceProperties device_properties;
+	vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+
+	arena->device                   = device;
+	arena->buffer_image_granularity = device_properties.limits.bufferImageGranularity;
+	arena->non_coherent_atom_size   = device_properties.limits.nonCoherentAtomSize;
+	arena->allocate_flags           = allocate_flags;
+	arena->block_count              = 0;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &arena->memory_properties);
+}
+
+// ranks a memory type for a usage, 0 means the type cannot be used for it
+uint32_t score_memory_type(VkMemoryPropertyFlags flags, enum memory_usage usage) {
+	bool const device_local  = flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bool const host_visible  = flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	bool const host_coherent = flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	bool const host_cached   = flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	if (flags & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT)) {
+		return 0;
+	}
+	if (usage != MEMORY_USAGE_GPU_ONLY && !host_visible) {
+		return 0;
+	}
+
+	switch (usage) {
+	case MEMORY_USAGE_GPU_ONLY:
+		// leave host visible device memory to the resources the cpu writes
+		return 1 + (device_local ? 2 : 0) + (host_visible ? 0 : 1);
+	case MEMORY_USAGE_UPLOAD:
+		// sequential writes are fine in write combined memory, staging stays out of device memory
+		return 1 + (host_coherent ? 2 : 0) + (device_local ? 0 : 1);
+	case MEMORY_USAGE_READBACK:
+		// reads from uncached memory bypass the cpu caches and run many times slower
+		return 1 + (host_cached ? 4 : 0) + (host_coherent ? 2 : 0) + (device_local ? 0 : 1);
+	case MEMORY_USAGE_DYNAMIC:
+		// the gpu reads small per frame data straight from device memory when it is mappable
+		return 1 + (device_local ? 4 : 0) + (host_coherent ? 2 : 0);
+	}
+
+	return 0;
+}
+
+// picks the best scoring memory type allowed by memory_type_bits, ties go to the lowest index
+bool find_memory_type(VkPhysicalDeviceMemoryProperties const *memory_properties,
+                      uint32_t memory_type_bits,
+                      enum memory_usage usage,
+                      uint32_t *memory_type_index) {
+	uint32_t best_score = 0;
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		if (!(memory_type_bits & (1u << i))) {
+			continue;
+		}
+		uint32_t const score = score_memory_type(memory_properties->memoryTypes[i].propertyFlags, usage);
+		if (score > best_score) {
+			best_score         = score;
+			*memory_type_index = i;
+		}
+	}
+
+	return best_score > 0;
+}
+
+bool allocate_from_block(struct memory_block *block,
+                         VkDeviceSize size,
+                         VkDeviceSize alignment,
+                         bool linear,
+                         VkDeviceSize granularity,
+                         VkDeviceSize *offset) {
+	// first fit, linear and optimal resources must not share a granularity page with each other
+	for (uint32_t i = 0; i < block->range_count; ++i) {
+		struct memory_range const range = block->ranges[i];
+		if (range.used) {
+			continue;
+		}
+
+		VkDeviceSize start = align_up(range.offset, alignment);
+		if (i > 0 && block->ranges[i - 1].used && block->ranges[i - 1].linear != linear) {
+			start = align_up(start, granularity);
+		}
+		VkDeviceSize const range_end = range.offset + range.size;
+		if (start + size > range_end) {
+			continue;
+		}
+		bool const next_conflicts = i + 1 < block->range_count &&
+		                            block->ranges[i + 1].used &&
+		                            block->ranges[i + 1].linear != linear;
+		if (next_conflicts && align_up(start + size, granularity) > range_end) {
+			continue;
+		}
+
+		// split into leading padding, the allocation and the free remainder
+		uint32_t const new_ranges = (start > range.offset ? 1 : 0) + (start + size < range_end ? 1 : 0);
+		if (block->range_count + new_ranges > MAX_MEMORY_BLOCK_RANGES) {
+			return false;
+		}
+		memmove(&block->ranges[i + 1 + new_ranges],
+		        &block->ranges[i + 1],
+		        (block->range_count - i - 1) * sizeof(struct memory_range));
+		block->range_count += new_ranges;
+
+		uint32_t r = i;
+		if (start > range.offset) {
+			block->ranges[r++] = (struct memory_range){
+				.offset = range.offset,
+				.size   = start - range.offset,
+			};
+		}
+		block->ranges[r++] = (struct memory_range){
+			.offset = start,
+			.size   = size,
+			.used   = true,
+			.linear = linear,
+		};
+		if (start + size < range_end) {
+			block->ranges[r] = (struct memory_range){
+				.offset = start + size,
+				.size   = range_end - (start + size),
+			};
+		}
+
+		*offset = start;
+		return true;
+	}
+
+	return false;
+}
+
+bool allocate_memory(struct memory_arena *arena,
+                     VkMemoryRequirements const *memory_requirements,
+                     enum memory_usage usage,
+                     bool linear,
+                     struct memory_allocation *allocation) {
+	uint32_t memory_type_index;
+	if (!find_memory_type(&arena->memory_properties,
+	                      memory_requirements->memoryTypeBits,
+	                      usage,
+	                      &memory_type_index)) {
+		return false;
+	}
+
+	// flushes and invalidates work on whole atoms, so non coherent allocations never share one
+	VkMemoryPropertyFlags const memory_type_flags =
+		arena->memory_properties.memoryTypes[memory_type_index].propertyFlags;
+	VkDeviceSize size      = memory_requirements->size;
+	VkDeviceSize alignment = memory_requirements->alignment;
+	if ((memory_type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+	    !(memory_type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		size      = align_up(size, arena->non_coherent_atom_size);
+		alignment = alignment > arena->non_coherent_atom_size ? alignment : arena->non_coherent_atom_size;
+	}
+
+	// try the existing blocks of this memory type before allocating a new one
+	for (uint32_t i = 0; i <= arena->block_count; ++i) {
+		if (i == arena->block_count) {
+			if (arena->block_count == MAX_MEMORY_BLOCKS) {
+				return false;
+			}
+
+			VkDeviceSize const block_size = size > MEMORY_BLOCK_SIZE ? size : MEMORY_BLOCK_SIZE;
+
+			VkMemoryAllocateFlagsInfo memory_allocate_flags_info = {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+				.flags = arena->allocate_flags,
+			};
+			VkMemoryAllocateInfo memory_allocate_info = {
+				.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+				.pNext           = arena->allocate_flags ? &memory_allocate_flags_info : NULL,
+				.allocationSize  = block_size,
+				.memoryTypeIndex = memory_type_index,
+			};
+			struct memory_block *block = &arena->blocks[i];
+			if (vkAllocateMemory(arena->device, &memory_allocate_info, NULL, &block->memory) != VK_SUCCESS) {
+				return false;
+			}
+
+			// host visible blocks stay mapped, a memory object can only be mapped once
+			void *mapped = NULL;
+			if ((memory_type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+			    vkMapMemory(arena->device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+				vkFreeMemory(arena->device, block->memory, NULL);
+				return false;
+			}
+
+			block->memory_type_index = memory_type_index;
+			block->size              = block_size;
+			block->mapped            = mapped;
+			block->range_count       = 1;
+			block->ranges[0]         = (struct memory_range){ .offset = 0, .size = block_size };
+			arena->block_count      += 1;
+		}
+
+		struct memory_block *block = &arena->blocks[i];
+		VkDeviceSize offset;
+		if (block->memory_type_index != memory_type_index ||
+		    !allocate_from_block(block,
+		                         size,
+		                         alignment,
+		                         linear,
+		                         arena->buffer_image_granularity,
+		                         &offset)) {
+			continue;
+		}
+
+		*allocation = (struct memory_allocation){
+			.memory      = block->memory,
+			.offset      = offset,
+			.size        = size,
+			.block_index = i,
+			.mapped      = block->mapped ? block->mapped + offset : NULL,
+		};
+		return true;
+	}
+
+	return false;
+}
+
+void free_memory(struct memory_arena *arena, struct memory_allocation const *allocation) {
+	struct memory_block *block = &arena->blocks[allocation->block_index];
+
+	uint32_t i = 0;
+	while (i < block->range_count && block->ranges[i].offset != allocation->offset) {
+		i += 1;
+	}
+	if (i == block->range_count) {
+		return;
+	}
+	block->ranges[i].used   = false;
+	block->ranges[i].linear = false;
+
+	// merge with free neighbours so the free list does not fragment into slivers
+	if (i + 1 < block->range_count && !block->ranges[i + 1].used) {
+		block->ranges[i].size += block->ranges[i + 1].size;
+		memmove(&block->ranges[i + 1],
+		        &block->ranges[i + 2],
+		        (block->range_count - i - 2) * sizeof(struct memory_range));
+		block->range_count -= 1;
+	}
+	if (i > 0 && !block->ranges[i - 1].used) {
+		block->ranges[i - 1].size += block->ranges[i].size;
+		memmove(&block->ranges[i],
+		        &block->ranges[i + 1],
+		        (block->range_count - i - 1) * sizeof(struct memory_range));
+		block->range_count -= 1;
+	}
+}
+
+bool bind_buffer_memory(struct memory_arena *arena,
+                        VkBuffer buffer,
+                        enum memory_usage usage,
+                        struct memory_allocation *allocation) {
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(arena->device, buffer, &memory_requirements);
+
+	if (!allocate_memory(arena, &memory_requirements, usage, true, allocation)) {
+		return false;
+	}
+
+	return vkBindBufferMemory(arena->device, buffer, allocation->memory, allocation->offset) == VK_SUCCESS;
+}
+
+bool bind_image_memory(struct memory_arena *arena,
+                       VkImage image,
+                       VkImageTiling tiling,
+                       enum memory_usage usage,
+                       struct memory_allocation *allocation) {
+	VkMemoryRequirements memory_requirements;
+	vkGetImageMemoryRequirements(arena->device, image, &memory_requirements);
+
+	if (!allocate_memory(arena,
+	                     &memory_requirements,
+	                     usage,
+	                     tiling == VK_IMAGE_TILING_LINEAR,
+	                     allocation)) {
+		return false;
+	}
+
+	return vkBindImageMemory(arena->device, image, allocation->memory, allocation->offset) == VK_SUCCESS;
+}
+
+// the range to flush or invalidate for an allocation, false when its memory is coherent and needs neither
+bool get_non_coherent_range(struct memory_arena const *arena,
+                            struct memory_allocation const *allocation,
+                            VkMappedMemoryRange *mapped_memory_range) {
+	struct memory_block const *block = &arena->blocks[allocation->block_index];
+	if (arena->memory_properties.memoryTypes[block->memory_type_index].propertyFlags &
+	    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+		return false;
+	}
+
+	*mapped_memory_range = (VkMappedMemoryRange){
+		.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.memory = allocation->memory,
+		.offset = allocation->offset,
+		.size   = allocation->size,
+	};
+	return true;
+}
+
+// makes cpu writes visible to the gpu, call before the submit that reads them
+bool flush_memory(struct memory_arena const *arena, struct memory_allocation const *allocation) {
+	VkMappedMemoryRange mapped_memory_range;
+	if (!get_non_coherent_range(arena, allocation, &mapped_memory_range)) {
+		return true;
+	}
+	return vkFlushMappedMemoryRanges(arena->device, 1, &mapped_memory_range) == VK_SUCCESS;
+}
+
+// makes gpu writes visible to the cpu, call after waiting for the submit that wrote them
+bool invalidate_memory(struct memory_arena const *arena, struct memory_allocation const *allocation) {
+	VkMappedMemoryRange mapped_memory_range;
+	if (!get_non_coherent_range(arena, allocation, &mapped_memory_range)) {
+		return true;
+	}
+	return vkInvalidateMappedMemoryRanges(arena->device, 1, &mapped_memory_range) == VK_SUCCESS;
+}
+
+void report_memory_arena(struct memory_arena const *arena) {
+	// fragmentation is the share of free memory outside the largest free range
+	VkDeviceSize total_size = 0, used_size = 0, free_size = 0, largest_free_size = 0;
+	uint32_t allocation_count = 0;
+	for (uint32_t i = 0; i < arena->block_count; ++i) {
+		struct memory_block const *block = &arena->blocks[i];
+		total_size += block->size;
+		for (uint32_t j = 0; j < block->range_count; ++j) {
+			struct memory_range const *range = &block->ranges[j];
+			if (range->used) {
+				used_size        += range->size;
+				allocation_count += 1;
+			} else {
+				free_size += range->size;
+				if (range->size > largest_free_size) {
+					largest_free_size = range->size;
+				}
+			}
+		}
+	}
+	double const fragmentation = free_size > 0 ? 1.0 - (double)largest_free_size / free_size : 0.0;
+
+	printf("memory arena: %u blocks, %.1f KiB allocated, %.1f KiB used by %u resources, %.1f%% fragmented\n",
+	       arena->block_count,
+	       total_size / 1024.0,
+	       used_size / 1024.0,
+	       allocation_count,
+	       fragmentation * 100.0);
+}
+
+void destroy_memory_arena(struct memory_arena *arena) {
+	for (uint32_t i = 0; i < arena->block_count; ++i) {
+		if (arena->blocks[i].mapped) {
+			vkUnmapMemory(arena->device, arena->blocks[i].memory);
+		}
+		vkFreeMemory(arena->device, arena->blocks[i].memory, NULL);
+	}
+	arena->block_count = 0;
+}
+
+// application memory imported with VK_EXT_external_memory_host, so the readback copy writes
+// straight into it instead of into driver allocated memory
+struct imported_host_buffer {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	uint8_t *host_memory;
+};
+
+bool create_imported_host_buffer(VkDevice device,
+                                 VkPhysicalDeviceMemoryProperties const *memory_properties,
+                                 VkDeviceSize import_alignment,
+                                 VkDeviceSize size,
+                                 struct imported_host_buffer *imported) {
+	// the pointer and the allocation size must be multiples of the import alignment
+	VkDeviceSize const page_size       = sysconf(_SC_PAGESIZE);
+	VkDeviceSize const alignment       = import_alignment > page_size ? import_alignment : page_size;
+	VkDeviceSize const allocation_size = align_up(size, alignment);
+	*imported = (struct imported_host_buffer){
+		.host_memory = aligned_alloc(alignment, allocation_size),
+	};
+	if (!imported->host_memory) {
+		return false;
+	}
+
+	VkExternalMemoryBufferCreateInfo external_memory_buffer_create_info = {
+		.sType       = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+	};
+	VkBufferCreateInfo buffer_create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = &external_memory_buffer_create_info,
+		.size  = size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	};
+	if (vkCreateBuffer(device, &buffer_create_info, NULL, &imported->buffer) != VK_SUCCESS) {
+		free(imported->host_memory);
+		return false;
+	}
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(device, imported->buffer, &memory_requirements);
+
+	VkMemoryHostPointerPropertiesEXT host_pointer_properties = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+	};
+	bool imported_ok =
+		ext.vkGetMemoryHostPointerPropertiesEXT(device,
+		                                        VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+		                                        imported->host_memory,
+		                                        &host_pointer_properties) == VK_SUCCESS;
+
+	// imported memory is never mapped, so there is nothing to invalidate and it must be coherent
+	uint32_t memory_type_bits = host_pointer_properties.memoryTypeBits & memory_requirements.memoryTypeBits;
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		if (!(memory_properties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			memory_type_bits &= ~(1u << i);
+		}
+	}
+
+	uint32_t memory_type_index;
+	imported_ok = imported_ok &&
+	              find_memory_type(memory_properties, memory_type_bits, MEMORY_USAGE_READBACK, &memory_type_index);
+	if (imported_ok) {
+		VkImportMemoryHostPointerInfoEXT import_memory_host_pointer_info = {
+			.sType        = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+			.handleType   = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+			.pHostPointer = imported->host_memory,
+		};
+		VkMemoryAllocateInfo memory_allocate_info = {
+			.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext           = &import_memory_host_pointer_info,
+			.allocationSize  = allocation_size,
+			.memoryTypeIndex = memory_type_index,
+		};
+		imported_ok = vkAllocateMemory(device, &memory_allocate_info, NULL, &imported->memory) == VK_SUCCESS;
+		if (imported_ok && vkBindBufferMemory(device, imported->buffer, imported->memory, 0) != VK_SUCCESS) {
+			vkFreeMemory(device, imported->memory, NULL);
+			imported_ok = false;
+		}
+	}
+
+	if (!imported_ok) {
+		vkDestroyBuffer(device, imported->buffer, NULL);
+		free(imported->host_memory);
+		return false;
+	}
+
+	return true;
+}
+
+void destroy_imported_host_buffer(VkDevice device, struct imported_host_buffer *imported) {
+	vkDestroyBuffer(device, imported->buffer, NULL);
+
+	// the application memory has to outlive the device memory imported from it
+	vkFreeMemory(device, imported->memory, NULL);
+	free(imported->host_memory);
+}
+
+struct render_context {
+	uint16_t width_px;
+	uint16_t height_px;
+	VkInstance instance;
+	VkDebugUtilsMessengerEXT debug_messenger;
+	VkDevice device;
+	struct memory_arena arena;
+	VkQueue graphics_queue;
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	VkQueryPool query_pool;
+	uint64_t timestamp_mask;
+	float timestamp_period;
+	double trace_ms;
+	double copy_ms;
+	double bottom_level_build_ms;
+	double top_level_build_ms;
+	VkImage image;
+	struct memory_allocation image_allocation;
+	VkImageView image_view;
+	VkBuffer vertex_buffer;
+	struct memory_allocation vertex_buffer_allocation;
+	VkBuffer index_buffer;
+	struct memory_allocation index_buffer_allocation;
+	VkBuffer transform_matrix_buffer;
+	struct memory_allocation transform_matrix_buffer_allocation;
+	VkBuffer bottom_level_acceleration_structure_buffer;
+	struct memory_allocation bottom_level_acceleration_structure_buffer_allocation;
+	VkAccelerationStructureKHR bottom_level_acceleration_structure;
+	VkBuffer top_level_acceleration_structure_buffer;
+	struct memory_allocation top_level_acceleration_structure_buffer_allocation;
+	VkAccelerationStructureKHR top_level_acceleration_structure;
+	VkBuffer image_buffer;
+	struct memory_allocation image_buffer_allocation;
+	bool host_memory_imported;
+	struct imported_host_buffer imported_image_buffer;
+	uint8_t *image_buffer_mapped;
+	struct convert_kernel convert_kernel;
+	uint32_t convert_thread_count;
+	VkDescriptorSetLayout descriptor_set_layout;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline ray_tracing_pipeline;
+	VkBuffer shader_table_buffer;
+	struct memory_allocation shader_table_buffer_allocation;
+	VkDescriptorPool descriptor_pool;
+};
+
 void save_rgb8_image_to_ppm(char const *filename,
                             uint16_t width_px,
                             uint16_t height_px,
@@ -36,6 +771,47 @@ void save_rgb8_image_to_ppm(char const *filename,
 	fclose(file);
 }
 
+// a ppm file mapped for writing, the header is already in place and the texels follow it
+struct mapped_ppm {
+	uint8_t *mapping;
+	size_t size;
+	uint8_t *texels;
+};
+
+bool map_ppm_file(char const *filename, uint32_t width_px, uint32_t height_px, struct mapped_ppm *ppm) {
+	char header[32];
+	int const header_size = snprintf(header, sizeof(header), "P6 %u %u 255\n", width_px, height_px);
+	size_t const size = header_size + (size_t)width_px * height_px * 3;
+
+	// the file is sized up front, converted texels reach it through the page cache
+	int const fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		return false;
+	}
+	void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	memcpy(mapping, header, header_size);
+
+	*ppm = (struct mapped_ppm){
+		.mapping = mapping,
+		.size    = size,
+		.texels  = (uint8_t *)mapping + header_size,
+	};
+	return true;
+}
+
+bool unmap_ppm_file(struct mapped_ppm *ppm) {
+	// the kernel writes the dirty pages back, nothing is copied on the way out
+	return munmap(ppm->mapping, ppm->size) == 0;
+}
+
 char *load_binary_file(char const *filename, size_t *size) {
 	FILE *file = fopen(filename, "rb");
 	if (!file) {
@@ -54,68 +830,292 @@ char *load_binary_file(char const *filename, size_t *size) {
 	return buffer;
 }
 
+// full validation prints every warning and error as it arrives, the performance mode only collects
+// the performance warnings of the best practices checks and summarizes them at exit
+enum validation_mode {
+	VALIDATION_FULL,
+	VALIDATION_PERFORMANCE,
+	VALIDATION_OFF,
+};
+
+// VK_EXAMPLES_VALIDATION is full, performance or off, a release build defaults to off
+enum validation_mode get_validation_mode(void) {
+	char const *mode = getenv("VK_EXAMPLES_VALIDATION");
+	if (mode && strcmp(mode, "full") == 0) {
+		return VALIDATION_FULL;
+	}
+	if (mode && strcmp(mode, "performance") == 0) {
+		return VALIDATION_PERFORMANCE;
+	}
+	if (mode && strcmp(mode, "off") == 0) {
+		return VALIDATION_OFF;
+	}
+#ifdef VK_EXAMPLES_RELEASE
+	return VALIDATION_OFF;
+#else
+	return VALIDATION_FULL;
+#endif
+}
+
+// performance messages are counted by message id, only the text of the first one is kept
+#define MAX_PERFORMANCE_MESSAGES 64
+
+struct performance_message {
+	int32_t id;
+	char *id_name;
+	char *text;
+	uint32_t count;
+};
+
+struct {
+	struct performance_message messages[MAX_PERFORMANCE_MESSAGES];
+	uint32_t message_count;
+	uint32_t dropped_count; // occurrences of messages that no longer fit in the table
+	bool summary_registered;
+} performance_messages;
+
+void record_performance_message(VkDebugUtilsMessengerCallbackDataEXT const *callback_data) {
+	char const *id_name = callback_data->pMessageIdName ? callback_data->pMessageIdName : "";
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		if (message->id == callback_data->messageIdNumber && strcmp(message->id_name, id_name) == 0) {
+			message->count += 1;
+			return;
+		}
+	}
+	if (performance_messages.message_count == MAX_PERFORMANCE_MESSAGES) {
+		performance_messages.dropped_count += 1;
+		return;
+	}
+	performance_messages.messages[performance_messages.message_count++] = (struct performance_message){
+		.id      = callback_data->messageIdNumber,
+		.id_name = strdup(id_name),
+		.text    = strdup(callback_data->pMessage ? callback_data->pMessage : ""),
+		.count   = 1,
+	};
+}
+
+// registered with atexit, so messages reported while the instance is destroyed are counted too
+void report_performance_messages(void) {
+	uint32_t total_count = performance_messages.dropped_count;
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		total_count += performance_messages.messages[i].count;
+	}
+	fprintf(stderr,
+	        "performance warnings: %u, %u distinct\n",
+	        total_count,
+	        performance_messages.message_count);
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		fprintf(stderr, "%8u  %s: %s\n", message->count, message->id_name, message->text);
+		free(message->id_name);
+		free(message->text);
+	}
+	if (performance_messages.dropped_count > 0) {
+		fprintf(stderr, "%8u  messages beyond the first %d distinct ones\n",
+		        performance_messages.dropped_count,
+		        MAX_PERFORMANCE_MESSAGES);
+	}
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
 	VkDebugUtilsMessageTypeFlagsEXT message_type,
 	VkDebugUtilsMessengerCallbackDataEXT const *callback_data,
 	void *user_data) {
+	// the performance mode passes the table that collects its messages
+	if (user_data) {
+		record_performance_message(callback_data);
+		return VK_FALSE;
+	}
 	if (message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
 		fprintf(stderr, "validation layer: %s\n", callback_data->pMessage);
 	}
 	return VK_FALSE;
 }
 
-bool create_buffer(VkDevice device,
-                   uint32_t usable_memory_types,
+bool create_debug_messenger(VkInstance instance,
+                            enum validation_mode validation,
+                            VkDebugUtilsMessengerEXT *debug_messenger) {
+	// load extension functions
+	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
+	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
+
+	// setup debug messenger
+	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+		.pfnUserCallback = debug_callback,
+	};
+
+	// the performance mode collects performance messages only, the callback counts them instead of
+	// printing each one
+	if (validation == VALIDATION_PERFORMANCE) {
+		debug_messenger_create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		debug_messenger_create_info.pUserData   = &performance_messages;
+		if (!performance_messages.summary_registered) {
+			atexit(report_performance_messages);
+			performance_messages.summary_registered = true;
+		}
+	}
+
+	return ext.vkCreateDebugUtilsMessengerEXT(instance,
+	                                          &debug_messenger_create_info,
+	                                          NULL,
+	                                          debug_messenger) == VK_SUCCESS;
+}
+
+// copies initial buffer contents into device local memory through a host visible staging buffer, on
+// a dedicated transfer queue when the device has one
+struct staging_uploader {
+	VkDevice device;
+	struct memory_arena *arena;
+	VkQueue queue;
+	bool dedicated_queue;
+	uint32_t queue_family_indices[2];
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	VkBuffer staging_buffer;
+	struct memory_allocation staging_buffer_allocation;
+	uint8_t *staging_buffer_mapped;
+	VkDeviceSize staging_buffer_offset;
+	bool recording;
+	VkDeviceSize bytes_uploaded;
+	uint32_t submit_count;
+};
+
+bool flush_staging_uploads(struct staging_uploader *uploader) {
+	if (!uploader->recording) {
+		return true;
+	}
+
+	if (vkEndCommandBuffer(uploader->command_buffer) != VK_SUCCESS ||
+	    !flush_memory(uploader->arena, &uploader->staging_buffer_allocation)) {
+		return false;
+	}
+
+	VkSubmitInfo submit_info = {
+		.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers    = &uploader->command_buffer,
+	};
+	if (vkQueueSubmit(uploader->queue, 1, &submit_info, uploader->fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	// the staging buffer is reused by the next upload, so wait for the copies to finish
+	if (vkWaitForFences(uploader->device, 1, &uploader->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+		return false;
+	}
+
+	vkResetFences(uploader->device, 1, &uploader->fence);
+
+	uploader->recording             = false;
+	uploader->staging_buffer_offset = 0;
+	uploader->submit_count         += 1;
+
+	return true;
+}
+
+bool stage_buffer_upload(struct staging_uploader *uploader,
+                         VkBuffer buffer,
+                         VkDeviceSize size,
+                         void const *data) {
+	// data larger than the staging buffer is copied in chunks, flushing whenever it fills up
+	VkDeviceSize uploaded = 0;
+	while (uploaded < size) {
+		if (uploader->staging_buffer_offset == STAGING_BUFFER_SIZE) {
+			if (!flush_staging_uploads(uploader)) {
+				return false;
+			}
+		}
+
+		if (!uploader->recording) {
+			vkResetCommandBuffer(uploader->command_buffer, 0);
+
+			VkCommandBufferBeginInfo command_buffer_begin_info = {
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			};
+			if (vkBeginCommandBuffer(uploader->command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+				return false;
+			}
+			uploader->recording = true;
+		}
+
+		VkDeviceSize const space = STAGING_BUFFER_SIZE - uploader->staging_buffer_offset;
+		VkDeviceSize const chunk_size = size - uploaded < space ? size - uploaded : space;
+		memcpy(uploader->staging_buffer_mapped + uploader->staging_buffer_offset,
+		       (uint8_t const *)data + uploaded,
+		       chunk_size);
+
+		VkBufferCopy buffer_copy = {
+			.srcOffset = uploader->staging_buffer_offset,
+			.dstOffset = uploaded,
+			.size      = chunk_size,
+		};
+		vkCmdCopyBuffer(uploader->command_buffer, uploader->staging_buffer, buffer, 1, &buffer_copy);
+
+		uploader->staging_buffer_offset += chunk_size;
+		uploaded                        += chunk_size;
+	}
+
+	uploader->bytes_uploaded += size;
+
+	return true;
+}
+
+bool create_buffer(struct memory_arena *arena,
+                   enum memory_usage usage,
                    VkDeviceSize buffer_size,
                    VkBufferUsageFlags usage_flags,
                    VkBuffer *buffer,
-                   VkDeviceMemory *buffer_memory,
+                   struct memory_allocation *buffer_allocation,
                    VkDeviceAddress *device_address,
-                   void const *data) {
+                   void const *data,
+                   struct staging_uploader *uploader) {
 	VkBufferCreateInfo buffer_create_info = {
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size  = buffer_size,
-		.usage = usage_flags,
+		.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size        = buffer_size,
+		.usage       = usage_flags,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 	};
-	if (vkCreateBuffer(device, &buffer_create_info, NULL, buffer) != VK_SUCCESS) {
-		return false;
-	}
 
-	VkMemoryRequirements memory_requirements;
-	vkGetBufferMemoryRequirements(device, *buffer, &memory_requirements);
+	// initial data goes through the uploader when there is one, otherwise the memory must be mappable
+	bool const staged = data && uploader;
+	if (staged) {
+		buffer_create_info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-	uint32_t const memory_types_matching_requirements =
-		memory_requirements.memoryTypeBits & usable_memory_types;
-	if (memory_types_matching_requirements == 0) {
-		return false;
+		// written on the transfer queue and read on the graphics queue without an ownership transfer
+		if (uploader->dedicated_queue) {
+			buffer_create_info.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+			buffer_create_info.queueFamilyIndexCount = 2;
+			buffer_create_info.pQueueFamilyIndices   = uploader->queue_family_indices;
+		}
 	}
 
-	VkMemoryAllocateFlagsInfo memory_alloc_flags_info = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
-		.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR,
-	};
+	if (vkCreateBuffer(arena->device, &buffer_create_info, NULL, buffer) != VK_SUCCESS) {
+		return false;
+	}
 
-	VkMemoryAllocateInfo buffer_memory_allocate_info = {
-		.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.pNext           = &memory_alloc_flags_info,
-		.allocationSize  = memory_requirements.size,
-		.memoryTypeIndex = __builtin_ctz(memory_types_matching_requirements),
-	};
-	if (vkAllocateMemory(device, &buffer_memory_allocate_info, NULL, buffer_memory) != VK_SUCCESS) {
+	if (!bind_buffer_memory(arena, *buffer, usage, buffer_allocation)) {
 		return false;
 	}
 
-	if (data) {
-		void *mapped;
-		if (vkMapMemory(device, *buffer_memory, 0, buffer_size, 0, &mapped) != VK_SUCCESS) {
+	if (data && !staged) {
+		memcpy(buffer_allocation->mapped, data, buffer_size);
+		if (!flush_memory(arena, buffer_allocation)) {
 			return false;
 		}
-		memcpy(mapped, data, buffer_size);
-		vkUnmapMemory(device, *buffer_memory);
 	}
 
-	if (vkBindBufferMemory(device, *buffer, *buffer_memory, 0) != VK_SUCCESS) {
+	if (staged && !stage_buffer_upload(uploader, *buffer, buffer_size, data)) {
 		return false;
 	}
 
@@ -124,16 +1124,123 @@ bool create_buffer(VkDevice device,
 			.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
 			.buffer = *buffer,
 		};
-		*device_address = ext.vkGetBufferDeviceAddressKHR(device, &buffer_device_address_info);
+		*device_address = ext.vkGetBufferDeviceAddressKHR(arena->device, &buffer_device_address_info);
+	}
+
+	return true;
+}
+
+bool create_staging_uploader(struct staging_uploader *uploader,
+                             struct memory_arena *arena,
+                             uint32_t transfer_queue_index,
+                             uint32_t graphics_queue_index) {
+	VkDevice device = arena->device;
+	*uploader = (struct staging_uploader){
+		.device                  = device,
+		.arena                   = arena,
+		.dedicated_queue         = transfer_queue_index != graphics_queue_index,
+		.queue_family_indices[0] = transfer_queue_index,
+		.queue_family_indices[1] = graphics_queue_index,
+	};
+
+	vkGetDeviceQueue(device, transfer_queue_index, 0, &uploader->queue);
+
+	VkCommandPoolCreateInfo command_pool_create_info = {
+		.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+		                    VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = transfer_queue_index,
+	};
+	if (vkCreateCommandPool(device, &command_pool_create_info, NULL, &uploader->command_pool) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkCommandBufferAllocateInfo command_buffer_alloc_info = {
+		.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool        = uploader->command_pool,
+		.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	if (vkAllocateCommandBuffers(device, &command_buffer_alloc_info, &uploader->command_buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkFenceCreateInfo fence_create_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
+	if (vkCreateFence(device, &fence_create_info, NULL, &uploader->fence) != VK_SUCCESS) {
+		return false;
 	}
 
+	if (!create_buffer(arena,
+	                   MEMORY_USAGE_UPLOAD,
+	                   STAGING_BUFFER_SIZE,
+	                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                   &uploader->staging_buffer,
+	                   &uploader->staging_buffer_allocation,
+	                   NULL, NULL, NULL)) {
+		return false;
+	}
+	uploader->staging_buffer_mapped = uploader->staging_buffer_allocation.mapped;
+
 	return true;
 }
 
+void destroy_staging_uploader(struct staging_uploader *uploader) {
+	VkDevice device = uploader->device;
+	vkDestroyBuffer(device, uploader->staging_buffer, NULL);
+	free_memory(uploader->arena, &uploader->staging_buffer_allocation);
+	vkDestroyFence(device, uploader->fence, NULL);
+	vkDestroyCommandPool(device, uploader->command_pool, NULL);
+}
+
+// spir-v compiled by the makefile and embedded in the binary, so no shader files are read at startup
+uint32_t const rgen_spv[] =
+#include "rgen.spv.inc"
+;
+
+uint32_t const miss_spv[] =
+#include "miss.spv.inc"
+;
+
+uint32_t const hit_spv[] =
+#include "hit.spv.inc"
+;
+
+struct embedded_shader {
+	char const *filename;
+	uint32_t const *code;
+	size_t code_size;
+};
+
+struct embedded_shader const embedded_shaders[] = {
+	{ "rgen.spv", rgen_spv, sizeof(rgen_spv) },
+	{ "miss.spv", miss_spv, sizeof(miss_spv) },
+	{ "hit.spv", hit_spv,  sizeof(hit_spv) },
+};
+
 bool create_shader_module(VkDevice device, char const *filename, VkShaderModule *shader_module) {
-	size_t shader_code_size;
-	void *shader_code = load_binary_file(filename, &shader_code_size);
+	// a directory in VK_EXAMPLES_SHADER_DIR overrides the embedded shaders with its .spv files
+	char const *shader_dir = getenv("VK_EXAMPLES_SHADER_DIR");
+	void *file_code = NULL;
+	uint32_t const *shader_code = NULL;
+	size_t shader_code_size = 0;
+	if (shader_dir && shader_dir[0] != '\0') {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", shader_dir, filename);
+		file_code = load_binary_file(path, &shader_code_size);
+		shader_code = file_code;
+	} else {
+		for (size_t i = 0; i < sizeof(embedded_shaders) / sizeof(embedded_shaders[0]); ++i) {
+			if (strcmp(embedded_shaders[i].filename, filename) == 0) {
+				shader_code      = embedded_shaders[i].code;
+				shader_code_size = embedded_shaders[i].code_size;
+				break;
+			}
+		}
+	}
 	if (!shader_code) {
+		fprintf(stderr, "failed to load shader %s\n", filename);
 		return false;
 	}
 
@@ -144,11 +1251,237 @@ bool create_shader_module(VkDevice device, char const *filename, VkShaderModule
 	};
 
 	VkResult result = vkCreateShaderModule(device, &shader_module_create_info, NULL, shader_module);
-	free(shader_code);
+	free(file_code);
 	return result == VK_SUCCESS;
 }
 
-bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_px) {
+bool device_matches_override(char const *device_override,
+                             uint32_t device_index,
+                             char const *device_name) {
+	// no override means every device is a candidate
+	if (!device_override || device_override[0] == '\0') {
+		return true;
+	}
+
+	// a number selects a device by index, anything else is matched against the device name
+	char *end;
+	unsigned long override_index = strtoul(device_override, &end, 10);
+	if (*end == '\0') {
+		return override_index == device_index;
+	}
+	return strstr(device_name, device_override) != NULL;
+}
+
+uint64_t score_physical_device(VkPhysicalDevice physical_device,
+                               VkPhysicalDeviceType device_type,
+                               VkQueueFamilyProperties const *queue_family_properties) {
+	// device type matters most, cpu implementations such as lavapipe are the last resort
+	uint64_t type_score;
+	switch (device_type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   type_score = 4; break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type_score = 3; break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    type_score = 2; break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:            type_score = 1; break;
+		default:                                     type_score = 0; break;
+	}
+
+	// then a queue that can record timestamps
+	uint64_t queue_score = queue_family_properties->timestampValidBits > 0 ? 1 : 0;
+
+	// then the amount of device local memory
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+	uint64_t device_local_mib = 0;
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+		if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			device_local_mib += memory_properties.memoryHeaps[i].size >> 20;
+		}
+	}
+	if (device_local_mib >= (1ull << 39)) {
+		device_local_mib = (1ull << 39) - 1;
+	}
+
+	return (type_score << 40) | (queue_score << 39) | device_local_mib;
+}
+
+double timestamp_delta_ms(uint64_t begin,
+                          uint64_t end,
+                          uint64_t timestamp_mask,
+                          float timestamp_period) {
+	// only the valid bits take part, so the subtraction also handles wrap around
+	return ((end - begin) & timestamp_mask) * timestamp_period / 1000000.0;
+}
+
+bool device_supports_extension(VkPhysicalDevice physical_device, char const *extension_name) {
+	uint32_t extension_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, NULL);
+	VkExtensionProperties extensions[extension_count];
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, extensions);
+	for (uint32_t i = 0; i < extension_count; ++i) {
+		if (strcmp(extension_name, extensions[i].extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void get_pipeline_cache_filename(VkPhysicalDeviceProperties const *device_properties,
+                                 char *filename,
+                                 size_t filename_size) {
+	// cache data is only valid for the device and driver version that produced it
+	char uuid[2 * VK_UUID_SIZE + 1];
+	for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+		sprintf(&uuid[2 * i], "%02x", device_properties->pipelineCacheUUID[i]);
+	}
+	snprintf(filename, filename_size, "pipeline-cache-%s-%08x.bin", uuid, device_properties->driverVersion);
+}
+
+bool save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, char const *filename) {
+	size_t data_size = 0;
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, NULL) != VK_SUCCESS) {
+		return false;
+	}
+
+	void *data = malloc(data_size);
+	if (!data) {
+		return false;
+	}
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, data) != VK_SUCCESS) {
+		free(data);
+		return false;
+	}
+
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		free(data);
+		return false;
+	}
+	size_t written = fwrite(data, 1, data_size, file);
+	fclose(file);
+	free(data);
+
+	return written == data_size;
+}
+
+void report_pipeline_creation(double creation_ms,
+                              size_t initial_cache_size,
+                              VkPipelineCreationFeedbackEXT const *feedback) {
+	printf("pipeline creation: %.3f ms (%s start", creation_ms, initial_cache_size > 0 ? "warm" : "cold");
+	if (feedback && (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+		bool const cache_hit =
+			feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+		printf(", driver reports %.3f ms, cache %s", feedback->duration / 1000000.0, cache_hit ? "hit" : "miss");
+	}
+	printf(")\n");
+}
+
+double get_time_ms(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+// startup phases, each timed with the monotonic clock the first time it runs, reported when
+// VK_EXAMPLES_PROFILE names the json file to write them to
+#define MAX_PROFILE_SPANS 32
+
+struct profile_span {
+	char const *name;
+	double start_ms;
+	double duration_ms;
+};
+
+struct {
+	struct profile_span spans[MAX_PROFILE_SPANS];
+	uint32_t span_count;
+	double origin_ms;
+} startup_profile;
+
+bool startup_profile_enabled(void) {
+	char const *json_filename = getenv("VK_EXAMPLES_PROFILE");
+	return json_filename && json_filename[0] != '\0';
+}
+
+// returns UINT32_MAX for a phase that already ran, ending that span is a no-op
+uint32_t begin_profile_span(char const *name) {
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		if (strcmp(startup_profile.spans[i].name, name) == 0) {
+			return UINT32_MAX;
+		}
+	}
+	if (startup_profile.span_count == MAX_PROFILE_SPANS) {
+		return UINT32_MAX;
+	}
+	double const now_ms = get_time_ms();
+	if (startup_profile.span_count == 0) {
+		startup_profile.origin_ms = now_ms;
+	}
+	startup_profile.spans[startup_profile.span_count] = (struct profile_span){
+		.name     = name,
+		.start_ms = now_ms - startup_profile.origin_ms,
+	};
+	return startup_profile.span_count++;
+}
+
+void end_profile_span(uint32_t span) {
+	if (span < startup_profile.span_count) {
+		struct profile_span *profile_span = &startup_profile.spans[span];
+		profile_span->duration_ms = get_time_ms() - startup_profile.origin_ms - profile_span->start_ms;
+	}
+}
+
+// the instance is created with the validation layer, the same instance without it is created once
+// more to show what the layer costs, after the loader has already been initialized by the first
+void profile_instance_without_validation(VkInstanceCreateInfo const *instance_create_info) {
+	if (!startup_profile_enabled() || instance_create_info->enabledLayerCount == 0) {
+		return;
+	}
+	VkInstanceCreateInfo create_info = *instance_create_info;
+	create_info.enabledLayerCount   = 0;
+	create_info.ppEnabledLayerNames = NULL;
+
+	VkInstance instance;
+	uint32_t const span = begin_profile_span("instance without validation");
+	VkResult const result = vkCreateInstance(&create_info, NULL, &instance);
+	end_profile_span(span);
+	if (result == VK_SUCCESS) {
+		vkDestroyInstance(instance, NULL);
+	}
+}
+
+// prints the phases as a table and writes them as json, start times are relative to the first phase
+bool report_startup_profile(void) {
+	if (!startup_profile_enabled() || startup_profile.span_count == 0) {
+		return true;
+	}
+	printf("%-28s %10s %10s\n", "phase", "start ms", "ms");
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		printf("%-28s %10.3f %10.3f\n", span->name, span->start_ms, span->duration_ms);
+	}
+
+	FILE *file = fopen(getenv("VK_EXAMPLES_PROFILE"), "w");
+	if (!file) {
+		return false;
+	}
+	fputs("{\n  \"phases\": [\n", file);
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		fprintf(file,
+		        "    { \"name\": \"%s\", \"start_ms\": %.3f, \"duration_ms\": %.3f }%s\n",
+		        span->name,
+		        span->start_ms,
+		        span->duration_ms,
+		        i + 1 < startup_profile.span_count ? "," : "");
+	}
+	fputs("  ]\n}\n", file);
+	return fclose(file) == 0;
+}
+
+bool create_render_context(struct render_context *context,
+                           uint16_t width_px,
+                           uint16_t height_px,
+                           bool import_host_memory) {
 	// create vulkan instance
 	VkApplicationInfo app_info = {
 		.sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO,
@@ -162,23 +1495,34 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	char const *extension_names[] = { VK_EXT_DEBUG_UTILS_EXTENSION_NAME };
 	char const *validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
 
+	// validation is off in release mode, the performance mode adds the best practices checks
+	enum validation_mode const validation = get_validation_mode();
+	VkValidationFeatureEnableEXT const best_practices = VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT;
+	VkValidationFeaturesEXT validation_features = {
+		.sType                         = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT,
+		.enabledValidationFeatureCount = 1,
+		.pEnabledValidationFeatures    = &best_practices,
+	};
+
 	VkInstanceCreateInfo instance_create_info = {
 		.sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pNext                   = validation == VALIDATION_PERFORMANCE ? &validation_features : NULL,
 		.pApplicationInfo        = &app_info,
-		.enabledLayerCount       = 1,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
 		.ppEnabledLayerNames     = validation_layers,
-		.enabledExtensionCount   = 1,
+		.enabledExtensionCount   = validation != VALIDATION_OFF ? 1 : 0,
 		.ppEnabledExtensionNames = extension_names,
 	};
 
+	uint32_t const instance_span = begin_profile_span("instance");
 	VkInstance instance;
 	if (vkCreateInstance(&instance_create_info, NULL, &instance) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(instance_span);
+	profile_instance_without_validation(&instance_create_info);
 
 	// load extension functions
-	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
-	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
 	LOAD_EXTENSION_FUNC(vkGetBufferDeviceAddressKHR);
 	LOAD_EXTENSION_FUNC(vkCreateAccelerationStructureKHR);
 	LOAD_EXTENSION_FUNC(vkDestroyAccelerationStructureKHR);
@@ -189,27 +1533,16 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	LOAD_EXTENSION_FUNC(vkGetRayTracingShaderGroupHandlesKHR);
 	LOAD_EXTENSION_FUNC(vkCreateRayTracingPipelinesKHR);
 
-	// setup debug messenger
-	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
-		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
-		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-		.pfnUserCallback = debug_callback,
-	};
-
-	VkDebugUtilsMessengerEXT debug_messenger;
-	if (ext.vkCreateDebugUtilsMessengerEXT(instance,
-                                           &debug_messenger_create_info,
-                                           NULL,
-                                           &debug_messenger) != VK_SUCCESS) {
+	// setup debug messenger, unless validation is off
+	uint32_t const debug_messenger_span = begin_profile_span("debug messenger");
+	VkDebugUtilsMessengerEXT debug_messenger = VK_NULL_HANDLE;
+	if (validation != VALIDATION_OFF && !create_debug_messenger(instance, validation, &debug_messenger)) {
 		return false;
 	}
+	end_profile_span(debug_messenger_span);
 
 	// select physical device
+	uint32_t const device_enumeration_span = begin_profile_span("device enumeration");
 	uint32_t physical_device_count = 0;
 	vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL);
 	if (physical_device_count == 0) {
@@ -230,13 +1563,18 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME
 	};
 
+	// an index or part of a device name in VK_EXAMPLES_DEVICE overrides the automatic choice
+	char const *device_override = getenv("VK_EXAMPLES_DEVICE");
+
 	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
-	uint32_t graphics_queue_index;
+	uint32_t graphics_queue_index, transfer_queue_index;
+	uint32_t timestamp_valid_bits;
+	float timestamp_period;
+	uint64_t best_device_score = 0;
 	for (uint32_t i = 0; i < physical_device_count; ++i) {
 		VkPhysicalDeviceProperties device_properties;
 		vkGetPhysicalDeviceProperties(physical_devices[i], &device_properties);
-		if (device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-		    device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
+		if (!device_matches_override(device_override, i, device_properties.deviceName)) {
 			continue;
 		}
 
@@ -263,25 +1601,70 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i],
 		                                         &queue_family_count,
 		                                         queue_family_properties);
-		graphics_queue_index = UINT32_MAX;
+		uint32_t candidate_graphics_queue_index = UINT32_MAX;
 		for (uint32_t j = 0; j < queue_family_count; ++j) {
 			if (queue_family_properties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				graphics_queue_index = j;
+				candidate_graphics_queue_index = j;
+				break;
+			}
+		}
+		if (candidate_graphics_queue_index == UINT32_MAX) {
+			continue;
+		}
+
+		// a family with transfer but no graphics or compute support is usually a dedicated copy engine,
+		// without one uploads go through the graphics queue
+		uint32_t candidate_transfer_queue_index = candidate_graphics_queue_index;
+		for (uint32_t j = 0; j < queue_family_count; ++j) {
+			VkQueueFlags const queue_flags = queue_family_properties[j].queueFlags;
+			if ((queue_flags & VK_QUEUE_TRANSFER_BIT) &&
+			    !(queue_flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				candidate_transfer_queue_index = j;
 				break;
 			}
 		}
-		if (graphics_queue_index == UINT32_MAX) {
+
+		// keep the highest scoring device that meets all requirements
+		uint64_t device_score =
+			score_physical_device(physical_devices[i],
+			                      device_properties.deviceType,
+			                      &queue_family_properties[candidate_graphics_queue_index]);
+		if (physical_device != VK_NULL_HANDLE && device_score <= best_device_score) {
 			continue;
 		}
 
-		physical_device = physical_devices[i];
-		break;
+		physical_device      = physical_devices[i];
+		best_device_score    = device_score;
+		graphics_queue_index = candidate_graphics_queue_index;
+		transfer_queue_index = candidate_transfer_queue_index;
+		timestamp_valid_bits = queue_family_properties[candidate_graphics_queue_index].timestampValidBits;
+		timestamp_period     = device_properties.limits.timestampPeriod;
 	}
 
 	if (physical_device == VK_NULL_HANDLE) {
 		return false;
 	}
 
+	// pipeline creation feedback is optional and only used to report pipeline cache hits
+	bool const creation_feedback_supported =
+		device_supports_extension(physical_device, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	char const *device_extensions[NUM_REQUIRED_EXTENSIONS + 2];
+	memcpy(device_extensions, required_extensions, sizeof(required_extensions));
+	uint32_t device_extension_count = NUM_REQUIRED_EXTENSIONS;
+	if (creation_feedback_supported) {
+		device_extensions[device_extension_count++] = VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME;
+	}
+
+	// importing the readback memory is optional, without the extension the copy goes to mapped memory
+	bool const host_memory_import_supported =
+		import_host_memory &&
+		device_supports_extension(physical_device, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+	if (host_memory_import_supported) {
+		device_extensions[device_extension_count++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+	} else if (import_host_memory) {
+		fputs("VK_EXT_external_memory_host is not supported, reading back through mapped memory\n", stderr);
+	}
+
 	// create device
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR ray_tracing_pipeline_properties = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR,
@@ -293,11 +1676,19 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	vkGetPhysicalDeviceProperties2(physical_device, &device_properties);
 
 	float const queue_priority = 1.0f;
-	VkDeviceQueueCreateInfo device_queue_create_info = {
-		.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-		.queueFamilyIndex = graphics_queue_index,
-		.queueCount       = 1,
-		.pQueuePriorities = &queue_priority,
+	VkDeviceQueueCreateInfo device_queue_create_infos[2] = {
+		{
+			.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = graphics_queue_index,
+			.queueCount       = 1,
+			.pQueuePriorities = &queue_priority,
+		},
+		{
+			.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = transfer_queue_index,
+			.queueCount       = 1,
+			.pQueuePriorities = &queue_priority,
+		}
 	};
 
 	VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address_features = {
@@ -325,38 +1716,40 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	VkDeviceCreateInfo device_create_info = {
 		.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
 		.pNext                   = (void*)&device_features,
-		.queueCreateInfoCount    = 1,
-		.pQueueCreateInfos       = &device_queue_create_info,
-		.enabledExtensionCount   = NUM_REQUIRED_EXTENSIONS,
-		.ppEnabledExtensionNames = required_extensions,
-		.enabledLayerCount       = 1,
+		.queueCreateInfoCount    = transfer_queue_index == graphics_queue_index ? 1 : 2,
+		.pQueueCreateInfos       = device_queue_create_infos,
+		.enabledExtensionCount   = device_extension_count,
+		.ppEnabledExtensionNames = device_extensions,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
 		.ppEnabledLayerNames     = validation_layers,
 	};
 
+	end_profile_span(device_enumeration_span);
+	uint32_t const device_span = begin_profile_span("device");
 	VkDevice device;
 	if (vkCreateDevice(physical_device, &device_create_info, NULL, &device) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(device_span);
 
-	// find host coherent memory types
-	VkPhysicalDeviceMemoryProperties memory_properties;
-	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
-	
-	uint32_t host_coherent_memory_types = 0;
-	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
-		if ((memory_properties.memoryTypes[i].propertyFlags &
-			 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
-			(memory_properties.memoryTypes[i].propertyFlags &
-			 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
-			) {
-			host_coherent_memory_types |= 1 << i;
-		}
-	}
+	// create arena that buffers and images are sub-allocated from
+	uint32_t const allocation_span = begin_profile_span("allocation");
+	struct memory_arena arena;
+	init_memory_arena(&arena, physical_device, device, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
 
 	// get graphics queue from device
 	VkQueue graphics_queue;
 	vkGetDeviceQueue(device, graphics_queue_index, 0, &graphics_queue);
 
+	// create uploader for the initial contents of device local buffers
+	struct staging_uploader uploader;
+	if (!create_staging_uploader(&uploader,
+	                             &arena,
+	                             transfer_queue_index,
+	                             graphics_queue_index)) {
+		return false;
+	}
+
 	// create command pool
 	VkCommandPoolCreateInfo command_pool_create_info = {
 		.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -390,6 +1783,22 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		return false;
 	}
 
+	// create timestamp query pool
+	VkQueryPoolCreateInfo query_pool_create_info = {
+		.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType  = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = TIMESTAMP_COUNT,
+	};
+
+	VkQueryPool query_pool;
+	if (vkCreateQueryPool(device, &query_pool_create_info, NULL, &query_pool) != VK_SUCCESS) {
+		return false;
+	}
+
+	// a queue without valid timestamp bits cannot write timestamps, so timing is skipped
+	uint64_t const timestamp_mask =
+		timestamp_valid_bits >= 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+
 	// create image
 	VkImageCreateInfo image_create_info = {
 		.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -412,25 +1821,12 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		return false;
 	}
 
-	VkMemoryRequirements memory_requirements;
-	vkGetImageMemoryRequirements(device, image, &memory_requirements);
-
-	uint32_t usable_memory_bits = memory_requirements.memoryTypeBits & host_coherent_memory_types;
-	if (usable_memory_bits == 0) {
-		return false;
-	}
-
-	VkMemoryAllocateInfo memory_alloc_info = {
-		.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize  = memory_requirements.size,
-		.memoryTypeIndex = __builtin_ctz(usable_memory_bits),
-	};
-	VkDeviceMemory image_memory;
-	if (vkAllocateMemory(device, &memory_alloc_info, NULL, &image_memory) != VK_SUCCESS) {
-		return false;
-	}
-
-	if (vkBindImageMemory(device, image, image_memory, 0) != VK_SUCCESS) {
+	struct memory_allocation image_allocation;
+	if (!bind_image_memory(&arena,
+	                       image,
+	                       VK_IMAGE_TILING_OPTIMAL,
+	                       MEMORY_USAGE_GPU_ONLY,
+	                       &image_allocation)) {
 		return false;
 	}
 
@@ -465,17 +1861,18 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	};
 
 	VkBuffer vertex_buffer;
-	VkDeviceMemory vertex_buffer_memory;
+	struct memory_allocation vertex_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR vertex_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   sizeof(vertices),
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &vertex_buffer,
-	                   &vertex_buffer_memory,
+	                   &vertex_buffer_allocation,
 	                   &vertex_buffer_device_address.deviceAddress,
-	                   vertices)) {
+	                   vertices,
+	                   &uploader)) {
 		return false;
 	}
 
@@ -483,17 +1880,18 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	uint32_t const indices[] = { 0, 1, 2 };
 
 	VkBuffer index_buffer;
-	VkDeviceMemory index_buffer_memory;
+	struct memory_allocation index_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR index_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   sizeof(indices),
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &index_buffer,
-	                   &index_buffer_memory,
+	                   &index_buffer_allocation,
 	                   &index_buffer_device_address.deviceAddress,
-	                   indices)) {
+	                   indices,
+	                   &uploader)) {
 		return false;
 	}
 
@@ -505,21 +1903,24 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	};
 
 	VkBuffer transform_matrix_buffer;
-	VkDeviceMemory transform_matrix_buffer_memory;
+	struct memory_allocation transform_matrix_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR transform_matrix_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   sizeof(transform_matrix),
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &transform_matrix_buffer,
-	                   &transform_matrix_buffer_memory,
+	                   &transform_matrix_buffer_allocation,
 	                   &transform_matrix_buffer_device_address.deviceAddress,
-	                   &transform_matrix)) {
+	                   &transform_matrix,
+	                   &uploader)) {
 		return false;
 	}
+	end_profile_span(allocation_span);
 
 	// create bottom level acceleration structure buffer
+	uint32_t const acceleration_structure_span = begin_profile_span("acceleration structures");
 	VkAccelerationStructureGeometryKHR bottom_level_acceleration_structure_geometry = {
 		.sType                            = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
 		.flags                            = VK_GEOMETRY_OPAQUE_BIT_KHR,
@@ -557,15 +1958,15 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	);
 
 	VkBuffer bottom_level_acceleration_structure_buffer;
-	VkDeviceMemory bottom_level_acceleration_structure_buffer_memory;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	struct memory_allocation bottom_level_acceleration_structure_buffer_allocation;
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   acceleration_structure_build_sizes_info.accelerationStructureSize,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
 	                   &bottom_level_acceleration_structure_buffer,
-	                   &bottom_level_acceleration_structure_buffer_memory,
-	                   NULL, NULL)) {
+	                   &bottom_level_acceleration_structure_buffer_allocation,
+	                   NULL, NULL, NULL)) {
 		return false;
 	}
 
@@ -586,17 +1987,17 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	}
 
 	VkBuffer scratch_buffer;
-	VkDeviceMemory scratch_buffer_memory;
+	struct memory_allocation scratch_buffer_allocation;
 	VkDeviceOrHostAddressKHR scratch_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   acceleration_structure_build_sizes_info.buildScratchSize,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 	                   &scratch_buffer,
-	                   &scratch_buffer_memory,
+	                   &scratch_buffer_allocation,
 	                   &scratch_buffer_device_address.deviceAddress,
-	                   NULL)) {
+	                   NULL, NULL)) {
 		return false;
 	}
 
@@ -613,6 +2014,11 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		&bottom_level_acceleration_structure_build_range_info,
 	};
 
+	// the build reads the vertex, index and transform buffers, so their uploads must have finished
+	if (!flush_staging_uploads(&uploader)) {
+		return false;
+	}
+
 	vkResetCommandBuffer(command_buffer, 0);
 
 	VkCommandBufferBeginInfo command_buffer_begin_info = {
@@ -622,6 +2028,14 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		return false;
 	}
 
+	if (timestamp_mask != 0) {
+		vkCmdResetQueryPool(command_buffer, query_pool, TIMESTAMP_BUILD_BEGIN, 2);
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_BUILD_BEGIN);
+	}
+
 	ext.vkCmdBuildAccelerationStructuresKHR(
 		command_buffer,
 		1,
@@ -629,6 +2043,13 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		bottom_level_acceleration_structure_build_range_infos
 	);
 
+	if (timestamp_mask != 0) {
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_BUILD_END);
+	}
+
 	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
 		return false;
 	}
@@ -648,6 +2069,22 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 
 	vkResetFences(device, 1, &fence);
 
+	double bottom_level_build_ms = 0.0;
+	if (timestamp_mask != 0) {
+		uint64_t timestamps[2];
+		if (vkGetQueryPoolResults(device,
+		                          query_pool,
+		                          TIMESTAMP_BUILD_BEGIN,
+		                          2,
+		                          sizeof(timestamps),
+		                          timestamps,
+		                          sizeof(uint64_t),
+		                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+			return false;
+		}
+		bottom_level_build_ms = timestamp_delta_ms(timestamps[0], timestamps[1], timestamp_mask, timestamp_period);
+	}
+
 	VkAccelerationStructureDeviceAddressInfoKHR bottom_level_acceleration_device_address_info = {
 		.sType                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
 		.accelerationStructure = bottom_level_acceleration_structure,
@@ -655,7 +2092,7 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	uint64_t const bottom_level_acceleration_structure_buffer_device_address =
 		ext.vkGetAccelerationStructureDeviceAddressKHR(device, &bottom_level_acceleration_device_address_info);
 
-	vkFreeMemory(device, scratch_buffer_memory, NULL);
+	free_memory(&arena, &scratch_buffer_allocation);
 	vkDestroyBuffer(device, scratch_buffer, NULL);
 
 	// create top level acceleration structure buffer
@@ -669,17 +2106,18 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	};
 
 	VkBuffer acceleration_structure_instance_buffer;
-	VkDeviceMemory acceleration_structure_instance_buffer_memory;
+	struct memory_allocation acceleration_structure_instance_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR acceleration_structure_instance_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   sizeof(acceleration_structure_instance),
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &acceleration_structure_instance_buffer,
-	                   &acceleration_structure_instance_buffer_memory,
+	                   &acceleration_structure_instance_buffer_allocation,
 	                   &acceleration_structure_instance_buffer_device_address.deviceAddress,
-	                   &acceleration_structure_instance)) {
+	                   &acceleration_structure_instance,
+	                   &uploader)) {
 		return false;
 	}
 
@@ -712,15 +2150,15 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	);
 
 	VkBuffer top_level_acceleration_structure_buffer;
-	VkDeviceMemory top_level_acceleration_structure_buffer_memory;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	struct memory_allocation top_level_acceleration_structure_buffer_allocation;
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   acceleration_structure_build_sizes_info.accelerationStructureSize,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
 	                   &top_level_acceleration_structure_buffer,
-	                   &top_level_acceleration_structure_buffer_memory,
-	                   NULL, NULL)) {
+	                   &top_level_acceleration_structure_buffer_allocation,
+	                   NULL, NULL, NULL)) {
 		return false;
 	}
 
@@ -740,15 +2178,15 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		return false;
 	}
 
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   acceleration_structure_build_sizes_info.buildScratchSize,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 	                   &scratch_buffer,
-	                   &scratch_buffer_memory,
+	                   &scratch_buffer_allocation,
 	                   &scratch_buffer_device_address.deviceAddress,
-	                   NULL)) {
+	                   NULL, NULL)) {
 		return false;
 	}
 
@@ -765,12 +2203,25 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		&top_level_acceleration_structure_build_range_info,
 	};
 
+	// the build reads the instance buffer, so its upload must have finished
+	if (!flush_staging_uploads(&uploader)) {
+		return false;
+	}
+
 	vkResetCommandBuffer(command_buffer, 0);
 
 	if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
 		return false;
 	}
 
+	if (timestamp_mask != 0) {
+		vkCmdResetQueryPool(command_buffer, query_pool, TIMESTAMP_BUILD_BEGIN, 2);
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_BUILD_BEGIN);
+	}
+
 	ext.vkCmdBuildAccelerationStructuresKHR(
 		command_buffer,
 		1,
@@ -778,6 +2229,13 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		top_level_acceleration_structure_build_range_infos
 	);
 
+	if (timestamp_mask != 0) {
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_BUILD_END);
+	}
+
 	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
 		return false;
 	}
@@ -792,24 +2250,66 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 
 	vkResetFences(device, 1, &fence);
 
-	vkFreeMemory(device, scratch_buffer_memory, NULL);
+	double top_level_build_ms = 0.0;
+	if (timestamp_mask != 0) {
+		uint64_t timestamps[2];
+		if (vkGetQueryPoolResults(device,
+		                          query_pool,
+		                          TIMESTAMP_BUILD_BEGIN,
+		                          2,
+		                          sizeof(timestamps),
+		                          timestamps,
+		                          sizeof(uint64_t),
+		                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+			return false;
+		}
+		top_level_build_ms = timestamp_delta_ms(timestamps[0], timestamps[1], timestamp_mask, timestamp_period);
+	}
+
+	free_memory(&arena, &scratch_buffer_allocation);
 	vkDestroyBuffer(device, scratch_buffer, NULL);
 
-	vkFreeMemory(device, acceleration_structure_instance_buffer_memory, NULL);
+	free_memory(&arena, &acceleration_structure_instance_buffer_allocation);
 	vkDestroyBuffer(device, acceleration_structure_instance_buffer, NULL);
+	end_profile_span(acceleration_structure_span);
 
-	// create destination buffer for image data
+	// create destination buffer for image data, in imported application memory when possible
 	uint32_t const image_buffer_size = width_px * height_px * 4;
 
-	VkBuffer image_buffer;
-	VkDeviceMemory image_buffer_memory;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
-	                   image_buffer_size,
-	                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-	                   &image_buffer,
-	                   &image_buffer_memory,
-	                   NULL, NULL)) {
+	struct imported_host_buffer imported_image_buffer = {0};
+	bool host_memory_imported = false;
+	if (host_memory_import_supported) {
+		LOAD_EXTENSION_FUNC(vkGetMemoryHostPointerPropertiesEXT);
+
+		VkPhysicalDeviceExternalMemoryHostPropertiesEXT external_memory_host_properties = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+		};
+		VkPhysicalDeviceProperties2 physical_device_properties2 = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &external_memory_host_properties,
+		};
+		vkGetPhysicalDeviceProperties2(physical_device, &physical_device_properties2);
+
+		host_memory_imported =
+			create_imported_host_buffer(device,
+			                            &arena.memory_properties,
+			                            external_memory_host_properties.minImportedHostPointerAlignment,
+			                            image_buffer_size,
+			                            &imported_image_buffer);
+		if (!host_memory_imported) {
+			fputs("host memory import failed, reading back through mapped memory\n", stderr);
+		}
+	}
+
+	VkBuffer image_buffer = imported_image_buffer.buffer;
+	struct memory_allocation image_buffer_allocation = {0};
+	if (!host_memory_imported && !create_buffer(&arena,
+	                                            MEMORY_USAGE_READBACK,
+	                                            image_buffer_size,
+	                                            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                                            &image_buffer,
+	                                            &image_buffer_allocation,
+	                                            NULL, NULL, NULL)) {
 		return false;
 	}
 
@@ -855,14 +2355,22 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	}
 
 	// create shader modules
+	uint32_t const shader_span = begin_profile_span("shader load");
 	VkShaderModule rgen_shader_module;
-	create_shader_module(device, "rgen.spv", &rgen_shader_module);
+	if (!create_shader_module(device, "rgen.spv", &rgen_shader_module)) {
+		return false;
+	}
 
 	VkShaderModule miss_shader_module;
-	create_shader_module(device, "miss.spv", &miss_shader_module);
+	if (!create_shader_module(device, "miss.spv", &miss_shader_module)) {
+		return false;
+	}
 	
 	VkShaderModule hit_shader_module;
-	create_shader_module(device, "hit.spv", &hit_shader_module);
+	if (!create_shader_module(device, "hit.spv", &hit_shader_module)) {
+		return false;
+	}
+	end_profile_span(shader_span);
 
 	// create ray tracing pipeline
 	VkPipelineShaderStageCreateInfo shader_stage_create_infos[3] = {
@@ -923,15 +2431,63 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		.layout                       = pipeline_layout,
 	};
 
+	// load the pipeline cache left behind by an earlier run on the same device and driver
+	uint32_t const pipeline_span = begin_profile_span("pipeline creation");
+	char pipeline_cache_filename[64];
+	get_pipeline_cache_filename(&device_properties.properties,
+	                            pipeline_cache_filename,
+	                            sizeof(pipeline_cache_filename));
+
+	size_t pipeline_cache_data_size = 0;
+	void *pipeline_cache_data = load_binary_file(pipeline_cache_filename, &pipeline_cache_data_size);
+	VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = pipeline_cache_data_size,
+		.pInitialData    = pipeline_cache_data,
+	};
+
+	VkPipelineCache pipeline_cache;
+	VkResult pipeline_cache_result =
+		vkCreatePipelineCache(device, &pipeline_cache_create_info, NULL, &pipeline_cache);
+	free(pipeline_cache_data);
+	if (pipeline_cache_result != VK_SUCCESS) {
+		return false;
+	}
+
+	// let the driver report whether the cache was hit
+	VkPipelineCreationFeedbackEXT pipeline_creation_feedback = {0};
+	VkPipelineCreationFeedbackEXT stage_creation_feedbacks[3];
+	VkPipelineCreationFeedbackCreateInfoEXT pipeline_creation_feedback_create_info = {
+		.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+		.pPipelineCreationFeedback          = &pipeline_creation_feedback,
+		.pipelineStageCreationFeedbackCount = 3,
+		.pPipelineStageCreationFeedbacks    = stage_creation_feedbacks,
+	};
+	if (creation_feedback_supported) {
+		ray_tracing_pipeline_create_info.pNext = &pipeline_creation_feedback_create_info;
+	}
+
 	VkPipeline ray_tracing_pipeline;
+	double const pipeline_creation_start_ms = get_time_ms();
 	if (ext.vkCreateRayTracingPipelinesKHR(device,
-	                                       VK_NULL_HANDLE, VK_NULL_HANDLE,
+	                                       VK_NULL_HANDLE, pipeline_cache,
 	                                       1,
 	                                       &ray_tracing_pipeline_create_info,
 	                                       NULL,
 	                                       &ray_tracing_pipeline) != VK_SUCCESS) {
 		return false;
 	}
+	double const pipeline_creation_ms = get_time_ms() - pipeline_creation_start_ms;
+	report_pipeline_creation(pipeline_creation_ms,
+	                         pipeline_cache_data_size,
+	                         creation_feedback_supported ? &pipeline_creation_feedback : NULL);
+
+	// write the cache back so the next run starts warm
+	if (!save_pipeline_cache(device, pipeline_cache, pipeline_cache_filename)) {
+		fprintf(stderr, "failed to save pipeline cache to %s\n", pipeline_cache_filename);
+	}
+	vkDestroyPipelineCache(device, pipeline_cache, NULL);
+	end_profile_span(pipeline_span);
 
 	// free shader modules
 	vkDestroyShaderModule(device, hit_shader_module, NULL);
@@ -947,40 +2503,48 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	    : ((shader_handle_size / shader_handle_alignment) + 1) * shader_handle_alignment;
 	uint32_t const shader_table_size = shader_handle_size_aligned * 3;
 
+	// fetch the shader group handles on the host, the table itself lives in device local memory
+	uint8_t shader_table[shader_table_size];
+	for (uint32_t i = 0; i < 3; ++i) {
+		if (ext.vkGetRayTracingShaderGroupHandlesKHR(
+			device,
+			ray_tracing_pipeline,
+			i,
+			1,
+			shader_handle_size_aligned,
+			shader_table + (i * shader_handle_size_aligned)
+		) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
 	VkBuffer shader_table_buffer;
-	VkDeviceMemory shader_table_buffer_memory;
+	struct memory_allocation shader_table_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR shader_table_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   shader_table_size,
 	                   VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR |
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 	                   &shader_table_buffer,
-	                   &shader_table_buffer_memory,
+	                   &shader_table_buffer_allocation,
 	                   &shader_table_buffer_device_address.deviceAddress,
-	                   NULL)) {
+	                   shader_table,
+	                   &uploader)) {
 		return false;
 	}
 
-	void *mapped;
-	if (vkMapMemory(device, shader_table_buffer_memory, 0, shader_table_size, 0, &mapped) != VK_SUCCESS) {
+	// the shader table is the last upload, wait for it before the first trace
+	if (!flush_staging_uploads(&uploader)) {
 		return false;
 	}
 
-	for (uint32_t i = 0; i < 3; ++i) {
-		if (ext.vkGetRayTracingShaderGroupHandlesKHR(
-			device,
-			ray_tracing_pipeline,
-			i,
-			1,
-			shader_handle_size_aligned,
-			(uint8_t *)mapped + (i * shader_handle_size_aligned)
-		) != VK_SUCCESS) {
-			return false;
-		}
-	}
-
-	vkUnmapMemory(device, shader_table_buffer_memory);
+	printf("staged uploads: %llu bytes in %u submits on the %s queue\n",
+	       (unsigned long long)uploader.bytes_uploaded,
+	       uploader.submit_count,
+	       uploader.dedicated_queue ? "transfer" : "graphics");
+	destroy_staging_uploader(&uploader);
+	report_memory_arena(&arena);
 
 	// create descriptor pool
 	VkDescriptorPoolSize descriptor_pool_sizes[2] = {
@@ -1054,6 +2618,14 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		return false;
 	}
 
+	if (timestamp_mask != 0) {
+		vkCmdResetQueryPool(command_buffer, query_pool, 0, TIMESTAMP_IMAGE_COUNT);
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_TRACE_BEGIN);
+	}
+
 	VkImageMemoryBarrier image_memory_barrier = {
 		.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 		.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED,
@@ -1123,6 +2695,13 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 		1
 	);
 
+	if (timestamp_mask != 0) {
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_TRACE_END);
+	}
+
 	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
 
 	vkCmdPipelineBarrier(
@@ -1161,76 +2740,723 @@ bool ray_trace_image(uint8_t *texel_buffer, uint16_t width_px, uint16_t height_p
 	                       1,
 	                       &buffer_image_copy);
 
+	// make the copy available to host reads, the invalidate after the fence then makes it visible
+	VkBufferMemoryBarrier image_buffer_memory_barrier = {
+		.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer              = image_buffer,
+		.offset              = 0,
+		.size                = VK_WHOLE_SIZE,
+	};
+	vkCmdPipelineBarrier(command_buffer,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_HOST_BIT,
+	                     0,
+	                     0, NULL,
+	                     1, &image_buffer_memory_barrier,
+	                     0, NULL);
+
+	if (timestamp_mask != 0) {
+		vkCmdWriteTimestamp(command_buffer,
+		                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		                    query_pool,
+		                    TIMESTAMP_COPY_END);
+	}
+
 
 	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
 		return false;
 	}
 
-	// submit command buffer
-	if (vkQueueSubmit(graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
+	// imported memory is the application's own, otherwise the destination buffer's block stays mapped
+	// for the lifetime of the context
+	uint8_t *image_buffer_mapped = host_memory_imported
+	                             ? imported_image_buffer.host_memory
+	                             : image_buffer_allocation.mapped;
+
+	// the gpu writes the rgba image to the readback memory and the cpu packs it into the texel buffer
+	printf("readback: %s, per image the gpu copies %u bytes and the cpu %u bytes\n",
+	       host_memory_imported ? "imported host memory" : "mapped device memory",
+	       image_buffer_size,
+	       width_px * height_px * 3);
+
+	// keep everything needed to render images and to clean up
+	*context = (struct render_context){
+		.width_px                                              = width_px,
+		.height_px                                             = height_px,
+		.instance                                              = instance,
+		.debug_messenger                                       = debug_messenger,
+		.device                                                = device,
+		.arena                                                 = arena,
+		.graphics_queue                                        = graphics_queue,
+		.command_pool                                          = command_pool,
+		.command_buffer                                        = command_buffer,
+		.fence                                                 = fence,
+		.query_pool                                            = query_pool,
+		.timestamp_mask                                        = timestamp_mask,
+		.timestamp_period                                      = timestamp_period,
+		.bottom_level_build_ms                                 = bottom_level_build_ms,
+		.top_level_build_ms                                    = top_level_build_ms,
+		.image                                                 = image,
+		.image_allocation                                      = image_allocation,
+		.image_view                                            = image_view,
+		.vertex_buffer                                         = vertex_buffer,
+		.vertex_buffer_allocation                              = vertex_buffer_allocation,
+		.index_buffer                                          = index_buffer,
+		.index_buffer_allocation                               = index_buffer_allocation,
+		.transform_matrix_buffer                               = transform_matrix_buffer,
+		.transform_matrix_buffer_allocation                    = transform_matrix_buffer_allocation,
+		.bottom_level_acceleration_structure_buffer            = bottom_level_acceleration_structure_buffer,
+		.bottom_level_acceleration_structure_buffer_allocation = bottom_level_acceleration_structure_buffer_allocation,
+		.bottom_level_acceleration_structure                   = bottom_level_acceleration_structure,
+		.top_level_acceleration_structure_buffer               = top_level_acceleration_structure_buffer,
+		.top_level_acceleration_structure_buffer_allocation    = top_level_acceleration_structure_buffer_allocation,
+		.top_level_acceleration_structure                      = top_level_acceleration_structure,
+		.image_buffer                                          = image_buffer,
+		.image_buffer_allocation                               = image_buffer_allocation,
+		.host_memory_imported                                  = host_memory_imported,
+		.imported_image_buffer                                 = imported_image_buffer,
+		.image_buffer_mapped                                   = image_buffer_mapped,
+		.convert_kernel                                        = select_convert_kernel(),
+		.convert_thread_count                                  = get_convert_thread_count(),
+		.descriptor_set_layout                                 = descriptor_set_layout,
+		.pipeline_layout                                       = pipeline_layout,
+		.ray_tracing_pipeline                                  = ray_tracing_pipeline,
+		.shader_table_buffer                                   = shader_table_buffer,
+		.shader_table_buffer_allocation                        = shader_table_buffer_allocation,
+		.descriptor_pool                                       = descriptor_pool,
+	};
+
+	return true;
+}
+
+bool ray_trace_image(struct render_context *context, uint8_t *texel_buffer) {
+	// submit the command buffer that was recorded when the context was created
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers    = &context->command_buffer,
+	};
+	uint32_t const submit_span = begin_profile_span("first submit");
+	if (vkQueueSubmit(context->graphics_queue, 1, &submit_info, context->fence) != VK_SUCCESS) {
 		return false;
 	}
 
-	if (vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+	if (vkWaitForFences(context->device, 1, &context->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(submit_span);
+
+	vkResetFences(context->device, 1, &context->fence);
+
+	// read back gpu timings
+	if (context->timestamp_mask != 0) {
+		uint64_t timestamps[TIMESTAMP_IMAGE_COUNT];
+		if (vkGetQueryPoolResults(context->device,
+		                          context->query_pool,
+		                          0,
+		                          TIMESTAMP_IMAGE_COUNT,
+		                          sizeof(timestamps),
+		                          timestamps,
+		                          sizeof(uint64_t),
+		                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+			return false;
+		}
+		context->trace_ms = timestamp_delta_ms(timestamps[TIMESTAMP_TRACE_BEGIN],
+		                                       timestamps[TIMESTAMP_TRACE_END],
+		                                       context->timestamp_mask,
+		                                       context->timestamp_period);
+		context->copy_ms = timestamp_delta_ms(timestamps[TIMESTAMP_TRACE_END],
+		                                      timestamps[TIMESTAMP_COPY_END],
+		                                      context->timestamp_mask,
+		                                      context->timestamp_period);
+	}
 
-	vkResetFences(device, 1, &fence);
+	// readback memory is preferably cached, which is not always coherent
+	uint32_t const readback_span = begin_profile_span("readback");
+	if (!context->host_memory_imported &&
+	    !invalidate_memory(&context->arena, &context->image_buffer_allocation)) {
+		return false;
+	}
 
-	// read back image data into output buffer
-	if (vkMapMemory(device, image_buffer_memory, 0, image_buffer_size, 0, &mapped) != VK_SUCCESS) {
-		return false;
-	}
-
-	uint8_t *image_src_data = mapped;
-	for (uint32_t s = 0, d = 0; s < image_buffer_size; s += 4, d += 3) {
-		texel_buffer[d+0] = image_src_data[s+0];
-		texel_buffer[d+1] = image_src_data[s+1];
-		texel_buffer[d+2] = image_src_data[s+2];
-	}
-
-	vkUnmapMemory(device, image_buffer_memory);
-
-	// free all resources
-	vkDestroyDescriptorPool(device, descriptor_pool, NULL);
-	vkFreeMemory(device, shader_table_buffer_memory, NULL);
-	vkDestroyBuffer(device, shader_table_buffer, NULL);
-	vkDestroyPipeline(device, ray_tracing_pipeline, NULL);
-	vkDestroyPipelineLayout(device, pipeline_layout, NULL);
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, NULL);
-	vkFreeMemory(device, image_buffer_memory, NULL);
-	vkDestroyBuffer(device, image_buffer, NULL);
-	ext.vkDestroyAccelerationStructureKHR(device, top_level_acceleration_structure, NULL);
-	vkFreeMemory(device, top_level_acceleration_structure_buffer_memory, NULL);
-	vkDestroyBuffer(device, top_level_acceleration_structure_buffer, NULL);
-	ext.vkDestroyAccelerationStructureKHR(device, bottom_level_acceleration_structure, NULL);
-	vkFreeMemory(device, bottom_level_acceleration_structure_buffer_memory, NULL);
-	vkDestroyBuffer(device, bottom_level_acceleration_structure_buffer, NULL);
-	vkFreeMemory(device, transform_matrix_buffer_memory, NULL);
-	vkDestroyBuffer(device, transform_matrix_buffer, NULL);
-	vkFreeMemory(device, index_buffer_memory, NULL);
-	vkDestroyBuffer(device, index_buffer, NULL);
-	vkFreeMemory(device, vertex_buffer_memory, NULL);
-	vkDestroyBuffer(device, vertex_buffer, NULL);
-	vkDestroyImageView(device, image_view, NULL);
-	vkFreeMemory(device, image_memory, NULL);
-	vkDestroyImage(device, image, NULL);
-	vkDestroyFence(device, fence, NULL);
-	vkDestroyCommandPool(device, command_pool, NULL);
-	vkDestroyDevice(device, NULL);
-	ext.vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, NULL);
-	vkDestroyInstance(instance, NULL);
+	// read back image data into output buffer, vectorized and split across threads by rows
+	convert_rgba8_image_to_rgb8(&context->convert_kernel,
+	                            context->image_buffer_mapped,
+	                            texel_buffer,
+	                            context->width_px,
+	                            context->height_px,
+	                            context->convert_thread_count);
+	end_profile_span(readback_span);
 
 	// report successful render
 	return true;
 }
 
-int main() {
+void destroy_render_context(struct render_context *context) {
+	uint32_t const teardown_span = begin_profile_span("teardown");
+	VkDevice device = context->device;
+	vkDestroyDescriptorPool(device, context->descriptor_pool, NULL);
+	vkDestroyBuffer(device, context->shader_table_buffer, NULL);
+	vkDestroyPipeline(device, context->ray_tracing_pipeline, NULL);
+	vkDestroyPipelineLayout(device, context->pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(device, context->descriptor_set_layout, NULL);
+	if (context->host_memory_imported) {
+		destroy_imported_host_buffer(device, &context->imported_image_buffer);
+	} else {
+		vkDestroyBuffer(device, context->image_buffer, NULL);
+	}
+	ext.vkDestroyAccelerationStructureKHR(device, context->top_level_acceleration_structure, NULL);
+	vkDestroyBuffer(device, context->top_level_acceleration_structure_buffer, NULL);
+	ext.vkDestroyAccelerationStructureKHR(device, context->bottom_level_acceleration_structure, NULL);
+	vkDestroyBuffer(device, context->bottom_level_acceleration_structure_buffer, NULL);
+	vkDestroyBuffer(device, context->transform_matrix_buffer, NULL);
+	vkDestroyBuffer(device, context->index_buffer, NULL);
+	vkDestroyBuffer(device, context->vertex_buffer, NULL);
+	vkDestroyImageView(device, context->image_view, NULL);
+	vkDestroyImage(device, context->image, NULL);
+	vkDestroyQueryPool(device, context->query_pool, NULL);
+	vkDestroyFence(device, context->fence, NULL);
+	vkDestroyCommandPool(device, context->command_pool, NULL);
+	destroy_memory_arena(&context->arena);
+	vkDestroyDevice(device, NULL);
+	if (context->debug_messenger != VK_NULL_HANDLE) {
+		ext.vkDestroyDebugUtilsMessengerEXT(context->instance, context->debug_messenger, NULL);
+	}
+	vkDestroyInstance(context->instance, NULL);
+	end_profile_span(teardown_span);
+}
+
+// header at the start of a frame ring, followed by slot_count slots of slot_size bytes. The one
+// producer and the one consumer each advance their own sequence number, on its own cache line, and
+// frame i lives in slot i % slot_count, so neither side ever takes a lock
+struct frame_ring_header {
+	_Atomic uint32_t magic; // published last, with release order
+	uint32_t slot_count;
+	uint32_t width_px;
+	uint32_t height_px;
+	uint64_t frame_size;
+	uint64_t slot_size;
+	uint64_t header_size;
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t write_sequence; // frames published
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t read_sequence;  // frames consumed
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint32_t closed;         // no more frames will be published
+};
+
+// start of every slot, the rgb8 texels of the frame follow at CACHE_LINE_SIZE
+struct frame_slot_header {
+	uint64_t sequence;
+	uint64_t frame_size;
+};
+
+struct frame_ring {
+	struct frame_ring_header *header;
+	size_t mapped_size;
+	uint64_t sequence;
+};
+
+void wait_for_frame_ring(uint32_t *spin_count) {
+	// spin briefly, then sleep so a stalled peer does not cost a whole core
+	if (++*spin_count < 64) {
+		sched_yield();
+	} else {
+		struct timespec const delay = { .tv_nsec = 50000 };
+		nanosleep(&delay, NULL);
+	}
+}
+
+uint8_t *get_frame_slot(struct frame_ring const *ring, uint64_t sequence) {
+	struct frame_ring_header const *header = ring->header;
+	return (uint8_t *)header + header->header_size + (sequence % header->slot_count) * header->slot_size;
+}
+
+bool create_frame_ring(char const *name,
+                       uint32_t slot_count,
+                       uint32_t width_px,
+                       uint32_t height_px,
+                       struct frame_ring *ring) {
+	size_t const page_size   = sysconf(_SC_PAGESIZE);
+	size_t const header_size = (sizeof(struct frame_ring_header) + page_size - 1) & ~(page_size - 1);
+	size_t const frame_size  = (size_t)width_px * height_px * 3;
+	size_t const slot_size   = (CACHE_LINE_SIZE + frame_size + page_size - 1) & ~(page_size - 1);
+	size_t const mapped_size = header_size + slot_count * slot_size;
+
+	// a ring left under this name may still be mapped by a consumer, so it is unlinked rather than
+	// truncated, the consumer keeps its own mapping and the new ring is a new object
+	shm_unlink(name);
+	int const fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, mapped_size) != 0) {
+		close(fd);
+		return false;
+	}
+	void *mapped = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	// the magic is written last, a consumer that sees it sees the rest of the header too
+	struct frame_ring_header *header = mapped;
+	header->slot_count  = slot_count;
+	header->width_px    = width_px;
+	header->height_px   = height_px;
+	header->frame_size  = frame_size;
+	header->slot_size   = slot_size;
+	header->header_size = header_size;
+	atomic_store_explicit(&header->write_sequence, 0, memory_order_relaxed);
+	atomic_store_explicit(&header->read_sequence, 0, memory_order_relaxed);
+	atomic_store_explicit(&header->closed, 0, memory_order_relaxed);
+	atomic_store_explicit(&header->magic, FRAME_RING_MAGIC, memory_order_release);
+
+	*ring = (struct frame_ring){
+		.header      = header,
+		.mapped_size = mapped_size,
+	};
+	return true;
+}
+
+uint8_t *acquire_frame_slot(struct frame_ring *ring, double *blocked_ms) {
+	// the next slot is free once the consumer is fewer than slot_count frames behind
+	struct frame_ring_header *header = ring->header;
+	double const start_ms = get_time_ms();
+	uint32_t spin_count = 0;
+	while (ring->sequence - atomic_load_explicit(&header->read_sequence, memory_order_acquire) >=
+	       header->slot_count) {
+		wait_for_frame_ring(&spin_count);
+	}
+	*blocked_ms += get_time_ms() - start_ms;
+	return get_frame_slot(ring, ring->sequence) + CACHE_LINE_SIZE;
+}
+
+void publish_frame(struct frame_ring *ring) {
+	struct frame_slot_header *slot_header = (struct frame_slot_header *)get_frame_slot(ring, ring->sequence);
+	slot_header->sequence   = ring->sequence;
+	slot_header->frame_size = ring->header->frame_size;
+	ring->sequence += 1;
+	atomic_store_explicit(&ring->header->write_sequence, ring->sequence, memory_order_release);
+}
+
+void close_frame_ring(struct frame_ring *ring) {
+	// the consumer unlinks the ring once it has drained it
+	atomic_store_explicit(&ring->header->closed, 1, memory_order_release);
+	munmap(ring->header, ring->mapped_size);
+}
+
+bool run_ring_output(char const *name, uint32_t frame_count, uint32_t slot_count, bool import_host_memory) {
+	if (frame_count == 0 || slot_count == 0) {
+		return false;
+	}
+
+	struct render_context context;
+	struct frame_ring ring;
+	if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, import_host_memory) ||
+	    !create_frame_ring(name, slot_count, IMAGE_WIDTH, IMAGE_HEIGHT, &ring)) {
+		return false;
+	}
+
+	// frames are converted straight into the slot, the ring is the only copy outside the gpu
+	double blocked_ms = 0.0;
+	double const start_ms = get_time_ms();
+	for (uint32_t i = 0; i < frame_count; ++i) {
+		uint8_t *texels = acquire_frame_slot(&ring, &blocked_ms);
+		if (!ray_trace_image(&context, texels)) {
+			return false;
+		}
+		publish_frame(&ring);
+	}
+	double const total_ms = get_time_ms() - start_ms;
+
+	uint64_t const frame_size = ring.header->frame_size;
+	close_frame_ring(&ring);
+	destroy_render_context(&context);
+
+	printf("ring %s: %u frames of %ux%u in %.3f ms, %.1f frames per second, %.1f MiB/s, "
+	       "%.3f ms waiting for the consumer\n",
+	       name,
+	       frame_count,
+	       IMAGE_WIDTH,
+	       IMAGE_HEIGHT,
+	       total_ms,
+	       frame_count * 1000.0 / total_ms,
+	       frame_count * frame_size / (1024.0 * 1024.0) / (total_ms / 1000.0),
+	       blocked_ms);
+	return true;
+}
+
+bool run_benchmark(uint32_t image_count, bool import_host_memory) {
 	uint8_t *texel_buffer = malloc(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
-	if (!ray_trace_image(texel_buffer, IMAGE_WIDTH, IMAGE_HEIGHT)) {
+
+	// time setup and the first image separately from the warmed up steady state
+	struct render_context context;
+	double start_ms = get_time_ms();
+	if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, import_host_memory)) {
+		return false;
+	}
+	double const setup_ms = get_time_ms() - start_ms;
+
+	start_ms = get_time_ms();
+	if (!ray_trace_image(&context, texel_buffer)) {
+		return false;
+	}
+	double const first_image_ms = get_time_ms() - start_ms;
+
+	double total_ms = 0.0;
+	double min_ms = 0.0;
+	double max_ms = 0.0;
+	double total_trace_ms = 0.0;
+	double total_copy_ms = 0.0;
+	for (uint32_t i = 0; i < image_count; ++i) {
+		start_ms = get_time_ms();
+		if (!ray_trace_image(&context, texel_buffer)) {
+			return false;
+		}
+		double const image_ms = get_time_ms() - start_ms;
+		total_ms += image_ms;
+		if (i == 0 || image_ms < min_ms) min_ms = image_ms;
+		if (i == 0 || image_ms > max_ms) max_ms = image_ms;
+		total_trace_ms += context.trace_ms;
+		total_copy_ms += context.copy_ms;
+	}
+
+	bool const has_timestamps = context.timestamp_mask != 0;
+
+	destroy_render_context(&context);
+	free(texel_buffer);
+
+	printf("image size:  %dx%d\n", IMAGE_WIDTH, IMAGE_HEIGHT);
+	printf("setup:       %.3f ms\n", setup_ms);
+	printf("first image: %.3f ms\n", first_image_ms);
+	if (has_timestamps) {
+		printf("gpu build:   bottom level %.3f ms, top level %.3f ms\n",
+		       context.bottom_level_build_ms, context.top_level_build_ms);
+	}
+	if (image_count > 0) {
+		printf("per image:   mean %.3f ms, min %.3f ms, max %.3f ms over %u images\n",
+		       total_ms / image_count, min_ms, max_ms, image_count);
+		if (has_timestamps) {
+			printf("gpu mean:    trace %.3f ms, copy %.3f ms\n",
+			       total_trace_ms / image_count, total_copy_ms / image_count);
+		}
+	}
+	return true;
+}
+
+bool run_convert_benchmark(uint32_t iteration_count) {
+	// 8k, the size at which the byte loop used to cost more than the render
+	uint32_t const width_px    = 7680;
+	uint32_t const height_px   = 4320;
+	size_t const   texel_count = (size_t)width_px * height_px;
+
+	uint8_t *rgba          = malloc(texel_count * 4);
+	uint8_t *rgb_reference = malloc(texel_count * 3);
+	uint8_t *rgb           = malloc(texel_count * 3);
+	if (!rgba || !rgb_reference || !rgb || iteration_count == 0) {
+		return false;
+	}
+	for (size_t i = 0; i < texel_count * 4; ++i) {
+		rgba[i] = (uint8_t)(i * 7 + (i >> 12));
+	}
+
+	struct convert_kernel const kernel = select_convert_kernel();
+	uint32_t const thread_count = get_convert_thread_count();
+
+	// the first pass of each variant faults in the destination pages and is not timed
+	double scalar_ms = 0.0;
+	for (uint32_t i = 0; i <= iteration_count; ++i) {
+		double const start_ms = get_time_ms();
+		convert_rgba8_to_rgb8_scalar(rgba, rgb_reference, texel_count);
+		if (i > 0) scalar_ms += get_time_ms() - start_ms;
+	}
+
+	double kernel_ms[2] = { 0.0, 0.0 };
+	uint32_t const kernel_threads[2] = { 1, thread_count };
+	for (uint32_t k = 0; k < 2; ++k) {
+		for (uint32_t i = 0; i <= iteration_count; ++i) {
+			memset(rgb, 0, texel_count * 3);
+			double const start_ms = get_time_ms();
+			convert_rgba8_image_to_rgb8(&kernel, rgba, rgb, width_px, height_px, kernel_threads[k]);
+			if (i > 0) kernel_ms[k] += get_time_ms() - start_ms;
+			if (memcmp(rgb, rgb_reference, texel_count * 3) != 0) {
+				fprintf(stderr, "%s conversion on %u threads does not match the byte loop\n",
+				        kernel.name, kernel_threads[k]);
+				return false;
+			}
+		}
+	}
+
+	free(rgb);
+	free(rgb_reference);
+	free(rgba);
+
+	// bandwidth counts the rgba bytes read plus the rgb bytes written
+	double const megabytes = texel_count * 7 / (1024.0 * 1024.0);
+	scalar_ms    /= iteration_count;
+	kernel_ms[0] /= iteration_count;
+	kernel_ms[1] /= iteration_count;
+
+	printf("image size: %ux%u, mean of %u conversions\n", width_px, height_px, iteration_count);
+	printf("%-20s %8.3f ms, %6.0f MiB/s\n", "byte loop:", scalar_ms, megabytes * 1000.0 / scalar_ms);
+	for (uint32_t k = 0; k < 2; ++k) {
+		char label[64];
+		snprintf(label, sizeof(label), "%s, %u thread%s:",
+		         kernel.name, kernel_threads[k], kernel_threads[k] == 1 ? "" : "s");
+		printf("%-20s %8.3f ms, %6.0f MiB/s, %.1fx the byte loop\n",
+		       label, kernel_ms[k], megabytes * 1000.0 / kernel_ms[k], scalar_ms / kernel_ms[k]);
+	}
+	return true;
+}
+
+bool run_readback_benchmark(uint32_t iteration_count) {
+	struct render_context context;
+	if (iteration_count == 0 || !create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, false)) {
+		return false;
+	}
+	VkDevice device = context.device;
+	VkPhysicalDeviceMemoryProperties const *memory_properties = &context.arena.memory_properties;
+
+	// the type the arena picked for the context's own readback buffer
+	uint32_t const readback_memory_type_index =
+		context.arena.blocks[context.image_buffer_allocation.block_index].memory_type_index;
+
+	// as much data as an 8k image, rewritten by the gpu before every read
+	VkDeviceSize const buffer_size = 7680 * 4320 * 4;
+	uint32_t const fill_value = 0x01020304;
+	uint8_t *host_copy = malloc(buffer_size);
+	if (!host_copy) {
+		return false;
+	}
+
+	VkBufferCreateInfo buffer_create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size  = buffer_size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	};
+
+	printf("readback of %.0f MiB, mean of %u reads\n", buffer_size / (1024.0 * 1024.0), iteration_count);
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		VkMemoryPropertyFlags const flags = memory_properties->memoryTypes[i].propertyFlags;
+		if (!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+			continue;
+		}
+
+		VkBuffer buffer;
+		if (vkCreateBuffer(device, &buffer_create_info, NULL, &buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkMemoryRequirements memory_requirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+
+		// a dedicated allocation of exactly this type rather than the arena's pick
+		VkMemoryAllocateInfo memory_allocate_info = {
+			.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize  = memory_requirements.size,
+			.memoryTypeIndex = i,
+		};
+		VkDeviceMemory memory;
+		if (!(memory_requirements.memoryTypeBits & (1u << i)) ||
+		    vkAllocateMemory(device, &memory_allocate_info, NULL, &memory) != VK_SUCCESS) {
+			printf("type %2u: cannot hold the buffer\n", i);
+			vkDestroyBuffer(device, buffer, NULL);
+			continue;
+		}
+
+		void *mapped;
+		if (vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS ||
+		    vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+			.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool        = context.command_pool,
+			.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VkCommandBuffer command_buffer;
+		if (vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &command_buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkCommandBufferBeginInfo command_buffer_begin_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		};
+		if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+			return false;
+		}
+
+		vkCmdFillBuffer(command_buffer, buffer, 0, VK_WHOLE_SIZE, fill_value);
+
+		VkBufferMemoryBarrier buffer_memory_barrier = {
+			.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer              = buffer,
+			.offset              = 0,
+			.size                = VK_WHOLE_SIZE,
+		};
+		vkCmdPipelineBarrier(command_buffer,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     VK_PIPELINE_STAGE_HOST_BIT,
+		                     0,
+		                     0, NULL,
+		                     1, &buffer_memory_barrier,
+		                     0, NULL);
+
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		VkSubmitInfo submit_info = {
+			.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers    = &command_buffer,
+		};
+		VkMappedMemoryRange mapped_memory_range = {
+			.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			.memory = memory,
+			.offset = 0,
+			.size   = VK_WHOLE_SIZE,
+		};
+
+		// the first read faults in the host copy and is not timed
+		double total_ms = 0.0;
+		for (uint32_t j = 0; j <= iteration_count; ++j) {
+			if (vkQueueSubmit(context.graphics_queue, 1, &submit_info, context.fence) != VK_SUCCESS ||
+			    vkWaitForFences(device, 1, &context.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+				return false;
+			}
+			vkResetFences(device, 1, &context.fence);
+
+			double const start_ms = get_time_ms();
+			if (!(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) &&
+			    vkInvalidateMappedMemoryRanges(device, 1, &mapped_memory_range) != VK_SUCCESS) {
+				return false;
+			}
+			memcpy(host_copy, mapped, buffer_size);
+			if (j > 0) total_ms += get_time_ms() - start_ms;
+		}
+
+		uint32_t last_value;
+		memcpy(&last_value, host_copy + buffer_size - sizeof(last_value), sizeof(last_value));
+		if (last_value != fill_value) {
+			fprintf(stderr, "type %u read back stale data\n", i);
+			return false;
+		}
+
+		char description[64];
+		snprintf(description, sizeof(description), "%shost visible%s%s",
+		         flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ? "device local, " : "",
+		         flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ? ", coherent" : "",
+		         flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT ? ", cached" : "");
+		double const mean_ms = total_ms / iteration_count;
+		printf("type %2u: heap %u, %-44s %8.3f ms, %6.0f MiB/s%s\n",
+		       i,
+		       memory_properties->memoryTypes[i].heapIndex,
+		       description,
+		       mean_ms,
+		       buffer_size / (1024.0 * 1024.0) * 1000.0 / mean_ms,
+		       i == readback_memory_type_index ? "  <- readback" : "");
+
+		vkFreeCommandBuffers(device, context.command_pool, 1, &command_buffer);
+		vkUnmapMemory(device, memory);
+		vkDestroyBuffer(device, buffer, NULL);
+		vkFreeMemory(device, memory, NULL);
+	}
+
+	free(host_copy);
+	destroy_render_context(&context);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	// a leading --import-host-memory applies to the render and to --bench, a leading --mmap-output
+	// has the render convert straight into the mapped output file
+	bool import_host_memory = false;
+	bool mmap_output = false;
+	while (argc > 1) {
+		if (strcmp(argv[1], "--import-host-memory") == 0) {
+			import_host_memory = true;
+		} else if (strcmp(argv[1], "--mmap-output") == 0) {
+			mmap_output = true;
+		} else {
+			break;
+		}
+		argc -= 1;
+		argv += 1;
+	}
+
+	if (argc == 3 && strcmp(argv[1], "--bench-readback") == 0) {
+		if (!run_readback_benchmark(strtoul(argv[2], NULL, 10))) {
+			fputs("readback benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc == 3 && strcmp(argv[1], "--bench-convert") == 0) {
+		if (!run_convert_benchmark(strtoul(argv[2], NULL, 10))) {
+			fputs("conversion benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
+
+	if ((argc == 4 || argc == 5) && strcmp(argv[1], "--ring") == 0) {
+		uint32_t const slot_count = argc == 5 ? strtoul(argv[4], NULL, 10) : FRAME_RING_SLOT_COUNT;
+		if (!run_ring_output(argv[2], strtoul(argv[3], NULL, 10), slot_count, import_host_memory)) {
+			fputs("ring output failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc == 3 && strcmp(argv[1], "--bench") == 0) {
+		if (!run_benchmark(strtoul(argv[2], NULL, 10), import_host_memory)) {
+			fputs("benchmark failed\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
+
+	// a mapped output file replaces the heap buffer and the copy out of it
+	struct mapped_ppm ppm;
+	uint8_t *texel_buffer;
+	if (mmap_output) {
+		if (!map_ppm_file("image.ppm", IMAGE_WIDTH, IMAGE_HEIGHT, &ppm)) {
+			fputs("failed to map image.ppm\n", stderr);
+			return 1;
+		}
+		texel_buffer = ppm.texels;
+	} else {
+		texel_buffer = malloc(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+	}
+	struct render_context context;
+	if (!create_render_context(&context, IMAGE_WIDTH, IMAGE_HEIGHT, import_host_memory) ||
+	    !ray_trace_image(&context, texel_buffer)) {
 		fputs("render failed\n", stderr);
 		return 1;
 	}
+	if (context.timestamp_mask != 0) {
+		printf("gpu bottom level build: %.3f ms\n", context.bottom_level_build_ms);
+		printf("gpu top level build:    %.3f ms\n", context.top_level_build_ms);
+		printf("gpu trace:              %.3f ms\n", context.trace_ms);
+		printf("gpu copy:               %.3f ms\n", context.copy_ms);
+	}
+	destroy_render_context(&context);
+	if (!report_startup_profile()) {
+		fputs("failed to write startup profile\n", stderr);
+	}
+	if (mmap_output) {
+		return unmap_ppm_file(&ppm) ? 0 : 1;
+	}
 	save_rgb8_image_to_ppm("image.ppm", IMAGE_WIDTH, IMAGE_HEIGHT, texel_buffer);
 	free(texel_buffer);
 	return 0;
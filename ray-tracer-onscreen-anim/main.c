@@ -1,9 +1,18 @@
+#include <fcntl.h>
+#include <linux/io_uring.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -12,6 +21,23 @@
 #define WINDOW_HEIGHT 600
 #define APP_NAME      "Onscreen Animated Ray Tracing Example"
 
+// frames the cpu may record ahead of the gpu
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define MAX_FRAMES_IN_FLIGHT     4
+
+// timestamps written around the gpu work for each frame
+#define TIMESTAMP_TRACE_BEGIN       0
+#define TIMESTAMP_TRACE_END         1
+#define TIMESTAMP_COPY_END          2
+#define TIMESTAMP_BLAS_UPDATE_BEGIN 3
+#define TIMESTAMP_BLAS_UPDATE_END   4
+#define TIMESTAMP_TLAS_UPDATE_BEGIN 5
+#define TIMESTAMP_TLAS_UPDATE_END   6
+#define TIMESTAMP_COUNT             7
+
+// initial buffer contents reach device local memory through a staging buffer of this size
+#define STAGING_BUFFER_SIZE (256 * 1024)
+
 struct {
 	PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessengerEXT;
 	PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessengerEXT;
@@ -48,106 +74,1799 @@ char *load_binary_file(char const *filename, size_t *size) {
 	return buffer;
 }
 
-VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
-	VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
-	VkDebugUtilsMessageTypeFlagsEXT message_type,
-	VkDebugUtilsMessengerCallbackDataEXT const *callback_data,
-	void *user_data) {
-	if (message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-		fprintf(stderr, "validation layer: %s\n", callback_data->pMessage);
+// full validation prints every warning and error as it arrives, the performance mode only collects
+// the performance warnings of the best practices checks and summarizes them at exit
+enum validation_mode {
+	VALIDATION_FULL,
+	VALIDATION_PERFORMANCE,
+	VALIDATION_OFF,
+};
+
+// VK_EXAMPLES_VALIDATION is full, performance or off, a release build defaults to off
+enum validation_mode get_validation_mode(void) {
+	char const *mode = getenv("VK_EXAMPLES_VALIDATION");
+	if (mode && strcmp(mode, "full") == 0) {
+		return VALIDATION_FULL;
+	}
+	if (mode && strcmp(mode, "performance") == 0) {
+		return VALIDATION_PERFORMANCE;
+	}
+	if (mode && strcmp(mode, "off") == 0) {
+		return VALIDATION_OFF;
+	}
+#ifdef VK_EXAMPLES_RELEASE
+	return VALIDATION_OFF;
+#else
+	return VALIDATION_FULL;
+#endif
+}
+
+// performance messages are counted by message id, only the text of the first one is kept
+#define MAX_PERFORMANCE_MESSAGES 64
+
+struct performance_message {
+	int32_t id;
+	char *id_name;
+	char *text;
+	uint32_t count;
+};
+
+struct {
+	struct performance_message messages[MAX_PERFORMANCE_MESSAGES];
+	uint32_t message_count;
+	uint32_t dropped_count; // occurrences of messages that no longer fit in the table
+	bool summary_registered;
+} performance_messages;
+
+void record_performance_message(VkDebugUtilsMessengerCallbackDataEXT const *callback_data) {
+	char const *id_name = callback_data->pMessageIdName ? callback_data->pMessageIdName : "";
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		if (message->id == callback_data->messageIdNumber && strcmp(message->id_name, id_name) == 0) {
+			message->count += 1;
+			return;
+		}
+	}
+	if (performance_messages.message_count == MAX_PERFORMANCE_MESSAGES) {
+		performance_messages.dropped_count += 1;
+		return;
+	}
+	performance_messages.messages[performance_messages.message_count++] = (struct performance_message){
+		.id      = callback_data->messageIdNumber,
+		.id_name = strdup(id_name),
+		.text    = strdup(callback_data->pMessage ? callback_data->pMessage : ""),
+		.count   = 1,
+	};
+}
+
+// registered with atexit, so messages reported while the instance is destroyed are counted too
+void report_performance_messages(void) {
+	uint32_t total_count = performance_messages.dropped_count;
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		total_count += performance_messages.messages[i].count;
+	}
+	fprintf(stderr,
+	        "performance warnings: %u, %u distinct\n",
+	        total_count,
+	        performance_messages.message_count);
+	for (uint32_t i = 0; i < performance_messages.message_count; ++i) {
+		struct performance_message *message = &performance_messages.messages[i];
+		fprintf(stderr, "%8u  %s: %s\n", message->count, message->id_name, message->text);
+		free(message->id_name);
+		free(message->text);
+	}
+	if (performance_messages.dropped_count > 0) {
+		fprintf(stderr, "%8u  messages beyond the first %d distinct ones\n",
+		        performance_messages.dropped_count,
+		        MAX_PERFORMANCE_MESSAGES);
+	}
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
+	VkDebugUtilsMessageTypeFlagsEXT message_type,
+	VkDebugUtilsMessengerCallbackDataEXT const *callback_data,
+	void *user_data) {
+	// the performance mode passes the table that collects its messages
+	if (user_data) {
+		record_performance_message(callback_data);
+		return VK_FALSE;
+	}
+	if (message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+		fprintf(stderr, "validation layer: %s\n", callback_data->pMessage);
+	}
+	return VK_FALSE;
+}
+
+bool create_debug_messenger(VkInstance instance,
+                            enum validation_mode validation,
+                            VkDebugUtilsMessengerEXT *debug_messenger) {
+	// load extension functions
+	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
+	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
+
+	// setup debug messenger
+	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+		.pfnUserCallback = debug_callback,
+	};
+
+	// the performance mode collects performance messages only, the callback counts them instead of
+	// printing each one
+	if (validation == VALIDATION_PERFORMANCE) {
+		debug_messenger_create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		debug_messenger_create_info.pUserData   = &performance_messages;
+		if (!performance_messages.summary_registered) {
+			atexit(report_performance_messages);
+			performance_messages.summary_registered = true;
+		}
+	}
+
+	return ext.vkCreateDebugUtilsMessengerEXT(instance,
+	                                          &debug_messenger_create_info,
+	                                          NULL,
+	                                          debug_messenger) == VK_SUCCESS;
+}
+
+// buffers and images are sub-allocated from device memory blocks of at least this size, so the
+// driver sees a handful of allocations instead of one per resource
+#define MEMORY_BLOCK_SIZE       (16 * 1024 * 1024)
+#define MAX_MEMORY_BLOCKS       16
+#define MAX_MEMORY_BLOCK_RANGES 64
+
+// what the cpu and gpu do with a resource, which decides the memory type it is placed in
+enum memory_usage {
+	MEMORY_USAGE_GPU_ONLY, // never mapped
+	MEMORY_USAGE_UPLOAD,   // written once by the cpu and copied from by the gpu
+	MEMORY_USAGE_READBACK, // written by the gpu and read by the cpu
+	MEMORY_USAGE_DYNAMIC,  // rewritten by the cpu every frame and read by the gpu
+};
+
+// a part of a memory block that is either free or holds one buffer or image
+struct memory_range {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	bool used;
+	bool linear;
+};
+
+// the ranges of a block are kept in offset order and always cover the whole block
+struct memory_block {
+	VkDeviceMemory memory;
+	uint32_t memory_type_index;
+	VkDeviceSize size;
+	uint8_t *mapped;
+	uint32_t range_count;
+	struct memory_range ranges[MAX_MEMORY_BLOCK_RANGES];
+};
+
+struct memory_arena {
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkDeviceSize buffer_image_granularity;
+	VkDeviceSize non_coherent_atom_size;
+	VkMemoryAllocateFlags allocate_flags;
+	uint32_t block_count;
+	struct memory_block blocks[MAX_MEMORY_BLOCKS];
+};
+
+// where a buffer or image lives in the arena, mapped is only set for host visible memory
+struct memory_allocation {
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t block_index;
+	uint8_t *mapped;
+};
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void init_memory_arena(struct memory_arena *arena,
+                       VkPhysicalDevice physical_device,
+                       VkDevice device,
+                       VkMemoryAllocateFlags allocate_flags) {
+	VkPhysicalDeviceProperties device_properties;
+	vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+
+	arena->device                   = device;
+	arena->buffer_image_granularity = device_properties.limits.bufferImageGranularity;
+	arena->non_coherent_atom_size   = device_properties.limits.nonCoherentAtomSize;
+	arena->allocate_flags           = allocate_flags;
+	arena->block_count              = 0;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &arena->memory_properties);
+}
+
+// ranks a memory type for a usage, 0 means the type cannot be used for it
+uint32_t score_memory_type(VkMemoryPropertyFlags flags, enum memory_usage usage) {
+	bool const device_local  = flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bool const host_visible  = flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	bool const host_coherent = flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	bool const host_cached   = flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	if (flags & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT)) {
+		return 0;
+	}
+	if (usage != MEMORY_USAGE_GPU_ONLY && !host_visible) {
+		return 0;
+	}
+
+	switch (usage) {
+	case MEMORY_USAGE_GPU_ONLY:
+		// leave host visible device memory to the resources the cpu writes
+		return 1 + (device_local ? 2 : 0) + (host_visible ? 0 : 1);
+	case MEMORY_USAGE_UPLOAD:
+		// sequential writes are fine in write combined memory, staging stays out of device memory
+		return 1 + (host_coherent ? 2 : 0) + (device_local ? 0 : 1);
+	case MEMORY_USAGE_READBACK:
+		// reads from uncached memory bypass the cpu caches and run many times slower
+		return 1 + (host_cached ? 4 : 0) + (host_coherent ? 2 : 0) + (device_local ? 0 : 1);
+	case MEMORY_USAGE_DYNAMIC:
+		// the gpu reads small per frame data straight from device memory when it is mappable
+		return 1 + (device_local ? 4 : 0) + (host_coherent ? 2 : 0);
+	}
+
+	return 0;
+}
+
+// picks the best scoring memory type allowed by memory_type_bits, ties go to the lowest index
+bool find_memory_type(VkPhysicalDeviceMemoryProperties const *memory_properties,
+                      uint32_t memory_type_bits,
+                      enum memory_usage usage,
+                      uint32_t *memory_type_index) {
+	uint32_t best_score = 0;
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+		if (!(memory_type_bits & (1u << i))) {
+			continue;
+		}
+		uint32_t const score = score_memory_type(memory_properties->memoryTypes[i].propertyFlags, usage);
+		if (score > best_score) {
+			best_score         = score;
+			*memory_type_index = i;
+		}
+	}
+
+	return best_score > 0;
+}
+
+bool allocate_from_block(struct memory_block *block,
+                         VkDeviceSize size,
+                         VkDeviceSize alignment,
+                         bool linear,
+                         VkDeviceSize granularity,
+                         VkDeviceSize *offset) {
+	// first fit, linear and optimal resources must not share a granularity page with each other
+	for (uint32_t i = 0; i < block->range_count; ++i) {
+		struct memory_range const range = block->ranges[i];
+		if (range.used) {
+			continue;
+		}
+
+		VkDeviceSize start = align_up(range.offset, alignment);
+		if (i > 0 && block->ranges[i - 1].used && block->ranges[i - 1].linear != linear) {
+			start = align_up(start, granularity);
+		}
+		VkDeviceSize const range_end = range.offset + range.size;
+		if (start + size > range_end) {
+			continue;
+		}
+		bool const next_conflicts = i + 1 < block->range_count &&
+		                            block->ranges[i + 1].used &&
+		                            block->ranges[i + 1].linear != linear;
+		if (next_conflicts && align_up(start + size, granularity) > range_end) {
+			continue;
+		}
+
+		// split into leading padding, the allocation and the free remainder
+		uint32_t const new_ranges = (start > range.offset ? 1 : 0) + (start + size < range_end ? 1 : 0);
+		if (block->range_count + new_ranges > MAX_MEMORY_BLOCK_RANGES) {
+			return false;
+		}
+		memmove(&block->ranges[i + 1 + new_ranges],
+		        &block->ranges[i + 1],
+		        (block->range_count - i - 1) * sizeof(struct memory_range));
+		block->range_count += new_ranges;
+
+		uint32_t r = i;
+		if (start > range.offset) {
+			block->ranges[r++] = (struct memory_range){
+				.offset = range.offset,
+				.size   = start - range.offset,
+			};
+		}
+		block->ranges[r++] = (struct memory_range){
+			.offset = start,
+			.size   = size,
+			.used   = true,
+			.linear = linear,
+		};
+		if (start + size < range_end) {
+			block->ranges[r] = (struct memory_range){
+				.offset = start + size,
+				.size   = range_end - (start + size),
+			};
+		}
+
+		*offset = start;
+		return true;
+	}
+
+	return false;
+}
+
+bool allocate_memory(struct memory_arena *arena,
+                     VkMemoryRequirements const *memory_requirements,
+                     enum memory_usage usage,
+                     bool linear,
+                     struct memory_allocation *allocation) {
+	uint32_t memory_type_index;
+	if (!find_memory_type(&arena->memory_properties,
+	                      memory_requirements->memoryTypeBits,
+	                      usage,
+	                      &memory_type_index)) {
+		return false;
+	}
+
+	// flushes and invalidates work on whole atoms, so non coherent allocations never share one
+	VkMemoryPropertyFlags const memory_type_flags =
+		arena->memory_properties.memoryTypes[memory_type_index].propertyFlags;
+	VkDeviceSize size      = memory_requirements->size;
+	VkDeviceSize alignment = memory_requirements->alignment;
+	if ((memory_type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+	    !(memory_type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		size      = align_up(size, arena->non_coherent_atom_size);
+		alignment = alignment > arena->non_coherent_atom_size ? alignment : arena->non_coherent_atom_size;
+	}
+
+	// try the existing blocks of this memory type before allocating a new one
+	for (uint32_t i = 0; i <= arena->block_count; ++i) {
+		if (i == arena->block_count) {
+			if (arena->block_count == MAX_MEMORY_BLOCKS) {
+				return false;
+			}
+
+			VkDeviceSize const block_size = size > MEMORY_BLOCK_SIZE ? size : MEMORY_BLOCK_SIZE;
+
+			VkMemoryAllocateFlagsInfo memory_allocate_flags_info = {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+				.flags = arena->allocate_flags,
+			};
+			VkMemoryAllocateInfo memory_allocate_info = {
+				.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+				.pNext           = arena->allocate_flags ? &memory_allocate_flags_info : NULL,
+				.allocationSize  = block_size,
+				.memoryTypeIndex = memory_type_index,
+			};
+			struct memory_block *block = &arena->blocks[i];
+			if (vkAllocateMemory(arena->device, &memory_allocate_info, NULL, &block->memory) != VK_SUCCESS) {
+				return false;
+			}
+
+			// host visible blocks stay mapped, a memory object can only be mapped once
+			void *mapped = NULL;
+			if ((memory_type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+			    vkMapMemory(arena->device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+				vkFreeMemory(arena->device, block->memory, NULL);
+				return false;
+			}
+
+			block->memory_type_index = memory_type_index;
+			block->size              = block_size;
+			block->mapped            = mapped;
+			block->range_count       = 1;
+			block->ranges[0]         = (struct memory_range){ .offset = 0, .size = block_size };
+			arena->block_count      += 1;
+		}
+
+		struct memory_block *block = &arena->blocks[i];
+		VkDeviceSize offset;
+		if (block->memory_type_index != memory_type_index ||
+		    !allocate_from_block(block,
+		                         size,
+		                         alignment,
+		                         linear,
+		                         arena->buffer_image_granularity,
+		                         &offset)) {
+			continue;
+		}
+
+		*allocation = (struct memory_allocation){
+			.memory      = block->memory,
+			.offset      = offset,
+			.size        = size,
+			.block_index = i,
+			.mapped      = block->mapped ? block->mapped + offset : NULL,
+		};
+		return true;
+	}
+
+	return false;
+}
+
+void free_memory(struct memory_arena *arena, struct memory_allocation const *allocation) {
+	struct memory_block *block = &arena->blocks[allocation->block_index];
+
+	uint32_t i = 0;
+	while (i < block->range_count && block->ranges[i].offset != allocation->offset) {
+		i += 1;
+	}
+	if (i == block->range_count) {
+		return;
+	}
+	block->ranges[i].used   = false;
+	block->ranges[i].linear = false;
+
+	// merge with free neighbours so the free list does not fragment into slivers
+	if (i + 1 < block->range_count && !block->ranges[i + 1].used) {
+		block->ranges[i].size += block->ranges[i + 1].size;
+		memmove(&block->ranges[i + 1],
+		        &block->ranges[i + 2],
+		        (block->range_count - i - 2) * sizeof(struct memory_range));
+		block->range_count -= 1;
+	}
+	if (i > 0 && !block->ranges[i - 1].used) {
+		block->ranges[i - 1].size += block->ranges[i].size;
+		memmove(&block->ranges[i],
+		        &block->ranges[i + 1],
+		        (block->range_count - i - 1) * sizeof(struct memory_range));
+		block->range_count -= 1;
+	}
+}
+
+bool bind_buffer_memory(struct memory_arena *arena,
+                        VkBuffer buffer,
+                        enum memory_usage usage,
+                        struct memory_allocation *allocation) {
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(arena->device, buffer, &memory_requirements);
+
+	if (!allocate_memory(arena, &memory_requirements, usage, true, allocation)) {
+		return false;
+	}
+
+	return vkBindBufferMemory(arena->device, buffer, allocation->memory, allocation->offset) == VK_SUCCESS;
+}
+
+bool bind_image_memory(struct memory_arena *arena,
+                       VkImage image,
+                       VkImageTiling tiling,
+                       enum memory_usage usage,
+                       struct memory_allocation *allocation) {
+	VkMemoryRequirements memory_requirements;
+	vkGetImageMemoryRequirements(arena->device, image, &memory_requirements);
+
+	if (!allocate_memory(arena,
+	                     &memory_requirements,
+	                     usage,
+	                     tiling == VK_IMAGE_TILING_LINEAR,
+	                     allocation)) {
+		return false;
+	}
+
+	return vkBindImageMemory(arena->device, image, allocation->memory, allocation->offset) == VK_SUCCESS;
+}
+
+// the range to flush or invalidate for an allocation, false when its memory is coherent and needs neither
+bool get_non_coherent_range(struct memory_arena const *arena,
+                            struct memory_allocation const *allocation,
+                            VkMappedMemoryRange *mapped_memory_range) {
+	struct memory_block const *block = &arena->blocks[allocation->block_index];
+	if (arena->memory_properties.memoryTypes[block->memory_type_index].propertyFlags &
+	    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+		return false;
+	}
+
+	*mapped_memory_range = (VkMappedMemoryRange){
+		.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.memory = allocation->memory,
+		.offset = allocation->offset,
+		.size   = allocation->size,
+	};
+	return true;
+}
+
+// makes cpu writes visible to the gpu, call before the submit that reads them
+bool flush_memory(struct memory_arena const *arena, struct memory_allocation const *allocation) {
+	VkMappedMemoryRange mapped_memory_range;
+	if (!get_non_coherent_range(arena, allocation, &mapped_memory_range)) {
+		return true;
+	}
+	return vkFlushMappedMemoryRanges(arena->device, 1, &mapped_memory_range) == VK_SUCCESS;
+}
+
+// makes gpu writes visible to the cpu, call after waiting for the submit that wrote them
+bool invalidate_memory(struct memory_arena const *arena, struct memory_allocation const *allocation) {
+	VkMappedMemoryRange mapped_memory_range;
+	if (!get_non_coherent_range(arena, allocation, &mapped_memory_range)) {
+		return true;
+	}
+	return vkInvalidateMappedMemoryRanges(arena->device, 1, &mapped_memory_range) == VK_SUCCESS;
+}
+
+void report_memory_arena(struct memory_arena const *arena) {
+	// fragmentation is the share of free memory outside the largest free range
+	VkDeviceSize total_size = 0, used_size = 0, free_size = 0, largest_free_size = 0;
+	uint32_t allocation_count = 0;
+	for (uint32_t i = 0; i < arena->block_count; ++i) {
+		struct memory_block const *block = &arena->blocks[i];
+		total_size += block->size;
+		for (uint32_t j = 0; j < block->range_count; ++j) {
+			struct memory_range const *range = &block->ranges[j];
+			if (range->used) {
+				used_size        += range->size;
+				allocation_count += 1;
+			} else {
+				free_size += range->size;
+				if (range->size > largest_free_size) {
+					largest_free_size = range->size;
+				}
+			}
+		}
+	}
+	double const fragmentation = free_size > 0 ? 1.0 - (double)largest_free_size / free_size : 0.0;
+
+	printf("memory arena: %u blocks, %.1f KiB allocated, %.1f KiB used by %u resources, %.1f%% fragmented\n",
+	       arena->block_count,
+	       total_size / 1024.0,
+	       used_size / 1024.0,
+	       allocation_count,
+	       fragmentation * 100.0);
+}
+
+void destroy_memory_arena(struct memory_arena *arena) {
+	for (uint32_t i = 0; i < arena->block_count; ++i) {
+		if (arena->blocks[i].mapped) {
+			vkUnmapMemory(arena->device, arena->blocks[i].memory);
+		}
+		vkFreeMemory(arena->device, arena->blocks[i].memory, NULL);
+	}
+	arena->block_count = 0;
+}
+
+// copies initial buffer contents into device local memory through a host visible staging buffer, on
+// a dedicated transfer queue when the device has one
+struct staging_uploader {
+	VkDevice device;
+	struct memory_arena *arena;
+	VkQueue queue;
+	bool dedicated_queue;
+	uint32_t queue_family_indices[2];
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	VkBuffer staging_buffer;
+	struct memory_allocation staging_buffer_allocation;
+	uint8_t *staging_buffer_mapped;
+	VkDeviceSize staging_buffer_offset;
+	bool recording;
+	VkDeviceSize bytes_uploaded;
+	uint32_t submit_count;
+};
+
+bool flush_staging_uploads(struct staging_uploader *uploader) {
+	if (!uploader->recording) {
+		return true;
+	}
+
+	if (vkEndCommandBuffer(uploader->command_buffer) != VK_SUCCESS ||
+	    !flush_memory(uploader->arena, &uploader->staging_buffer_allocation)) {
+		return false;
+	}
+
+	VkSubmitInfo submit_info = {
+		.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers    = &uploader->command_buffer,
+	};
+	if (vkQueueSubmit(uploader->queue, 1, &submit_info, uploader->fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	// the staging buffer is reused by the next upload, so wait for the copies to finish
+	if (vkWaitForFences(uploader->device, 1, &uploader->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+		return false;
+	}
+
+	vkResetFences(uploader->device, 1, &uploader->fence);
+
+	uploader->recording             = false;
+	uploader->staging_buffer_offset = 0;
+	uploader->submit_count         += 1;
+
+	return true;
+}
+
+bool stage_buffer_upload(struct staging_uploader *uploader,
+                         VkBuffer buffer,
+                         VkDeviceSize size,
+                         void const *data) {
+	// data larger than the staging buffer is copied in chunks, flushing whenever it fills up
+	VkDeviceSize uploaded = 0;
+	while (uploaded < size) {
+		if (uploader->staging_buffer_offset == STAGING_BUFFER_SIZE) {
+			if (!flush_staging_uploads(uploader)) {
+				return false;
+			}
+		}
+
+		if (!uploader->recording) {
+			vkResetCommandBuffer(uploader->command_buffer, 0);
+
+			VkCommandBufferBeginInfo command_buffer_begin_info = {
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			};
+			if (vkBeginCommandBuffer(uploader->command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+				return false;
+			}
+			uploader->recording = true;
+		}
+
+		VkDeviceSize const space = STAGING_BUFFER_SIZE - uploader->staging_buffer_offset;
+		VkDeviceSize const chunk_size = size - uploaded < space ? size - uploaded : space;
+		memcpy(uploader->staging_buffer_mapped + uploader->staging_buffer_offset,
+		       (uint8_t const *)data + uploaded,
+		       chunk_size);
+
+		VkBufferCopy buffer_copy = {
+			.srcOffset = uploader->staging_buffer_offset,
+			.dstOffset = uploaded,
+			.size      = chunk_size,
+		};
+		vkCmdCopyBuffer(uploader->command_buffer, uploader->staging_buffer, buffer, 1, &buffer_copy);
+
+		uploader->staging_buffer_offset += chunk_size;
+		uploaded                        += chunk_size;
+	}
+
+	uploader->bytes_uploaded += size;
+
+	return true;
+}
+
+bool create_buffer(struct memory_arena *arena,
+                   enum memory_usage usage,
+                   VkDeviceSize buffer_size,
+                   VkBufferUsageFlags usage_flags,
+                   VkBuffer *buffer,
+                   struct memory_allocation *buffer_allocation,
+                   VkDeviceAddress *device_address,
+                   void const *data,
+                   struct staging_uploader *uploader) {
+	VkBufferCreateInfo buffer_create_info = {
+		.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size        = buffer_size,
+		.usage       = usage_flags,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+
+	// initial data goes through the uploader when there is one, otherwise the memory must be mappable
+	bool const staged = data && uploader;
+	if (staged) {
+		buffer_create_info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+		// written on the transfer queue and read on the graphics queue without an ownership transfer
+		if (uploader->dedicated_queue) {
+			buffer_create_info.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+			buffer_create_info.queueFamilyIndexCount = 2;
+			buffer_create_info.pQueueFamilyIndices   = uploader->queue_family_indices;
+		}
+	}
+
+	if (vkCreateBuffer(arena->device, &buffer_create_info, NULL, buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (!bind_buffer_memory(arena, *buffer, usage, buffer_allocation)) {
+		return false;
+	}
+
+	if (data && !staged) {
+		memcpy(buffer_allocation->mapped, data, buffer_size);
+		if (!flush_memory(arena, buffer_allocation)) {
+			return false;
+		}
+	}
+
+	if (staged && !stage_buffer_upload(uploader, *buffer, buffer_size, data)) {
+		return false;
+	}
+
+	if (device_address) {
+		VkBufferDeviceAddressInfoKHR buffer_device_address_info = {
+			.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+			.buffer = *buffer,
+		};
+		*device_address = ext.vkGetBufferDeviceAddressKHR(arena->device, &buffer_device_address_info);
+	}
+
+	return true;
+}
+
+bool create_staging_uploader(struct staging_uploader *uploader,
+                             struct memory_arena *arena,
+                             uint32_t transfer_queue_index,
+                             uint32_t graphics_queue_index) {
+	VkDevice device = arena->device;
+	*uploader = (struct staging_uploader){
+		.device                  = device,
+		.arena                   = arena,
+		.dedicated_queue         = transfer_queue_index != graphics_queue_index,
+		.queue_family_indices[0] = transfer_queue_index,
+		.queue_family_indices[1] = graphics_queue_index,
+	};
+
+	vkGetDeviceQueue(device, transfer_queue_index, 0, &uploader->queue);
+
+	VkCommandPoolCreateInfo command_pool_create_info = {
+		.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+		                    VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = transfer_queue_index,
+	};
+	if (vkCreateCommandPool(device, &command_pool_create_info, NULL, &uploader->command_pool) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkCommandBufferAllocateInfo command_buffer_alloc_info = {
+		.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool        = uploader->command_pool,
+		.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	if (vkAllocateCommandBuffers(device, &command_buffer_alloc_info, &uploader->command_buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkFenceCreateInfo fence_create_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
+	if (vkCreateFence(device, &fence_create_info, NULL, &uploader->fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (!create_buffer(arena,
+	                   MEMORY_USAGE_UPLOAD,
+	                   STAGING_BUFFER_SIZE,
+	                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                   &uploader->staging_buffer,
+	                   &uploader->staging_buffer_allocation,
+	                   NULL, NULL, NULL)) {
+		return false;
+	}
+	uploader->staging_buffer_mapped = uploader->staging_buffer_allocation.mapped;
+
+	return true;
+}
+
+void destroy_staging_uploader(struct staging_uploader *uploader) {
+	VkDevice device = uploader->device;
+	vkDestroyBuffer(device, uploader->staging_buffer, NULL);
+	free_memory(uploader->arena, &uploader->staging_buffer_allocation);
+	vkDestroyFence(device, uploader->fence, NULL);
+	vkDestroyCommandPool(device, uploader->command_pool, NULL);
+}
+
+// spir-v compiled by the makefile and embedded in the binary, so no shader files are read at startup
+uint32_t const rgen_spv[] =
+#include "rgen.spv.inc"
+;
+
+uint32_t const miss_spv[] =
+#include "miss.spv.inc"
+;
+
+uint32_t const hit_spv[] =
+#include "hit.spv.inc"
+;
+
+struct embedded_shader {
+	char const *filename;
+	uint32_t const *code;
+	size_t code_size;
+};
+
+struct embedded_shader const embedded_shaders[] = {
+	{ "rgen.spv", rgen_spv, sizeof(rgen_spv) },
+	{ "miss.spv", miss_spv, sizeof(miss_spv) },
+	{ "hit.spv", hit_spv,  sizeof(hit_spv) },
+};
+
+bool create_shader_module(VkDevice device, char const *filename, VkShaderModule *shader_module) {
+	// a directory in VK_EXAMPLES_SHADER_DIR overrides the embedded shaders with its .spv files
+	char const *shader_dir = getenv("VK_EXAMPLES_SHADER_DIR");
+	void *file_code = NULL;
+	uint32_t const *shader_code = NULL;
+	size_t shader_code_size = 0;
+	if (shader_dir && shader_dir[0] != '\0') {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", shader_dir, filename);
+		file_code = load_binary_file(path, &shader_code_size);
+		shader_code = file_code;
+	} else {
+		for (size_t i = 0; i < sizeof(embedded_shaders) / sizeof(embedded_shaders[0]); ++i) {
+			if (strcmp(embedded_shaders[i].filename, filename) == 0) {
+				shader_code      = embedded_shaders[i].code;
+				shader_code_size = embedded_shaders[i].code_size;
+				break;
+			}
+		}
+	}
+	if (!shader_code) {
+		fprintf(stderr, "failed to load shader %s\n", filename);
+		return false;
+	}
+
+	VkShaderModuleCreateInfo shader_module_create_info = {
+		.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shader_code_size,
+		.pCode    = shader_code,
+	};
+
+	VkResult result = vkCreateShaderModule(device, &shader_module_create_info, NULL, shader_module);
+	free(file_code);
+	return result == VK_SUCCESS;
+}
+
+bool device_matches_override(char const *device_override,
+                             uint32_t device_index,
+                             char const *device_name) {
+	// no override means every device is a candidate
+	if (!device_override || device_override[0] == '\0') {
+		return true;
+	}
+
+	// a number selects a device by index, anything else is matched against the device name
+	char *end;
+	unsigned long override_index = strtoul(device_override, &end, 10);
+	if (*end == '\0') {
+		return override_index == device_index;
+	}
+	return strstr(device_name, device_override) != NULL;
+}
+
+uint64_t score_physical_device(VkPhysicalDevice physical_device,
+                               VkPhysicalDeviceType device_type,
+                               VkQueueFamilyProperties const *queue_family_properties) {
+	// device type matters most, cpu implementations such as lavapipe are the last resort
+	uint64_t type_score;
+	switch (device_type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   type_score = 4; break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type_score = 3; break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    type_score = 2; break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:            type_score = 1; break;
+		default:                                     type_score = 0; break;
+	}
+
+	// then a queue that can record timestamps
+	uint64_t queue_score = queue_family_properties->timestampValidBits > 0 ? 1 : 0;
+
+	// then the amount of device local memory
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+	uint64_t device_local_mib = 0;
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+		if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			device_local_mib += memory_properties.memoryHeaps[i].size >> 20;
+		}
+	}
+	if (device_local_mib >= (1ull << 39)) {
+		device_local_mib = (1ull << 39) - 1;
+	}
+
+	return (type_score << 40) | (queue_score << 39) | device_local_mib;
+}
+
+double timestamp_delta_ms(uint64_t begin,
+                          uint64_t end,
+                          uint64_t timestamp_mask,
+                          float timestamp_period) {
+	// only the valid bits take part, so the subtraction also handles wrap around
+	return ((end - begin) & timestamp_mask) * timestamp_period / 1000000.0;
+}
+
+bool write_frame_timings(FILE *timings_file,
+                         VkDevice device,
+                         VkQueryPool query_pool,
+                         uint32_t first_query,
+                         uint32_t frame_index,
+                         double frame_ms,
+                         uint64_t timestamp_mask,
+                         float timestamp_period) {
+	uint64_t timestamps[TIMESTAMP_COUNT];
+	if (vkGetQueryPoolResults(device,
+	                          query_pool,
+	                          first_query,
+	                          TIMESTAMP_COUNT,
+	                          sizeof(timestamps),
+	                          timestamps,
+	                          sizeof(uint64_t),
+	                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+		return false;
+	}
+	fprintf(timings_file,
+	        "%u,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+	        frame_index,
+	        frame_ms,
+	        timestamp_delta_ms(timestamps[TIMESTAMP_BLAS_UPDATE_BEGIN],
+	                           timestamps[TIMESTAMP_BLAS_UPDATE_END],
+	                           timestamp_mask,
+	                           timestamp_period),
+	        timestamp_delta_ms(timestamps[TIMESTAMP_TLAS_UPDATE_BEGIN],
+	                           timestamps[TIMESTAMP_TLAS_UPDATE_END],
+	                           timestamp_mask,
+	                           timestamp_period),
+	        timestamp_delta_ms(timestamps[TIMESTAMP_TRACE_BEGIN],
+	                           timestamps[TIMESTAMP_TRACE_END],
+	                           timestamp_mask,
+	                           timestamp_period),
+	        timestamp_delta_ms(timestamps[TIMESTAMP_TRACE_END],
+	                           timestamps[TIMESTAMP_COPY_END],
+	                           timestamp_mask,
+	                           timestamp_period));
+
+	return true;
+}
+
+bool get_frame_gpu_ms(VkDevice device,
+                      VkQueryPool query_pool,
+                      uint32_t first_query,
+                      uint64_t timestamp_mask,
+                      float timestamp_period,
+                      double *gpu_ms) {
+	// from the start of the bottom level update to the end of the copy
+	uint64_t timestamps[TIMESTAMP_COUNT];
+	if (vkGetQueryPoolResults(device,
+	                          query_pool,
+	                          first_query,
+	                          TIMESTAMP_COUNT,
+	                          sizeof(timestamps),
+	                          timestamps,
+	                          sizeof(uint64_t),
+	                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+		return false;
+	}
+	*gpu_ms = timestamp_delta_ms(timestamps[TIMESTAMP_BLAS_UPDATE_BEGIN],
+	                             timestamps[TIMESTAMP_COPY_END],
+	                             timestamp_mask,
+	                             timestamp_period);
+	return true;
+}
+
+VkDeviceSize scratch_region_size(VkAccelerationStructureBuildSizesInfoKHR const *build_sizes_info,
+                                 VkDeviceSize alignment) {
+	// the same region is used for the initial build and every later update
+	VkDeviceSize size = build_sizes_info->buildScratchSize;
+	if (build_sizes_info->updateScratchSize > size) {
+		size = build_sizes_info->updateScratchSize;
+	}
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+double get_time_ms(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+// startup phases, each timed with the monotonic clock the first time it runs, reported when
+// VK_EXAMPLES_PROFILE names the json file to write them to
+#define MAX_PROFILE_SPANS 32
+
+struct profile_span {
+	char const *name;
+	double start_ms;
+	double duration_ms;
+};
+
+struct {
+	struct profile_span spans[MAX_PROFILE_SPANS];
+	uint32_t span_count;
+	double origin_ms;
+} startup_profile;
+
+bool startup_profile_enabled(void) {
+	char const *json_filename = getenv("VK_EXAMPLES_PROFILE");
+	return json_filename && json_filename[0] != '\0';
+}
+
+// returns UINT32_MAX for a phase that already ran, ending that span is a no-op
+uint32_t begin_profile_span(char const *name) {
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		if (strcmp(startup_profile.spans[i].name, name) == 0) {
+			return UINT32_MAX;
+		}
+	}
+	if (startup_profile.span_count == MAX_PROFILE_SPANS) {
+		return UINT32_MAX;
+	}
+	double const now_ms = get_time_ms();
+	if (startup_profile.span_count == 0) {
+		startup_profile.origin_ms = now_ms;
+	}
+	startup_profile.spans[startup_profile.span_count] = (struct profile_span){
+		.name     = name,
+		.start_ms = now_ms - startup_profile.origin_ms,
+	};
+	return startup_profile.span_count++;
+}
+
+void end_profile_span(uint32_t span) {
+	if (span < startup_profile.span_count) {
+		struct profile_span *profile_span = &startup_profile.spans[span];
+		profile_span->duration_ms = get_time_ms() - startup_profile.origin_ms - profile_span->start_ms;
+	}
+}
+
+// the instance is created with the validation layer, the same instance without it is created once
+// more to show what the layer costs, after the loader has already been initialized by the first
+void profile_instance_without_validation(VkInstanceCreateInfo const *instance_create_info) {
+	if (!startup_profile_enabled() || instance_create_info->enabledLayerCount == 0) {
+		return;
+	}
+	VkInstanceCreateInfo create_info = *instance_create_info;
+	create_info.enabledLayerCount   = 0;
+	create_info.ppEnabledLayerNames = NULL;
+
+	VkInstance instance;
+	uint32_t const span = begin_profile_span("instance without validation");
+	VkResult const result = vkCreateInstance(&create_info, NULL, &instance);
+	end_profile_span(span);
+	if (result == VK_SUCCESS) {
+		vkDestroyInstance(instance, NULL);
+	}
+}
+
+// prints the phases as a table and writes them as json, start times are relative to the first phase
+bool report_startup_profile(void) {
+	if (!startup_profile_enabled() || startup_profile.span_count == 0) {
+		return true;
+	}
+	printf("%-28s %10s %10s\n", "phase", "start ms", "ms");
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		printf("%-28s %10.3f %10.3f\n", span->name, span->start_ms, span->duration_ms);
+	}
+
+	FILE *file = fopen(getenv("VK_EXAMPLES_PROFILE"), "w");
+	if (!file) {
+		return false;
+	}
+	fputs("{\n  \"phases\": [\n", file);
+	for (uint32_t i = 0; i < startup_profile.span_count; ++i) {
+		struct profile_span const *span = &startup_profile.spans[i];
+		fprintf(file,
+		        "    { \"name\": \"%s\", \"start_ms\": %.3f, \"duration_ms\": %.3f }%s\n",
+		        span->name,
+		        span->start_ms,
+		        span->duration_ms,
+		        i + 1 < startup_profile.span_count ? "," : "");
+	}
+	fputs("  ]\n}\n", file);
+	return fclose(file) == 0;
+}
+
+// where the kernel allows it images are written through io_uring, otherwise by a few writer
+// threads, in both cases straight from a pool of pinned buffers. A buffer holds a whole ppm file,
+// with the header right before the texels so a single write covers it, or rows that land at their
+// own offsets in a larger file, such as one tile of an image or one frame of a stream
+#define MAX_WRITER_BUFFERS     16
+#define MAX_WRITER_SUBMISSIONS 1024
+#define WRITER_BUFFER_COUNT    4
+#define WRITER_THREAD_COUNT    4
+#define WRITER_HEADER_SIZE     64
+
+struct writer_buffer {
+	uint8_t *data;        // WRITER_HEADER_SIZE bytes of header space, then the rgb8 texels
+	size_t mapped_size;
+	uint8_t *start;       // of the first row, a whole file is one row that starts with its header
+	size_t row_size;
+	uint32_t row_count;
+	off_t offset;         // of the first row in the file
+	off_t row_stride;     // between the starts of consecutive rows in the file
+	struct iovec *rows;   // what is left to write of every row
+	uint32_t next_row;    // the first row that has not been submitted yet
+	uint32_t rows_in_flight;
+	int fd;               // owned by the buffer until its write completes
+	bool pending;         // the buffer returns to the pool once all of its rows are written
+};
+
+// the submission and completion rings shared with the kernel
+struct io_uring_queue {
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	_Atomic uint32_t *sq_tail;
+	uint32_t sq_mask;
+	uint32_t *sq_array;
+	_Atomic uint32_t *cq_head;
+	_Atomic uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+	uint32_t unsubmitted; // prepared submissions the kernel has not taken yet
+	bool buffers_registered;
+};
+
+struct image_writer {
+	bool use_uring;
+	struct io_uring_queue uring;
+	struct writer_buffer buffers[MAX_WRITER_BUFFERS];
+	uint32_t buffer_count;
+	uint32_t max_row_count;
+	uint32_t rows_per_submission; // rows of one buffer in flight at once, so the queue never overflows
+	pthread_t threads[WRITER_THREAD_COUNT];
+	uint32_t thread_count;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; // signalled when a write is queued or completes
+	uint32_t queue[MAX_WRITER_BUFFERS];
+	uint32_t queue_head;
+	uint32_t queue_count;
+	bool stopping;
+	bool failed;
+};
+
+bool create_io_uring_queue(struct io_uring_queue *uring, uint32_t entry_count) {
+	struct io_uring_params params = {0};
+	*uring = (struct io_uring_queue){ .fd = syscall(__NR_io_uring_setup, entry_count, &params) };
+	if (uring->fd < 0) {
+		return false;
+	}
+
+	// newer kernels map both rings with a single mmap
+	uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap && uring->cq_ring_size > uring->sq_ring_size) {
+		uring->sq_ring_size = uring->cq_ring_size;
+	}
+	uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	uring->sq_ring = mmap(NULL,
+	                      uring->sq_ring_size,
+	                      PROT_READ | PROT_WRITE,
+	                      MAP_SHARED | MAP_POPULATE,
+	                      uring->fd,
+	                      IORING_OFF_SQ_RING);
+	uring->cq_ring = single_mmap ? uring->sq_ring : mmap(NULL,
+	                                                     uring->cq_ring_size,
+	                                                     PROT_READ | PROT_WRITE,
+	                                                     MAP_SHARED | MAP_POPULATE,
+	                                                     uring->fd,
+	                                                     IORING_OFF_CQ_RING);
+	uring->sqes = mmap(NULL,
+	                   uring->sqes_size,
+	                   PROT_READ | PROT_WRITE,
+	                   MAP_SHARED | MAP_POPULATE,
+	                   uring->fd,
+	                   IORING_OFF_SQES);
+	if (uring->sq_ring == MAP_FAILED || uring->cq_ring == MAP_FAILED || uring->sqes == MAP_FAILED) {
+		close(uring->fd);
+		return false;
+	}
+
+	uint8_t *sq_ring = uring->sq_ring;
+	uint8_t *cq_ring = uring->cq_ring;
+	uring->sq_tail  = (_Atomic uint32_t *)(sq_ring + params.sq_off.tail);
+	uring->sq_mask  = *(uint32_t *)(sq_ring + params.sq_off.ring_mask);
+	uring->sq_array = (uint32_t *)(sq_ring + params.sq_off.array);
+	uring->cq_head  = (_Atomic uint32_t *)(cq_ring + params.cq_off.head);
+	uring->cq_tail  = (_Atomic uint32_t *)(cq_ring + params.cq_off.tail);
+	uring->cq_mask  = *(uint32_t *)(cq_ring + params.cq_off.ring_mask);
+	uring->cqes     = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+	return true;
+}
+
+void destroy_io_uring_queue(struct io_uring_queue *uring) {
+	munmap(uring->sqes, uring->sqes_size);
+	if (uring->cq_ring != uring->sq_ring) {
+		munmap(uring->cq_ring, uring->cq_ring_size);
+	}
+	munmap(uring->sq_ring, uring->sq_ring_size);
+	close(uring->fd);
+}
+
+// fills a submission for what is left of one row, the kernel picks it up on the next enter
+void prepare_row_write(struct image_writer *writer, uint32_t buffer_index, uint32_t row) {
+	struct io_uring_queue *uring = &writer->uring;
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	struct iovec *rest = &buffer->rows[row];
+	size_t const written = (uint8_t *)rest->iov_base - (buffer->start + row * buffer->row_size);
+	uint32_t const tail  = atomic_load_explicit(uring->sq_tail, memory_order_relaxed);
+	uint32_t const index = tail & uring->sq_mask;
+	struct io_uring_sqe *sqe = &uring->sqes[index];
+	*sqe = (struct io_uring_sqe){
+		.fd        = buffer->fd,
+		.off       = buffer->offset + row * buffer->row_stride + written,
+		.user_data = (uint64_t)buffer_index << 32 | row,
+	};
+	if (uring->buffers_registered) {
+		sqe->opcode    = IORING_OP_WRITE_FIXED;
+		sqe->addr      = (uintptr_t)rest->iov_base;
+		sqe->len       = rest->iov_len;
+		sqe->buf_index = buffer_index;
+	} else {
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr   = (uintptr_t)rest;
+		sqe->len    = 1;
+	}
+	uring->sq_array[index] = index;
+	atomic_store_explicit(uring->sq_tail, tail + 1, memory_order_release);
+	uring->unsubmitted += 1;
+	buffer->rows_in_flight += 1;
+}
+
+// hands every prepared submission to the kernel, and waits for a completion when asked to. What the
+// kernel does not take now is handed over again on the next call, so no prepared write is lost
+bool enter_io_uring(struct io_uring_queue *uring, bool wait) {
+	if (uring->unsubmitted == 0 && !wait) {
+		return true;
+	}
+	int const submitted = syscall(__NR_io_uring_enter,
+	                              uring->fd,
+	                              uring->unsubmitted,
+	                              wait ? 1 : 0,
+	                              wait ? IORING_ENTER_GETEVENTS : 0,
+	                              NULL,
+	                              0);
+	if (submitted < 0) {
+		return false;
+	}
+	uring->unsubmitted -= submitted;
+	return true;
+}
+
+// prepares the next rows of a buffer up to its share of the queue
+void prepare_buffer_rows(struct image_writer *writer, uint32_t buffer_index) {
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	while (buffer->next_row < buffer->row_count && buffer->rows_in_flight < writer->rows_per_submission) {
+		prepare_row_write(writer, buffer_index, buffer->next_row++);
+	}
+}
+
+bool reap_image_writes(struct image_writer *writer, bool wait) {
+	struct io_uring_queue *uring = &writer->uring;
+	if (wait && !enter_io_uring(uring, true)) {
+		return false;
+	}
+
+	uint32_t head = atomic_load_explicit(uring->cq_head, memory_order_relaxed);
+	uint32_t const tail = atomic_load_explicit(uring->cq_tail, memory_order_acquire);
+	for (; head != tail; ++head) {
+		struct io_uring_cqe const *cqe = &uring->cqes[head & uring->cq_mask];
+		uint32_t const buffer_index = cqe->user_data >> 32;
+		uint32_t const row = (uint32_t)cqe->user_data;
+		struct writer_buffer *buffer = &writer->buffers[buffer_index];
+		struct iovec *rest = &buffer->rows[row];
+		buffer->rows_in_flight -= 1;
+		if (cqe->res <= 0) {
+			writer->failed = true;
+		} else {
+			rest->iov_base = (uint8_t *)rest->iov_base + cqe->res;
+			rest->iov_len -= cqe->res;
+		}
+
+		// a short write is continued from where it stopped, a finished row makes room for the next
+		if (!writer->failed) {
+			if (rest->iov_len > 0) {
+				prepare_row_write(writer, buffer_index, row);
+			} else {
+				prepare_buffer_rows(writer, buffer_index);
+			}
+		}
+
+		// after a failure nothing more is submitted and the buffer is released once it is idle
+		if (buffer->rows_in_flight == 0 && (writer->failed || buffer->next_row == buffer->row_count)) {
+			if (close(buffer->fd) != 0) {
+				writer->failed = true;
+			}
+			buffer->pending = false;
+		}
+	}
+	atomic_store_explicit(uring->cq_head, head, memory_order_release);
+	if (!enter_io_uring(uring, false)) {
+		writer->failed = true;
+	}
+	return !writer->failed;
+}
+
+bool write_buffer_rows(struct writer_buffer *buffer) {
+	for (uint32_t row = 0; row < buffer->row_count; ++row) {
+		struct iovec *rest = &buffer->rows[row];
+		while (rest->iov_len > 0) {
+			size_t const written_before = (uint8_t *)rest->iov_base - (buffer->start + row * buffer->row_size);
+			ssize_t const written = pwrite(buffer->fd,
+			                               rest->iov_base,
+			                               rest->iov_len,
+			                               buffer->offset + row * buffer->row_stride + written_before);
+			if (written <= 0) {
+				return false;
+			}
+			rest->iov_base = (uint8_t *)rest->iov_base + written;
+			rest->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+void *image_writer_thread(void *arg) {
+	struct image_writer *writer = arg;
+	pthread_mutex_lock(&writer->mutex);
+	while (true) {
+		while (writer->queue_count == 0 && !writer->stopping) {
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		if (writer->queue_count == 0) {
+			break;
+		}
+		struct writer_buffer *buffer = &writer->buffers[writer->queue[writer->queue_head]];
+		writer->queue_head = (writer->queue_head + 1) % MAX_WRITER_BUFFERS;
+		writer->queue_count -= 1;
+		pthread_mutex_unlock(&writer->mutex);
+
+		bool const written = write_buffer_rows(buffer);
+		bool const closed = close(buffer->fd) == 0;
+
+		pthread_mutex_lock(&writer->mutex);
+		writer->failed |= !written || !closed;
+		buffer->pending = false;
+		pthread_cond_broadcast(&writer->cond);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+	return NULL;
+}
+
+void destroy_image_writer(struct image_writer *writer) {
+	if (writer->use_uring) {
+		destroy_io_uring_queue(&writer->uring);
+	} else if (writer->thread_count > 0) {
+		pthread_mutex_lock(&writer->mutex);
+		writer->stopping = true;
+		pthread_cond_broadcast(&writer->cond);
+		pthread_mutex_unlock(&writer->mutex);
+		for (uint32_t i = 0; i < writer->thread_count; ++i) {
+			pthread_join(writer->threads[i], NULL);
+		}
+	}
+	if (!writer->use_uring) {
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->mutex);
+	}
+	for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+		munmap(writer->buffers[i].data, writer->buffers[i].mapped_size);
+		free(writer->buffers[i].rows);
+	}
+}
+
+bool create_image_writer(struct image_writer *writer,
+                         uint32_t buffer_count,
+                         size_t texel_size,
+                         uint32_t max_row_count,
+                         bool use_threads) {
+	if (buffer_count == 0 || buffer_count > MAX_WRITER_BUFFERS || max_row_count == 0) {
+		return false;
+	}
+	*writer = (struct image_writer){
+		.buffer_count        = buffer_count,
+		.max_row_count       = max_row_count,
+		.rows_per_submission = MAX_WRITER_SUBMISSIONS / buffer_count,
+	};
+	if (writer->rows_per_submission > max_row_count) {
+		writer->rows_per_submission = max_row_count;
+	}
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+
+	// page aligned and faulted in up front, locked where the memlock limit allows
+	size_t const page_size = sysconf(_SC_PAGESIZE);
+	struct iovec iovecs[MAX_WRITER_BUFFERS];
+	for (uint32_t i = 0; i < buffer_count; ++i) {
+		struct writer_buffer *buffer = &writer->buffers[i];
+		buffer->mapped_size = (WRITER_HEADER_SIZE + texel_size + page_size - 1) & ~(page_size - 1);
+		buffer->data = mmap(NULL,
+		                    buffer->mapped_size,
+		                    PROT_READ | PROT_WRITE,
+		                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+		                    -1,
+		                    0);
+		buffer->rows = buffer->data != MAP_FAILED ? malloc(max_row_count * sizeof(struct iovec)) : NULL;
+		if (!buffer->rows) {
+			if (buffer->data != MAP_FAILED) {
+				munmap(buffer->data, buffer->mapped_size);
+			}
+			writer->buffer_count = i;
+			destroy_image_writer(writer);
+			return false;
+		}
+		mlock(buffer->data, buffer->mapped_size);
+		iovecs[i] = (struct iovec){ .iov_base = buffer->data, .iov_len = buffer->mapped_size };
+	}
+
+	// registered buffers stay pinned by the kernel, so writes skip mapping them on every submission
+	if (!use_threads && create_io_uring_queue(&writer->uring, buffer_count * writer->rows_per_submission)) {
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->mutex);
+		writer->use_uring = true;
+		writer->uring.buffers_registered =
+			syscall(__NR_io_uring_register, writer->uring.fd, IORING_REGISTER_BUFFERS, iovecs, buffer_count) == 0;
+		return true;
+	}
+
+	for (uint32_t i = 0; i < WRITER_THREAD_COUNT; ++i) {
+		if (pthread_create(&writer->threads[i], NULL, image_writer_thread, writer) != 0) {
+			break;
+		}
+		writer->thread_count += 1;
+	}
+	if (writer->thread_count == 0) {
+		destroy_image_writer(writer);
+		return false;
+	}
+	return true;
+}
+
+bool find_free_writer_buffer(struct image_writer const *writer, uint32_t *buffer_index) {
+	for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+		if (!writer->buffers[i].pending) {
+			*buffer_index = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint8_t *acquire_writer_buffer(struct image_writer *writer, uint32_t *buffer_index) {
+	bool failed;
+	if (writer->use_uring) {
+		if (!reap_image_writes(writer, false)) {
+			return NULL;
+		}
+		while (!find_free_writer_buffer(writer, buffer_index)) {
+			if (!reap_image_writes(writer, true)) {
+				return NULL;
+			}
+		}
+		failed = writer->failed;
+	} else {
+		pthread_mutex_lock(&writer->mutex);
+		while (!find_free_writer_buffer(writer, buffer_index)) {
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		failed = writer->failed;
+		pthread_mutex_unlock(&writer->mutex);
+	}
+	return failed ? NULL : writer->buffers[*buffer_index].data + WRITER_HEADER_SIZE;
+}
+
+// queues row_count rows of row_size bytes from start, which lies in the acquired buffer, to the
+// file at offset and every row_stride bytes after it, the writer closes fd once they are written
+bool queue_buffer_write(struct image_writer *writer,
+                        uint32_t buffer_index,
+                        uint8_t *start,
+                        int fd,
+                        off_t offset,
+                        size_t row_size,
+                        uint32_t row_count,
+                        off_t row_stride) {
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	if (row_count == 0 || row_count > writer->max_row_count) {
+		close(fd);
+		return false;
+	}
+	buffer->start      = start;
+	buffer->fd         = fd;
+	buffer->offset     = offset;
+	buffer->row_size   = row_size;
+	buffer->row_count  = row_count;
+	buffer->row_stride = row_stride;
+	for (uint32_t row = 0; row < row_count; ++row) {
+		buffer->rows[row] = (struct iovec){ .iov_base = start + row * row_size, .iov_len = row_size };
+	}
+
+	if (writer->use_uring) {
+		buffer->pending        = true;
+		buffer->next_row       = 0;
+		buffer->rows_in_flight = 0;
+		prepare_buffer_rows(writer, buffer_index);
+		return enter_io_uring(&writer->uring, false);
+	}
+	pthread_mutex_lock(&writer->mutex);
+	buffer->pending = true;
+	writer->queue[(writer->queue_head + writer->queue_count) % MAX_WRITER_BUFFERS] = buffer_index;
+	writer->queue_count += 1;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+	return true;
+}
+
+// queues the acquired buffer as a whole ppm file
+bool queue_image_write(struct image_writer *writer,
+                       uint32_t buffer_index,
+                       char const *filename,
+                       uint32_t width_px,
+                       uint32_t height_px) {
+	struct writer_buffer *buffer = &writer->buffers[buffer_index];
+	char header[WRITER_HEADER_SIZE];
+	int const header_size = snprintf(header, sizeof(header), "P6 %u %u 255\n", width_px, height_px);
+	uint8_t *start = buffer->data + WRITER_HEADER_SIZE - header_size;
+	memcpy(start, header, header_size);
+
+	int const fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	return queue_buffer_write(writer,
+	                          buffer_index,
+	                          start,
+	                          fd,
+	                          0,
+	                          header_size + (size_t)width_px * height_px * 3,
+	                          1,
+	                          0);
+}
+
+// waits for every queued write, a failure is reported once and the writer can be used again after
+bool finish_image_writes(struct image_writer *writer) {
+	bool failed;
+	if (writer->use_uring) {
+		for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+			while (writer->buffers[i].pending) {
+				if (!enter_io_uring(&writer->uring, true)) {
+					return false;
+				}
+				reap_image_writes(writer, false);
+			}
+		}
+		failed = writer->failed;
+		writer->failed = false;
+	} else {
+		pthread_mutex_lock(&writer->mutex);
+		for (uint32_t i = 0; i < writer->buffer_count; ++i) {
+			while (writer->buffers[i].pending) {
+				pthread_cond_wait(&writer->cond, &writer->mutex);
+			}
+		}
+		failed = writer->failed;
+		writer->failed = false;
+		pthread_mutex_unlock(&writer->mutex);
+	}
+	return !failed;
+}
+
+// an offscreen sequence is written as numbered ppm files when the output is a printf pattern such
+// as frame-%05u.ppm, and otherwise as one raw rgb8 stream with every frame after the last. Frames
+// are converted into writer buffers and written while the frames after them render
+struct sequence_output {
+	uint32_t            frame_count;
+	char const         *filename;
+	int                 stream_fd; // only for a raw stream
+	struct image_writer writer;
+	double              write_ms;  // spent converting frames and waiting for their writes
+};
+
+// the pattern becomes the format of snprintf, so besides %% it may hold only one conversion, of the
+// frame index, as a decimal with optional flags and width such as %05u
+bool is_frame_pattern(char const *pattern) {
+	uint32_t conversion_count = 0;
+	for (char const *c = pattern; *c; ++c) {
+		if (*c != '%') {
+			continue;
+		}
+		if (*++c == '%') {
+			continue;
+		}
+		while (*c == '-' || *c == '0' || *c == '+' || *c == ' ') {
+			++c;
+		}
+		while (*c >= '0' && *c <= '9') {
+			++c;
+		}
+		if (*c != 'u' && *c != 'd' && *c != 'i') {
+			return false;
+		}
+		conversion_count += 1;
 	}
-	return VK_FALSE;
+	return conversion_count == 1;
 }
 
-bool create_buffer(VkDevice device,
-                   uint32_t usable_memory_types,
-                   VkDeviceSize buffer_size,
-                   VkBufferUsageFlags usage_flags,
-                   VkBuffer *buffer,
-                   VkDeviceMemory *buffer_memory,
-                   VkDeviceAddress *device_address,
-                   void const *data) {
-	VkBufferCreateInfo buffer_create_info = {
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size  = buffer_size,
-		.usage = usage_flags,
-	};
-	if (vkCreateBuffer(device, &buffer_create_info, NULL, buffer) != VK_SUCCESS) {
+bool open_sequence_output(struct sequence_output *output, uint32_t width, uint32_t height) {
+	output->stream_fd = -1;
+	output->write_ms = 0.0;
+	if (strchr(output->filename, '%') && !is_frame_pattern(output->filename)) {
+		fprintf(stderr, "%s must hold exactly one frame number conversion such as %%05u\n", output->filename);
 		return false;
 	}
-
-	VkMemoryRequirements memory_requirements;
-	vkGetBufferMemoryRequirements(device, *buffer, &memory_requirements);
-
-	uint32_t const memory_types_matching_requirements =
-		memory_requirements.memoryTypeBits & usable_memory_types;
-	if (memory_types_matching_requirements == 0) {
+	if (!strchr(output->filename, '%')) {
+		output->stream_fd = open(output->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (output->stream_fd < 0) {
+			return false;
+		}
+	}
+	if (!create_image_writer(&output->writer, WRITER_BUFFER_COUNT, (size_t)width * height * 3, 1, false)) {
+		if (output->stream_fd >= 0) {
+			close(output->stream_fd);
+		}
 		return false;
 	}
+	return true;
+}
 
-	VkMemoryAllocateFlagsInfo memory_alloc_flags_info = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
-		.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR,
-	};
-
-	VkMemoryAllocateInfo buffer_memory_allocate_info = {
-		.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.pNext           = &memory_alloc_flags_info,
-		.allocationSize  = memory_requirements.size,
-		.memoryTypeIndex = __builtin_ctz(memory_types_matching_requirements),
-	};
-	if (vkAllocateMemory(device, &buffer_memory_allocate_info, NULL, buffer_memory) != VK_SUCCESS) {
+bool write_sequence_frame(struct sequence_output *output,
+                          uint8_t const *rgba,
+                          uint32_t width,
+                          uint32_t height,
+                          uint32_t frame_index) {
+	double const write_start_ms = get_time_ms();
+
+	// drop the alpha channel into a writer buffer, which waits for an earlier frame's write to
+	// complete when none is free
+	uint32_t buffer_index;
+	uint8_t *texels = acquire_writer_buffer(&output->writer, &buffer_index);
+	if (!texels) {
 		return false;
 	}
-
-	if (data) {
-		void *mapped;
-		if (vkMapMemory(device, *buffer_memory, 0, buffer_size, 0, &mapped) != VK_SUCCESS) {
+	size_t const texel_count = (size_t)width * height;
+	for (size_t i = 0; i < texel_count; ++i) {
+		texels[3 * i + 0] = rgba[4 * i + 0];
+		texels[3 * i + 1] = rgba[4 * i + 1];
+		texels[3 * i + 2] = rgba[4 * i + 2];
+	}
+
+	// a frame of the raw stream goes to its place after the earlier frames through its own
+	// descriptor, which the writer closes once the frame is written
+	bool queued;
+	if (output->stream_fd < 0) {
+		char filename[256];
+		int const filename_length = snprintf(filename, sizeof(filename), output->filename, frame_index);
+		if (filename_length < 0 || filename_length >= (int)sizeof(filename)) {
+			fprintf(stderr, "the name of frame %u is longer than %zu characters\n", frame_index, sizeof(filename) - 1);
 			return false;
 		}
-		memcpy(mapped, data, buffer_size);
-		vkUnmapMemory(device, *buffer_memory);
-	}
+		queued = queue_image_write(&output->writer, buffer_index, filename, width, height);
+	} else {
+		int const fd = dup(output->stream_fd);
+		queued = fd >= 0 &&
+		         queue_buffer_write(&output->writer,
+		                            buffer_index,
+		                            texels,
+		                            fd,
+		                            (off_t)frame_index * texel_count * 3,
+		                            texel_count * 3,
+		                            1,
+		                            0);
+	}
+	output->write_ms += get_time_ms() - write_start_ms;
+	return queued;
+}
 
-	if (vkBindBufferMemory(device, *buffer, *buffer_memory, 0) != VK_SUCCESS) {
-		return false;
+// waits for the frames still being written, so it belongs inside the timed part of the run
+bool close_sequence_output(struct sequence_output *output) {
+	double const write_start_ms = get_time_ms();
+	bool closed = finish_image_writes(&output->writer);
+	destroy_image_writer(&output->writer);
+	if (output->stream_fd >= 0) {
+		closed = close(output->stream_fd) == 0 && closed;
 	}
+	output->write_ms += get_time_ms() - write_start_ms;
+	return closed;
+}
 
-	if (device_address) {
-		VkBufferDeviceAddressInfoKHR buffer_device_address_info = {
-			.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-			.buffer = *buffer,
-		};
-		*device_address = ext.vkGetBufferDeviceAddressKHR(device, &buffer_device_address_info);
+void report_sequence_output(struct sequence_output const *output,
+                            uint32_t frame_count,
+                            double loop_ms,
+                            double gpu_ms) {
+	printf("offscreen frames: %u, %.1f fps, wall %.3f ms, cpu readback and write wait %.3f ms",
+	       frame_count,
+	       frame_count * 1000.0 / loop_ms,
+	       loop_ms,
+	       output->write_ms);
+
+	// the share of the shorter of gpu and cpu work that was hidden behind the other
+	if (gpu_ms > 0.0) {
+		double const hidden_ms = gpu_ms + output->write_ms - loop_ms;
+		double const shorter_ms = gpu_ms < output->write_ms ? gpu_ms : output->write_ms;
+		double overlap = shorter_ms > 0.0 ? hidden_ms / shorter_ms : 0.0;
+		overlap = overlap < 0.0 ? 0.0 : overlap > 1.0 ? 1.0 : overlap;
+		printf(", gpu %.3f ms, overlap %.0f%%", gpu_ms, overlap * 100.0);
+	}
+	printf("\n");
+}
+
+bool device_supports_extension(VkPhysicalDevice physical_device, char const *extension_name) {
+	uint32_t extension_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, NULL);
+	VkExtensionProperties extensions[extension_count];
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, extensions);
+	for (uint32_t i = 0; i < extension_count; ++i) {
+		if (strcmp(extension_name, extensions[i].extensionName) == 0) {
+			return true;
+		}
 	}
+	return false;
+}
 
-	return true;
+void get_pipeline_cache_filename(VkPhysicalDeviceProperties const *device_properties,
+                                 char *filename,
+                                 size_t filename_size) {
+	// cache data is only valid for the device and driver version that produced it
+	char uuid[2 * VK_UUID_SIZE + 1];
+	for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+		sprintf(&uuid[2 * i], "%02x", device_properties->pipelineCacheUUID[i]);
+	}
+	snprintf(filename, filename_size, "pipeline-cache-%s-%08x.bin", uuid, device_properties->driverVersion);
 }
 
-bool create_shader_module(VkDevice device, char const *filename, VkShaderModule *shader_module) {
-	size_t shader_code_size;
-	void *shader_code = load_binary_file(filename, &shader_code_size);
-	if (!shader_code) {
+bool save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, char const *filename) {
+	size_t data_size = 0;
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, NULL) != VK_SUCCESS) {
 		return false;
 	}
 
-	VkShaderModuleCreateInfo shader_module_create_info = {
-		.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = shader_code_size,
-		.pCode    = shader_code,
-	};
+	void *data = malloc(data_size);
+	if (!data) {
+		return false;
+	}
+	if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, data) != VK_SUCCESS) {
+		free(data);
+		return false;
+	}
 
-	VkResult result = vkCreateShaderModule(device, &shader_module_create_info, NULL, shader_module);
-	free(shader_code);
-	return result == VK_SUCCESS;
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		free(data);
+		return false;
+	}
+	size_t written = fwrite(data, 1, data_size, file);
+	fclose(file);
+	free(data);
+
+	return written == data_size;
 }
 
-bool run_ray_tracer() {
-	// create window
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, APP_NAME, NULL, NULL);
+void report_pipeline_creation(double creation_ms,
+                              size_t initial_cache_size,
+                              VkPipelineCreationFeedbackEXT const *feedback) {
+	printf("pipeline creation: %.3f ms (%s start", creation_ms, initial_cache_size > 0 ? "warm" : "cold");
+	if (feedback && (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+		bool const cache_hit =
+			feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+		printf(", driver reports %.3f ms, cache %s", feedback->duration / 1000000.0, cache_hit ? "hit" : "miss");
+	}
+	printf(")\n");
+}
+
+bool run_ray_tracer(char const *timings_filename,
+                    uint32_t frames_in_flight,
+                    struct sequence_output *sequence) {
+	// open the per frame gpu timings file if one was requested
+	FILE *timings_file = NULL;
+	if (timings_filename) {
+		timings_file = fopen(timings_filename, "w");
+		if (!timings_file) {
+			return false;
+		}
+	}
+
+	// create window, an offscreen sequence renders without one
+	GLFWwindow *window = NULL;
+	if (!sequence) {
+		uint32_t const window_span = begin_profile_span("window");
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, APP_NAME, NULL, NULL);
+		end_profile_span(window_span);
+	}
 
 	// create vulkan instance
 	VkApplicationInfo app_info = {
@@ -160,7 +1879,7 @@ bool run_ray_tracer() {
 	};
 
 	uint32_t glfw_extension_count = 0;
-	char const **glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+	char const **glfw_extensions = window ? glfwGetRequiredInstanceExtensions(&glfw_extension_count) : NULL;
 	char const *extension_names[glfw_extension_count+1];
 	for (uint32_t i = 0; i < glfw_extension_count; ++i) {
 		extension_names[i] = glfw_extensions[i];
@@ -169,23 +1888,34 @@ bool run_ray_tracer() {
 
 	char const *validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
 
+	// validation is off in release mode, the performance mode adds the best practices checks
+	enum validation_mode const validation = get_validation_mode();
+	VkValidationFeatureEnableEXT const best_practices = VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT;
+	VkValidationFeaturesEXT validation_features = {
+		.sType                         = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT,
+		.enabledValidationFeatureCount = 1,
+		.pEnabledValidationFeatures    = &best_practices,
+	};
+
 	VkInstanceCreateInfo instance_create_info = {
 		.sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pNext                   = validation == VALIDATION_PERFORMANCE ? &validation_features : NULL,
 		.pApplicationInfo        = &app_info,
-		.enabledLayerCount       = 1,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
 		.ppEnabledLayerNames     = validation_layers,
-		.enabledExtensionCount   = glfw_extension_count + 1,
+		.enabledExtensionCount   = glfw_extension_count + (validation != VALIDATION_OFF ? 1 : 0),
 		.ppEnabledExtensionNames = extension_names,
 	};
 
+	uint32_t const instance_span = begin_profile_span("instance");
 	VkInstance instance;
 	if (vkCreateInstance(&instance_create_info, NULL, &instance) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(instance_span);
+	profile_instance_without_validation(&instance_create_info);
 
 	// load extension functions
-	LOAD_EXTENSION_FUNC(vkCreateDebugUtilsMessengerEXT);
-	LOAD_EXTENSION_FUNC(vkDestroyDebugUtilsMessengerEXT);
 	LOAD_EXTENSION_FUNC(vkGetBufferDeviceAddressKHR);
 	LOAD_EXTENSION_FUNC(vkCreateAccelerationStructureKHR);
 	LOAD_EXTENSION_FUNC(vkDestroyAccelerationStructureKHR);
@@ -196,32 +1926,23 @@ bool run_ray_tracer() {
 	LOAD_EXTENSION_FUNC(vkGetRayTracingShaderGroupHandlesKHR);
 	LOAD_EXTENSION_FUNC(vkCreateRayTracingPipelinesKHR);
 
-	// setup debug messenger
-	VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info = {
-		.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-		.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
-		.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                           VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-		.pfnUserCallback = debug_callback,
-	};
-
-	VkDebugUtilsMessengerEXT debug_messenger;
-	if (ext.vkCreateDebugUtilsMessengerEXT(instance,
-                                           &debug_messenger_create_info,
-                                           NULL,
-                                           &debug_messenger) != VK_SUCCESS) {
+	// setup debug messenger, unless validation is off
+	uint32_t const debug_messenger_span = begin_profile_span("debug messenger");
+	VkDebugUtilsMessengerEXT debug_messenger = VK_NULL_HANDLE;
+	if (validation != VALIDATION_OFF && !create_debug_messenger(instance, validation, &debug_messenger)) {
 		return false;
 	}
+	end_profile_span(debug_messenger_span);
 
-	VkSurfaceKHR surface;
-	if (glfwCreateWindowSurface(instance, window, NULL, &surface) != VK_SUCCESS) {
+	uint32_t const surface_span = begin_profile_span("surface");
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	if (window && glfwCreateWindowSurface(instance, window, NULL, &surface) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(surface_span);
 
 	// select physical device
+	uint32_t const device_enumeration_span = begin_profile_span("device enumeration");
 	uint32_t physical_device_count = 0;
 	vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL);
 	if (physical_device_count == 0) {
@@ -243,13 +1964,21 @@ bool run_ray_tracer() {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 
+	// the swap chain extension comes last and is only needed with a window
+	uint32_t const required_extension_count = window ? NUM_REQUIRED_EXTENSIONS : NUM_REQUIRED_EXTENSIONS - 1;
+
+	// an index or part of a device name in VK_EXAMPLES_DEVICE overrides the automatic choice
+	char const *device_override = getenv("VK_EXAMPLES_DEVICE");
+
 	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
-	uint32_t graphics_queue_index, present_queue_index;
+	uint32_t graphics_queue_index, present_queue_index, transfer_queue_index;
+	uint32_t timestamp_valid_bits;
+	float timestamp_period;
+	uint64_t best_device_score = 0;
 	for (uint32_t i = 0; i < physical_device_count; ++i) {
 		VkPhysicalDeviceProperties device_properties;
 		vkGetPhysicalDeviceProperties(physical_devices[i], &device_properties);
-		if (device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-		    device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
+		if (!device_matches_override(device_override, i, device_properties.deviceName)) {
 			continue;
 		}
 
@@ -258,7 +1987,7 @@ bool run_ray_tracer() {
 		VkExtensionProperties extensions[extension_count];
 		vkEnumerateDeviceExtensionProperties(physical_devices[i], NULL, &extension_count, extensions);
 		size_t extensions_found = 0;
-		for (size_t j = 0; j < NUM_REQUIRED_EXTENSIONS; ++j) {
+		for (size_t j = 0; j < required_extension_count; ++j) {
 			for (uint32_t k = 0; k < extension_count; ++k) {
 				if (strcmp(required_extensions[j], extensions[k].extensionName) == 0) {
 					extensions_found += 1;
@@ -266,7 +1995,7 @@ bool run_ray_tracer() {
 				}
 			}
 		}
-		if (extensions_found < NUM_REQUIRED_EXTENSIONS) {
+		if (extensions_found < required_extension_count) {
 			continue;
 		}
 
@@ -276,33 +2005,81 @@ bool run_ray_tracer() {
 		vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i],
 		                                         &queue_family_count,
 		                                         queue_family_properties);
-		graphics_queue_index = UINT32_MAX;
-		present_queue_index  = UINT32_MAX;
+		uint32_t candidate_graphics_queue_index = UINT32_MAX;
+		uint32_t candidate_present_queue_index  = UINT32_MAX;
 		for (uint32_t j = 0; j < queue_family_count; ++j) {
 			if (queue_family_properties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				graphics_queue_index = j;
+				candidate_graphics_queue_index = j;
 			}
 			VkBool32 present_support = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i], j, surface, &present_support);
+			if (surface != VK_NULL_HANDLE) {
+				vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i], j, surface, &present_support);
+			}
 			if (present_support) {
-				present_queue_index = j;
+				candidate_present_queue_index = j;
+			}
+		}
+
+		// without a window nothing is presented, so the graphics queue stands in for a present queue
+		if (!window) {
+			candidate_present_queue_index = candidate_graphics_queue_index;
+		}
+		if (candidate_graphics_queue_index == UINT32_MAX ||
+		    candidate_present_queue_index == UINT32_MAX) {
+			continue;
+		}
+
+		// a family with transfer but no graphics or compute support is usually a dedicated copy engine,
+		// without one uploads go through the graphics queue
+		uint32_t candidate_transfer_queue_index = candidate_graphics_queue_index;
+		for (uint32_t j = 0; j < queue_family_count; ++j) {
+			VkQueueFlags const queue_flags = queue_family_properties[j].queueFlags;
+			if ((queue_flags & VK_QUEUE_TRANSFER_BIT) &&
+			    !(queue_flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				candidate_transfer_queue_index = j;
+				break;
 			}
 		}
-		if (graphics_queue_index == UINT32_MAX || present_queue_index == UINT32_MAX) {
+
+		// keep the highest scoring device that meets all requirements
+		uint64_t device_score =
+			score_physical_device(physical_devices[i],
+			                      device_properties.deviceType,
+			                      &queue_family_properties[candidate_graphics_queue_index]);
+		if (physical_device != VK_NULL_HANDLE && device_score <= best_device_score) {
 			continue;
 		}
 
-		physical_device = physical_devices[i];
-		break;
+		physical_device      = physical_devices[i];
+		best_device_score    = device_score;
+		graphics_queue_index = candidate_graphics_queue_index;
+		present_queue_index  = candidate_present_queue_index;
+		transfer_queue_index = candidate_transfer_queue_index;
+		timestamp_valid_bits = queue_family_properties[candidate_graphics_queue_index].timestampValidBits;
+		timestamp_period     = device_properties.limits.timestampPeriod;
 	}
 
 	if (physical_device == VK_NULL_HANDLE) {
 		return false;
 	}
 
+	// pipeline creation feedback is optional and only used to report pipeline cache hits
+	bool const creation_feedback_supported =
+		device_supports_extension(physical_device, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	char const *device_extensions[NUM_REQUIRED_EXTENSIONS + 1];
+	memcpy(device_extensions, required_extensions, required_extension_count * sizeof(required_extensions[0]));
+	uint32_t device_extension_count = required_extension_count;
+	if (creation_feedback_supported) {
+		device_extensions[device_extension_count++] = VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME;
+	}
+
 	// create device
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR acceleration_structure_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR,
+	};
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR ray_tracing_pipeline_properties = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR,
+		.pNext = &acceleration_structure_properties,
 	};
 	VkPhysicalDeviceProperties2 device_properties = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
@@ -311,23 +2088,28 @@ bool run_ray_tracer() {
 	vkGetPhysicalDeviceProperties2(physical_device, &device_properties);
 
 	float const queue_priority = 1.0f;
-	VkDeviceQueueCreateInfo device_queue_create_infos[2] = {
-		{
-			.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-			.queueFamilyIndex = graphics_queue_index,
-			.queueCount       = 1,
-			.pQueuePriorities = &queue_priority,
-		},
-		{
+	uint32_t queue_indices[2] = { graphics_queue_index, present_queue_index };
+	uint32_t const num_queues = graphics_queue_index == present_queue_index ? 1 : 2;
+
+	// one queue from each distinct family used for graphics, presentation and uploads
+	uint32_t const used_queue_indices[3] = { graphics_queue_index, present_queue_index, transfer_queue_index };
+	VkDeviceQueueCreateInfo device_queue_create_infos[3];
+	uint32_t device_queue_create_info_count = 0;
+	for (uint32_t i = 0; i < 3; ++i) {
+		bool already_used = false;
+		for (uint32_t j = 0; j < i; ++j) {
+			already_used |= used_queue_indices[j] == used_queue_indices[i];
+		}
+		if (already_used) {
+			continue;
+		}
+		device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo){
 			.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-			.queueFamilyIndex = present_queue_index,
+			.queueFamilyIndex = used_queue_indices[i],
 			.queueCount       = 1,
 			.pQueuePriorities = &queue_priority,
-		}
-	};
-
-	uint32_t queue_indices[2] = { graphics_queue_index, present_queue_index };
-	uint32_t const num_queues = graphics_queue_index == present_queue_index ? 1 : 2;
+		};
+	}
 
 	VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address_features = {
 		.sType               = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
@@ -354,33 +2136,25 @@ bool run_ray_tracer() {
 	VkDeviceCreateInfo device_create_info = {
 		.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
 		.pNext                   = (void*)&device_features,
-		.queueCreateInfoCount    = num_queues,
+		.queueCreateInfoCount    = device_queue_create_info_count,
 		.pQueueCreateInfos       = device_queue_create_infos,
-		.enabledExtensionCount   = NUM_REQUIRED_EXTENSIONS,
-		.ppEnabledExtensionNames = required_extensions,
-		.enabledLayerCount       = 1,
+		.enabledExtensionCount   = device_extension_count,
+		.ppEnabledExtensionNames = device_extensions,
+		.enabledLayerCount       = validation != VALIDATION_OFF ? 1 : 0,
 		.ppEnabledLayerNames     = validation_layers,
 	};
 
+	end_profile_span(device_enumeration_span);
+	uint32_t const device_span = begin_profile_span("device");
 	VkDevice device;
 	if (vkCreateDevice(physical_device, &device_create_info, NULL, &device) != VK_SUCCESS) {
 		return false;
 	}
+	end_profile_span(device_span);
 
-	// find host coherent memory types
-	VkPhysicalDeviceMemoryProperties memory_properties;
-	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
-	
-	uint32_t host_coherent_memory_types = 0;
-	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
-		if ((memory_properties.memoryTypes[i].propertyFlags &
-			 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
-			(memory_properties.memoryTypes[i].propertyFlags &
-			 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
-			) {
-			host_coherent_memory_types |= 1 << i;
-		}
-	}
+	// create arena that buffers and images are sub-allocated from
+	struct memory_arena arena;
+	init_memory_arena(&arena, physical_device, device, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
 
 	// get queues from device
 	VkQueue graphics_queue;
@@ -388,89 +2162,132 @@ bool run_ray_tracer() {
 	VkQueue present_queue;
 	vkGetDeviceQueue(device, present_queue_index, 0, &present_queue);
 
-	// create swap chain
-	VkSurfaceCapabilitiesKHR swap_chain_capabilities;
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &swap_chain_capabilities);
-
-	uint32_t surface_format_count;
-	vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &surface_format_count, NULL);
-	VkSurfaceFormatKHR surface_formats[surface_format_count];
-	vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &surface_format_count, surface_formats);
+	// create uploader for the initial contents of device local buffers
+	struct staging_uploader uploader;
+	if (!create_staging_uploader(&uploader,
+	                             &arena,
+	                             transfer_queue_index,
+	                             graphics_queue_index)) {
+		return false;
+	}
 
-	VkSurfaceFormatKHR surface_format = surface_formats[0];
-	for (uint32_t i = 0; i < surface_format_count; ++i) {
-		if (surface_formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
-		    surface_formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-			surface_format = surface_formats[i];
-			break;
+	// create swap chain, an offscreen sequence copies each traced frame to a readback buffer instead
+	uint32_t const swap_chain_span = begin_profile_span("swap chain");
+	VkSurfaceFormatKHR surface_format = {
+		.format     = VK_FORMAT_R8G8B8A8_UNORM,
+		.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+	};
+	VkExtent2D surface_extent = { WINDOW_WIDTH, WINDOW_HEIGHT };
+	uint32_t image_count = frames_in_flight;
+	VkSwapchainKHR swap_chain = VK_NULL_HANDLE;
+	if (window) {
+		VkSurfaceCapabilitiesKHR swap_chain_capabilities;
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &swap_chain_capabilities);
+
+		uint32_t surface_format_count;
+		vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &surface_format_count, NULL);
+		VkSurfaceFormatKHR surface_formats[surface_format_count];
+		vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &surface_format_count, surface_formats);
+
+		surface_format = surface_formats[0];
+		for (uint32_t i = 0; i < surface_format_count; ++i) {
+			if (surface_formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
+			    surface_formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+				surface_format = surface_formats[i];
+				break;
+			}
 		}
-	}
 
-	uint32_t present_mode_count;
-	vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, NULL);
-	if (present_mode_count == 0) {
-		return false;
-	}
-	VkPresentModeKHR present_modes[present_mode_count];
-	vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, present_modes);
+		uint32_t present_mode_count;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, NULL);
+		if (present_mode_count == 0) {
+			return false;
+		}
+		VkPresentModeKHR present_modes[present_mode_count];
+		vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, present_modes);
+
+		VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		for (uint32_t i = 0; i < present_mode_count; ++i) {
+			if (present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+				present_mode = present_modes[i];
+				break;
+			}
+		}
 
-	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
-	for (uint32_t i = 0; i < present_mode_count; ++i) {
-		if (present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-			present_mode = present_modes[i];
-			break;
+		surface_extent = swap_chain_capabilities.currentExtent;
+		if (swap_chain_capabilities.currentExtent.width == UINT32_MAX) {
+			int width, height;
+			glfwGetFramebufferSize(window, &width, &height);
+			surface_extent.width  = width > swap_chain_capabilities.maxImageExtent.width
+			                      ? swap_chain_capabilities.maxImageExtent.width
+			                      : width < swap_chain_capabilities.minImageExtent.width
+			                      ? swap_chain_capabilities.minImageExtent.width
+			                      : width;
+			surface_extent.height = height > swap_chain_capabilities.maxImageExtent.height
+			                      ? swap_chain_capabilities.maxImageExtent.height
+			                      : height < swap_chain_capabilities.minImageExtent.height
+			                      ? swap_chain_capabilities.minImageExtent.height
+			                      : height;
 		}
-	}
 
-	VkExtent2D surface_extent = swap_chain_capabilities.currentExtent;
-	if (swap_chain_capabilities.currentExtent.width == UINT32_MAX) {
-		int width, height;
-		glfwGetFramebufferSize(window, &width, &height);
-		surface_extent.width  = width > swap_chain_capabilities.maxImageExtent.width
-		                      ? swap_chain_capabilities.maxImageExtent.width
-		                      : width < swap_chain_capabilities.minImageExtent.width
-		                      ? swap_chain_capabilities.minImageExtent.width
-		                      : width;
-		surface_extent.height = height > swap_chain_capabilities.maxImageExtent.height
-		                      ? swap_chain_capabilities.maxImageExtent.height
-		                      : height < swap_chain_capabilities.minImageExtent.height
-		                      ? swap_chain_capabilities.minImageExtent.height
-		                      : height;
-	}
+		image_count = swap_chain_capabilities.minImageCount + 1;
+		if (swap_chain_capabilities.maxImageCount > 0 && image_count > swap_chain_capabilities.maxImageCount) {
+			image_count = swap_chain_capabilities.maxImageCount;
+		}
 
-	uint32_t image_count = swap_chain_capabilities.minImageCount + 1;
-	if (swap_chain_capabilities.maxImageCount > 0 && image_count > swap_chain_capabilities.maxImageCount) {
-		image_count = swap_chain_capabilities.maxImageCount;
-	}
+		VkSwapchainCreateInfoKHR swapchain_create_info = {
+			.sType                 = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+			.surface               = surface,
+			.minImageCount         = image_count,
+			.imageFormat           = surface_format.format,
+			.imageColorSpace       = surface_format.colorSpace,
+			.imageExtent           = surface_extent,
+			.imageArrayLayers      = 1,
+			.imageUsage            = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			.imageSharingMode      = num_queues > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = num_queues,
+			.pQueueFamilyIndices   = queue_indices,
+			.preTransform          = swap_chain_capabilities.currentTransform,
+			.compositeAlpha        = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+			.presentMode           = present_mode,
+			.clipped               = VK_TRUE,
+			.oldSwapchain          = VK_NULL_HANDLE,
+		};
 
-	VkSwapchainCreateInfoKHR swapchain_create_info = {
-		.sType                 = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-		.surface               = surface,
-		.minImageCount         = image_count,
-		.imageFormat           = surface_format.format,
-		.imageColorSpace       = surface_format.colorSpace,
-		.imageExtent           = surface_extent,
-		.imageArrayLayers      = 1,
-		.imageUsage            = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		.imageSharingMode      = num_queues > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
-		.queueFamilyIndexCount = num_queues,
-		.pQueueFamilyIndices   = queue_indices,
-		.preTransform          = swap_chain_capabilities.currentTransform,
-		.compositeAlpha        = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		.presentMode           = present_mode,
-		.clipped               = VK_TRUE,
-		.oldSwapchain          = VK_NULL_HANDLE,
-	};
+		if (vkCreateSwapchainKHR(device, &swapchain_create_info, NULL, &swap_chain) != VK_SUCCESS) {
+			return false;
+		}
 
-	VkSwapchainKHR swap_chain;
-	if (vkCreateSwapchainKHR(device, &swapchain_create_info, NULL, &swap_chain) != VK_SUCCESS) {
-		return false;
+		// get swap chain images
+		vkGetSwapchainImagesKHR(device, swap_chain, &image_count, NULL);
 	}
 
-	// get swap chain images
-	vkGetSwapchainImagesKHR(device, swap_chain, &image_count, NULL);
 	VkImage swap_chain_images[image_count];
-	vkGetSwapchainImagesKHR(device, swap_chain, &image_count, swap_chain_images);
+	if (window) {
+		vkGetSwapchainImagesKHR(device, swap_chain, &image_count, swap_chain_images);
+	}
+
+	// create a readback buffer per frame in flight, so frame k is written out while later frames render
+	VkDeviceSize const readback_size = (VkDeviceSize)surface_extent.width * surface_extent.height * 4;
+	VkBuffer readback_buffers[MAX_FRAMES_IN_FLIGHT];
+	struct memory_allocation readback_allocations[MAX_FRAMES_IN_FLIGHT];
+	for (uint32_t i = 0; i < frames_in_flight && !window; ++i) {
+		VkBufferCreateInfo readback_buffer_create_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size  = readback_size,
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		};
+		if (vkCreateBuffer(device, &readback_buffer_create_info, NULL, &readback_buffers[i]) != VK_SUCCESS) {
+			return false;
+		}
+		if (!bind_buffer_memory(&arena, readback_buffers[i], MEMORY_USAGE_READBACK, &readback_allocations[i])) {
+			return false;
+		}
+	}
+	if (sequence && !open_sequence_output(sequence, surface_extent.width, surface_extent.height)) {
+		return false;
+	}
+	end_profile_span(swap_chain_span);
 
 	// create command pool
 	VkCommandPoolCreateInfo command_pool_create_info = {
@@ -495,18 +2312,45 @@ bool run_ray_tracer() {
 		return false;
 	}
 
-	// create semaphores
+	// create per frame command buffers so the cpu can record a frame while the gpu works on earlier ones
+	VkCommandBufferAllocateInfo frame_command_buffer_alloc_info = {
+		.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool        = command_pool,
+		.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = frames_in_flight,
+	};
+	VkCommandBuffer frame_command_buffers[MAX_FRAMES_IN_FLIGHT];
+	if (vkAllocateCommandBuffers(device, &frame_command_buffer_alloc_info, frame_command_buffers) != VK_SUCCESS) {
+		return false;
+	}
+
+	// create per frame semaphores and fences, the fences start signalled so the first wait on each returns
 	VkSemaphoreCreateInfo semaphore_create_info = {
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
 	};
+	VkFenceCreateInfo frame_fence_create_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
 
-	VkSemaphore image_available_semaphore;
-	if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &image_available_semaphore) != VK_SUCCESS) {
-		return false;
+	VkSemaphore image_available_semaphores[MAX_FRAMES_IN_FLIGHT];
+	VkFence frame_fences[MAX_FRAMES_IN_FLIGHT];
+	for (uint32_t i = 0; i < frames_in_flight; ++i) {
+		if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &image_available_semaphores[i]) != VK_SUCCESS) {
+			return false;
+		}
+		if (vkCreateFence(device, &frame_fence_create_info, NULL, &frame_fences[i]) != VK_SUCCESS) {
+			return false;
+		}
 	}
-	VkSemaphore render_finished_semaphore;
-	if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &render_finished_semaphore) != VK_SUCCESS) {
-		return false;
+
+	// a swap chain image can still be queued for presentation when its frame slot comes round again,
+	// so the render finished semaphores belong to the swap chain images rather than the frames
+	VkSemaphore render_finished_semaphores[image_count];
+	for (uint32_t i = 0; i < image_count; ++i) {
+		if (vkCreateSemaphore(device, &semaphore_create_info, NULL, &render_finished_semaphores[i]) != VK_SUCCESS) {
+			return false;
+		}
 	}
 
 	// create fence
@@ -519,7 +2363,36 @@ bool run_ray_tracer() {
 		return false;
 	}
 
+	// create timestamp query pool
+	VkQueryPoolCreateInfo query_pool_create_info = {
+		.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType  = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = TIMESTAMP_COUNT * frames_in_flight,
+	};
+
+	VkQueryPool query_pool;
+	if (vkCreateQueryPool(device, &query_pool_create_info, NULL, &query_pool) != VK_SUCCESS) {
+		return false;
+	}
+
+	// a queue without valid timestamp bits cannot write timestamps, so timing is skipped
+	uint64_t const timestamp_mask =
+		timestamp_valid_bits >= 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+
+	// per frame gpu timings are only written when the queue supports timestamps
+	if (timings_file) {
+		if (timestamp_mask == 0) {
+			fputs("timestamps not supported, no gpu timings will be written\n", stderr);
+		}
+		fputs("frame,frame_ms,blas_update_ms,tlas_update_ms,trace_ms,copy_ms\n", timings_file);
+	}
+	bool const write_timings = timings_file && timestamp_mask != 0;
+
+	// an offscreen sequence also records them, to report how much gpu and cpu work overlapped
+	bool const record_timestamps = (timings_file || sequence) && timestamp_mask != 0;
+
 	// create image
+	uint32_t const allocation_span = begin_profile_span("allocation");
 	VkImageCreateInfo image_create_info = {
 		.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 		.imageType     = VK_IMAGE_TYPE_2D,
@@ -541,25 +2414,12 @@ bool run_ray_tracer() {
 		return false;
 	}
 
-	VkMemoryRequirements memory_requirements;
-	vkGetImageMemoryRequirements(device, image, &memory_requirements);
-
-	uint32_t usable_memory_bits = memory_requirements.memoryTypeBits & host_coherent_memory_types;
-	if (usable_memory_bits == 0) {
-		return false;
-	}
-
-	VkMemoryAllocateInfo memory_alloc_info = {
-		.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize  = memory_requirements.size,
-		.memoryTypeIndex = __builtin_ctz(usable_memory_bits),
-	};
-	VkDeviceMemory image_memory;
-	if (vkAllocateMemory(device, &memory_alloc_info, NULL, &image_memory) != VK_SUCCESS) {
-		return false;
-	}
-
-	if (vkBindImageMemory(device, image, image_memory, 0) != VK_SUCCESS) {
+	struct memory_allocation image_allocation;
+	if (!bind_image_memory(&arena,
+	                       image,
+	                       VK_IMAGE_TILING_OPTIMAL,
+	                       MEMORY_USAGE_GPU_ONLY,
+	                       &image_allocation)) {
 		return false;
 	}
 
@@ -648,17 +2508,18 @@ bool run_ray_tracer() {
 	};
 
 	VkBuffer vertex_buffer;
-	VkDeviceMemory vertex_buffer_memory;
+	struct memory_allocation vertex_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR vertex_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   sizeof(vertices),
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &vertex_buffer,
-	                   &vertex_buffer_memory,
+	                   &vertex_buffer_allocation,
 	                   &vertex_buffer_device_address.deviceAddress,
-	                   vertices)) {
+	                   vertices,
+	                   &uploader)) {
 		return false;
 	}
 
@@ -666,17 +2527,18 @@ bool run_ray_tracer() {
 	uint32_t const indices[] = { 0, 1, 2 };
 
 	VkBuffer index_buffer;
-	VkDeviceMemory index_buffer_memory;
+	struct memory_allocation index_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR index_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   sizeof(indices),
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &index_buffer,
-	                   &index_buffer_memory,
+	                   &index_buffer_allocation,
 	                   &index_buffer_device_address.deviceAddress,
-	                   indices)) {
+	                   indices,
+	                   &uploader)) {
 		return false;
 	}
 
@@ -687,22 +2549,32 @@ bool run_ray_tracer() {
 		0.0f, 0.0f, 1.0f, 0.0f
 	};
 
+	// each frame in flight has its own copy of the transform, so the cpu never overwrites one that an
+	// earlier frame's update is still reading
+	VkTransformMatrixKHR transform_matrices[MAX_FRAMES_IN_FLIGHT];
+	for (uint32_t i = 0; i < frames_in_flight; ++i) {
+		transform_matrices[i] = transform_matrix;
+	}
+
 	VkBuffer transform_matrix_buffer;
-	VkDeviceMemory transform_matrix_buffer_memory;
+	struct memory_allocation transform_matrix_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR transform_matrix_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
-	                   sizeof(transform_matrix),
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_DYNAMIC,
+	                   sizeof(transform_matrix) * frames_in_flight,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &transform_matrix_buffer,
-	                   &transform_matrix_buffer_memory,
+	                   &transform_matrix_buffer_allocation,
 	                   &transform_matrix_buffer_device_address.deviceAddress,
-	                   &transform_matrix)) {
+	                   transform_matrices,
+	                   NULL)) {
 		return false;
 	}
+	end_profile_span(allocation_span);
 
 	// create bottom level acceleration structure buffer
+	uint32_t const acceleration_structure_span = begin_profile_span("acceleration structures");
 	VkAccelerationStructureGeometryKHR bottom_level_acceleration_structure_geometry = {
 		.sType                            = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
 		.flags                            = VK_GEOMETRY_OPAQUE_BIT_KHR,
@@ -740,16 +2612,22 @@ bool run_ray_tracer() {
 		&acceleration_structure_build_sizes_info
 	);
 
+	// scratch memory is sized once for both the build and the per frame updates
+	VkDeviceSize const scratch_alignment =
+		acceleration_structure_properties.minAccelerationStructureScratchOffsetAlignment;
+	VkDeviceSize const bottom_level_scratch_size =
+		scratch_region_size(&acceleration_structure_build_sizes_info, scratch_alignment);
+
 	VkBuffer bottom_level_acceleration_structure_buffer;
-	VkDeviceMemory bottom_level_acceleration_structure_buffer_memory;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	struct memory_allocation bottom_level_acceleration_structure_buffer_allocation;
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   acceleration_structure_build_sizes_info.accelerationStructureSize,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
 	                   &bottom_level_acceleration_structure_buffer,
-	                   &bottom_level_acceleration_structure_buffer_memory,
-	                   NULL, NULL)) {
+	                   &bottom_level_acceleration_structure_buffer_allocation,
+	                   NULL, NULL, NULL)) {
 		return false;
 	}
 
@@ -757,73 +2635,18 @@ bool run_ray_tracer() {
 	VkAccelerationStructureCreateInfoKHR bottom_level_acceleration_structure_create_info = {
 		.sType  = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
 		.buffer = bottom_level_acceleration_structure_buffer,
-		.size   = acceleration_structure_build_sizes_info.accelerationStructureSize,
-		.type   = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
-	};
-
-	VkAccelerationStructureKHR bottom_level_acceleration_structure;
-	if (ext.vkCreateAccelerationStructureKHR(device,
-	                                     &bottom_level_acceleration_structure_create_info,
-	                                     NULL,
-	                                     &bottom_level_acceleration_structure) != VK_SUCCESS) {
-		return false;
-	}
-
-	VkBuffer scratch_buffer;
-	VkDeviceMemory scratch_buffer_memory;
-	VkDeviceOrHostAddressKHR scratch_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
-	                   acceleration_structure_build_sizes_info.buildScratchSize,
-	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-	                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-	                   &scratch_buffer,
-	                   &scratch_buffer_memory,
-	                   &scratch_buffer_device_address.deviceAddress,
-	                   NULL)) {
-		return false;
-	}
-
-	bottom_level_acceleration_structure_build_geometry_info.dstAccelerationStructure = bottom_level_acceleration_structure;
-	bottom_level_acceleration_structure_build_geometry_info.scratchData              = scratch_buffer_device_address;
-
-	VkAccelerationStructureBuildRangeInfoKHR bottom_level_acceleration_structure_build_range_info = {
-		.primitiveCount  = num_triangles,
-		.primitiveOffset = 0,
-		.firstVertex     = 0,
-		.transformOffset = 0,
-	};
-	VkAccelerationStructureBuildRangeInfoKHR const *bottom_level_acceleration_structure_build_range_infos[] = {
-		&bottom_level_acceleration_structure_build_range_info,
-	};
-
-	vkResetCommandBuffer(command_buffer, 0);
-
-	if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
-		return false;
-	}
-
-	ext.vkCmdBuildAccelerationStructuresKHR(
-		command_buffer,
-		1,
-		&bottom_level_acceleration_structure_build_geometry_info,
-		bottom_level_acceleration_structure_build_range_infos
-	);
-
-	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-		return false;
-	}
-
-	if (vkQueueSubmit(graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
-		return false;
-	}
+		.size   = acceleration_structure_build_sizes_info.accelerationStructureSize,
+		.type   = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+	};
 
-	if (vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+	VkAccelerationStructureKHR bottom_level_acceleration_structure;
+	if (ext.vkCreateAccelerationStructureKHR(device,
+	                                     &bottom_level_acceleration_structure_create_info,
+	                                     NULL,
+	                                     &bottom_level_acceleration_structure) != VK_SUCCESS) {
 		return false;
 	}
 
-	vkResetFences(device, 1, &fence);
-
 	VkAccelerationStructureDeviceAddressInfoKHR bottom_level_acceleration_device_address_info = {
 		.sType                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
 		.accelerationStructure = bottom_level_acceleration_structure,
@@ -831,9 +2654,6 @@ bool run_ray_tracer() {
 	uint64_t const bottom_level_acceleration_structure_buffer_device_address =
 		ext.vkGetAccelerationStructureDeviceAddressKHR(device, &bottom_level_acceleration_device_address_info);
 
-	vkFreeMemory(device, scratch_buffer_memory, NULL);
-	vkDestroyBuffer(device, scratch_buffer, NULL);
-
 	// create top level acceleration structure buffer
 	VkAccelerationStructureInstanceKHR acceleration_structure_instance = {
 		.transform                              = transform_matrix,
@@ -845,17 +2665,18 @@ bool run_ray_tracer() {
 	};
 
 	VkBuffer acceleration_structure_instance_buffer;
-	VkDeviceMemory acceleration_structure_instance_buffer_memory;
+	struct memory_allocation acceleration_structure_instance_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR acceleration_structure_instance_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   sizeof(acceleration_structure_instance),
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 	                   &acceleration_structure_instance_buffer,
-	                   &acceleration_structure_instance_buffer_memory,
+	                   &acceleration_structure_instance_buffer_allocation,
 	                   &acceleration_structure_instance_buffer_device_address.deviceAddress,
-	                   &acceleration_structure_instance)) {
+	                   &acceleration_structure_instance,
+	                   &uploader)) {
 		return false;
 	}
 
@@ -889,15 +2710,15 @@ bool run_ray_tracer() {
 	);
 
 	VkBuffer top_level_acceleration_structure_buffer;
-	VkDeviceMemory top_level_acceleration_structure_buffer_memory;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	struct memory_allocation top_level_acceleration_structure_buffer_allocation;
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   acceleration_structure_build_sizes_info.accelerationStructureSize,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
 	                   &top_level_acceleration_structure_buffer,
-	                   &top_level_acceleration_structure_buffer_memory,
-	                   NULL, NULL)) {
+	                   &top_level_acceleration_structure_buffer_allocation,
+	                   NULL, NULL, NULL)) {
 		return false;
 	}
 
@@ -917,20 +2738,80 @@ bool run_ray_tracer() {
 		return false;
 	}
 
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
-	                   acceleration_structure_build_sizes_info.buildScratchSize,
+	// create one scratch buffer for every acceleration structure build and update, the bottom level
+	// structure uses the start of it and the top level structure the region after that
+	VkDeviceSize const top_level_scratch_size =
+		scratch_region_size(&acceleration_structure_build_sizes_info, scratch_alignment);
+
+	VkBuffer scratch_buffer;
+	struct memory_allocation scratch_buffer_allocation;
+	VkDeviceAddress scratch_buffer_device_address;
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
+	                   bottom_level_scratch_size + top_level_scratch_size + scratch_alignment,
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 	                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 	                   &scratch_buffer,
-	                   &scratch_buffer_memory,
-	                   &scratch_buffer_device_address.deviceAddress,
-	                   NULL)) {
+	                   &scratch_buffer_allocation,
+	                   &scratch_buffer_device_address,
+	                   NULL, NULL)) {
+		return false;
+	}
+
+	// the buffer address only meets the buffer alignment, so round it up to the scratch alignment
+	VkDeviceAddress const bottom_level_scratch_address =
+		(scratch_buffer_device_address + scratch_alignment - 1) & ~(scratch_alignment - 1);
+	VkDeviceAddress const top_level_scratch_address = bottom_level_scratch_address + bottom_level_scratch_size;
+
+	// build bottom level acceleration structure
+	bottom_level_acceleration_structure_build_geometry_info.dstAccelerationStructure  = bottom_level_acceleration_structure;
+	bottom_level_acceleration_structure_build_geometry_info.scratchData.deviceAddress = bottom_level_scratch_address;
+
+	VkAccelerationStructureBuildRangeInfoKHR bottom_level_acceleration_structure_build_range_info = {
+		.primitiveCount  = num_triangles,
+		.primitiveOffset = 0,
+		.firstVertex     = 0,
+		.transformOffset = 0,
+	};
+	VkAccelerationStructureBuildRangeInfoKHR const *bottom_level_acceleration_structure_build_range_infos[] = {
+		&bottom_level_acceleration_structure_build_range_info,
+	};
+
+	// the builds read the geometry and instance buffers, so their uploads must have finished
+	if (!flush_staging_uploads(&uploader)) {
+		return false;
+	}
+
+	vkResetCommandBuffer(command_buffer, 0);
+
+	if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+		return false;
+	}
+
+	ext.vkCmdBuildAccelerationStructuresKHR(
+		command_buffer,
+		1,
+		&bottom_level_acceleration_structure_build_geometry_info,
+		bottom_level_acceleration_structure_build_range_infos
+	);
+
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (vkQueueSubmit(graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
 		return false;
 	}
 
-	top_level_acceleration_structure_build_geometry_info.dstAccelerationStructure = top_level_acceleration_structure;
-	top_level_acceleration_structure_build_geometry_info.scratchData              = scratch_buffer_device_address;
+	vkResetFences(device, 1, &fence);
+
+	// build top level acceleration structure
+	top_level_acceleration_structure_build_geometry_info.dstAccelerationStructure  = top_level_acceleration_structure;
+	top_level_acceleration_structure_build_geometry_info.scratchData.deviceAddress = top_level_scratch_address;
 
 	VkAccelerationStructureBuildRangeInfoKHR top_level_acceleration_structure_build_range_info = {
 		.primitiveCount  = 1,
@@ -968,9 +2849,7 @@ bool run_ray_tracer() {
 	}
 
 	vkResetFences(device, 1, &fence);
-
-	vkFreeMemory(device, scratch_buffer_memory, NULL);
-	vkDestroyBuffer(device, scratch_buffer, NULL);
+	end_profile_span(acceleration_structure_span);
 
 	// create descriptor set layout
 	VkDescriptorSetLayoutBinding descriptor_set_layout_bindings[2] = {
@@ -1014,14 +2893,22 @@ bool run_ray_tracer() {
 	}
 
 	// create shader modules
+	uint32_t const shader_span = begin_profile_span("shader load");
 	VkShaderModule rgen_shader_module;
-	create_shader_module(device, "rgen.spv", &rgen_shader_module);
+	if (!create_shader_module(device, "rgen.spv", &rgen_shader_module)) {
+		return false;
+	}
 
 	VkShaderModule miss_shader_module;
-	create_shader_module(device, "miss.spv", &miss_shader_module);
+	if (!create_shader_module(device, "miss.spv", &miss_shader_module)) {
+		return false;
+	}
 	
 	VkShaderModule hit_shader_module;
-	create_shader_module(device, "hit.spv", &hit_shader_module);
+	if (!create_shader_module(device, "hit.spv", &hit_shader_module)) {
+		return false;
+	}
+	end_profile_span(shader_span);
 
 	// create ray tracing pipeline
 	VkPipelineShaderStageCreateInfo shader_stage_create_infos[3] = {
@@ -1082,15 +2969,63 @@ bool run_ray_tracer() {
 		.layout                       = pipeline_layout,
 	};
 
+	// load the pipeline cache left behind by an earlier run on the same device and driver
+	uint32_t const pipeline_span = begin_profile_span("pipeline creation");
+	char pipeline_cache_filename[64];
+	get_pipeline_cache_filename(&device_properties.properties,
+	                            pipeline_cache_filename,
+	                            sizeof(pipeline_cache_filename));
+
+	size_t pipeline_cache_data_size = 0;
+	void *pipeline_cache_data = load_binary_file(pipeline_cache_filename, &pipeline_cache_data_size);
+	VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+		.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = pipeline_cache_data_size,
+		.pInitialData    = pipeline_cache_data,
+	};
+
+	VkPipelineCache pipeline_cache;
+	VkResult pipeline_cache_result =
+		vkCreatePipelineCache(device, &pipeline_cache_create_info, NULL, &pipeline_cache);
+	free(pipeline_cache_data);
+	if (pipeline_cache_result != VK_SUCCESS) {
+		return false;
+	}
+
+	// let the driver report whether the cache was hit
+	VkPipelineCreationFeedbackEXT pipeline_creation_feedback = {0};
+	VkPipelineCreationFeedbackEXT stage_creation_feedbacks[3];
+	VkPipelineCreationFeedbackCreateInfoEXT pipeline_creation_feedback_create_info = {
+		.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+		.pPipelineCreationFeedback          = &pipeline_creation_feedback,
+		.pipelineStageCreationFeedbackCount = 3,
+		.pPipelineStageCreationFeedbacks    = stage_creation_feedbacks,
+	};
+	if (creation_feedback_supported) {
+		ray_tracing_pipeline_create_info.pNext = &pipeline_creation_feedback_create_info;
+	}
+
 	VkPipeline ray_tracing_pipeline;
+	double const pipeline_creation_start_ms = get_time_ms();
 	if (ext.vkCreateRayTracingPipelinesKHR(device,
-	                                       VK_NULL_HANDLE, VK_NULL_HANDLE,
+	                                       VK_NULL_HANDLE, pipeline_cache,
 	                                       1,
 	                                       &ray_tracing_pipeline_create_info,
 	                                       NULL,
 	                                       &ray_tracing_pipeline) != VK_SUCCESS) {
 		return false;
 	}
+	double const pipeline_creation_ms = get_time_ms() - pipeline_creation_start_ms;
+	report_pipeline_creation(pipeline_creation_ms,
+	                         pipeline_cache_data_size,
+	                         creation_feedback_supported ? &pipeline_creation_feedback : NULL);
+
+	// write the cache back so the next run starts warm
+	if (!save_pipeline_cache(device, pipeline_cache, pipeline_cache_filename)) {
+		fprintf(stderr, "failed to save pipeline cache to %s\n", pipeline_cache_filename);
+	}
+	vkDestroyPipelineCache(device, pipeline_cache, NULL);
+	end_profile_span(pipeline_span);
 
 	// free shader modules
 	vkDestroyShaderModule(device, hit_shader_module, NULL);
@@ -1106,40 +3041,48 @@ bool run_ray_tracer() {
 	    : ((shader_handle_size / shader_handle_alignment) + 1) * shader_handle_alignment;
 	uint32_t const shader_table_size = shader_handle_size_aligned * 3;
 
+	// fetch the shader group handles on the host, the table itself lives in device local memory
+	uint8_t shader_table[shader_table_size];
+	for (uint32_t i = 0; i < 3; ++i) {
+		if (ext.vkGetRayTracingShaderGroupHandlesKHR(
+			device,
+			ray_tracing_pipeline,
+			i,
+			1,
+			shader_handle_size_aligned,
+			shader_table + (i * shader_handle_size_aligned)
+		) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
 	VkBuffer shader_table_buffer;
-	VkDeviceMemory shader_table_buffer_memory;
+	struct memory_allocation shader_table_buffer_allocation;
 	VkDeviceOrHostAddressConstKHR shader_table_buffer_device_address;
-	if (!create_buffer(device,
-	                   host_coherent_memory_types,
+	if (!create_buffer(&arena,
+	                   MEMORY_USAGE_GPU_ONLY,
 	                   shader_table_size,
 	                   VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR |
 	                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 	                   &shader_table_buffer,
-	                   &shader_table_buffer_memory,
+	                   &shader_table_buffer_allocation,
 	                   &shader_table_buffer_device_address.deviceAddress,
-	                   NULL)) {
+	                   shader_table,
+	                   &uploader)) {
 		return false;
 	}
 
-	void *mapped;
-	if (vkMapMemory(device, shader_table_buffer_memory, 0, shader_table_size, 0, &mapped) != VK_SUCCESS) {
+	// the shader table is the last upload, wait for it before the first trace
+	if (!flush_staging_uploads(&uploader)) {
 		return false;
 	}
 
-	for (uint32_t i = 0; i < 3; ++i) {
-		if (ext.vkGetRayTracingShaderGroupHandlesKHR(
-			device,
-			ray_tracing_pipeline,
-			i,
-			1,
-			shader_handle_size_aligned,
-			(uint8_t *)mapped + (i * shader_handle_size_aligned)
-		) != VK_SUCCESS) {
-			return false;
-		}
-	}
-
-	vkUnmapMemory(device, shader_table_buffer_memory);
+	printf("staged uploads: %llu bytes in %u submits on the %s queue\n",
+	       (unsigned long long)uploader.bytes_uploaded,
+	       uploader.submit_count,
+	       uploader.dedicated_queue ? "transfer" : "graphics");
+	destroy_staging_uploader(&uploader);
+	report_memory_arena(&arena);
 
 	// create descriptor pool
 	VkDescriptorPoolSize descriptor_pool_sizes[2] = {
@@ -1207,189 +3150,253 @@ bool run_ray_tracer() {
 	vkUpdateDescriptorSets(device, 2, write_descriptor_sets, 0, NULL);
 
 	// main app loop
-	while (!glfwWindowShouldClose(window)) {
+	uint32_t frame_index = 0;
+	uint32_t submit_count = 0;
+	double frame_ms_history[MAX_FRAMES_IN_FLIGHT];
+	double total_wait_ms = 0.0;
+	double total_gpu_ms = 0.0;
+	double const loop_start_ms = get_time_ms();
+	while (window ? !glfwWindowShouldClose(window) : frame_index < sequence->frame_count) {
+		double const frame_start_ms = get_time_ms();
+
 		// handle window system events
-		glfwPollEvents();
+		if (window) {
+			glfwPollEvents();
+		}
+
+		// wait until the gpu has finished the last frame that used this slot
+		uint32_t const frame_slot = frame_index % frames_in_flight;
+		uint32_t const first_query = frame_slot * TIMESTAMP_COUNT;
+		VkCommandBuffer const frame_command_buffer = frame_command_buffers[frame_slot];
+		double const wait_start_ms = get_time_ms();
+		vkWaitForFences(device, 1, &frame_fences[frame_slot], VK_TRUE, UINT64_MAX);
+		total_wait_ms += get_time_ms() - wait_start_ms;
+
+		// that frame's timestamps are now available
+		if (write_timings && frame_index >= frames_in_flight) {
+			if (!write_frame_timings(timings_file,
+			                         device,
+			                         query_pool,
+			                         first_query,
+			                         frame_index - frames_in_flight,
+			                         frame_ms_history[frame_slot],
+			                         timestamp_mask,
+			                         timestamp_period)) {
+				return false;
+			}
+		}
+
+		// write out the earlier frame while the frames submitted after it keep the gpu busy
+		if (sequence && frame_index >= frames_in_flight) {
+			double gpu_ms = 0.0;
+			if (record_timestamps &&
+			    !get_frame_gpu_ms(device, query_pool, first_query, timestamp_mask, timestamp_period, &gpu_ms)) {
+				return false;
+			}
+			total_gpu_ms += gpu_ms;
+			uint32_t const readback_span = frame_index == frames_in_flight ? begin_profile_span("readback") : UINT32_MAX;
+			if (!invalidate_memory(&arena, &readback_allocations[frame_slot]) ||
+			    !write_sequence_frame(sequence,
+			                          readback_allocations[frame_slot].mapped,
+			                          surface_extent.width,
+			                          surface_extent.height,
+			                          frame_index - frames_in_flight)) {
+				return false;
+			}
+			end_profile_span(readback_span);
+		}
 
 		// update acceleration structures to animate triangle
 		static float x = 0.0f;
 		transform_matrix.matrix[0][3] = sinf(x);
 		x += 0.001f;
 
-		if (vkMapMemory(device, transform_matrix_buffer_memory, 0, sizeof(transform_matrix), 0, &mapped) != VK_SUCCESS) {
+		VkDeviceSize const transform_offset = frame_slot * sizeof(transform_matrix);
+		memcpy(transform_matrix_buffer_allocation.mapped + transform_offset,
+		       &transform_matrix,
+		       sizeof(transform_matrix));
+		if (!flush_memory(&arena, &transform_matrix_buffer_allocation)) {
 			return false;
 		}
-		memcpy(mapped, &transform_matrix, sizeof(transform_matrix));
-		vkUnmapMemory(device, transform_matrix_buffer_memory);
 
 		VkAccelerationStructureBuildGeometryInfoKHR blas_update_build_geometry_info = {
-			.sType                    = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
-			.type                     = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
-			.flags                    = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR |
-			                            VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR,
-			.geometryCount            = 1,
-			.pGeometries              = &bottom_level_acceleration_structure_geometry,
-			.mode                     = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR,
-			.srcAccelerationStructure = bottom_level_acceleration_structure,
-			.dstAccelerationStructure = bottom_level_acceleration_structure,
+			.sType                     = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type                      = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			.flags                     = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR |
+			                             VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR,
+			.geometryCount             = 1,
+			.pGeometries               = &bottom_level_acceleration_structure_geometry,
+			.mode                      = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR,
+			.srcAccelerationStructure  = bottom_level_acceleration_structure,
+			.dstAccelerationStructure  = bottom_level_acceleration_structure,
+			.scratchData.deviceAddress = bottom_level_scratch_address,
 		};
 
-		ext.vkGetAccelerationStructureBuildSizesKHR(
-			device,
-			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-			&blas_update_build_geometry_info,
-			&num_triangles,
-			&acceleration_structure_build_sizes_info
-		);
-
-		if (!create_buffer(device,
-		                   host_coherent_memory_types,
-		                   acceleration_structure_build_sizes_info.buildScratchSize,
-		                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-		                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-		                   &scratch_buffer,
-		                   &scratch_buffer_memory,
-		                   &scratch_buffer_device_address.deviceAddress,
-		                   NULL)) {
-			return false;
-		}
-
-		blas_update_build_geometry_info.scratchData = scratch_buffer_device_address;
-
 		VkAccelerationStructureBuildRangeInfoKHR blas_update_build_range_info = {
 			.primitiveCount  = num_triangles,
 			.primitiveOffset = 0,
 			.firstVertex     = 0,
-			.transformOffset = 0,
+			.transformOffset = transform_offset,
 		};
 		VkAccelerationStructureBuildRangeInfoKHR const *blas_update_build_range_infos[] = {
 			&blas_update_build_range_info,
 		};
 
-		vkResetCommandBuffer(command_buffer, 0);
-
-		if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
-			return false;
-		}
+		VkAccelerationStructureBuildGeometryInfoKHR tlas_update_build_geometry_info = {
+			.sType                     = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type                      = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+			.flags                     = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR |
+			                             VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR,
+			.geometryCount             = 1,
+			.pGeometries               = &top_level_acceleration_structure_geometry,
+			.mode                      = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR,
+			.srcAccelerationStructure  = top_level_acceleration_structure,
+			.dstAccelerationStructure  = top_level_acceleration_structure,
+			.scratchData.deviceAddress = top_level_scratch_address,
+		};
 
-		ext.vkCmdBuildAccelerationStructuresKHR(
-			command_buffer,
-			1,
-			&blas_update_build_geometry_info,
-			blas_update_build_range_infos
-		);
+		VkAccelerationStructureBuildRangeInfoKHR tlas_update_build_range_info = {
+			.primitiveCount  = num_triangles,
+			.primitiveOffset = 0,
+			.firstVertex     = 0,
+			.transformOffset = 0,
+		};
+		VkAccelerationStructureBuildRangeInfoKHR const *tlas_update_build_range_infos[] = {
+			&tlas_update_build_range_info,
+		};
 
-		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-			return false;
+		// acquire next swap chain image
+		uint32_t swap_chain_image_index = 0;
+		if (window) {
+			vkAcquireNextImageKHR(device,
+			                      swap_chain,
+			                      UINT64_MAX,
+			                      image_available_semaphores[frame_slot],
+			                      VK_NULL_HANDLE,
+			                      &swap_chain_image_index);
 		}
 
-		if (vkQueueSubmit(graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
-			return false;
-		}
+		// record the acceleration structure updates, trace and copy into a single command buffer
+		vkResetCommandBuffer(frame_command_buffer, 0);
 
-		if (vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+		if (vkBeginCommandBuffer(frame_command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
 			return false;
 		}
 
-		vkResetFences(device, 1, &fence);
-
-		vkFreeMemory(device, scratch_buffer_memory, NULL);
-		vkDestroyBuffer(device, scratch_buffer, NULL);
-
-		VkAccelerationStructureBuildGeometryInfoKHR tlas_update_build_geometry_info = {
-			.sType                    = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
-			.type                     = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
-			.flags                    = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR |
-			                            VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR,
-			.geometryCount            = 1,
-			.pGeometries              = &top_level_acceleration_structure_geometry,
-			.mode                     = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR,
-			.srcAccelerationStructure = top_level_acceleration_structure,
-			.dstAccelerationStructure = top_level_acceleration_structure,
+		// an earlier frame may still be updating or tracing against the acceleration structures and
+		// scratch memory that this frame updates, or tracing into and copying out of the image that
+		// this frame traces into, so both the update and the trace wait for it
+		VkMemoryBarrier previous_frame_memory_barrier = {
+			.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+			                 VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_SHADER_WRITE_BIT,
 		};
 
-		ext.vkGetAccelerationStructureBuildSizesKHR(
-			device,
-			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-			&tlas_update_build_geometry_info,
-			&primitive_count,
-			&acceleration_structure_build_sizes_info
+		vkCmdPipelineBarrier(
+			frame_command_buffer,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+			0,
+			1,
+			&previous_frame_memory_barrier,
+			0,
+			NULL,
+			0,
+			NULL
 		);
 
-		if (!create_buffer(device,
-		                   host_coherent_memory_types,
-		                   acceleration_structure_build_sizes_info.buildScratchSize,
-		                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-		                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-		                   &scratch_buffer,
-		                   &scratch_buffer_memory,
-		                   &scratch_buffer_device_address.deviceAddress,
-		                   NULL)) {
-			return false;
+		if (record_timestamps) {
+			vkCmdResetQueryPool(frame_command_buffer, query_pool, first_query, TIMESTAMP_COUNT);
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_BLAS_UPDATE_BEGIN);
 		}
 
-		tlas_update_build_geometry_info.scratchData = scratch_buffer_device_address;
+		ext.vkCmdBuildAccelerationStructuresKHR(
+			frame_command_buffer,
+			1,
+			&blas_update_build_geometry_info,
+			blas_update_build_range_infos
+		);
+
+		if (record_timestamps) {
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_BLAS_UPDATE_END);
+		}
 
-		VkAccelerationStructureBuildRangeInfoKHR tlas_update_build_range_info = {
-			.primitiveCount  = num_triangles,
-			.primitiveOffset = 0,
-			.firstVertex     = 0,
-			.transformOffset = 0,
-		};
-		VkAccelerationStructureBuildRangeInfoKHR const *tlas_update_build_range_infos[] = {
-			&tlas_update_build_range_info,
+		// the top level update reads the bottom level structure written by the previous build
+		VkMemoryBarrier acceleration_structure_memory_barrier = {
+			.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+			.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+			                 VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
 		};
 
-		vkResetCommandBuffer(command_buffer, 0);
+		vkCmdPipelineBarrier(
+			frame_command_buffer,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+			0,
+			1,
+			&acceleration_structure_memory_barrier,
+			0,
+			NULL,
+			0,
+			NULL
+		);
 
-		if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
-			return false;
+		if (record_timestamps) {
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_TLAS_UPDATE_BEGIN);
 		}
 
 		ext.vkCmdBuildAccelerationStructuresKHR(
-			command_buffer,
+			frame_command_buffer,
 			1,
 			&tlas_update_build_geometry_info,
 			tlas_update_build_range_infos
 		);
 
-		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-			return false;
-		}
-
-		if (vkQueueSubmit(graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
-			return false;
-		}
-
-		if (vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
-			return false;
+		if (record_timestamps) {
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_TLAS_UPDATE_END);
 		}
 
-		vkResetFences(device, 1, &fence);
-
-		vkFreeMemory(device, scratch_buffer_memory, NULL);
-		vkDestroyBuffer(device, scratch_buffer, NULL);
+		// the trace reads the top level structure written by the update
+		acceleration_structure_memory_barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+		vkCmdPipelineBarrier(
+			frame_command_buffer,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+			VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+			0,
+			1,
+			&acceleration_structure_memory_barrier,
+			0,
+			NULL,
+			0,
+			NULL
+		);
 
-		// acquire next swap chain image
-		uint32_t swap_chain_image_index;
-		vkAcquireNextImageKHR(device,
-		                      swap_chain,
-		                      UINT64_MAX,
-		                      image_available_semaphore,
-		                      VK_NULL_HANDLE,
-		                      &swap_chain_image_index);
-
-		// record command buffer
-		vkResetCommandBuffer(command_buffer, 0);
-
-		if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
-			return false;
+		if (record_timestamps) {
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_TRACE_BEGIN);
 		}
 
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, ray_tracing_pipeline);
+		vkCmdBindPipeline(frame_command_buffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, ray_tracing_pipeline);
 
 		vkCmdBindDescriptorSets(
-			command_buffer,
+			frame_command_buffer,
 			VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
 			pipeline_layout,
 			0,
@@ -1420,7 +3427,7 @@ bool run_ray_tracer() {
 		VkStridedDeviceAddressRegionKHR callable_shader_table_entry = { };
 
 		ext.vkCmdTraceRaysKHR(
-			command_buffer,
+			frame_command_buffer,
 			&raygen_shader_table_entry,
 			&miss_shader_table_entry,
 			&hit_shader_table_entry,
@@ -1430,74 +3437,147 @@ bool run_ray_tracer() {
 			1
 		);
 
-		VkImageMemoryBarrier image_memory_barrier = {
-			.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-			.subresourceRange.baseMipLevel   = 0,
-			.subresourceRange.levelCount     = 1,
-			.subresourceRange.baseArrayLayer = 0,
-			.subresourceRange.layerCount     = 1,
-			.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED,
-			.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED,
-			.srcAccessMask                   = VK_ACCESS_MEMORY_READ_BIT,
-			.dstAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT,
-			.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED,
-			.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			.image                           = swap_chain_images[swap_chain_image_index],
-		};
-
-		vkCmdPipelineBarrier(
-			command_buffer,
-			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-			0,
-			0,
-			NULL,
-			0,
-			NULL,
-			1,
-			&image_memory_barrier
-		);
+		if (record_timestamps) {
+			vkCmdWriteTimestamp(frame_command_buffer,
+			                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			                    query_pool,
+			                    first_query + TIMESTAMP_TRACE_END);
+		}
 
-		VkImageCopy image_copy = {
-			.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.srcSubresource.layerCount = 1,
-			.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.dstSubresource.layerCount = 1,
-			.extent.width              = surface_extent.width,
-			.extent.height             = surface_extent.height,
-			.extent.depth              = 1,
-		};
+		if (window) {
+			VkImageMemoryBarrier image_memory_barrier = {
+				.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+				.subresourceRange.baseMipLevel   = 0,
+				.subresourceRange.levelCount     = 1,
+				.subresourceRange.baseArrayLayer = 0,
+				.subresourceRange.layerCount     = 1,
+				.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED,
+				.srcAccessMask                   = VK_ACCESS_MEMORY_READ_BIT,
+				.dstAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED,
+				.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.image                           = swap_chain_images[swap_chain_image_index],
+			};
+
+			// the copy reads what the trace wrote
+			VkMemoryBarrier trace_to_transfer_barrier = {
+				.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			};
+
+			vkCmdPipelineBarrier(
+				frame_command_buffer,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				1,
+				&trace_to_transfer_barrier,
+				0,
+				NULL,
+				1,
+				&image_memory_barrier
+			);
+
+			VkImageCopy image_copy = {
+				.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.srcSubresource.layerCount = 1,
+				.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.dstSubresource.layerCount = 1,
+				.extent.width              = surface_extent.width,
+				.extent.height             = surface_extent.height,
+				.extent.depth              = 1,
+			};
+
+			vkCmdCopyImage(
+				frame_command_buffer,
+				image,
+				VK_IMAGE_LAYOUT_GENERAL,
+				swap_chain_images[swap_chain_image_index],
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1,
+				&image_copy
+			);
+
+			if (record_timestamps) {
+				vkCmdWriteTimestamp(frame_command_buffer,
+				                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				                    query_pool,
+				                    first_query + TIMESTAMP_COPY_END);
+			}
 
-		vkCmdCopyImage(
-			command_buffer,
-			image,
-			VK_IMAGE_LAYOUT_GENERAL,
-			swap_chain_images[swap_chain_image_index],
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&image_copy
-		);
+			image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			image_memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			image_memory_barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			image_memory_barrier.newLayout     = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			image_memory_barrier.image         = swap_chain_images[swap_chain_image_index];
+			vkCmdPipelineBarrier(
+				frame_command_buffer,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				0,
+				NULL,
+				0,
+				NULL,
+				1,
+				&image_memory_barrier
+			);
+		} else {
+			// copy the traced image into this frame's readback buffer
+			VkMemoryBarrier trace_to_transfer_barrier = {
+				.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			};
+			vkCmdPipelineBarrier(frame_command_buffer,
+			                     VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+			                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+			                     0,
+			                     1, &trace_to_transfer_barrier,
+			                     0, NULL,
+			                     0, NULL);
+
+			VkBufferImageCopy readback_region = {
+				.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.imageSubresource.layerCount = 1,
+				.imageExtent                 = { surface_extent.width, surface_extent.height, 1 },
+			};
+			vkCmdCopyImageToBuffer(frame_command_buffer,
+			                       image,
+			                       VK_IMAGE_LAYOUT_GENERAL,
+			                       readback_buffers[frame_slot],
+			                       1,
+			                       &readback_region);
+
+			if (record_timestamps) {
+				vkCmdWriteTimestamp(frame_command_buffer,
+				                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				                    query_pool,
+				                    first_query + TIMESTAMP_COPY_END);
+			}
 
-		image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		image_memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		image_memory_barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		image_memory_barrier.newLayout     = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		image_memory_barrier.image         = swap_chain_images[swap_chain_image_index];
-		vkCmdPipelineBarrier(
-			command_buffer,
-			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-			0,
-			0,
-			NULL,
-			0,
-			NULL,
-			1,
-			&image_memory_barrier
-		);
+			VkBufferMemoryBarrier transfer_to_host_barrier = {
+				.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.buffer              = readback_buffers[frame_slot],
+				.size                = VK_WHOLE_SIZE,
+			};
+			vkCmdPipelineBarrier(frame_command_buffer,
+			                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+			                     VK_PIPELINE_STAGE_HOST_BIT,
+			                     0,
+			                     0, NULL,
+			                     1, &transfer_to_host_barrier,
+			                     0, NULL);
+		}
 
-		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		if (vkEndCommandBuffer(frame_command_buffer) != VK_SUCCESS) {
 			return false;
 		}
 
@@ -1506,79 +3586,193 @@ bool run_ray_tracer() {
 		VkSubmitInfo submit_info = {
 			.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 			.waitSemaphoreCount   = 1,
-			.pWaitSemaphores      = &image_available_semaphore,
+			.pWaitSemaphores      = &image_available_semaphores[frame_slot],
 			.pWaitDstStageMask    = &wait_stage,
 			.commandBufferCount   = 1,
-			.pCommandBuffers      = &command_buffer,
+			.pCommandBuffers      = &frame_command_buffer,
 			.signalSemaphoreCount = 1,
-			.pSignalSemaphores    = &render_finished_semaphore,
+			.pSignalSemaphores    = &render_finished_semaphores[swap_chain_image_index],
 		};
 
-		if (vkQueueSubmit(graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
-			return false;
+		// without a window there is no image to wait for and nothing to present
+		if (!window) {
+			submit_info.waitSemaphoreCount   = 0;
+			submit_info.signalSemaphoreCount = 0;
 		}
 
-		VkPresentInfoKHR present_info = {
-			.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores    = &render_finished_semaphore,
-			.swapchainCount     = 1,
-			.pSwapchains        = &swap_chain,
-			.pImageIndices      = &swap_chain_image_index,
-		};
-		vkQueuePresentKHR(present_queue, &present_info);
+		uint32_t const submit_span = frame_index == 0 ? begin_profile_span("first submit") : UINT32_MAX;
+		vkResetFences(device, 1, &frame_fences[frame_slot]);
+		if (vkQueueSubmit(graphics_queue, 1, &submit_info, frame_fences[frame_slot]) != VK_SUCCESS) {
+			return false;
+		}
+		end_profile_span(submit_span);
+		submit_count += 1;
+
+		if (window) {
+			VkPresentInfoKHR present_info = {
+				.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+				.waitSemaphoreCount = 1,
+				.pWaitSemaphores    = &render_finished_semaphores[swap_chain_image_index],
+				.swapchainCount     = 1,
+				.pSwapchains        = &swap_chain,
+				.pImageIndices      = &swap_chain_image_index,
+			};
+			uint32_t const present_span = frame_index == 0 ? begin_profile_span("first present") : UINT32_MAX;
+			vkQueuePresentKHR(present_queue, &present_info);
+			end_profile_span(present_span);
+		}
 
-		vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &fence);
+		frame_ms_history[frame_slot] = get_time_ms() - frame_start_ms;
+		frame_index += 1;
 	}
 
 	// wait for all renders to finish before cleanup
 	vkDeviceWaitIdle(device);
 
+	// write out the frames of an offscreen sequence that were still in flight when the loop ended
+	if (sequence) {
+		uint32_t const first_pending_frame = frame_index > frames_in_flight ? frame_index - frames_in_flight : 0;
+		for (uint32_t i = first_pending_frame; i < frame_index; ++i) {
+			uint32_t const slot = i % frames_in_flight;
+			double gpu_ms = 0.0;
+			if (record_timestamps &&
+			    !get_frame_gpu_ms(device,
+			                      query_pool,
+			                      slot * TIMESTAMP_COUNT,
+			                      timestamp_mask,
+			                      timestamp_period,
+			                      &gpu_ms)) {
+				return false;
+			}
+			total_gpu_ms += gpu_ms;
+			if (!invalidate_memory(&arena, &readback_allocations[slot]) ||
+			    !write_sequence_frame(sequence,
+			                          readback_allocations[slot].mapped,
+			                          surface_extent.width,
+			                          surface_extent.height,
+			                          i)) {
+				return false;
+			}
+		}
+
+		// the run is only over once the last frames are on disk
+		if (!close_sequence_output(sequence)) {
+			return false;
+		}
+	}
+	double const loop_ms = get_time_ms() - loop_start_ms;
+
+	// write the timings of the frames that were still in flight when the loop ended
+	if (write_timings) {
+		uint32_t const first_pending_frame = frame_index > frames_in_flight ? frame_index - frames_in_flight : 0;
+		for (uint32_t i = first_pending_frame; i < frame_index; ++i) {
+			if (!write_frame_timings(timings_file,
+			                         device,
+			                         query_pool,
+			                         (i % frames_in_flight) * TIMESTAMP_COUNT,
+			                         i,
+			                         frame_ms_history[i % frames_in_flight],
+			                         timestamp_mask,
+			                         timestamp_period)) {
+				return false;
+			}
+		}
+	}
+
+	// report the frame rate and how long the cpu spent blocked on the gpu
+	if (frame_index > 0) {
+		printf("frames: %u, frames in flight: %u, %.1f fps, mean cpu wait: %.3f ms per frame, "
+		       "submits per frame: %.2f\n",
+		       frame_index,
+		       frames_in_flight,
+		       frame_index * 1000.0 / loop_ms,
+		       total_wait_ms / frame_index,
+		       (double)submit_count / frame_index);
+	}
+	if (sequence) {
+		report_sequence_output(sequence, frame_index, loop_ms, total_gpu_ms);
+	}
+
 	// free all resources
+	uint32_t const teardown_span = begin_profile_span("teardown");
 	vkDestroyDescriptorPool(device, descriptor_pool, NULL);
-	vkFreeMemory(device, shader_table_buffer_memory, NULL);
 	vkDestroyBuffer(device, shader_table_buffer, NULL);
 	vkDestroyPipeline(device, ray_tracing_pipeline, NULL);
 	vkDestroyPipelineLayout(device, pipeline_layout, NULL);
 	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, NULL);
+	vkDestroyBuffer(device, scratch_buffer, NULL);
 	ext.vkDestroyAccelerationStructureKHR(device, top_level_acceleration_structure, NULL);
-	vkFreeMemory(device, top_level_acceleration_structure_buffer_memory, NULL);
 	vkDestroyBuffer(device, top_level_acceleration_structure_buffer, NULL);
-	vkFreeMemory(device, acceleration_structure_instance_buffer_memory, NULL);
 	vkDestroyBuffer(device, acceleration_structure_instance_buffer, NULL);
 	ext.vkDestroyAccelerationStructureKHR(device, bottom_level_acceleration_structure, NULL);
-	vkFreeMemory(device, bottom_level_acceleration_structure_buffer_memory, NULL);
 	vkDestroyBuffer(device, bottom_level_acceleration_structure_buffer, NULL);
-	vkFreeMemory(device, transform_matrix_buffer_memory, NULL);
 	vkDestroyBuffer(device, transform_matrix_buffer, NULL);
-	vkFreeMemory(device, index_buffer_memory, NULL);
 	vkDestroyBuffer(device, index_buffer, NULL);
-	vkFreeMemory(device, vertex_buffer_memory, NULL);
 	vkDestroyBuffer(device, vertex_buffer, NULL);
 	vkDestroyImageView(device, image_view, NULL);
-	vkFreeMemory(device, image_memory, NULL);
 	vkDestroyImage(device, image, NULL);
+	for (uint32_t i = 0; i < frames_in_flight && !window; ++i) {
+		vkDestroyBuffer(device, readback_buffers[i], NULL);
+	}
+	vkDestroyQueryPool(device, query_pool, NULL);
 	vkDestroyFence(device, fence, NULL);
-	vkDestroySemaphore(device, render_finished_semaphore, NULL);
-	vkDestroySemaphore(device, image_available_semaphore, NULL);
+	for (uint32_t i = 0; i < image_count; ++i) {
+		vkDestroySemaphore(device, render_finished_semaphores[i], NULL);
+	}
+	for (uint32_t i = 0; i < frames_in_flight; ++i) {
+		vkDestroyFence(device, frame_fences[i], NULL);
+		vkDestroySemaphore(device, image_available_semaphores[i], NULL);
+	}
 	vkDestroyCommandPool(device, command_pool, NULL);
 	vkDestroySwapchainKHR(device, swap_chain, NULL);
+	destroy_memory_arena(&arena);
 	vkDestroyDevice(device, NULL);
 	vkDestroySurfaceKHR(instance, surface, NULL);
-	ext.vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, NULL);
+	if (debug_messenger != VK_NULL_HANDLE) {
+		ext.vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, NULL);
+	}
 	vkDestroyInstance(instance, NULL);
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	if (window) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+	end_profile_span(teardown_span);
+	if (timings_file) {
+		fclose(timings_file);
+	}
 
 	// report successful run
 	return true;
 }
 
-int main() {
-	if (!run_ray_tracer()) {
+int main(int argc, char **argv) {
+	// optionally write per frame gpu timings to a csv file, change the number of frames in flight
+	// and render a sequence of frames offscreen instead of to a window
+	char const *timings_filename = NULL;
+	uint32_t frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+	struct sequence_output sequence = {0};
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--timings-csv") == 0) {
+			timings_filename = argv[i + 1];
+		} else if (strcmp(argv[i], "--frames-in-flight") == 0) {
+			frames_in_flight = strtoul(argv[i + 1], NULL, 10);
+		} else if (strcmp(argv[i], "--offscreen-frames") == 0 && i + 2 < argc) {
+			sequence.frame_count = strtoul(argv[i + 1], NULL, 10);
+			sequence.filename    = argv[i + 2];
+			i += 1;
+		}
+	}
+	if (frames_in_flight < 1 || frames_in_flight > MAX_FRAMES_IN_FLIGHT) {
+		fprintf(stderr, "frames in flight must be between 1 and %d\n", MAX_FRAMES_IN_FLIGHT);
+		return 1;
+	}
+
+	if (!run_ray_tracer(timings_filename, frames_in_flight, sequence.filename ? &sequence : NULL)) {
 		fputs("run failed\n", stderr);
 		return 1;
 	}
+	if (!report_startup_profile()) {
+		fputs("failed to write startup profile\n", stderr);
+	}
 	return 0;
 }